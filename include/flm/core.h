@@ -22,16 +22,29 @@ extern "C" {
 #endif
 
 #include <flm/core/public/buffer.h>
+#include <flm/core/public/buffer_builder.h>
+#include <flm/core/public/buffer_chain.h>
+#include <flm/core/public/conn_pool.h>
 #include <flm/core/public/error.h>
 #include <flm/core/public/file.h>
+#include <flm/core/public/file_cache.h>
+#include <flm/core/public/file_queue.h>
+#include <flm/core/public/framer.h>
+#include <flm/core/public/http.h>
 #include <flm/core/public/io.h>
 #include <flm/core/public/monitor.h>
 #include <flm/core/public/obj.h>
+#include <flm/core/public/rate_limit.h>
+#include <flm/core/public/scan.h>
 #include <flm/core/public/stream.h>
+#include <flm/core/public/tcp_client.h>
 #include <flm/core/public/tcp_server.h>
 #include <flm/core/public/timer.h>
+#include <flm/core/public/tls_cache.h>
 #include <flm/core/public/thread.h>
 #include <flm/core/public/thread_pool.h>
+#include <flm/core/public/udp_socket.h>
+#include <flm/core/public/unix_server.h>
 
 #ifdef __cplusplus
 }
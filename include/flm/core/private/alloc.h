@@ -25,6 +25,7 @@
 #ifndef _FLM_CORE_PRIVATE_ALLOC_H_
 # define _FLM_CORE_PRIVATE_ALLOC_H_
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 /**
@@ -48,6 +49,45 @@ flm__Alloc (size_t size);
 void
 flm__Free (void * mem);
 
+/**
+ * \brief Simple wrapper around realloc(3).
+ *
+ * \param mem A pointer to a memory area allocated with flm__Alloc() or
+ *   flm__Realloc(), or NULL.
+ * \param size The new size (in byte) of the area.
+ * \return A pointer to the resized memory area, the content is kept up
+ *   to the smallest of the old and new sizes.
+ * \retval NULL in case of error, the original area is left untouched.
+ *
+ * \remark Fails with FLM_ERR_NOSYS when flm__HasRealloc() is false.
+ */
+void *
+flm__Realloc (void * mem, size_t size);
+
+/**
+ * \brief Tells if flm__Realloc() can be used with the current handlers.
+ *
+ * \return false when an allocation or a free handler was given without
+ *   a realloc handler: the caller has to allocate, copy and free instead.
+ */
+bool
+flm__HasRealloc ();
+
+/**
+ * \brief Allocate a memory area starting on a multiple of \c align.
+ *
+ * \param size Size to allocate (in byte).
+ * \param align A power of two, at least the size of a pointer.
+ * \return A pointer to the newly allocated memory area, to be freed with
+ *   flm__FreeAligned().
+ * \retval NULL in case of error.
+ */
+void *
+flm__AllocAligned (size_t size, size_t align);
+
+void
+flm__FreeAligned (void * mem);
+
 void
 flm__SetAlloc (void * (*handler)(size_t));
 
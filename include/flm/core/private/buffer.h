@@ -17,8 +17,12 @@
 #ifndef _FLM_CORE_PRIVATE_BUFFER_H_
 # define _FLM_CORE_PRIVATE_BUFFER_H_
 
+#include <sys/queue.h>
+
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "flm/core/public/buffer.h"
 
@@ -26,11 +30,18 @@
 
 #define FLM__TYPE_BUFFER	0x00020000
 
+struct flm__BufferPool;
+
 struct flm_Buffer
 {
     struct flm_Obj				obj;
 
     int                                         type;
+
+    /* given back to its pool once released, see flm__BufferPoolGet() */
+    struct flm__BufferPool *                    pool;
+    int                                         class;
+
     union {
         struct {
             char *				content;
@@ -38,6 +49,11 @@ struct flm_Buffer
             struct {
                 flm_BufferFreeContentHandler	handler;
             } fr;
+            /* the whole pages mapped by flm_BufferMap() */
+            struct {
+                void *                          addr;
+                size_t                          len;
+            } map;
         } raw;
         struct {
             flm_Buffer *                        from;
@@ -50,6 +66,45 @@ struct flm_Buffer
 #define FLM__BUFFER_TYPE_RAW            0x01
 #define FLM__BUFFER_TYPE_VIEW           0x02
 
+/**
+ * Size classes of the pools: 64 bytes to 4 KiB of content, by powers of
+ * two. Larger buffers are not kept.
+ */
+#define FLM__BUFFER_POOL_SHIFT          6
+#define FLM__BUFFER_POOL_CLASSES        7
+#define FLM__BUFFER_POOL_KEEP           32   /* released buffers per class */
+
+/**
+ * Released buffer, linked through its first bytes
+ */
+struct flm__BufferPoolBlock
+{
+    SLIST_ENTRY (flm__BufferPoolBlock)          entries;
+};
+
+/**
+ * Buffers with their content in the same allocation, kept once released
+ * for the next buffer of the same class. Only the owner thread, the one
+ * running the monitor, takes from and gives back to the lists; a buffer
+ * released by another thread is freed. The pool is freed once its monitor
+ * and every buffer it handed out are gone.
+ */
+struct flm__BufferPool
+{
+    uint32_t                                    refs;   /* atomic */
+    pthread_t                                   owner;
+    bool                                        closed;
+
+    struct {
+        size_t                                  count;
+        SLIST_HEAD (bpfr, flm__BufferPoolBlock) free;
+    } classes[FLM__BUFFER_POOL_CLASSES];
+
+    /* buffers taken from the lists, and allocated */
+    uint64_t                                    hits;
+    uint64_t                                    misses;
+};
+
 void
 flm__BufferInitRaw (flm_Buffer *			buffer,		\
                     char *				content,        \
@@ -65,4 +120,27 @@ flm__BufferInitView (flm_Buffer *                       buffer,         \
 void
 flm__BufferPerfDestruct (flm_Buffer * buffer);
 
+struct flm__BufferPool *
+flm__BufferPoolNew ();
+
+void
+flm__BufferPoolOwn (struct flm__BufferPool *		pool);
+
+flm_Buffer *
+flm__BufferPoolGet (struct flm__BufferPool *		pool,
+                    size_t				length);
+
+void
+flm__BufferPoolPut (struct flm__BufferPool *		pool,
+                    flm_Buffer *			buffer);
+
+void
+flm__BufferPoolClose (struct flm__BufferPool *		pool);
+
+void
+flm__BufferPoolDrop (struct flm__BufferPool *		pool);
+
+void
+flm__BufferPerfReleasePooled (flm_Buffer *		buffer);
+
 #endif /* !_FLM_CORE_PRIVATE_BUFFER_H_ */
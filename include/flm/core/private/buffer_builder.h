@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FLM_CORE_PRIVATE_BUFFER_BUILDER_H_
+# define _FLM_CORE_PRIVATE_BUFFER_BUILDER_H_
+
+#include <sys/types.h>
+
+#include "flm/core/public/buffer_builder.h"
+
+#include "flm/core/private/buffer.h"
+#include "flm/core/private/obj.h"
+
+#define FLM__TYPE_BUFFER_BUILDER	0x00190000
+
+/* room made for the content the first time it grows */
+#define FLM__BUFFER_BUILDER_MIN		64
+
+struct flm_BufferBuilder
+{
+	/* inheritance */
+	struct flm_Obj				obj;
+
+	/**
+	 * The buffer object and its content share a single block, like
+	 * with flm_BufferAlloc(): the object is only initialized once the
+	 * builder is finished.
+	 */
+	flm_Buffer *				block;
+	size_t					length;
+	size_t					size;
+};
+
+int
+flm__BufferBuilderInit (flm_BufferBuilder *	builder,
+			size_t			hint);
+
+void
+flm__BufferBuilderPerfDestruct (flm_BufferBuilder *	builder);
+
+int
+flm__BufferBuilderGrow (flm_BufferBuilder *	builder,
+			size_t			length);
+
+#endif /* !_FLM_CORE_PRIVATE_BUFFER_BUILDER_H_ */
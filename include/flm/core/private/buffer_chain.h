@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FLM_CORE_PRIVATE_BUFFER_CHAIN_H_
+# define _FLM_CORE_PRIVATE_BUFFER_CHAIN_H_
+
+#include <sys/queue.h>
+#include <sys/types.h>
+
+#include "flm/core/public/buffer_chain.h"
+
+#include "flm/core/private/buffer.h"
+#include "flm/core/private/obj.h"
+
+#define FLM__TYPE_BUFFER_CHAIN	0x00180000
+
+struct flm__BufferChainSegment
+{
+	flm_Buffer *				buffer;
+	off_t					off;
+	size_t					count;
+
+	TAILQ_ENTRY (flm__BufferChainSegment)	entries;
+};
+
+struct flm_BufferChain
+{
+	/* inheritance */
+	struct flm_Obj				obj;
+
+	size_t					length;
+	size_t					count;
+
+	TAILQ_HEAD (bcsg, flm__BufferChainSegment)	segments;
+};
+
+int
+flm__BufferChainInit (flm_BufferChain *		chain);
+
+void
+flm__BufferChainPerfDestruct (flm_BufferChain *	chain);
+
+struct flm__BufferChainSegment *
+flm__BufferChainSegment (flm_Buffer *		buffer,
+			 off_t			off,
+			 size_t			count);
+
+#endif /* !_FLM_CORE_PRIVATE_BUFFER_CHAIN_H_ */
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FLM_CORE_PRIVATE_CONN_POOL_H_
+# define _FLM_CORE_PRIVATE_CONN_POOL_H_
+
+#include <sys/queue.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "flm/core/public/conn_pool.h"
+#include "flm/core/public/timer.h"
+
+#include "flm/core/private/obj.h"
+
+#define FLM__TYPE_CONN_POOL	0x00130000
+
+/* must be a power of two */
+#define FLM__CONN_POOL_BUCKETS		64
+
+struct flm__ConnPoolDest;
+
+/**
+ * A parked stream, its state points to this entry while it is idle
+ */
+struct flm__ConnPoolEntry
+{
+	flm_Stream *				stream;
+	flm_Timer *				timer;
+	flm_ConnPool *				pool;
+	struct flm__ConnPoolDest *		dest;
+
+	TAILQ_ENTRY (flm__ConnPoolEntry)	entries;
+};
+
+struct flm__ConnPoolDest
+{
+	uint32_t				hash;
+	uint16_t				port;
+
+	size_t					count;
+	size_t					max;
+
+	/* most recently parked first */
+	TAILQ_HEAD (cpid, flm__ConnPoolEntry)	idle;
+
+	LIST_ENTRY (flm__ConnPoolDest)		bucket;
+
+	char					address[];
+};
+
+struct flm_ConnPool
+{
+	/* inheritance */
+	struct flm_Obj				obj;
+
+	flm_Monitor *				monitor;
+
+	size_t					max;
+	uint32_t				timeout;
+
+	LIST_HEAD (cpbk, flm__ConnPoolDest)	buckets[FLM__CONN_POOL_BUCKETS];
+
+	struct flm_ConnPoolStats		stats;
+};
+
+int
+flm__ConnPoolInit (flm_ConnPool *		pool,
+		   flm_Monitor *		monitor,
+		   size_t			max,
+		   uint32_t			timeout);
+
+void
+flm__ConnPoolPerfDestruct (flm_ConnPool *	pool);
+
+uint32_t
+flm__ConnPoolHash (const char *			address,
+		   uint16_t			port);
+
+struct flm__ConnPoolDest *
+flm__ConnPoolFind (flm_ConnPool *		pool,
+		   const char *			address,
+		   uint16_t			port,
+		   bool				create);
+
+flm_Stream *
+flm__ConnPoolUnpark (struct flm__ConnPoolEntry *	entry);
+
+void
+flm__ConnPoolDrop (struct flm__ConnPoolEntry *	entry);
+
+void
+flm__ConnPoolIdleRead (flm_Stream *		stream,
+		       void *			state,
+		       flm_Buffer *		buffer);
+
+void
+flm__ConnPoolIdleClose (flm_Stream *		stream,
+			void *			state);
+
+void
+flm__ConnPoolIdleTimeout (flm_Timer *		timer,
+			  void *		state);
+
+#endif /* !_FLM_CORE_PRIVATE_CONN_POOL_H_ */
@@ -29,6 +29,7 @@ typedef struct flm__Epoll
 
 	struct epoll_event *	events;
 	int			size;
+	int			ready;	/* events being dispatched */
 } flm__Epoll;
 
 #define FLM__EPOLL_MAXEVENTS_DEFAULT	4096
@@ -20,16 +20,28 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <stdbool.h>
+
 #include "flm/core/public/file.h"
 
 #include "flm/core/private/io.h"
 
 #define FLM__TYPE_FILE	0x00030000
 
+/* offsets and sizes of the reads of a file opened with O_DIRECT */
+#define FLM__FILE_DIRECT_ALIGN	4096
+
 struct flm_File
 {
 	/* inheritance */
 	struct flm_IO		io;
+
+	/* set by a file cache, saves a fstat(2) to flm_StreamPushFile() */
+	bool			sized;
+	off_t			size;
+
+	/* opened with O_DIRECT, see flm_FileDirect() */
+	bool			direct;
 };
 
 int
@@ -39,4 +51,7 @@ int
 flm__FileInitOpen (flm_File * file,					\
 		   const char * root, const char * path, const char * mode);
 
+int
+flm__FileOpenAt (int dirfd, const char * path, const char * mode);
+
 #endif /* !_FLM_CORE_PRIVATE_FILE_H_ */
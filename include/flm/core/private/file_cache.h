@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FLM_CORE_PRIVATE_FILE_CACHE_H_
+# define _FLM_CORE_PRIVATE_FILE_CACHE_H_
+
+#include <sys/queue.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "flm/core/public/file_cache.h"
+
+#include "flm/core/private/file.h"
+#include "flm/core/private/obj.h"
+
+#define FLM__TYPE_FILE_CACHE	0x00170000
+
+struct flm__FileCacheEntry
+{
+	flm_File *				file;
+	struct stat				stat;
+
+	/* monitor time of the last check, in milliseconds */
+	uint64_t				checked;
+
+	uint32_t				hash;
+
+	LIST_ENTRY (flm__FileCacheEntry)	bucket;
+	TAILQ_ENTRY (flm__FileCacheEntry)	lru;
+
+	char					path[];
+};
+
+struct flm_FileCache
+{
+	/* inheritance */
+	struct flm_Obj				obj;
+
+	flm_Monitor *				monitor;
+	int					dirfd;
+
+	size_t					max;
+	uint32_t				validity;
+
+	LIST_HEAD (fcbk, flm__FileCacheEntry) *	buckets;
+	uint32_t				mask;
+
+	/* most recently used first */
+	TAILQ_HEAD (fclr, flm__FileCacheEntry)	lru;
+
+	struct flm_FileCacheStats		stats;
+};
+
+int
+flm__FileCacheInit (flm_FileCache *		cache,
+		    flm_Monitor *		monitor,
+		    const char *		root,
+		    size_t			max,
+		    uint32_t			validity);
+
+void
+flm__FileCachePerfDestruct (flm_FileCache *	cache);
+
+bool
+flm__FileCacheValidPath (const char *		path);
+
+int
+flm__FileCacheOpenAt (flm_FileCache *		cache,
+		      const char *		path);
+
+uint32_t
+flm__FileCacheHash (const char *		path);
+
+uint64_t
+flm__FileCacheNow (flm_FileCache *		cache);
+
+struct flm__FileCacheEntry *
+flm__FileCacheFind (flm_FileCache *		cache,
+		    const char *		path,
+		    uint32_t			hash);
+
+int
+flm__FileCacheCheck (flm_FileCache *		cache,
+		     struct flm__FileCacheEntry *	entry);
+
+struct flm__FileCacheEntry *
+flm__FileCacheAdd (flm_FileCache *		cache,
+		   const char *			path,
+		   uint32_t			hash);
+
+void
+flm__FileCacheDrop (flm_FileCache *		cache,
+		    struct flm__FileCacheEntry *	entry);
+
+#endif /* !_FLM_CORE_PRIVATE_FILE_CACHE_H_ */
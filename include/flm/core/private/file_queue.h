@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FLM_CORE_PRIVATE_FILE_QUEUE_H_
+# define _FLM_CORE_PRIVATE_FILE_QUEUE_H_
+
+#include <sys/queue.h>
+#include <sys/types.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "flm/core/public/file_queue.h"
+
+#include "flm/core/private/io.h"
+#include "flm/core/private/monitor.h"
+#include "flm/core/private/obj.h"
+
+#define FLM__TYPE_FILE_QUEUE	0x00160000
+
+#define FLM__FILE_QUEUE_THREADS		4
+#define FLM__FILE_QUEUE_THREADS_MAX	64
+
+/* read by each helper thread to bring a range in the page cache */
+#define FLM__FILE_QUEUE_PREFETCH_SIZE	65536
+
+enum flm__FileQueueOp {
+	FLM__FILE_QUEUE_READ,
+	FLM__FILE_QUEUE_WRITE,
+	FLM__FILE_QUEUE_SYNC,
+	FLM__FILE_QUEUE_PREFETCH
+};
+
+struct flm__FileQueueJob
+{
+	enum flm__FileQueueOp		op;
+	flm_File *			file;
+	flm_Buffer *			buffer;
+	off_t				off;
+	size_t				count;	/* prefetch only */
+
+	flm_FileQueueHandler		handler;
+	void *				state;
+
+	/* set by the helper thread */
+	ssize_t				result;
+	int				error;
+
+	TAILQ_ENTRY (flm__FileQueueJob)	entries;
+};
+
+struct flm_FileQueue
+{
+	/* inheritance */
+	struct flm_Obj			obj;
+
+	flm_Monitor *			monitor;
+
+	/**
+	 * The helper threads write to the pipe when the list of completed
+	 * jobs stops being empty, the read end is only watched while jobs
+	 * are pending.
+	 */
+	struct {
+		flm_IO *		io;
+		int			in;
+		bool			watched;
+	} wk;
+
+	/* only used by the monitor */
+	size_t				pending;
+	struct flm_FileQueueStats	stats;
+
+	pthread_mutex_t			lock;
+	pthread_cond_t			cond;
+	bool				stop;
+	TAILQ_HEAD (fqjb, flm__FileQueueJob)	jobs;
+	TAILQ_HEAD (fqdn, flm__FileQueueJob)	done;
+
+	uint32_t			count;
+	pthread_t *			threads;
+};
+
+int
+flm__FileQueueInit (flm_FileQueue *		file_queue,
+		    flm_Monitor *		monitor,
+		    uint32_t			threads);
+
+void
+flm__FileQueuePerfDestruct (flm_FileQueue *	file_queue);
+
+int
+flm__FileQueuePush (flm_FileQueue *		file_queue,
+		    enum flm__FileQueueOp	op,
+		    flm_File *			file,
+		    flm_Buffer *		buffer,
+		    off_t			off,
+		    size_t			count,
+		    flm_FileQueueHandler	handler,
+		    void *			state);
+
+void
+flm__FileQueueStop (flm_FileQueue *		file_queue,
+		    uint32_t			count);
+
+void *
+flm__FileQueueRoutine (void *			_file_queue);
+
+void
+flm__FileQueueRun (struct flm__FileQueueJob *	job);
+
+void
+flm__FileQueuePrefetchRange (struct flm__FileQueueJob *	job);
+
+void
+flm__FileQueueComplete (flm_IO *		io,
+			void *			_file_queue);
+
+#endif /* !_FLM_CORE_PRIVATE_FILE_QUEUE_H_ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef _FLM_CORE_PRIVATE_FRAMER_H_
+# define _FLM_CORE_PRIVATE_FRAMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flm/core/public/buffer.h"
+#include "flm/core/public/framer.h"
+
+#include "flm/core/private/obj.h"
+
+#define FLM__TYPE_FRAMER	0x00100000
+
+#define FLM__FRAMER_TYPE_LENGTH		0x01
+#define FLM__FRAMER_TYPE_VARINT		0x02
+#define FLM__FRAMER_TYPE_DELIMITER	0x03
+#define FLM__FRAMER_TYPE_LINE		0x04
+
+/* longest varint of a 64 bits length */
+#define FLM__FRAMER_HEADER_SIZE		10
+
+/* first allocation for a delimited frame crossing buffers */
+#define FLM__FRAMER_PARTIAL_SIZE	256
+
+struct flm_Framer
+{
+	/* inheritance */
+	struct flm_Obj			obj;
+
+	int				type;
+	size_t				max;
+	bool				failed;
+
+	union {
+		struct {
+			size_t			width;
+		} length;
+		struct {
+			char *			content;
+			size_t			len;
+		} delimiter;
+	} format;
+
+	/**
+	 * Frame crossing the end of the last buffer: the length prefix
+	 * being read, then the content copied so far.
+	 */
+	struct {
+		unsigned char		header[FLM__FRAMER_HEADER_SIZE];
+		size_t			header_len;
+
+		char *			content;
+		size_t			len;
+		size_t			size;
+		size_t			need;	/* length prefixed frames */
+	} partial;
+};
+
+int
+flm__FramerInit (flm_Framer *		framer,
+		 int			type,
+		 size_t			max);
+
+void
+flm__FramerPerfDestruct (flm_Framer *	framer);
+
+int
+flm__FramerHeader (flm_Framer *			framer,
+		   const unsigned char *	content,
+		   size_t			len,
+		   size_t *			header_len,
+		   uint64_t *			frame_len);
+
+int
+flm__FramerFeedLength (flm_Framer *		framer,
+		       flm_Buffer *		buffer,
+		       flm_FramerHandler	handler,
+		       void *			state);
+
+int
+flm__FramerFeedDelimiter (flm_Framer *		framer,
+			  flm_Buffer *		buffer,
+			  flm_FramerHandler	handler,
+			  void *		state);
+
+int
+flm__FramerReserve (flm_Framer *	framer,
+		    size_t		size);
+
+const char *
+flm__FramerSearch (const char *		content,
+		   size_t		len,
+		   const char *		delimiter,
+		   size_t		delimiter_len);
+
+size_t
+flm__FramerTrim (flm_Framer *		framer,
+		 const char *		content,
+		 size_t			len);
+
+void
+flm__FramerFail (flm_Framer *		framer);
+
+#endif /* !_FLM_CORE_PRIVATE_FRAMER_H_ */
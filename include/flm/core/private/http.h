@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef _FLM_CORE_PRIVATE_HTTP_H_
+# define _FLM_CORE_PRIVATE_HTTP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flm/core/public/buffer.h"
+#include "flm/core/public/http.h"
+
+#include "flm/core/private/obj.h"
+
+#define FLM__TYPE_HTTP_PARSER	0x00110000
+
+enum flm__HTTPState
+{
+	FLM__HTTP_HEAD =		0x0000,
+	FLM__HTTP_BODY,			/* content length */
+	FLM__HTTP_BODY_EOF,		/* until the end of the flow */
+	FLM__HTTP_CHUNK_SIZE,
+	FLM__HTTP_CHUNK_EXT,
+	FLM__HTTP_CHUNK_SIZE_LF,
+	FLM__HTTP_CHUNK_DATA,
+	FLM__HTTP_CHUNK_CR,
+	FLM__HTTP_CHUNK_LF,
+	FLM__HTTP_TRAILER,		/* at the start of a trailer line */
+	FLM__HTTP_TRAILER_LINE,
+	FLM__HTTP_TRAILER_LF,
+	FLM__HTTP_FAILED
+};
+
+struct flm_HTTPParser
+{
+	/* inheritance */
+	struct flm_Obj			obj;
+
+	int				type;
+	int				state;
+	void *				data;
+
+	size_t				max_head;
+	size_t				max_headers;
+
+	struct {
+		flm_HTTPHeadHandler	head;
+		flm_HTTPBodyHandler	body;
+		flm_HTTPEndHandler	end;
+	} handlers;
+
+	struct flm_HTTPHead		head;
+	bool				skip_body;
+
+	/* body or chunk bytes left */
+	uint64_t			remaining;
+	bool				digits;
+	size_t				line_len; /* extensions and trailers */
+
+	/**
+	 * Head crossing the end of the last buffer, scanned is the start
+	 * of its last incomplete line.
+	 */
+	struct {
+		char *			content;
+		size_t			len;
+		size_t			scanned;
+		bool			started;
+	} partial;
+};
+
+int
+flm__HTTPParserInit (flm_HTTPParser *		parser,
+		     int			type,
+		     size_t			max_head,
+		     size_t			max_headers,
+		     void *			state);
+
+void
+flm__HTTPParserPerfDestruct (flm_HTTPParser *	parser);
+
+ssize_t
+flm__HTTPParserFeedHead (flm_HTTPParser *	parser,
+			 const char *		content,
+			 size_t			len);
+
+ssize_t
+flm__HTTPParserFeedBody (flm_HTTPParser *	parser,
+			 const char *		content,
+			 size_t			len);
+
+ssize_t
+flm__HTTPParserFeedChunked (flm_HTTPParser *	parser,
+			    const char *	content,
+			    size_t		len);
+
+ssize_t
+flm__HTTPParserSkipLine (flm_HTTPParser *	parser,
+			 const char *		content,
+			 size_t			len);
+
+size_t
+flm__HTTPParserHeadEnd (const char *		content,
+			size_t			len,
+			size_t *		scanned,
+			bool *			started);
+
+ssize_t
+flm__HTTPParserHead (flm_HTTPParser *		parser,
+		     const char *		content,
+		     size_t			len);
+
+void
+flm__HTTPParserHeadDone (flm_HTTPParser *	parser);
+
+int
+flm__HTTPParserStartLine (flm_HTTPParser *	parser,
+			  const char *		line,
+			  size_t		len);
+
+int
+flm__HTTPParserHeader (flm_HTTPParser *		parser,
+		       const char *		line,
+		       size_t			len,
+		       bool *			has_encoding);
+
+int
+flm__HTTPParserVersion (const char *		content,
+			size_t			len);
+
+bool
+flm__HTTPParserIsToken (char			c);
+
+bool
+flm__HTTPParserChunked (const char *		content,
+			size_t			len);
+
+bool
+flm__HTTPParserToken (const char *		content,
+		      size_t			len,
+		      const char *		token);
+
+bool
+flm__HTTPParserEquals (const char *		content,
+		       size_t			len,
+		       const char *		name);
+
+void
+flm__HTTPParserBody (flm_HTTPParser *		parser);
+
+void
+flm__HTTPParserEnd (flm_HTTPParser *		parser);
+
+int
+flm__HTTPParserFail (flm_HTTPParser *		parser,
+		     int			error);
+
+#endif /* !_FLM_CORE_PRIVATE_HTTP_H_ */
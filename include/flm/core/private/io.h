@@ -38,6 +38,9 @@ typedef void	(*flm__IOSysWrite_f)			\
 typedef void	(*flm__IOSysClose_f)			\
 (flm_IO * io, flm_Monitor * monitor);
 
+typedef void	(*flm__IOSysError_f)			\
+(flm_IO * io, flm_Monitor * monitor);
+
 struct flm_IO
 {
     /* inheritance */
@@ -54,12 +57,16 @@ struct flm_IO
     struct {
         bool			can;
         bool			want;
+        bool			hold;
         uint8_t			limit;
         flm_IOReadHandler	handler;
     } rd;
     struct {
         bool			can;
         bool			want;
+        bool			hold;
+        /* set by the IO itself while waiting for its own data */
+        bool			pause;
         uint8_t			limit;
         flm_IOWriteHandler	handler;
     } wr;
@@ -77,6 +84,7 @@ struct flm_IO
         flm__IOSysRead_f	read;
         flm__IOSysWrite_f	write;
         flm__IOSysClose_f	close;
+        flm__IOSysError_f	error;
     } perf;
 
     TAILQ_ENTRY (flm_IO)		entries;
@@ -24,6 +24,7 @@
 #include "flm/core/public/monitor.h"
 #include "flm/core/public/timer.h"
 
+#include "flm/core/private/buffer.h"
 #include "flm/core/private/obj.h"
 #include "flm/core/private/io.h"
 
@@ -37,6 +38,10 @@ typedef int (*flm__MonitorWait_f) (flm_Monitor * monitor);
 #define FLM__MONITOR_TM_WHEEL_SIZE	4096
 #define FLM__MONITOR_TM_RES		100  /* milliseconds */
 
+#define FLM__MONITOR_CHUNK_SIZE		65536
+#define FLM__MONITOR_CHUNK_POOL		16   /* chunks kept for reuse */
+#define FLM__MONITOR_CHUNK_ALIGN	4096 /* usable with O_DIRECT */
+
 enum flm__MonitorBackend {
     FLM__MONITOR_BACKEND_AUTO,
     FLM__MONITOR_BACKEND_SELECT,
@@ -44,6 +49,14 @@ enum flm__MonitorBackend {
     FLM__MONITOR_BACKEND_NONE
 };
 
+/**
+ * Unused chunk, linked through its first bytes
+ */
+struct flm__MonitorChunk
+{
+	SLIST_ENTRY (flm__MonitorChunk)	entries;
+};
+
 struct flm_Monitor
 {
     struct flm_Obj			obj;
@@ -79,6 +92,14 @@ struct flm_Monitor
         /* simple timer wheel */
         TAILQ_HEAD (tmwh, flm_Timer) *	wheel;
     } tm;
+
+    struct {
+        size_t                          count;
+        SLIST_HEAD (mnck, flm__MonitorChunk)	free;
+    } chunks;
+
+    /* small buffers, created on first use */
+    struct flm__BufferPool *		buffers;
 };
 
 int
@@ -116,6 +137,17 @@ flm__MonitorTimerReset (flm_Monitor *	monitor,
 void
 flm__MonitorTimerRearm (flm_Monitor *	monitor);
 
+void *
+flm__MonitorChunkGet (flm_Monitor *	monitor);
+
+void
+flm__MonitorChunkPut (flm_Monitor *	monitor,
+		      void *		chunk);
+
+flm_Buffer *
+flm__MonitorBuffer (flm_Monitor *	monitor,
+		    size_t		length);
+
 void
 flm__setMonitorDefaultTmSize (size_t tm_size);
 
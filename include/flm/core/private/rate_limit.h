@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef _FLM_CORE_PRIVATE_RATE_LIMIT_H_
+# define _FLM_CORE_PRIVATE_RATE_LIMIT_H_
+
+#include <sys/queue.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "flm/core/public/rate_limit.h"
+#include "flm/core/public/timer.h"
+
+#include "flm/core/private/io.h"
+#include "flm/core/private/obj.h"
+
+#define FLM__TYPE_RATE_LIMIT	0x000D0000
+
+/**
+ * An IO waiting for the bucket to be refilled, the IO is held (see the
+ * hold flags of flm_IO) until the next refill.
+ */
+struct flm__RateLimitWait
+{
+	flm_RateLimit *				limit;
+
+	flm_IO *				io;
+	bool *					hold;
+
+	/* linked in the waiting list of the bucket */
+	bool					waiting;
+
+	TAILQ_ENTRY (flm__RateLimitWait)	entries;
+};
+
+struct flm_RateLimit
+{
+	/* inheritance */
+	struct flm_Obj				obj;
+
+	flm_Monitor *				monitor;
+
+	uint32_t				rate;
+	uint32_t				burst;
+	uint64_t				tokens;
+
+	/* last refill, based on the monitor clock */
+	struct timespec				last;
+
+	flm_Timer *				timer;
+	TAILQ_HEAD (rlwt, flm__RateLimitWait)	waits;
+};
+
+int
+flm__RateLimitInit (flm_RateLimit *	limit,
+		    flm_Monitor *	monitor,
+		    uint32_t		rate,
+		    uint32_t		burst);
+
+void
+flm__RateLimitPerfDestruct (flm_RateLimit *	limit);
+
+size_t
+flm__RateLimitAvailable (flm_RateLimit *	limit);
+
+void
+flm__RateLimitConsume (flm_RateLimit *		limit,
+		       size_t			count);
+
+void
+flm__RateLimitWait (struct flm__RateLimitWait *	wait);
+
+void
+flm__RateLimitCancel (struct flm__RateLimitWait *	wait);
+
+void
+flm__RateLimitAttach (struct flm__RateLimitWait *	wait,
+		      flm_RateLimit *			limit);
+
+void
+flm__RateLimitRefill (flm_Timer *	timer,
+		      void *		_limit);
+
+#endif /* !_FLM_CORE_PRIVATE_RATE_LIMIT_H_ */
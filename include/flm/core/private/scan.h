@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef _FLM_CORE_PRIVATE_SCAN_H_
+# define _FLM_CORE_PRIVATE_SCAN_H_
+
+#include <unistd.h>
+
+#include "flm/core/public/scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define FLM__SCAN_X86
+#endif
+
+/* sets larger than this use the lookup table */
+#define FLM__SCAN_SET_SIZE		16
+
+enum flm__ScanLevel
+{
+	FLM__SCAN_SCALAR =		0x0000,
+	FLM__SCAN_SSE2,
+	FLM__SCAN_AVX2
+};
+
+typedef const char * (*flm__ScanByte_f) (const char *, size_t, char);
+typedef const char * (*flm__ScanPair_f) (const char *, size_t, char, char);
+typedef const char * (*flm__ScanSet_f) (const char *,
+					size_t,
+					const char *,
+					size_t);
+
+struct flm__ScanOps
+{
+	int				level;
+
+	flm__ScanByte_f			byte;
+	flm__ScanPair_f			pair;
+	flm__ScanSet_f			set;
+};
+
+/**
+ * Select the fastest version supported by the processor, called once.
+ */
+void
+flm__ScanInit (void);
+
+int
+flm__ScanUse (int			level);
+
+/**
+ * Force a version, used by the tests and the benchmarks to compare them.
+ * Returns -1 if the processor does not support it.
+ */
+int
+flm__ScanSetLevel (int			level);
+
+int
+flm__ScanGetLevel (void);
+
+const char *
+flm__ScanByteScalar (const char *	content,
+		     size_t		len,
+		     char		byte);
+
+const char *
+flm__ScanPairScalar (const char *	content,
+		     size_t		len,
+		     char		first,
+		     char		second);
+
+const char *
+flm__ScanSetScalar (const char *	content,
+		    size_t		len,
+		    const char *	set,
+		    size_t		count);
+
+#if defined(FLM__SCAN_X86)
+const char *
+flm__ScanSetSSE2 (const char *		content,
+		  size_t		len,
+		  const char *		set,
+		  size_t		count);
+
+const char *
+flm__ScanSetAVX2 (const char *		content,
+		  size_t		len,
+		  const char *		set,
+		  size_t		count);
+#endif
+
+#endif /* !_FLM_CORE_PRIVATE_SCAN_H_ */
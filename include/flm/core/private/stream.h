@@ -25,33 +25,74 @@
 
 #include <openssl/ssl.h>
 
+#include "flm/core/public/framer.h"
+#include "flm/core/public/http.h"
 #include "flm/core/public/stream.h"
 #include "flm/core/public/monitor.h"
+#include "flm/core/public/thread.h"
+#include "flm/core/public/timer.h"
 
 #include "flm/core/private/io.h"
+#include "flm/core/private/rate_limit.h"
 
 #define FLM__TYPE_STREAM	0x00060000
+#define FLM__TYPE_STREAM_RELAY	0x000E0000
 
 typedef flm_Buffer *(*flm__StreamPerfAlloc_f) (flm_Stream * stream);
 
+/**
+ * Kernel pipe between two streams, the source splices into it and the
+ * destination splices out of it.
+ */
+struct flm__StreamRelay
+{
+	struct flm_Obj			obj;
+
+	flm_Stream *			from;	/* cleared when closed */
+	flm_Stream *			to;	/* retained by the source */
+
+	int				pipe[2];
+	size_t				size;
+	size_t				pending;
+	uint64_t			count;
+
+	bool				paused;
+	bool				starved;
+	bool				eof;
+};
+
 struct flm__StreamInput
 {
 	union {
 		flm_Obj *		obj;
 		flm_File *		file;
 		flm_Buffer *		buffer;
+		struct flm__StreamRelay *	relay;
 	} class;
 	enum {
 					FLM__STREAM_TYPE_FILE,
-					FLM__STREAM_TYPE_BUFFER
+					FLM__STREAM_TYPE_BUFFER,
+					FLM__STREAM_TYPE_PIPE
 	} type;
 
 	off_t				off;
 	size_t				count;
 	int				tried;
+	int				fd;	/* sent with the first byte */
 	TAILQ_ENTRY (flm__StreamInput)	entries;
 };
 
+/**
+ * Buffer sent with MSG_ZEROCOPY, the kernel may still be reading it
+ * until the completion of its send call is reported.
+ */
+struct flm__StreamZeroCopy
+{
+	flm_Buffer *			buffer;
+	uint32_t			seq;
+	TAILQ_ENTRY (flm__StreamZeroCopy)	entries;
+};
+
 struct flm_Stream
 {
     /* inheritance */
@@ -59,15 +100,82 @@ struct flm_Stream
 
     struct {
         flm_StreamReadHandler		handler;
+        flm_StreamDescriptorHandler	descriptor;
+        struct flm__RateLimitWait	rate;
+        flm_Framer *			framer;
+        flm_HTTPParser *		http;
     } rd;
     struct {
         flm_StreamWriteHandler		handler;
+        struct flm__RateLimitWait	rate;
     } wr;
 
     struct {
         SSL *                           obj;
+        bool                            handshake;
+        bool                            flush;  /* handshake wants to write */
+        bool                            failed;
+        bool                            quiet;  /* no close_notify */
+        bool                            rd_blocked; /* read wants to write */
+        bool                            wr_blocked; /* write wants to read */
+        size_t                          retry;
+        bool                            kernel; /* kTLS requested */
+        int                             offload;
+        SSL_SESSION *                   session; /* to resume */
     } tls;
 
+    struct {
+        struct flm__StreamRelay *       obj;
+    } relay;
+
+    struct {
+        flm_Thread *                    thread; /* set while migrating */
+        flm_StreamMigrateHandler        handler;
+    } mg;
+
+    struct {
+        size_t                          threshold;
+        uint32_t                        seq;
+        TAILQ_HEAD (flzc, flm__StreamZeroCopy)	pending;
+    } zc;
+
+    /**
+     * Part of a file read but not sent yet when it cannot be spliced by
+     * the kernel, the chunk comes from the pool of the monitor.
+     */
+    struct {
+        char *                          data;
+        struct flm__StreamInput *       input;
+        off_t                           off;    /* file offset of data */
+        size_t                          len;
+    } fc;
+
+    /**
+     * Files opened with O_DIRECT are read into two aligned chunks of the
+     * monitor at aligned offsets: one is sent while the file queue of the
+     * stream, if any, reads the next one.
+     */
+    struct {
+        char *                          data[2];
+        off_t                           off[2];
+        size_t                          len[2];
+        int                             cur;
+        bool                            reading;  /* next one is queued */
+        int                             error;
+        struct flm__StreamInput *       input;
+    } dr;
+
+    /**
+     * Checks that a file range is in the page cache before sending it,
+     * and has it read by the queue otherwise.
+     */
+    struct {
+        flm_FileQueue *                 queue;
+        bool                            warm;   /* just prefetched */
+        flm_File *                      file;   /* prefetched ahead */
+        off_t                           next;
+    } pf;
+
     struct {
         flm__StreamPerfAlloc_f          alloc;
     } perf;
@@ -76,8 +184,12 @@ struct flm_Stream
 };
 
 #define FLM_STREAM__RBUFFER_SIZE		2048
-#define FLM_STREAM__IOVEC_SIZE			8
-#define FLM_STREAM__READ_FILE_SIZE              2048
+#define FLM_STREAM__IOVEC_SIZE			64   /* segments per writev(2) */
+#define FLM_STREAM__RELAY_PIPE_SIZE             65536
+#define FLM_STREAM__TLS_RECORD_SIZE             16384
+#define FLM_STREAM__DESCRIPTOR_COUNT            8
+#define FLM_STREAM__PREFETCH_WINDOW             262144
+#define FLM_STREAM__PREFETCH_SIZE               1048576
 
 int
 flm__StreamInit (flm_Stream *           stream,
@@ -92,9 +204,31 @@ flm__StreamInitTLS (flm_Stream *        stream,
 void
 flm__StreamShutdownTLS (flm_Stream *    stream);
 
+int
+flm__StreamTLSHandshake (flm_Stream *   stream);
+
+void
+flm__StreamTLSOffload (flm_Stream *     stream);
+
+void
+flm__StreamTLSRead (flm_Stream *        stream,
+                    size_t              max);
+
+ssize_t
+flm__StreamTLSWrite (flm_Stream *       stream,
+                     size_t             max);
+
 void
 flm__StreamPerfDestruct (flm_Stream *	stream);
 
+void
+flm__StreamPerfClose (flm_Stream *	stream,
+		      flm_Monitor *	monitor);
+
+void
+flm__StreamPerfError (flm_Stream *	stream,
+		      flm_Monitor *	monitor);
+
 void *
 flm__StreamDefaultFeed (void *          state,
 			size_t		size);
@@ -104,24 +238,144 @@ flm__StreamPerfRead (flm_Stream *	stream,
 		     flm_Monitor *	monitor,
 		     uint8_t		count);
 
+ssize_t
+flm__StreamSysReadv (flm_Stream *	stream,
+                     struct iovec *	iovec,
+                     int		iov_count);
+
+void
+flm__StreamMigrateDetach (flm_Timer *   timer,
+                          void *        _stream);
+
+void
+flm__StreamMigrateAttach (flm_Thread *  thread,
+                          flm_Monitor * monitor,
+                          void *        _state,
+                          void *        _stream);
+
+void
+flm__StreamMigrateAbort (flm_Stream *   stream);
+
+int
+flm__StreamReadBuffer (flm_Stream *	stream,
+                       flm_Buffer *	buffer);
+
+void
+flm__StreamReadFrame (void *		_stream,
+                      flm_Buffer *	frame);
+
+void
+flm__StreamReadEnd (flm_Stream *	stream);
+
 void
 flm__StreamPerfWrite (flm_Stream *	stream,
 		      flm_Monitor *	monitor,
 		      uint8_t		count);
 
 ssize_t
-flm__StreamWrite (flm_Stream *		stream);
+flm__StreamWrite (flm_Stream *		stream,
+                  size_t		max);
 
 flm_Buffer *
 flm__StreamPerfAlloc (flm_Stream *      stream);
 
 ssize_t
-flm__StreamSysWritev (flm_Stream *	stream);
+flm__StreamSysWritev (flm_Stream *	stream,
+                      size_t		max);
+
+char *
+flm__StreamFileChunk (flm_Stream *			stream,
+                      struct flm__StreamInput *	input,
+                      size_t *			size);
+
+int
+flm__StreamFileFill (flm_Stream *	stream);
+
+void
+flm__StreamFileRelease (flm_Stream *	stream);
+
+char *
+flm__StreamDirectChunk (flm_Stream *			stream,
+                        struct flm__StreamInput *	input,
+                        size_t *			size);
+
+int
+flm__StreamDirectRead (flm_Stream *	stream,
+                       int		pos,
+                       off_t		off);
+
+void
+flm__StreamDirectAhead (flm_Stream *	stream);
+
+void
+flm__StreamDirectDone (flm_File *	file,
+                       void *		_stream,
+                       flm_Buffer *	buffer,
+                       ssize_t		count);
+
+void
+flm__StreamDirectRelease (flm_Stream *	stream);
+
+bool
+flm__StreamFileCold (flm_Stream *			stream,
+                     struct flm__StreamInput *		input,
+                     size_t *				max);
+
+void
+flm__StreamPrefetchAhead (flm_Stream *			stream,
+                          struct flm__StreamInput *	input);
+
+void
+flm__StreamPrefetched (flm_File *	file,
+                       void *		_stream,
+                       flm_Buffer *	buffer,
+                       ssize_t		count);
+
+ssize_t
+flm__StreamSysReadWriteTo (flm_Stream *	stream,
+                           size_t	max);
+
+ssize_t
+flm__StreamSysSendFile (flm_Stream *	stream,
+                        size_t		max);
 
 ssize_t
-flm__StreamSysReadWriteTo (flm_Stream *	stream);
+flm__StreamSysSplice (flm_Stream *	stream,
+                      size_t		max);
 
 ssize_t
-flm__StreamSysSendFile (flm_Stream *	stream);
+flm__StreamSysSendZeroCopy (flm_Stream *	stream,
+                            size_t		max);
+
+void
+flm__StreamZeroCopyComplete (flm_Stream *	stream);
+
+int
+flm__StreamRelayInit (struct flm__StreamRelay *	relay,
+                      flm_Stream *		from,
+                      flm_Stream *		to);
+
+void
+flm__StreamRelayPerfDestruct (struct flm__StreamRelay *	relay);
+
+void
+flm__StreamRelayStop (flm_Stream *	stream);
+
+void
+flm__StreamRelayRead (flm_Stream *	stream,
+                      size_t		max);
+
+void
+flm__StreamRelayEnd (flm_Stream *	stream);
+
+int
+flm__StreamRelayPush (flm_Stream *		stream,
+                      struct flm__StreamRelay *	relay,
+                      size_t			count);
+
+void
+flm__StreamRelayDrain (flm_Stream *		stream,
+                       struct flm__StreamRelay *	relay,
+                       size_t			count);
 
 #endif /* !_FLM_CORE_PRIVATE_STREAM_H_ */
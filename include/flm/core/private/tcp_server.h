@@ -41,6 +41,16 @@ flm__TCPServerInit (flm_TCPServer *		tcp_server,
 		    uint16_t			port,
 		    void *		state);
 
+/**
+ * Make a bound socket listen and watch it, shared by every kind of server.
+ * The socket is not closed on error.
+ */
+int
+flm__TCPServerListen (flm_TCPServer *		tcp_server,
+		      flm_Monitor *		monitor,
+		      int			fd,
+		      void *			state);
+
 int
 flm__TCPServerPerfRead (flm_TCPServer *		tcp_server,
 			flm_Monitor *		monitor,
@@ -45,6 +45,7 @@ struct flm_Timer
 	struct {
 		uint32_t			rounds;
 		size_t				pos;
+		bool				expired;
 		TAILQ_ENTRY (flm_Timer)		entries;
 	} wh;
 };
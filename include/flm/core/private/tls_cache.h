@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FLM_CORE_PRIVATE_TLS_CACHE_H_
+# define _FLM_CORE_PRIVATE_TLS_CACHE_H_
+
+#include <sys/queue.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/ssl.h>
+
+#include "flm/core/public/timer.h"
+#include "flm/core/public/tls_cache.h"
+
+#include "flm/core/private/obj.h"
+
+#define FLM__TYPE_TLS_CACHE	0x000F0000
+
+/* must be a power of two */
+#define FLM__TLS_CACHE_SHARDS		16
+
+/* current ticket key and the previous ones still accepted */
+#define FLM__TLS_CACHE_KEYS		3
+
+#define FLM__TLS_CACHE_KEY_NAME_SIZE	16
+#define FLM__TLS_CACHE_KEY_SIZE		32
+
+struct flm__TLSCacheEntry
+{
+	unsigned char				id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+	unsigned int				id_len;
+	uint32_t				hash;
+
+	SSL_SESSION *				session;
+	time_t					expire;
+
+	LIST_ENTRY (flm__TLSCacheEntry)		bucket;
+	TAILQ_ENTRY (flm__TLSCacheEntry)	lru;
+};
+
+/**
+ * The counters of a shard are protected by its lock
+ */
+struct flm__TLSCacheShard
+{
+	pthread_mutex_t				lock;
+
+	size_t					count;
+	size_t					max;
+
+	LIST_HEAD (tcbk, flm__TLSCacheEntry) *	buckets;
+	uint32_t				mask;
+	TAILQ_HEAD (tclr, flm__TLSCacheEntry)	lru;
+
+	uint64_t				lookups;
+	uint64_t				hits;
+	uint64_t				stores;
+	uint64_t				evictions;
+};
+
+struct flm__TLSCacheKey
+{
+	unsigned char		name[FLM__TLS_CACHE_KEY_NAME_SIZE];
+	unsigned char		aes[FLM__TLS_CACHE_KEY_SIZE];
+	unsigned char		hmac[FLM__TLS_CACHE_KEY_SIZE];
+};
+
+struct flm_TLSCache
+{
+	/* inheritance */
+	struct flm_Obj				obj;
+
+	struct flm__TLSCacheShard		shards[FLM__TLS_CACHE_SHARDS];
+
+	struct {
+		pthread_rwlock_t		lock;
+		struct flm__TLSCacheKey		keys[FLM__TLS_CACHE_KEYS];
+		size_t				current;
+		size_t				count;
+
+		flm_Timer *			timer;
+		uint32_t			interval;
+
+		/* updated atomically, the lock is only read locked */
+		uint64_t			decrypted;
+		uint64_t			unknown;
+		uint64_t			rotations;
+	} tickets;
+};
+
+int
+flm__TLSCacheInit (flm_TLSCache *	cache,
+		   size_t		size);
+
+void
+flm__TLSCachePerfDestruct (flm_TLSCache *	cache);
+
+int
+flm__TLSCacheIndex (void);
+
+void
+flm__TLSCacheExFree (void *		parent,
+		     void *		ptr,
+		     CRYPTO_EX_DATA *	ad,
+		     int		idx,
+		     long		argl,
+		     void *		argp);
+
+uint32_t
+flm__TLSCacheHash (const unsigned char *	id,
+		   unsigned int			id_len);
+
+flm_TLSCache *
+flm__TLSCacheGet (SSL_CTX *		context);
+
+struct flm__TLSCacheEntry *
+flm__TLSCacheFind (struct flm__TLSCacheShard *	shard,
+		   const unsigned char *	id,
+		   unsigned int			id_len,
+		   uint32_t			hash);
+
+void
+flm__TLSCacheUnlink (struct flm__TLSCacheShard *	shard,
+		     struct flm__TLSCacheEntry *	entry);
+
+int
+flm__TLSCachePerfNew (SSL *		ssl,
+		      SSL_SESSION *	session);
+
+SSL_SESSION *
+flm__TLSCachePerfGet (SSL *			ssl,
+		      const unsigned char *	id,
+		      int			id_len,
+		      int *			copy);
+
+void
+flm__TLSCachePerfRemove (SSL_CTX *	context,
+			 SSL_SESSION *	session);
+
+int
+flm__TLSCacheFindKey (flm_TLSCache *		cache,
+		      const unsigned char *	name,
+		      int			enc,
+		      struct flm__TLSCacheKey *	key);
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int
+flm__TLSCachePerfTicket (SSL *			ssl,
+			 unsigned char *	name,
+			 unsigned char *	iv,
+			 EVP_CIPHER_CTX *	cipher,
+			 EVP_MAC_CTX *		mac,
+			 int			enc);
+#else
+int
+flm__TLSCachePerfTicket (SSL *			ssl,
+			 unsigned char *	name,
+			 unsigned char *	iv,
+			 EVP_CIPHER_CTX *	cipher,
+			 HMAC_CTX *		mac,
+			 int			enc);
+#endif
+
+void
+flm__TLSCacheRotateHandler (flm_Timer *	timer,
+			    void *	_cache);
+
+#endif /* !_FLM_CORE_PRIVATE_TLS_CACHE_H_ */
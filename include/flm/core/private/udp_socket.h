@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FLM_CORE_PRIVATE_UDP_SOCKET_H_
+# define _FLM_CORE_PRIVATE_UDP_SOCKET_H_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <stdbool.h>
+
+#include "flm/core/public/udp_socket.h"
+
+#include "flm/core/private/io.h"
+#include "flm/core/private/monitor.h"
+
+#define FLM__TYPE_UDP_SOCKET	0x00140000
+
+#define FLM__UDP_SOCKET_BATCH_COUNT	32
+#define FLM__UDP_SOCKET_BATCH_SIZE	2048
+#define FLM__UDP_SOCKET_BATCH_MAX	1024
+
+/* datagrams waiting to be sent */
+#define FLM__UDP_SOCKET_QUEUE_SIZE	4096
+
+/**
+ * Segmentation offload: datagrams sent by a single message, and the
+ * largest message, on both sides.
+ */
+#define FLM__UDP_SOCKET_GSO_SEGMENTS	64
+#define FLM__UDP_SOCKET_GSO_SIZE	65000
+#define FLM__UDP_SOCKET_GRO_SIZE	65535
+
+/* room for a single integer option */
+#define FLM__UDP_SOCKET_CTRL_SIZE	CMSG_SPACE (sizeof (int))
+
+struct flm__UDPSocketOutput
+{
+	flm_Buffer *				buffer;
+	struct sockaddr_storage			addr;
+	socklen_t				addr_len;
+};
+
+struct flm_UDPSocket
+{
+	/* inheritance */
+	struct flm_IO				io;
+
+	struct {
+		size_t				count;
+		size_t				size;
+	} batch;
+
+	struct {
+		flm_UDPSocketReadHandler	handler;
+		/* the datagrams of a batch are views of it */
+		flm_Buffer *			slab;
+		struct mmsghdr *		msgs;
+		struct iovec *			iov;
+		struct sockaddr_storage *	addrs;
+		char *				ctrl;
+		/* space given to each message of the slab */
+		size_t				stride;
+		bool				gro;
+	} rd;
+
+	struct {
+		/* ring of datagrams */
+		struct flm__UDPSocketOutput *	queue;
+		size_t				head;
+		size_t				count;
+		struct mmsghdr *		msgs;
+		struct iovec *			iov;
+		/* datagrams carried by each message */
+		size_t *			segs;
+		char *				ctrl;
+		bool				gso;
+	} wr;
+};
+
+int
+flm__UDPSocketInit (flm_UDPSocket *		udp_socket,
+		    flm_Monitor *		monitor,
+		    const char *		address,
+		    uint16_t			port,
+		    void *			state);
+
+void
+flm__UDPSocketPerfDestruct (flm_UDPSocket *	udp_socket);
+
+void
+flm__UDPSocketPerfRead (flm_UDPSocket *		udp_socket,
+			flm_Monitor *		monitor,
+			uint8_t			count);
+
+void
+flm__UDPSocketPerfWrite (flm_UDPSocket *	udp_socket,
+			 flm_Monitor *		monitor,
+			 uint8_t		count);
+
+int
+flm__UDPSocketAlloc (flm_UDPSocket *		udp_socket,
+		     size_t			count);
+
+flm_Buffer *
+flm__UDPSocketSlab (flm_UDPSocket *		udp_socket);
+
+size_t
+flm__UDPSocketTrain (flm_UDPSocket *		udp_socket,
+		     size_t			first,
+		     struct iovec *		iov);
+
+void
+flm__UDPSocketDrop (flm_UDPSocket *		udp_socket,
+		    size_t			count);
+
+void
+flm__UDPSocketError (flm_UDPSocket *		udp_socket);
+
+#endif /* !_FLM_CORE_PRIVATE_UDP_SOCKET_H_ */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _FLM_CORE_PRIVATE_UNIX_SERVER_H_
+# define _FLM_CORE_PRIVATE_UNIX_SERVER_H_
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "flm/core/public/unix_server.h"
+
+#include "flm/core/private/monitor.h"
+#include "flm/core/private/tcp_server.h"
+
+#define FLM__TYPE_UNIX_SERVER	0x00150000
+
+struct flm_UnixServer
+{
+	/* inheritance */
+	struct flm_TCPServer		tcp_server;
+
+	struct sockaddr_un		addr;
+	socklen_t			len;
+};
+
+int
+flm__UnixServerInit (flm_UnixServer *		unix_server,
+		     flm_Monitor *		monitor,
+		     const char *		path,
+		     void *			state);
+
+int
+flm__UnixServerBind (flm_UnixServer *		unix_server,
+		     int			fd);
+
+void
+flm__UnixServerPerfDestruct (flm_UnixServer *	unix_server);
+
+#endif /* !_FLM_CORE_PRIVATE_UNIX_SERVER_H_ */
@@ -37,6 +37,7 @@
 
 typedef struct flm_Buffer flm_Buffer;
 
+#include "flm/core/public/file.h"
 #include "flm/core/public/obj.h"
 
 #endif /* _FLM__SKIP */
@@ -78,6 +79,69 @@ flm_BufferNew (char *				content,
 	       size_t				length,
 	       flm_BufferFreeContentHandler	fr_handler);
 
+/**
+ * \brief Create a new buffer along with its content.
+ *
+ * The object and its content are allocated at once, and freed at once
+ * when the buffer is released: the content is meant to be filled right
+ * after through flm_BufferContent().
+ *
+ * \param length The length (in bytes) of the content.
+ *
+ * \return A pointer to a new flm_Buffer object.
+ * \retval NULL in case of error.
+ */
+flm_Buffer *
+flm_BufferAlloc (size_t                         length);
+
+/**
+ * Hints given to flm_BufferMap() about how the content will be accessed.
+ */
+#define FLM_BUFFER_MAP_NORMAL           0x00
+#define FLM_BUFFER_MAP_SEQUENTIAL       0x01
+#define FLM_BUFFER_MAP_RANDOM           0x02
+#define FLM_BUFFER_MAP_WILLNEED         0x04    /* read it ahead now */
+
+/**
+ * \brief Create a new buffer from a range of a file mapped in memory.
+ *
+ * The content is read from the file as it is accessed, without being
+ * copied to the memory of the process first, and unmapped when the
+ * buffer is released. The mapping is private: changes made to the
+ * content never reach the file. The buffer can be sliced with
+ * flm_BufferView() and pushed on a stream like any other one.
+ *
+ * \param file A pointer to a flm_File object, opened for reading.
+ * \param off The offset of the range in the file, EINVAL if negative.
+ * \param count The length of the range, 0 for the rest of the file. The
+ * range stops at the end of the file as it is when the buffer is
+ * created: the file should not be truncated while the buffer is used.
+ * \param advice FLM_BUFFER_MAP_SEQUENTIAL or FLM_BUFFER_MAP_RANDOM,
+ * optionally with FLM_BUFFER_MAP_WILLNEED.
+ *
+ * \return A pointer to a new flm_Buffer object.
+ * \retval NULL in case of error.
+ */
+flm_Buffer *
+flm_BufferMap (flm_File *                      file,
+               off_t                           off,
+               size_t                          count,
+               int                             advice);
+
+/**
+ * \brief Create a new buffer sharing a part of the content of another one.
+ *
+ * The view keeps a reference to the buffer holding the content. A view of
+ * a view refers directly to that root buffer, so slicing repeatedly does
+ * not chain the views together.
+ *
+ * \param buffer The buffer to take the content from.
+ * \param off The offset of the view in the content of \a buffer.
+ * \param count The length (in bytes) of the view.
+ *
+ * \return A pointer to a new flm_Buffer object.
+ * \retval NULL in case of error.
+ */
 flm_Buffer *
 flm_BufferView (flm_Buffer *                    buffer,
                 off_t                           off,
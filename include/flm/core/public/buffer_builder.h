@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \brief A buffer growing as content is added to it.
+ */
+
+/**
+ * \file buffer_builder.h
+ * \c A buffer builder lets a message be written without knowing its
+ * length in advance: the content grows geometrically as data is
+ * appended, so that adding a byte costs amortized constant time, and
+ * can be written in place by reserving room then committing what was
+ * actually written. Once done, flm_BufferBuilderFinish() turns the
+ * content into a flm_Buffer without copying it.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_BUFFER_BUILDER_H_
+# define _FLM_CORE_PUBLIC_BUFFER_BUILDER_H_
+
+#ifndef _FLM__SKIP
+
+#include <sys/types.h>
+
+typedef struct flm_BufferBuilder flm_BufferBuilder;
+
+#include "flm/core/public/buffer.h"
+#include "flm/core/public/obj.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * \brief Create an empty buffer builder.
+ *
+ * \param hint The expected length (in bytes) of the content, room for it
+ * is made at once. 0 if unknown.
+ * \return A pointer to a new flm_BufferBuilder object.
+ * \retval NULL in case of error.
+ */
+flm_BufferBuilder *
+flm_BufferBuilderNew (size_t				hint);
+
+/**
+ * \brief Copy data at the end of the content.
+ *
+ * \param builder A pointer to a flm_BufferBuilder object.
+ * \param data The data to copy.
+ * \param length The length (in bytes) of the data.
+ * \return 0 on success, -1 in case of error, the content is then left
+ * untouched.
+ */
+int
+flm_BufferBuilderAppend (flm_BufferBuilder *		builder,
+			 const void *			data,
+			 size_t				length);
+
+/**
+ * \brief Make room at the end of the content to write in place.
+ *
+ * The room is not part of the content until flm_BufferBuilderCommit() is
+ * called. The pointer is only valid until the next call that may grow
+ * the builder.
+ *
+ * \param builder A pointer to a flm_BufferBuilder object.
+ * \param length The length (in bytes) of the room needed.
+ * \return A pointer to at least \a length writable bytes.
+ * \retval NULL in case of error.
+ */
+char *
+flm_BufferBuilderReserve (flm_BufferBuilder *		builder,
+			  size_t			length);
+
+/**
+ * \brief Add to the content the bytes written in the reserved room.
+ *
+ * \param builder A pointer to a flm_BufferBuilder object.
+ * \param length The number of bytes written, at most the length of the
+ * room made by flm_BufferBuilderReserve().
+ * \return 0 on success, -1 if the room is too small.
+ */
+int
+flm_BufferBuilderCommit (flm_BufferBuilder *		builder,
+			 size_t				length);
+
+/**
+ * \brief Returns the content built so far, NULL while empty.
+ *
+ * The pointer is only valid until the next call that may grow the
+ * builder.
+ */
+char *
+flm_BufferBuilderContent (flm_BufferBuilder *		builder);
+
+/**
+ * \brief Returns the length (in bytes) of the content built so far.
+ */
+size_t
+flm_BufferBuilderLength (flm_BufferBuilder *		builder);
+
+/**
+ * \brief Turn the content into a buffer.
+ *
+ * The content is not copied, the buffer takes it over and the builder
+ * is left empty, ready to build another one.
+ *
+ * \param builder A pointer to a flm_BufferBuilder object.
+ * \return A pointer to a new flm_Buffer object.
+ * \retval NULL in case of error.
+ */
+flm_Buffer *
+flm_BufferBuilderFinish (flm_BufferBuilder *		builder);
+
+flm_BufferBuilder *
+flm_BufferBuilderRetain (flm_BufferBuilder *		builder);
+
+void
+flm_BufferBuilderRelease (flm_BufferBuilder *		builder);
+
+#endif /* !_FLM_CORE_PUBLIC_BUFFER_BUILDER_H_ */
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \brief A sequence of buffers handled as a single one.
+ */
+
+/**
+ * \file buffer_chain.h
+ * \c A buffer chain is a list of segments, each one a part of a
+ * flm_Buffer it holds a reference to. Appending, prepending and cutting
+ * a chain in two only move references around, the content of the
+ * buffers is never copied: a message can be built from its parts and
+ * sent with flm_StreamPushChain(), which gives each segment to the
+ * kernel in a single gather write.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_BUFFER_CHAIN_H_
+# define _FLM_CORE_PUBLIC_BUFFER_CHAIN_H_
+
+#ifndef _FLM__SKIP
+
+#include <sys/types.h>
+
+typedef struct flm_BufferChain flm_BufferChain;
+
+#include "flm/core/public/buffer.h"
+#include "flm/core/public/obj.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * Called for each segment of a chain, in order. Returning anything else
+ * than 0 stops the iteration.
+ */
+typedef int (*flm_BufferChainHandler)			\
+(void * state, char * content, size_t length);
+
+/**
+ * \brief Create an empty buffer chain.
+ *
+ * \return A pointer to a new flm_BufferChain object.
+ * \retval NULL in case of error.
+ */
+flm_BufferChain *
+flm_BufferChainNew ();
+
+/**
+ * \brief Add a part of a buffer at the end of the chain.
+ *
+ * The buffer is retained, not copied.
+ *
+ * \param chain A pointer to a flm_BufferChain object.
+ * \param buffer The buffer to add.
+ * \param off The offset of the part in the buffer.
+ * \param count The length of the part, 0 for the rest of the buffer.
+ * \return 0 on success, -1 in case of error.
+ */
+int
+flm_BufferChainAppend (flm_BufferChain *		chain,
+		       flm_Buffer *			buffer,
+		       off_t				off,
+		       size_t				count);
+
+/**
+ * \brief Add a part of a buffer at the beginning of the chain.
+ *
+ * See flm_BufferChainAppend().
+ */
+int
+flm_BufferChainPrepend (flm_BufferChain *		chain,
+			flm_Buffer *			buffer,
+			off_t				off,
+			size_t				count);
+
+/**
+ * \brief Cut a chain in two.
+ *
+ * The segment the offset falls in is shared by both chains, each one
+ * with its own part of it.
+ *
+ * \param chain A pointer to a flm_BufferChain object, keeps the bytes
+ * before the offset.
+ * \param off The offset of the cut in the chain.
+ * \return A new chain with the bytes from the offset on, empty if the
+ * offset is past the end of the chain.
+ * \retval NULL in case of error, the chain is left untouched.
+ */
+flm_BufferChain *
+flm_BufferChainSplit (flm_BufferChain *		chain,
+		      size_t			off);
+
+/**
+ * \brief Call a handler with the content of each segment.
+ *
+ * \param chain A pointer to a flm_BufferChain object.
+ * \param handler The handler to call.
+ * \param state A pointer given to the handler.
+ * \return 0 once every segment was seen, or the value returned by the
+ * handler that stopped the iteration.
+ */
+int
+flm_BufferChainForEach (flm_BufferChain *		chain,
+			flm_BufferChainHandler		handler,
+			void *				state);
+
+/**
+ * \brief Returns the length (in bytes) of the chain.
+ */
+size_t
+flm_BufferChainLength (flm_BufferChain *	chain);
+
+/**
+ * \brief Returns the number of segments of the chain.
+ */
+size_t
+flm_BufferChainCount (flm_BufferChain *		chain);
+
+flm_BufferChain *
+flm_BufferChainRetain (flm_BufferChain *	chain);
+
+void
+flm_BufferChainRelease (flm_BufferChain *	chain);
+
+#endif /* !_FLM_CORE_PUBLIC_BUFFER_CHAIN_H_ */
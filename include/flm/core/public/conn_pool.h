@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \brief Keep idle upstream connections for later requests.
+ */
+
+/**
+ * \file conn_pool.h
+ * \c A connection pool parks the streams that are not used anymore,
+ * grouped by destination address, so that the next request to the same
+ * destination does not pay a new handshake. A pool belongs to a single
+ * monitor and is not locked. The most recently parked connection is
+ * handed out first, the others are closed after an idle timeout or as
+ * soon as the peer closes them.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_CONN_POOL_H_
+# define _FLM_CORE_PUBLIC_CONN_POOL_H_
+
+#ifndef _FLM__SKIP
+
+#include <stdint.h>
+#include <unistd.h>
+
+typedef struct flm_ConnPool flm_ConnPool;
+
+#include "flm/core/public/monitor.h"
+#include "flm/core/public/obj.h"
+#include "flm/core/public/stream.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * Counters of a connection pool, see flm_ConnPoolStats().
+ */
+struct flm_ConnPoolStats
+{
+    /* connections asked for, found idle or not */
+    uint64_t            hits;
+    uint64_t            misses;
+
+    /* idle connections closed to respect the limit of their destination */
+    uint64_t            evictions;
+
+    /* idle connections timed out, and closed or written to by the peer */
+    uint64_t            expirations;
+    uint64_t            closed;
+
+    /* connections currently parked */
+    size_t              idle;
+};
+
+/**
+ * \brief Create a new connection pool.
+ *
+ * \param monitor The monitor of all the streams parked in the pool.
+ * \param max The default maximum number of idle connections kept for a
+ * destination.
+ * \param timeout The delay in milliseconds after which an idle
+ * connection is closed, 0 to keep them until the peer closes them.
+ *
+ * \return A pointer to a new flm_ConnPool object.
+ * \retval NULL in case of error.
+ */
+flm_ConnPool *
+flm_ConnPoolNew (flm_Monitor *			monitor,
+                 size_t				max,
+                 uint32_t			timeout);
+
+/**
+ * \brief Change the maximum number of idle connections to a destination.
+ *
+ * Idle connections over the new limit are closed, oldest first.
+ *
+ * \param pool A pointer to a flm_ConnPool object.
+ * \param address The numeric address of the destination.
+ * \param port The port of the destination.
+ * \param max The maximum number of idle connections.
+ * \return 0 on success, -1 on error.
+ */
+int
+flm_ConnPoolLimit (flm_ConnPool *		pool,
+                   const char *			address,
+                   uint16_t			port,
+                   size_t			max);
+
+/**
+ * \brief Take an idle connection to a destination.
+ *
+ * The stream is handed out without any handler, reading and with the
+ * given state. The caller owns a reference to it.
+ *
+ * \param pool A pointer to a flm_ConnPool object.
+ * \param address The numeric address of the destination.
+ * \param port The port of the destination.
+ * \param state The new state of the stream.
+ *
+ * \return A pointer to a flm_Stream object.
+ * \retval NULL if there is no usable idle connection, a new one has to
+ * be opened (see flm_TCPClientNew()).
+ */
+flm_Stream *
+flm_ConnPoolGet (flm_ConnPool *			pool,
+                 const char *			address,
+                 uint16_t			port,
+                 void *				state);
+
+/**
+ * \brief Park a connection that is not used anymore.
+ *
+ * The stream must not have any pending output and must be attached to
+ * the monitor of the pool. The pool takes its own reference and replaces
+ * its handlers, the framer or HTTP parser attached to it is removed. If
+ * the destination already has its maximum of idle connections, the
+ * oldest one is closed.
+ *
+ * \param pool A pointer to a flm_ConnPool object.
+ * \param address The numeric address of the destination.
+ * \param port The port of the destination.
+ * \param stream The connection to park.
+ * \return 0 on success, -1 on error. The stream is closed if it cannot
+ * be parked.
+ *
+ * \code
+ *  flm_ConnPoolPut (pool, "10.0.0.1", 8080, stream);
+ *  flm_StreamRelease (stream);
+ * \endcode
+ */
+int
+flm_ConnPoolPut (flm_ConnPool *			pool,
+                 const char *			address,
+                 uint16_t			port,
+                 flm_Stream *			stream);
+
+/**
+ * \brief Close all the idle connections.
+ *
+ * The monitor does not return from flm_MonitorWait() while idle
+ * connections are open, this has to be called to let it stop.
+ *
+ * \param pool A pointer to a flm_ConnPool object.
+ */
+void
+flm_ConnPoolClear (flm_ConnPool *		pool);
+
+/**
+ * \brief Get the counters of the pool.
+ *
+ * \param pool A pointer to a flm_ConnPool object.
+ * \param stats Filled with the counters.
+ */
+void
+flm_ConnPoolStats (flm_ConnPool *		pool,
+                   struct flm_ConnPoolStats *	stats);
+
+/**
+ * \brief Increment the reference counter.
+ *
+ * \param pool A pointer to a flm_ConnPool object.
+ * \return The same flm_ConnPool object.
+ */
+flm_ConnPool *
+flm_ConnPoolRetain (flm_ConnPool *		pool);
+
+/**
+ * \brief Decrement the reference counter, the idle connections are
+ * closed when the pool is destroyed.
+ *
+ * \param pool A pointer to a flm_ConnPool object.
+ */
+void
+flm_ConnPoolRelease (flm_ConnPool *		pool);
+
+#endif /* !_FLM_CORE_PUBLIC_CONN_POOL_H_ */
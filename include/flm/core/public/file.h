@@ -35,6 +35,8 @@ flm_FileNew (int fd);
  *
  * See fopen(3) for further explanations about the parameters.
  *
+ * \param root A directory the relative paths are resolved from, NULL for
+ *   the current directory.
  * \param path A path to a file in the file system.
  * \param flags File flags as described in fopen(3).
  * \return A pointer to a new \c flm_file obj.
@@ -45,6 +47,22 @@ flm_FileNew (int fd);
 flm_File *
 flm_FileOpen (const char * root, const char * path, const char * mode);
 
+/**
+ * \brief Read the file around the page cache.
+ *
+ * Meant for the very large files sent by streams: they are read with
+ * O_DIRECT into aligned chunks of the monitor, and do not push the small
+ * and often read files out of the page cache. A stream with a file queue
+ * (see flm_StreamPrefetch()) reads the next chunk while the current one is
+ * sent, otherwise the next chunk is read when the socket is full.
+ *
+ * \param file A pointer to a flm_File object.
+ * \return 0 on success, -1 if the file system does not support direct
+ *   I/O.
+ */
+int
+flm_FileDirect (flm_File * file);
+
 flm_File *
 flm_FileRetain (flm_File * file);
 
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \brief Cache of the files opened by a static file server.
+ */
+
+/**
+ * \file file_cache.h
+ * \c A file cache keeps the files a server sends over and over open,
+ * along with their attributes, so that serving a cached file costs
+ * neither an open(2) nor a fstat(2). The paths are resolved relative to
+ * a root directory opened once. A cache belongs to a single monitor and
+ * is not locked, its clock is the one of the monitor. The least
+ * recently used files are closed when the cache is full.
+ *
+ * The cache is invalidated by time: once an entry is older than the
+ * validity delay, the next lookup checks the path again with a single
+ * fstatat(2). A file modified in place keeps its descriptor and gets its
+ * new attributes, a file replaced or removed is opened again or reported
+ * as missing.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_FILE_CACHE_H_
+# define _FLM_CORE_PUBLIC_FILE_CACHE_H_
+
+#ifndef _FLM__SKIP
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <stdint.h>
+
+typedef struct flm_FileCache flm_FileCache;
+
+#include "flm/core/public/file.h"
+#include "flm/core/public/monitor.h"
+#include "flm/core/public/obj.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * Counters of a file cache, see flm_FileCacheStats().
+ */
+struct flm_FileCacheStats
+{
+    /* lookups answered from the cache, and by opening the file */
+    uint64_t            hits;
+    uint64_t            misses;
+
+    /* expired entries checked again, and found replaced or removed */
+    uint64_t            revalidations;
+    uint64_t            stale;
+
+    /* files closed to make room for new ones */
+    uint64_t            evictions;
+
+    /* files currently open */
+    size_t              open;
+};
+
+/**
+ * \brief Create a new file cache.
+ *
+ * \param monitor The monitor whose clock is used for the validity delay.
+ * \param root The directory the paths are resolved from.
+ * \param max The maximum number of files kept open.
+ * \param validity The delay in milliseconds after which a cached file is
+ * checked again, 0 to never check.
+ *
+ * \return A pointer to a new flm_FileCache object.
+ * \retval NULL in case of error, the root directory cannot be opened or
+ * \c max is 0.
+ *
+ * \code
+ *  flm_FileCache * cache;
+ *  flm_File * file;
+ *  struct stat stat;
+ *
+ *  cache = flm_FileCacheNew (monitor, "/var/www", 1024, 5000);
+ *
+ *  file = flm_FileCacheOpen (cache, "index.html", &stat);
+ *  flm_StreamPushFile (stream, file, 0, stat.st_size);
+ *  flm_FileRelease (file);
+ * \endcode
+ */
+flm_FileCache *
+flm_FileCacheNew (flm_Monitor *		monitor,
+                  const char *		root,
+                  size_t		max,
+                  uint32_t		validity);
+
+/**
+ * \brief Open a regular file through the cache.
+ *
+ * The file is opened read only. The same flm_File is handed out to every
+ * caller until it is evicted or found stale, it must only be read at an
+ * explicit offset.
+ *
+ * \param cache A pointer to a flm_FileCache object.
+ * \param path A path relative to the root of the cache, it cannot be
+ * absolute nor contain any ".." component. On Linux 5.6 and later the
+ * file is opened with openat2(2) and RESOLVE_BENEATH: symbolic links
+ * leading out of the root, and absolute ones, are refused with EXDEV.
+ * Elsewhere symbolic links are followed, even out of the root.
+ * \param stat Filled with the attributes of the file, may be NULL.
+ *
+ * \return A new reference to the file, to be released by the caller.
+ * \retval NULL in case of error, errno is EINVAL for a rejected path, EXDEV
+ * for a path leading out of the root and EISDIR or EINVAL when the path
+ * is not a regular file.
+ */
+flm_File *
+flm_FileCacheOpen (flm_FileCache *	cache,
+                   const char *		path,
+                   struct stat *	stat);
+
+/**
+ * \brief Close all the cached files.
+ *
+ * The files still referenced elsewhere stay open until they are released.
+ *
+ * \param cache A pointer to a flm_FileCache object.
+ */
+void
+flm_FileCacheClear (flm_FileCache *	cache);
+
+/**
+ * \brief Read the counters of the cache.
+ *
+ * \param cache A pointer to a flm_FileCache object.
+ * \param stats The counters since the creation of the cache.
+ */
+void
+flm_FileCacheStats (flm_FileCache *		cache,
+                    struct flm_FileCacheStats *	stats);
+
+/**
+ * \brief Increment the reference counter.
+ *
+ * \param cache A pointer to a flm_FileCache object.
+ * \return The same pointer, this function cannot fail.
+ */
+flm_FileCache *
+flm_FileCacheRetain (flm_FileCache *	cache);
+
+/**
+ * \brief Decrement the reference counter.
+ *
+ * When the counter reaches zero the cache is freed and its files are
+ * released.
+ *
+ * \param cache A pointer to a flm_FileCache object.
+ */
+void
+flm_FileCacheRelease (flm_FileCache *	cache);
+
+#endif /* !_FLM_CORE_PUBLIC_FILE_CACHE_H_ */
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \brief Read and write regular files without blocking the loop.
+ */
+
+/**
+ * \file file_queue.h
+ * \c Regular files are always ready as far as the monitor knows, so a
+ * read that has to wait for the disk blocks the whole loop. A file queue
+ * hands the reads, writes and fsync(2) calls to a few helper threads, the
+ * handlers are then called from the monitor that submitted them once they
+ * are done. The helper threads only make system calls, the buffers and
+ * files are retained until the operation completes.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_FILE_QUEUE_H_
+# define _FLM_CORE_PUBLIC_FILE_QUEUE_H_
+
+#ifndef _FLM__SKIP
+
+#include <sys/types.h>
+
+#include <stdint.h>
+
+typedef struct flm_FileQueue flm_FileQueue;
+
+#include "flm/core/public/buffer.h"
+#include "flm/core/public/file.h"
+#include "flm/core/public/monitor.h"
+#include "flm/core/public/obj.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * Counters of a file queue, see flm_FileQueueStats().
+ */
+struct flm_FileQueueStats
+{
+    /* operations queued, and not completed yet */
+    uint64_t            operations;
+    size_t              pending;
+
+    /**
+     * File ranges checked by the streams before sending them, and found
+     * out of the page cache: each of those would have blocked the loop.
+     */
+    uint64_t            probes;
+    uint64_t            stalls_avoided;
+};
+
+/**
+ * Called from the monitor once an operation is done. \c count is the
+ * number of bytes read or written, 0 for a sync, or -1 with errno set if
+ * the operation failed. The handler gets its own reference to the buffer
+ * only if it retains it.
+ */
+typedef void (*flm_FileQueueHandler)		\
+(flm_File * file, void * state, flm_Buffer * buffer, ssize_t count);
+
+/**
+ * \brief Create a file queue.
+ *
+ * The monitor is only kept busy while operations are pending.
+ *
+ * \param monitor The monitor calling the handlers.
+ * \param threads The number of helper threads, the number of operations
+ * done at the same time. 0 for the default of 4.
+ *
+ * \return A pointer to a new flm_FileQueue object.
+ * \retval NULL in case of error.
+ */
+flm_FileQueue *
+flm_FileQueueNew (flm_Monitor *			monitor,
+		  uint32_t			threads);
+
+/**
+ * \brief Read a file at an offset.
+ *
+ * The buffer is filled from the beginning, the read stops at the end of
+ * the buffer or of the file.
+ *
+ * \param file_queue A pointer to a flm_FileQueue object.
+ * \param file The file to read from.
+ * \param buffer The buffer to read into.
+ * \param off The offset in the file.
+ * \param handler The handler called once the read is done.
+ * \param state A pointer given to the handler.
+ * \return 0 on success, -1 if the read could not be queued.
+ */
+int
+flm_FileQueueRead (flm_FileQueue *		file_queue,
+		   flm_File *			file,
+		   flm_Buffer *			buffer,
+		   off_t			off,
+		   flm_FileQueueHandler		handler,
+		   void *			state);
+
+/**
+ * \brief Write the whole content of a buffer to a file at an offset.
+ *
+ * \param file_queue A pointer to a flm_FileQueue object.
+ * \param file The file to write to.
+ * \param buffer The buffer to write.
+ * \param off The offset in the file, ignored if it was opened in append
+ * mode.
+ * \param handler The handler called once the write is done.
+ * \param state A pointer given to the handler.
+ * \return 0 on success, -1 if the write could not be queued.
+ */
+int
+flm_FileQueueWrite (flm_FileQueue *		file_queue,
+		    flm_File *			file,
+		    flm_Buffer *		buffer,
+		    off_t			off,
+		    flm_FileQueueHandler	handler,
+		    void *			state);
+
+/**
+ * \brief Flush a file to the disk with fsync(2).
+ *
+ * The operations are not ordered between them, the writes to sync must be
+ * done before the sync is queued.
+ *
+ * \param file_queue A pointer to a flm_FileQueue object.
+ * \param file The file to flush.
+ * \param handler The handler called once the file is flushed, with a NULL
+ * buffer.
+ * \param state A pointer given to the handler.
+ * \return 0 on success, -1 if the sync could not be queued.
+ */
+int
+flm_FileQueueSync (flm_FileQueue *		file_queue,
+		   flm_File *			file,
+		   flm_FileQueueHandler		handler,
+		   void *			state);
+
+/**
+ * \brief Bring a range of a file in the page cache.
+ *
+ * \param file_queue A pointer to a flm_FileQueue object.
+ * \param file The file to read from.
+ * \param off The offset in the file.
+ * \param count The number of bytes to read.
+ * \param handler The handler called once the range is in memory, with a
+ * NULL buffer and the number of bytes actually read.
+ * \param state A pointer given to the handler.
+ * \return 0 on success, -1 if the prefetch could not be queued.
+ */
+int
+flm_FileQueuePrefetch (flm_FileQueue *		file_queue,
+		       flm_File *		file,
+		       off_t			off,
+		       size_t			count,
+		       flm_FileQueueHandler	handler,
+		       void *			state);
+
+/**
+ * \brief Read the counters of the queue.
+ *
+ * \param file_queue A pointer to a flm_FileQueue object.
+ * \param stats The counters since the creation of the queue.
+ */
+void
+flm_FileQueueStats (flm_FileQueue *		file_queue,
+		    struct flm_FileQueueStats *	stats);
+
+flm_FileQueue *
+flm_FileQueueRetain (flm_FileQueue *		file_queue);
+
+void
+flm_FileQueueRelease (flm_FileQueue *		file_queue);
+
+#endif /* !_FLM_CORE_PUBLIC_FILE_QUEUE_H_ */
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * \brief Split a flow of buffers into protocol frames.
+ */
+
+/**
+ * \file framer.h
+ * \c A framer rebuilds the messages of a protocol from the buffers read
+ * on a stream, whatever the way they were split by the network. The
+ * frames are either prefixed by their length (a fixed width big endian
+ * integer or a varint) or terminated by a delimiter. A frame that fits in
+ * a single buffer is handed out as a view of this buffer, only the frames
+ * crossing the end of a buffer are copied.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_FRAMER_H_
+# define _FLM_CORE_PUBLIC_FRAMER_H_
+
+#ifndef _FLM__SKIP
+
+#include <unistd.h>
+
+typedef struct flm_Framer flm_Framer;
+
+#include "flm/core/public/buffer.h"
+#include "flm/core/public/obj.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * Called for each complete frame, the handler owns the frame and has to
+ * release it.
+ */
+typedef void (*flm_FramerHandler) (void * state, flm_Buffer * frame);
+
+/**
+ * \brief Create a framer for frames prefixed by a fixed width length.
+ *
+ * \param width The size of the prefix in bytes: 1, 2, 4 or 8. The length
+ * is in network byte order and does not include the prefix itself.
+ * \param max The maximum length of a frame, longer frames are rejected
+ * before anything is allocated for them.
+ *
+ * \return A pointer to a new flm_Framer object.
+ * \retval NULL in case of error.
+ */
+flm_Framer *
+flm_FramerLengthNew (size_t			width,
+                     size_t			max);
+
+/**
+ * \brief Create a framer for frames prefixed by a varint length.
+ *
+ * The length is encoded on 7 bits per byte, least significant group
+ * first, the high bit of each byte telling whether another one follows
+ * (the protobuf encoding).
+ *
+ * \param max The maximum length of a frame.
+ *
+ * \return A pointer to a new flm_Framer object.
+ * \retval NULL in case of error.
+ */
+flm_Framer *
+flm_FramerVarintNew (size_t			max);
+
+/**
+ * \brief Create a framer for frames terminated by a delimiter.
+ *
+ * The delimiter is not part of the frames.
+ *
+ * \param delimiter The bytes ending a frame, for example "\r\n".
+ * \param length The length of the delimiter.
+ * \param max The maximum length of a frame, the framer gives up as soon
+ * as more data are buffered without finding the delimiter.
+ *
+ * \return A pointer to a new flm_Framer object.
+ * \retval NULL in case of error.
+ *
+ * \code
+ *  flm_Framer * framer;
+ *
+ *  framer = flm_FramerDelimiterNew ("\r\n", 2, 8192);
+ *  flm_StreamFrameRead (stream, framer);
+ *  flm_FramerRelease (framer);
+ * \endcode
+ */
+flm_Framer *
+flm_FramerDelimiterNew (const char *		delimiter,
+                        size_t			length,
+                        size_t			max);
+
+/**
+ * \brief Create a framer for the lines of a text protocol.
+ *
+ * The lines end with "\n" or "\r\n", the end of line is not part of the
+ * frames.
+ *
+ * \param max The maximum length of a line, without its end of line.
+ *
+ * \return A pointer to a new flm_Framer object.
+ * \retval NULL in case of error.
+ */
+flm_Framer *
+flm_FramerLineNew (size_t			max);
+
+/**
+ * \brief Cut the frames out of the next buffer of the flow.
+ *
+ * The handler is called for each frame completed by this buffer, the
+ * beginning of an incomplete frame is kept by the framer until the next
+ * call. The buffer is not released.
+ *
+ * \param framer A pointer to a flm_Framer object.
+ * \param buffer The next data of the flow.
+ * \param handler The function called for each frame.
+ * \param state A pointer given to the handler.
+ * \return 0 on success, -1 on error. If a frame exceeds the maximum length
+ * or its length prefix is invalid, the error is FLM_ERR_ERRNO and errno is
+ * EMSGSIZE. The framer cannot be used anymore after an error.
+ */
+int
+flm_FramerFeed (flm_Framer *			framer,
+                flm_Buffer *			buffer,
+                flm_FramerHandler		handler,
+                void *				state);
+
+/**
+ * \brief Increment the reference counter.
+ *
+ * \param framer A pointer to a flm_Framer object.
+ * \return The same pointer, this function cannot fail.
+ */
+flm_Framer *
+flm_FramerRetain (flm_Framer *		framer);
+
+/**
+ * \brief Decrement the reference counter.
+ *
+ * When the counter reaches zero the framer and the incomplete frame it
+ * holds are freed.
+ *
+ * \param framer A pointer to a flm_Framer object.
+ */
+void
+flm_FramerRelease (flm_Framer *		framer);
+
+#endif /* !_FLM_CORE_PUBLIC_FRAMER_H_ */
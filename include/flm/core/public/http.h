@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * \brief Incremental HTTP/1.1 parser.
+ */
+
+/**
+ * \file http.h
+ * \c The HTTP parser reads requests or responses from the buffers of a
+ * stream, whatever the way they were split by the network. The request
+ * line, the status line and the headers are handed out as views of the
+ * buffers, nothing is copied unless a head crosses the end of a buffer.
+ * Pipelined messages, content length and chunked bodies are handled, the
+ * line ends are found with flm_ScanByte().
+ */
+
+#ifndef _FLM_CORE_PUBLIC_HTTP_H_
+# define _FLM_CORE_PUBLIC_HTTP_H_
+
+#ifndef _FLM__SKIP
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+typedef struct flm_HTTPParser flm_HTTPParser;
+
+#include "flm/core/public/buffer.h"
+#include "flm/core/public/obj.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * Kind of messages read by a parser, see flm_HTTPParserNew().
+ */
+enum flm_http_type
+{
+        /**
+         * Requests, as read by a server.
+         */
+        FLM_HTTP_REQUEST =              0x0000,
+
+        /**
+         * Responses, as read by a client.
+         */
+        FLM_HTTP_RESPONSE =             0x0001
+};
+
+/**
+ * A part of the message, it is only valid during the call of the handler.
+ */
+struct flm_HTTPView
+{
+	const char *			content;
+	size_t				len;
+};
+
+struct flm_HTTPHeader
+{
+	struct flm_HTTPView		name;
+	struct flm_HTTPView		value;	/* without surrounding spaces */
+};
+
+/**
+ * The start line and the headers of a message.
+ */
+struct flm_HTTPHead
+{
+	/* requests */
+	struct flm_HTTPView		method;
+	struct flm_HTTPView		target;
+
+	/* responses */
+	int				status;
+	struct flm_HTTPView		reason;
+
+	/* 0 for HTTP/1.0, 1 for HTTP/1.1 */
+	int				minor;
+
+	struct flm_HTTPHeader *		headers;
+	size_t				count;
+
+	bool				keep_alive;
+	bool				chunked;
+	bool				has_length;
+	uint64_t			length;
+};
+
+typedef void (*flm_HTTPHeadHandler)				\
+(flm_HTTPParser * parser, void * state, const struct flm_HTTPHead * head);
+
+typedef void (*flm_HTTPBodyHandler)				\
+(flm_HTTPParser * parser, void * state, const char * content, size_t len);
+
+typedef void (*flm_HTTPEndHandler)				\
+(flm_HTTPParser * parser, void * state);
+
+/**
+ * \brief Create an HTTP parser.
+ *
+ * Everything the parser needs is allocated here, parsing a message does
+ * not allocate anything.
+ *
+ * \param type FLM_HTTP_REQUEST or FLM_HTTP_RESPONSE.
+ * \param max_head The maximum size of the start line and the headers, also
+ * the size of the buffer used to join the heads crossing buffers.
+ * \param max_headers The maximum number of headers of a message.
+ * \param state A pointer given to the handlers.
+ *
+ * \return A pointer to a new flm_HTTPParser object.
+ * \retval NULL in case of error.
+ */
+flm_HTTPParser *
+flm_HTTPParserNew (int				type,
+                   size_t			max_head,
+                   size_t			max_headers,
+                   void *			state);
+
+/**
+ * \brief Set the handler called once the head of a message is parsed.
+ *
+ * \param parser A pointer to a flm_HTTPParser object.
+ * \param handler The function called with the head of each message.
+ */
+void
+flm_HTTPParserOnHead (flm_HTTPParser *		parser,
+                      flm_HTTPHeadHandler	handler);
+
+/**
+ * \brief Set the handler called with the body of the messages.
+ *
+ * The handler can be called many times for the same message, with the
+ * parts of the body found in each buffer. The chunked encoding is removed.
+ *
+ * \param parser A pointer to a flm_HTTPParser object.
+ * \param handler The function called with each part of the body.
+ */
+void
+flm_HTTPParserOnBody (flm_HTTPParser *		parser,
+                      flm_HTTPBodyHandler	handler);
+
+/**
+ * \brief Set the handler called at the end of each message.
+ *
+ * \param parser A pointer to a flm_HTTPParser object.
+ * \param handler The function called when a message is complete.
+ */
+void
+flm_HTTPParserOnEnd (flm_HTTPParser *		parser,
+                     flm_HTTPEndHandler		handler);
+
+/**
+ * \brief Parse the next buffer of the flow.
+ *
+ * The handlers are called for everything completed by this buffer, then
+ * the beginning of an incomplete head is kept by the parser until the next
+ * call. The buffer is not released.
+ *
+ * \param parser A pointer to a flm_HTTPParser object.
+ * \param buffer The next data of the flow.
+ * \return 0 on success, -1 on error. If the message is malformed the error
+ * is FLM_ERR_ERRNO and errno is EPROTO, if a head is too large or has too
+ * many headers errno is EMSGSIZE. The parser cannot be used anymore after
+ * an error.
+ *
+ * \code
+ *  parser = flm_HTTPParserNew (FLM_HTTP_REQUEST, 8192, 64, state);
+ *  flm_HTTPParserOnHead (parser, _head_handler);
+ *  flm_StreamHTTPRead (stream, parser);
+ *  flm_HTTPParserRelease (parser);
+ * \endcode
+ */
+int
+flm_HTTPParserFeed (flm_HTTPParser *		parser,
+                    flm_Buffer *		buffer);
+
+/**
+ * \brief Tell the parser that the flow is over.
+ *
+ * A response without length or chunked encoding ends with the connection,
+ * its end handler is called here.
+ *
+ * \param parser A pointer to a flm_HTTPParser object.
+ * \return 0 on success, -1 if a message was interrupted, the error is
+ * FLM_ERR_ERRNO and errno is EPROTO.
+ */
+int
+flm_HTTPParserFinish (flm_HTTPParser *		parser);
+
+/**
+ * \brief Ignore the body of the current response.
+ *
+ * To be called from the head handler of the response to a HEAD request,
+ * which has the headers of a body it does not carry.
+ *
+ * \param parser A pointer to a flm_HTTPParser object.
+ */
+void
+flm_HTTPParserSkipBody (flm_HTTPParser *	parser);
+
+/**
+ * \brief Find a header of the head.
+ *
+ * The names are compared without case.
+ *
+ * \param head The head given to the head handler.
+ * \param name The name of the header.
+ * \return The first header with this name, or NULL.
+ */
+const struct flm_HTTPHeader *
+flm_HTTPHeadFind (const struct flm_HTTPHead *	head,
+                  const char *			name);
+
+/**
+ * \brief Increment the reference counter.
+ *
+ * \param parser A pointer to a flm_HTTPParser object.
+ * \return The same pointer, this function cannot fail.
+ */
+flm_HTTPParser *
+flm_HTTPParserRetain (flm_HTTPParser *		parser);
+
+/**
+ * \brief Decrement the reference counter.
+ *
+ * \param parser A pointer to a flm_HTTPParser object.
+ */
+void
+flm_HTTPParserRelease (flm_HTTPParser *		parser);
+
+#endif /* !_FLM_CORE_PUBLIC_HTTP_H_ */
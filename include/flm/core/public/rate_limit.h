@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * \brief Token bucket shared by one or more streams.
+ */
+
+/**
+ * \file rate_limit.h
+ * \c A rate limit is a token bucket that throttles the number of bytes
+ * read or written by the streams attached to it. Each byte transferred
+ * consumes a token, and the bucket is refilled at a fixed rate by the
+ * timer wheel of the monitor. A bucket can be attached to a single
+ * stream, or shared by all the streams of a monitor to split the
+ * bandwidth between them.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_RATE_LIMIT_H_
+# define _FLM_CORE_PUBLIC_RATE_LIMIT_H_
+
+#ifndef _FLM__SKIP
+
+#include <stdint.h>
+
+typedef struct flm_RateLimit flm_RateLimit;
+
+#include "flm/core/public/monitor.h"
+#include "flm/core/public/obj.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * \brief Create a new token bucket.
+ *
+ * \param monitor A pointer to the monitor whose timer wheel will refill
+ * the bucket, the streams using this bucket should be handled by the same
+ * monitor.
+ * \param rate The number of bytes allowed per second.
+ * \param burst The size of the bucket in bytes, it is the maximum number
+ * of bytes that can be transferred at once after an idle period. If
+ * zero, the bucket holds one second worth of tokens.
+ *
+ * \return A pointer to a new flm_RateLimit object.
+ * \retval NULL in case of error.
+ *
+ * \code
+ *  flm_RateLimit * limit;
+ *
+ *  limit = flm_RateLimitNew (monitor, 64 * 1024, 0);
+ *  flm_StreamLimitRead (stream, limit);
+ *  flm_StreamLimitWrite (stream, limit);
+ *  flm_RateLimitRelease (limit);
+ * \endcode
+ */
+flm_RateLimit *
+flm_RateLimitNew (flm_Monitor *		monitor,
+                  uint32_t		rate,
+                  uint32_t		burst);
+
+/**
+ * \brief Increment the reference counter.
+ *
+ * \param limit A pointer to a flm_RateLimit object.
+ * \return The same pointer, this function cannot fail.
+ */
+flm_RateLimit *
+flm_RateLimitRetain (flm_RateLimit *	limit);
+
+/**
+ * \brief Decrement the reference counter.
+ *
+ * \remark Each stream using the bucket keeps its own reference, so it
+ * can be released right after being attached to the streams.
+ *
+ * \param limit A pointer to a flm_RateLimit object.
+ */
+void
+flm_RateLimitRelease (flm_RateLimit *	limit);
+
+#endif /* !_FLM_CORE_PUBLIC_RATE_LIMIT_H_ */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * \brief Fast byte searches for text protocols.
+ */
+
+/**
+ * \file scan.h
+ * \c The scan functions look for delimiters in the content of buffers,
+ * like the end of a line of a text protocol. The single byte searches
+ * rely on the memchr() of the C library, which is already vectorized.
+ * The sets are compared 16 or 32 bytes at once with the SSE2 or AVX2
+ * instructions when the processor has them, the best version being
+ * chosen the first time a scan function is called.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_SCAN_H_
+# define _FLM_CORE_PUBLIC_SCAN_H_
+
+#ifndef _FLM__SKIP
+
+#include <unistd.h>
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * \brief Find the first occurrence of a byte.
+ *
+ * \param content The memory to search.
+ * \param len The length of the memory to search.
+ * \param byte The byte to find.
+ * \return A pointer to the first occurrence, or NULL if the byte was not
+ * found.
+ */
+const char *
+flm_ScanByte (const char *		content,
+              size_t			len,
+              char			byte);
+
+/**
+ * \brief Find the first occurrence of a sequence of two bytes.
+ *
+ * \param content The memory to search.
+ * \param len The length of the memory to search.
+ * \param first The first byte of the sequence, for example '\\r'.
+ * \param second The second byte of the sequence, for example '\\n'.
+ * \return A pointer to the first byte of the first occurrence, or NULL if
+ * the sequence was not found.
+ */
+const char *
+flm_ScanPair (const char *		content,
+              size_t			len,
+              char			first,
+              char			second);
+
+/**
+ * \brief Find the first byte belonging to a set.
+ *
+ * Small sets (up to 16 bytes) are compared in parallel, larger ones fall
+ * back to a lookup table.
+ *
+ * \param content The memory to search.
+ * \param len The length of the memory to search.
+ * \param set The bytes to find, for example " \\t\\r\\n".
+ * \param count The number of bytes in the set.
+ * \return A pointer to the first byte of the content found in the set, or
+ * NULL if there is none.
+ *
+ * \code
+ *  const char * token;
+ *
+ *  token = flm_ScanSet (content, len, " \t\r\n", 4);
+ * \endcode
+ */
+const char *
+flm_ScanSet (const char *		content,
+             size_t			len,
+             const char *		set,
+             size_t			count);
+
+#endif /* !_FLM_CORE_PUBLIC_SCAN_H_ */
@@ -26,12 +26,39 @@
 typedef struct flm_Stream flm_Stream;
 
 #include "flm/core/public/buffer.h"
+#include "flm/core/public/buffer_chain.h"
 #include "flm/core/public/file.h"
+#include "flm/core/public/file_queue.h"
+#include "flm/core/public/framer.h"
+#include "flm/core/public/http.h"
 #include "flm/core/public/monitor.h"
 #include "flm/core/public/obj.h"
+#include "flm/core/public/rate_limit.h"
+#include "flm/core/public/thread.h"
 
 #endif /* !_FLM__SKIP */
 
+/**
+ * Paths taken by the records of a TLS stream, see flm_StreamTLSOffload().
+ */
+enum flm_stream_tls_offload
+{
+        /**
+         * Records are encrypted and decrypted by OpenSSL in user space.
+         */
+        FLM_STREAM_TLS_USER =           0x0000,
+
+        /**
+         * Records are encrypted by the kernel.
+         */
+        FLM_STREAM_TLS_KERNEL_SEND =    0x0001,
+
+        /**
+         * Records are decrypted by the kernel.
+         */
+        FLM_STREAM_TLS_KERNEL_RECV =    0x0002
+};
+
 typedef void (*flm_StreamReadHandler)			\
 (flm_Stream * stream, void * state, flm_Buffer * buffer);
 
@@ -44,6 +71,20 @@ typedef void (*flm_StreamCloseHandler)                  \
 typedef void (*flm_StreamErrorHandler)                  \
 (flm_Stream * stream, void * state, int error);
 
+/**
+ * Called with each file descriptor received, before the data it was sent
+ * with. The handler owns the descriptor.
+ */
+typedef void (*flm_StreamDescriptorHandler)             \
+(flm_Stream * stream, void * state, int fd);
+
+/**
+ * Called from the thread a stream was migrated to, once its monitor
+ * watches the stream.
+ */
+typedef void (*flm_StreamMigrateHandler)                \
+(flm_Stream * stream, void * state, flm_Monitor * monitor);
+
 flm_Stream *
 flm_StreamNew (flm_Monitor *	monitor,	\
 	       int		fd,		\
@@ -60,18 +101,251 @@ flm_StreamPushBuffer (flm_Stream *	stream,
 		      off_t		off,
 		      size_t		count);
 
+/**
+ * \brief Queue every segment of a buffer chain.
+ *
+ * The segments are retained, not copied, and are sent with as few gather
+ * writes as possible. The chain itself may be released or changed right
+ * after.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \param chain The chain to send.
+ * \return 0 on success, -1 in case of error, nothing was queued then.
+ */
+int
+flm_StreamPushChain (flm_Stream *	stream,
+		     flm_BufferChain *	chain);
+
 int
 flm_StreamPushFile (flm_Stream *	stream,
 		    flm_File *		file,
 		    off_t		off,
 		    size_t		count);
 
+/**
+ * \brief Send a file descriptor to the peer of a Unix domain socket.
+ *
+ * The descriptor is passed with SCM_RIGHTS along with the first byte of
+ * the buffer, which is queued as with flm_StreamPushBuffer(): a process
+ * can hand an accepted connection to another one without proxying it.
+ * The stream closes its copy of the descriptor once it has been sent.
+ *
+ * \param stream A pointer to a flm_Stream object wrapping a Unix domain
+ * socket, TLS streams cannot pass descriptors.
+ * \param buffer The data sent with the descriptor, it cannot be empty.
+ * \param fd The descriptor, owned by the stream on success.
+ * \return 0 on success, -1 on error.
+ */
+int
+flm_StreamPushDescriptor (flm_Stream *	stream,
+			  flm_Buffer *	buffer,
+			  int		fd);
+
 void
 flm_StreamShutdown (flm_Stream *        stream);
 
 void
 flm_StreamClose (flm_Stream *           stream);
 
+/**
+ * \brief Stop reading from the stream until flm_StreamResumeRead() is
+ * called.
+ *
+ * Unlike flm_StreamShutdown() the stream stays open and the data to
+ * write are still written. The data received in the meantime are kept in
+ * the kernel buffers, so the peer will be slowed down by the flow control
+ * of the underlying transport.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \return 0 on success, -1 if the monitor could not be updated.
+ */
+int
+flm_StreamPauseRead (flm_Stream *	stream);
+
+/**
+ * \brief Start reading again from a stream paused with
+ * flm_StreamPauseRead().
+ *
+ * This function has no effect on a stream that has been shut down.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \return 0 on success, -1 if the monitor could not be updated.
+ */
+int
+flm_StreamResumeRead (flm_Stream *	stream);
+
+/**
+ * \brief Throttle the reads of the stream with a token bucket.
+ *
+ * The same bucket can be used by many streams, see flm_RateLimitNew().
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \param limit A pointer to a flm_RateLimit object, or NULL to remove the
+ * current limit.
+ */
+void
+flm_StreamLimitRead (flm_Stream *	stream,
+		     flm_RateLimit *	limit);
+
+/**
+ * \brief Throttle the writes of the stream with a token bucket.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \param limit A pointer to a flm_RateLimit object, or NULL to remove the
+ * current limit.
+ */
+void
+flm_StreamLimitWrite (flm_Stream *	stream,
+		      flm_RateLimit *	limit);
+
+/**
+ * \brief Hand the read handler complete frames instead of raw buffers.
+ *
+ * The stream is closed and the error handler called if a frame is
+ * invalid or longer than the maximum allowed by the framer.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \param framer A pointer to a flm_Framer object, or NULL to get the raw
+ * buffers again. A framer holds the incomplete frame of one stream, so it
+ * cannot be shared.
+ */
+void
+flm_StreamFrameRead (flm_Stream *	stream,
+		     flm_Framer *	framer);
+
+/**
+ * \brief Hand the read handler one line at a time.
+ *
+ * The lines are views of the read buffers without their end of line,
+ * see flm_FramerLineNew().
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \param max The maximum length of a line, the stream is closed if a
+ * longer one is received.
+ * \return 0 on success, -1 on error.
+ */
+int
+flm_StreamReadLines (flm_Stream *	stream,
+		     size_t		max);
+
+/**
+ * \brief Feed the data read from the stream to an HTTP parser.
+ *
+ * The read handler is not called anymore, the handlers of the parser are
+ * called instead. The end of the flow is given to flm_HTTPParserFinish().
+ * The stream is closed and the error handler called if a message is
+ * malformed.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \param parser A pointer to a flm_HTTPParser object, or NULL to get the
+ * raw buffers again. A parser holds the incomplete head of one stream, so
+ * it cannot be shared.
+ */
+void
+flm_StreamHTTPRead (flm_Stream *	stream,
+		    flm_HTTPParser *	parser);
+
+/**
+ * \brief Send the large buffers of the stream without copying them.
+ *
+ * Buffers pushed with at least \c threshold bytes left to write are sent
+ * with MSG_ZEROCOPY: the kernel reads them directly from user memory, so
+ * they are retained until the kernel reports it is done with them. The
+ * stream is not closed after a shutdown until every completion has been
+ * received. Only worth it for buffers of a few kilobytes or more.
+ *
+ * \param stream A pointer to a flm_Stream object wrapping a TCP socket.
+ * \param threshold The minimum size of a zero-copy send, 0 to disable it.
+ * \return 0 on success, -1 if the socket does not support it.
+ */
+int
+flm_StreamZeroCopy (flm_Stream *	stream,
+		    size_t		threshold);
+
+/**
+ * \brief Keep the files sent by the stream from blocking the loop.
+ *
+ * Before a range of a file is sent, the stream checks that its first and
+ * last pages are in the page cache. If they are not the range is read by
+ * the file queue and the stream stops writing until it is done, instead
+ * of waiting for the disk from the loop. The files encrypted in user
+ * space are not checked. See flm_FileQueueStats() for the number of
+ * stalls avoided.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \param file_queue A file queue of the monitor of the stream, NULL to
+ * stop checking.
+ * \return 0 on success, -1 if preadv2(2) cannot tell if a page is in the
+ * cache on this system.
+ */
+int
+flm_StreamPrefetch (flm_Stream *	stream,
+		    flm_FileQueue *	file_queue);
+
+/**
+ * \brief Relay everything read on a stream to another stream.
+ *
+ * The data is moved through a kernel pipe with splice(2) and is never
+ * copied to user space, so the read handler of the source is not called
+ * anymore and the write handler of the destination is called with the
+ * number of relayed bytes. Both file descriptors must be non-blocking.
+ *
+ * The source stops reading while the pipe is full. When it reaches the
+ * end of file, the write side of the destination is shut down as soon as
+ * the pipe is drained and the source is shut down, unless the destination
+ * is relayed back to it and still open: a proxy built with two relays is
+ * closed once both directions are done.
+ *
+ * \param from The stream to read from.
+ * \param to The stream to write to.
+ * \return 0 on success, -1 on error or if splice(2) is not available.
+ */
+int
+flm_StreamRelay (flm_Stream *		from,
+		 flm_Stream *		to);
+
+/**
+ * \brief Move a stream to the monitor of another thread.
+ *
+ * The stream is detached from its monitor once the current iteration of
+ * the loop is done with it, then attached to the monitor of the thread
+ * with flm_ThreadCall(). Everything queued on the stream, its TLS session
+ * and its parsers move along with it. Nothing is read or written in
+ * between, and from then on the stream must only be used from the other
+ * thread, starting with the handler. If the thread cannot be reached the
+ * stream stays where it was and the error handler is called.
+ *
+ * On success the reference of the caller on the stream is taken over:
+ * reference counts are not shared safely between threads, so the caller
+ * must not use nor release the stream anymore. The reference is given to
+ * the handler, which releases it from the other thread once done with
+ * it. Without a handler, or if the migration fails, it is released by
+ * the library.
+ *
+ * \param stream A pointer to a flm_Stream object, it must be used from the
+ * thread of its monitor.
+ * \param thread The thread to move the stream to.
+ * \param handler Called from the other thread once the stream is
+ * attached, with the reference of the caller, may be NULL.
+ * \return 0 on success, -1 with errno set to EBUSY if the stream is
+ * relayed, rate limited, prefetching files or already migrating, EINVAL
+ * if it is shut down. The caller keeps its reference in that case.
+ */
+int
+flm_StreamMigrate (flm_Stream *			stream,
+		   flm_Thread *			thread,
+		   flm_StreamMigrateHandler	handler);
+
+/**
+ * \brief Number of bytes relayed from a stream.
+ *
+ * \param stream A pointer to a flm_Stream object given as a source to
+ * flm_StreamRelay().
+ * \return The number of bytes written to the destination so far.
+ */
+uint64_t
+flm_StreamRelayed (flm_Stream *		stream);
+
 void
 flm_StreamOnRead (flm_Stream *		stream,
 		  flm_StreamReadHandler	handler);
@@ -84,6 +358,20 @@ void
 flm_StreamOnClose (flm_Stream *                 stream,
                    flm_StreamCloseHandler       handler);
 
+/**
+ * \brief Receive the file descriptors sent by the peer.
+ *
+ * Without a handler the descriptors sent by the peer are closed by the
+ * kernel.
+ *
+ * \param stream A pointer to a flm_Stream object wrapping a Unix domain
+ * socket.
+ * \param handler The handler, or NULL to stop receiving descriptors.
+ */
+void
+flm_StreamOnDescriptor (flm_Stream *			stream,
+                        flm_StreamDescriptorHandler	handler);
+
 void
 flm_StreamOnError (flm_Stream *                 stream,
                    flm_StreamErrorHandler       handler);
@@ -96,6 +384,72 @@ int
 flm_StreamStartTLSClient (flm_Stream *		stream,
                           SSL_CTX *             context);
 
+/**
+ * \brief Let the kernel encrypt and decrypt the records of a TLS stream.
+ *
+ * Once the handshake is done the negotiated keys are installed on the
+ * socket with setsockopt(SOL_TLS), the buffers and files pushed to the
+ * stream are then written with writev(2) and sendfile(2) as on a plain
+ * stream. If the kernel does not support kTLS or the negotiated cipher,
+ * the records go through OpenSSL in user space as usual.
+ *
+ * Must be called before flm_StreamStartTLSServer() or
+ * flm_StreamStartTLSClient().
+ *
+ * \param stream A pointer to a flm_Stream object wrapping a TCP socket.
+ * \return 0 on success, -1 if OpenSSL was built without kTLS.
+ */
+int
+flm_StreamKernelTLS (flm_Stream *		stream);
+
+/**
+ * \brief Tell which path the records of a TLS stream take.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \return A combination of FLM_STREAM_TLS_KERNEL_SEND and
+ * FLM_STREAM_TLS_KERNEL_RECV, FLM_STREAM_TLS_USER if every record goes
+ * through user space or if the handshake is not done yet.
+ */
+int
+flm_StreamTLSOffload (flm_Stream *		stream);
+
+/**
+ * \brief Try to resume a previous TLS session.
+ *
+ * Must be called before flm_StreamStartTLSClient(). If the server does
+ * not know the session anymore a full handshake is done.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \param session A session returned by flm_StreamTLSSession(), the stream
+ * takes its own reference.
+ * \return 0 on success, -1 if TLS was already started.
+ */
+int
+flm_StreamTLSResume (flm_Stream *		stream,
+                     SSL_SESSION *		session);
+
+/**
+ * \brief Get the TLS session of a stream to resume it later.
+ *
+ * With TLS 1.3 the server sends the session after the handshake, so this
+ * should be called once something was read from the stream.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \return A new reference to the session, to free with SSL_SESSION_free(),
+ * or NULL if there is no session yet.
+ */
+SSL_SESSION *
+flm_StreamTLSSession (flm_Stream *		stream);
+
+/**
+ * \brief Tell whether the handshake resumed a previous session.
+ *
+ * \param stream A pointer to a flm_Stream object.
+ * \return 1 if the session was resumed, 0 otherwise.
+ */
+int
+flm_StreamTLSResumed (flm_Stream *		stream);
+
 flm_Stream *
 flm_StreamRetain (flm_Stream * stream);
 
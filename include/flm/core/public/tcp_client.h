@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \brief Open outbound TCP connections without blocking.
+ */
+
+/**
+ * \file tcp_client.h
+ * \c A TCP client connects a non-blocking socket and waits for the end
+ * of the handshake through the monitor, like any other IO. When the
+ * connection is established the socket is handed out as a flm_Stream,
+ * when it fails or when the timeout expires the error handler is called
+ * instead. The address must be numeric: resolving a name could block the
+ * whole loop, it has to be done beforehand.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_TCP_CLIENT_H_
+# define _FLM_CORE_PUBLIC_TCP_CLIENT_H_
+
+#ifndef _FLM__SKIP
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct flm_TCPClient flm_TCPClient;
+
+#include "flm/core/public/monitor.h"
+#include "flm/core/public/obj.h"
+#include "flm/core/public/stream.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * Called once the connection is established. The stream is kept alive by
+ * the monitor, the handler has to retain it to keep a reference.
+ */
+typedef void (*flm_TCPClientConnectHandler)	\
+(flm_TCPClient * tcp_client, void * state, flm_Stream * stream);
+
+/**
+ * Called if the connection fails, errno tells why (ECONNREFUSED,
+ * ETIMEDOUT, ...).
+ */
+typedef void (*flm_TCPClientErrorHandler)	\
+(flm_TCPClient * tcp_client, void * state, int error);
+
+/**
+ * \brief Create a TCP client.
+ *
+ * The socket is created but not connected yet, see
+ * flm_TCPClientConnect().
+ *
+ * \param monitor The monitor waiting for the connection, the stream
+ * handed out is attached to it as well.
+ * \param address A numeric IPv4 or IPv6 address.
+ * \param port The port to connect to.
+ * \param state A pointer given to the handlers and to the stream.
+ *
+ * \return A pointer to a new flm_TCPClient object.
+ * \retval NULL in case of error, a name that is not a numeric address
+ * fails with FLM_ERR_ERRNO and errno set to EINVAL.
+ */
+flm_TCPClient *
+flm_TCPClientNew (flm_Monitor *			monitor,
+                  const char *			address,
+                  uint16_t			port,
+                  void *			state);
+
+/**
+ * \brief Give up the connection if it is not established in time.
+ *
+ * Must be called before flm_TCPClientConnect(). When the delay expires
+ * the error handler is called with errno set to ETIMEDOUT.
+ *
+ * \param tcp_client A pointer to a flm_TCPClient object.
+ * \param delay A delay in milliseconds, 0 to wait for the system timeout.
+ */
+void
+flm_TCPClientTimeout (flm_TCPClient *		tcp_client,
+                      uint32_t			delay);
+
+/**
+ * \brief Send the first data with the SYN (TCP Fast Open).
+ *
+ * Must be called before flm_TCPClientConnect(). The connect handler is
+ * then called right away and the first write on the stream goes with
+ * the handshake when the server already gave a cookie, the kernel falls
+ * back to a regular handshake otherwise.
+ *
+ * \param tcp_client A pointer to a flm_TCPClient object.
+ * \return 0 on success, -1 on error. The error is FLM_ERR_NOSYS if the
+ * system does not support TCP Fast Open for clients.
+ */
+int
+flm_TCPClientFastOpen (flm_TCPClient *		tcp_client);
+
+/**
+ * \brief Start connecting.
+ *
+ * \param tcp_client A pointer to a flm_TCPClient object.
+ * \return 0 if the connection is in progress, -1 if it failed right away
+ * (the handlers are not called in that case).
+ */
+int
+flm_TCPClientConnect (flm_TCPClient *		tcp_client);
+
+/**
+ * \brief Abort the connection, no handler will be called.
+ *
+ * \param tcp_client A pointer to a flm_TCPClient object.
+ */
+void
+flm_TCPClientClose (flm_TCPClient *		tcp_client);
+
+void
+flm_TCPClientOnConnect (flm_TCPClient *			tcp_client,
+                        flm_TCPClientConnectHandler	handler);
+
+void
+flm_TCPClientOnError (flm_TCPClient *			tcp_client,
+                      flm_TCPClientErrorHandler		handler);
+
+flm_TCPClient *
+flm_TCPClientRetain (flm_TCPClient *		tcp_client);
+
+void
+flm_TCPClientRelease (flm_TCPClient *		tcp_client);
+
+#endif /* !_FLM_CORE_PUBLIC_TCP_CLIENT_H_ */
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * \brief TLS session cache shared by many threads.
+ */
+
+/**
+ * \file tls_cache.h
+ * \c A TLS cache keeps the server side TLS sessions and the session
+ * ticket keys out of the SSL_CTX, so that every thread of a pool can
+ * resume the sessions created by the others. The sessions are spread
+ * over independently locked shards to keep the contention low, and the
+ * ticket keys can be rotated periodically by a timer.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_TLS_CACHE_H_
+# define _FLM_CORE_PUBLIC_TLS_CACHE_H_
+
+#ifndef _FLM__SKIP
+
+#include <stdint.h>
+
+#include <openssl/ssl.h>
+
+typedef struct flm_TLSCache flm_TLSCache;
+
+#include "flm/core/public/monitor.h"
+#include "flm/core/public/obj.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * Counters of a TLS cache, see flm_TLSCacheStats(). The resumption hit
+ * rate is (hits + tickets) / (lookups + tickets + bad_tickets): the
+ * handshakes that did not try to resume any session are not counted.
+ */
+struct flm_TLSCacheStats
+{
+    /* session IDs looked up, and found */
+    uint64_t            lookups;
+    uint64_t            hits;
+
+    /* sessions added, and removed to make room for new ones */
+    uint64_t            stores;
+    uint64_t            evictions;
+
+    /* tickets decrypted, and tickets whose key was unknown or expired */
+    uint64_t            tickets;
+    uint64_t            bad_tickets;
+
+    /* ticket keys generated */
+    uint64_t            rotations;
+};
+
+/**
+ * \brief Create a new TLS cache.
+ *
+ * A first ticket key is generated immediately.
+ *
+ * \param size The maximum number of sessions kept, the least recently
+ * used ones are dropped first.
+ *
+ * \return A pointer to a new flm_TLSCache object.
+ * \retval NULL in case of error.
+ *
+ * \code
+ *  flm_TLSCache * cache;
+ *
+ *  cache = flm_TLSCacheNew (20000);
+ *  flm_TLSCacheAttach (cache, context);
+ *  flm_TLSCacheRotate (cache, monitor, 3600 * 1000);
+ *  flm_TLSCacheRelease (cache);
+ * \endcode
+ */
+flm_TLSCache *
+flm_TLSCacheNew (size_t			size);
+
+/**
+ * \brief Use the cache for the sessions and the tickets of a context.
+ *
+ * The internal session cache of the context is disabled. The same cache
+ * can be attached to many contexts, and the contexts can be shared by
+ * any number of threads. The context keeps a reference to the cache
+ * until it is freed.
+ *
+ * \param cache A pointer to a flm_TLSCache object.
+ * \param context A server SSL_CTX, it should be attached before any
+ * stream uses it.
+ * \return 0 on success, -1 on error.
+ */
+int
+flm_TLSCacheAttach (flm_TLSCache *	cache,
+                    SSL_CTX *		context);
+
+/**
+ * \brief Generate a new ticket key.
+ *
+ * New tickets are encrypted with the new key. The tickets encrypted with
+ * the two previous keys are still accepted and renewed, the older ones
+ * fall back to a full handshake.
+ *
+ * \param cache A pointer to a flm_TLSCache object.
+ * \return 0 on success, -1 if no random key could be generated.
+ */
+int
+flm_TLSCacheRotateKeys (flm_TLSCache *	cache);
+
+/**
+ * \brief Rotate the ticket keys periodically.
+ *
+ * The rotation timer is handled by the given monitor, so only one thread
+ * rotates the keys shared by all the others. A pending rotation keeps the
+ * monitor running.
+ *
+ * \param cache A pointer to a flm_TLSCache object.
+ * \param monitor The monitor handling the rotation timer.
+ * \param interval The delay between two keys in milliseconds, 0 to stop
+ * the rotation.
+ * \return 0 on success, -1 on error.
+ */
+int
+flm_TLSCacheRotate (flm_TLSCache *	cache,
+                    flm_Monitor *	monitor,
+                    uint32_t		interval);
+
+/**
+ * \brief Read the counters of the cache.
+ *
+ * \param cache A pointer to a flm_TLSCache object.
+ * \param stats The counters since the creation of the cache.
+ */
+void
+flm_TLSCacheStats (flm_TLSCache *		cache,
+                   struct flm_TLSCacheStats *	stats);
+
+/**
+ * \brief Increment the reference counter.
+ *
+ * \param cache A pointer to a flm_TLSCache object.
+ * \return The same pointer, this function cannot fail.
+ */
+flm_TLSCache *
+flm_TLSCacheRetain (flm_TLSCache *	cache);
+
+/**
+ * \brief Decrement the reference counter.
+ *
+ * When the counter reaches zero the cache and its sessions are freed.
+ *
+ * \param cache A pointer to a flm_TLSCache object.
+ */
+void
+flm_TLSCacheRelease (flm_TLSCache *	cache);
+
+#endif /* !_FLM_CORE_PUBLIC_TLS_CACHE_H_ */
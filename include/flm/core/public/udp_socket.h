@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \brief Send and receive datagrams in batches.
+ */
+
+/**
+ * \file udp_socket.h
+ * \c A UDP socket reads and writes many datagrams per system call, with
+ * recvmmsg(2) and sendmmsg(2). The datagrams of a batch are received in
+ * a single buffer and handed out as views of it, this buffer is reused
+ * for the next batch once every view has been released. The datagrams
+ * sent are queued and the queue is flushed once per iteration of the
+ * monitor. With segmentation offload, the consecutive datagrams of the
+ * same size to the same destination even go in a single message, which
+ * the kernel cuts back into datagrams.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_UDP_SOCKET_H_
+# define _FLM_CORE_PUBLIC_UDP_SOCKET_H_
+
+#ifndef _FLM__SKIP
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <stdint.h>
+
+typedef struct flm_UDPSocket flm_UDPSocket;
+
+#include "flm/core/public/buffer.h"
+#include "flm/core/public/monitor.h"
+#include "flm/core/public/obj.h"
+
+#endif /* !_FLM__SKIP */
+
+/**
+ * Called for each datagram received. The datagram is released after the
+ * call, the handler has to retain it to keep it. The address is only
+ * valid during the call.
+ */
+typedef void (*flm_UDPSocketReadHandler)			\
+(flm_UDPSocket * udp_socket,						\
+ void * state,								\
+ flm_Buffer * datagram,							\
+ const struct sockaddr * addr,						\
+ socklen_t addr_len);
+
+/**
+ * Called when a datagram cannot be sent or received, errno tells why.
+ * These errors are not fatal, the socket stays open.
+ */
+typedef void (*flm_UDPSocketErrorHandler)			\
+(flm_UDPSocket * udp_socket, void * state, int error);
+
+/**
+ * \brief Create a UDP socket.
+ *
+ * \param monitor The monitor of the socket.
+ * \param address The numeric local address to bind, NULL for any.
+ * \param port The local port, 0 to let the system choose one.
+ * \param state A pointer given to the handlers.
+ *
+ * \return A pointer to a new flm_UDPSocket object.
+ * \retval NULL in case of error.
+ */
+flm_UDPSocket *
+flm_UDPSocketNew (flm_Monitor *			monitor,
+                  const char *			address,
+                  uint16_t			port,
+                  void *			state);
+
+/**
+ * \brief Change the size of the batches.
+ *
+ * \param udp_socket A pointer to a flm_UDPSocket object.
+ * \param count The number of datagrams read or written by a system call,
+ * between 1 and 1024. The default is 32.
+ * \param size The largest datagram received, longer ones are dropped.
+ * The default is 2048 bytes.
+ * \return 0 on success, -1 on error.
+ */
+int
+flm_UDPSocketBatch (flm_UDPSocket *		udp_socket,
+                    size_t			count,
+                    size_t			size);
+
+/**
+ * \brief Send the datagrams of the same size with a single message (UDP
+ * generic segmentation offload).
+ *
+ * Up to 64 consecutive datagrams to the same destination are grouped as
+ * long as they have the same size, the last one of a group may be
+ * shorter. The datagrams must fit in the MTU of the path, the kernel
+ * does not fragment them.
+ *
+ * \param udp_socket A pointer to a flm_UDPSocket object.
+ * \return 0 on success, -1 on error. The error is FLM_ERR_NOSYS if the
+ * system does not support it.
+ */
+int
+flm_UDPSocketGSO (flm_UDPSocket *		udp_socket);
+
+/**
+ * \brief Receive the datagrams of the same size coalesced by the kernel
+ * (UDP generic receive offload).
+ *
+ * The read handler still gets the datagrams one by one, as views of the
+ * coalesced message. Each message of a batch takes 64KB of the receive
+ * buffer.
+ *
+ * \param udp_socket A pointer to a flm_UDPSocket object.
+ * \return 0 on success, -1 on error. The error is FLM_ERR_NOSYS if the
+ * system does not support it.
+ */
+int
+flm_UDPSocketGRO (flm_UDPSocket *		udp_socket);
+
+/**
+ * \brief Queue a datagram.
+ *
+ * The datagram is sent during the next iteration of the monitor, along
+ * with all the others queued in the meantime.
+ *
+ * \param udp_socket A pointer to a flm_UDPSocket object.
+ * \param datagram The content of the datagram, retained until it is
+ * sent.
+ * \param addr The destination.
+ * \param addr_len The size of the destination address.
+ * \return 0 on success, -1 on error. The error is FLM_ERR_ERRNO and errno
+ * is ENOBUFS if the queue is full.
+ */
+int
+flm_UDPSocketSend (flm_UDPSocket *		udp_socket,
+                   flm_Buffer *			datagram,
+                   const struct sockaddr *	addr,
+                   socklen_t			addr_len);
+
+/**
+ * \brief Close the socket, the datagrams still queued are dropped.
+ *
+ * \param udp_socket A pointer to a flm_UDPSocket object.
+ */
+void
+flm_UDPSocketClose (flm_UDPSocket *		udp_socket);
+
+void
+flm_UDPSocketOnRead (flm_UDPSocket *			udp_socket,
+                     flm_UDPSocketReadHandler		handler);
+
+void
+flm_UDPSocketOnError (flm_UDPSocket *			udp_socket,
+                      flm_UDPSocketErrorHandler		handler);
+
+flm_UDPSocket *
+flm_UDPSocketRetain (flm_UDPSocket *		udp_socket);
+
+void
+flm_UDPSocketRelease (flm_UDPSocket *		udp_socket);
+
+#endif /* !_FLM_CORE_PUBLIC_UDP_SOCKET_H_ */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2008-2009, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \brief Accept connections on a Unix domain socket.
+ */
+
+/**
+ * \file unix_server.h
+ * \c A Unix server works like a flm_TCPServer bound to a path instead of
+ * a port: local peers connect without going through the TCP stack, and
+ * the accepted streams can pass file descriptors to each other, see
+ * flm_StreamPushDescriptor(). A path starting with '@' is bound in the
+ * abstract namespace of Linux, nothing is created on the filesystem.
+ */
+
+#ifndef _FLM_CORE_PUBLIC_UNIX_SERVER_H_
+# define _FLM_CORE_PUBLIC_UNIX_SERVER_H_
+
+#ifndef _FLM__SKIP
+
+typedef struct flm_UnixServer flm_UnixServer;
+
+#include "flm/core/public/monitor.h"
+#include "flm/core/public/obj.h"
+
+#endif /* !_FLM__SKIP */
+
+typedef void (*flm_UnixServerCloseHandler)	\
+(flm_UnixServer * unix_server, void * state);
+
+typedef void (*flm_UnixServerErrorHandler)	\
+(flm_UnixServer * unix_server, void * state, int error);
+
+/**
+ * Called for each accepted connection, the handler owns the non-blocking
+ * file descriptor.
+ */
+typedef void (*flm_UnixServerAcceptHandler)	\
+(flm_UnixServer * unix_server, void * state, int fd);
+
+/**
+ * \brief Create a Unix server listening on a path.
+ *
+ * A socket left on the path by a server that is gone is replaced, the
+ * creation fails if another server still listens on it. The path is
+ * removed when the server is destroyed.
+ *
+ * \param monitor The monitor watching the server.
+ * \param path The path to bind to, or an abstract name starting with '@'.
+ * \param state A pointer given to the handlers.
+ *
+ * \return A pointer to a new flm_UnixServer object.
+ * \retval NULL in case of error, a path too long for a socket address
+ * fails with FLM_ERR_ERRNO and errno set to ENAMETOOLONG.
+ */
+flm_UnixServer *
+flm_UnixServerNew (flm_Monitor *		monitor,
+		   const char *			path,
+		   void *			state);
+
+void
+flm_UnixServerClose (flm_UnixServer *		unix_server);
+
+void
+flm_UnixServerOnClose (flm_UnixServer *			unix_server,
+                       flm_UnixServerCloseHandler	handler);
+
+void
+flm_UnixServerOnError (flm_UnixServer *			unix_server,
+                       flm_UnixServerErrorHandler	handler);
+
+void
+flm_UnixServerOnAccept (flm_UnixServer *		unix_server,
+			flm_UnixServerAcceptHandler	handler);
+
+flm_UnixServer *
+flm_UnixServerRetain (flm_UnixServer *			unix_server);
+
+void
+flm_UnixServerRelease (flm_UnixServer *			unix_server);
+
+#endif /* !_FLM_CORE_PUBLIC_UNIX_SERVER_H_ */
@@ -14,6 +14,8 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <pthread.h>
 
@@ -21,6 +23,7 @@
 #include "flm/core/private/alloc.h"
 
 void * (*allocHandler)(size_t);
+void * (*reallocHandler)(void *, size_t);
 void   (*freeHandler)(void *);
 
 void
@@ -29,6 +32,12 @@ flm__SetAlloc (void * (*handler)(size_t))
     allocHandler = handler;
 }
 
+void
+flm__SetRealloc (void * (*handler)(void *, size_t))
+{
+    reallocHandler = handler;
+}
+
 void
 flm__SetFree (void (*handler)(void *))
 {
@@ -53,6 +62,36 @@ flm__Alloc (size_t      size)
     return (mem);
 }
 
+void *
+flm__Realloc (void *    mem,
+              size_t    size)
+{
+    void * new;
+
+    if (reallocHandler) {
+        new = reallocHandler (mem, size);
+    }
+    else if (!flm__HasRealloc ()) {
+        /* realloc(3) would mix its memory with the one of the handlers */
+        flm__Error = FLM_ERR_NOSYS;
+        return (NULL);
+    }
+    else {
+        new = realloc (mem, size);
+    }
+    if (new == NULL) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (NULL);
+    }
+    return (new);
+}
+
+bool
+flm__HasRealloc ()
+{
+    return (reallocHandler || (allocHandler == NULL && freeHandler == NULL));
+}
+
 void
 flm__Free (void *       mem)
 {
@@ -64,3 +103,30 @@ flm__Free (void *       mem)
     }
     return ;
 }
+
+void *
+flm__AllocAligned (size_t       size,
+                   size_t       align)
+{
+    char * mem;
+    char * aligned;
+
+    /**
+     * Goes through flm__Alloc() like every other allocation, the start of
+     * the real area is kept just before the aligned one.
+     */
+    if ((mem = flm__Alloc (size + align + sizeof (void *))) == NULL) {
+        return (NULL);
+    }
+    aligned = (char *)(((uintptr_t) mem + sizeof (void *) + align - 1) &  \
+                       ~((uintptr_t) align - 1));
+    ((void **) aligned)[-1] = mem;
+    return (aligned);
+}
+
+void
+flm__FreeAligned (void *        mem)
+{
+    flm__Free (((void **) mem)[-1]);
+    return ;
+}
@@ -14,6 +14,9 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include <errno.h>
 #include <stdbool.h>
 #include <stdarg.h>
@@ -25,6 +28,7 @@
 #include "flm/core/private/alloc.h"
 #include "flm/core/private/error.h"
 #include "flm/core/private/buffer.h"
+#include "flm/core/private/file.h"
 
 flm_Buffer *
 flm_BufferNew (char *                           content,
@@ -41,6 +45,98 @@ flm_BufferNew (char *                           content,
     return (buffer);
 }
 
+flm_Buffer *
+flm_BufferAlloc (size_t         length)
+{
+    flm_Buffer *        buffer;
+
+    if ((buffer = flm__Alloc (sizeof (flm_Buffer) + length)) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (NULL);
+    }
+    flm__BufferInitRaw (buffer, (char *) &buffer[1], length, NULL);
+    return (buffer);
+}
+
+flm_Buffer *
+flm_BufferMap (flm_File *       file,
+               off_t            off,
+               size_t           count,
+               int              advice)
+{
+    flm_Buffer *        buffer;
+    struct stat         stat;
+    off_t               size;
+    off_t               start;
+    size_t              len;
+    void *              addr;
+
+    if (off < 0) {
+        errno = EINVAL;
+        flm__Error = FLM_ERR_ERRNO;
+        return (NULL);
+    }
+
+    /**
+     * Nothing is mapped past the current end of the file, touching these
+     * pages would raise SIGBUS. The size cached by a file cache may be
+     * stale, so it is always asked for.
+     */
+    if (fstat (file->io.sys.fd, &stat) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (NULL);
+    }
+    size = stat.st_size;
+    if (off > size) {
+        off = size;
+    }
+    if (count == 0 || (off_t) count > size - off) {
+        count = size - off;
+    }
+    if (count == 0) {
+        return (flm_BufferAlloc (0));
+    }
+
+    if ((buffer = flm__Alloc (sizeof (flm_Buffer))) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (NULL);
+    }
+
+    /**
+     * The mapping starts on a page boundary. It is private, so that the
+     * content can be modified like the one of any other buffer without
+     * the changes ever reaching the file.
+     */
+    start = off & ~((off_t) sysconf (_SC_PAGESIZE) - 1);
+    len = count + (off - start);
+    addr = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                 file->io.sys.fd, start);
+    if (addr == MAP_FAILED) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto free_buffer;
+    }
+
+    /* only hints, nothing to do if the kernel does not follow them */
+    if (advice & FLM_BUFFER_MAP_SEQUENTIAL) {
+        madvise (addr, len, MADV_SEQUENTIAL);
+    }
+    else if (advice & FLM_BUFFER_MAP_RANDOM) {
+        madvise (addr, len, MADV_RANDOM);
+    }
+    if (advice & FLM_BUFFER_MAP_WILLNEED) {
+        madvise (addr, len, MADV_WILLNEED);
+    }
+
+    flm__BufferInitRaw (buffer, (char *) addr + (off - start), count, NULL);
+    buffer->content.raw.map.addr = addr;
+    buffer->content.raw.map.len = len;
+    return (buffer);
+
+  free_buffer:
+    flm__Free (buffer);
+    return (NULL);
+}
+
 flm_Buffer *
 flm_BufferView (flm_Buffer *    from,
                 off_t           off,
@@ -62,7 +158,6 @@ flm_BufferVPrintf (const char *         format,
 {
     flm_Buffer *        buffer;
 
-    char *              content;
     int                 len;
     size_t              alloc;
 
@@ -72,28 +167,25 @@ flm_BufferVPrintf (const char *         format,
     len = vsnprintf (NULL, 0, format, ap_copy);
     va_end (ap_copy);
 
+    if (len < 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (NULL);
+    }
     alloc = len + 1;
 
-    content = flm__Alloc (alloc * sizeof (char));
-    if (content == NULL) {
-        flm__Error = FLM_ERR_NOMEM;
-        goto error;
+    if ((buffer = flm_BufferAlloc (alloc * sizeof (char))) == NULL) {
+        return (NULL);
     }
 
     va_copy (ap_copy, ap);
-    vsnprintf (content, alloc, format, ap_copy);
+    vsnprintf (flm_BufferContent (buffer), alloc, format, ap_copy);
     va_end (ap_copy);
 
-    if ((buffer = flm_BufferNew (content, len, flm__Free)) == NULL) {
-        goto free_content;
-    }
-
+    /**
+     * The ending \0 is there but not counted
+     */
+    buffer->content.raw.len = len;
     return (buffer);
-
-free_content:
-    flm__Free (content);
-error:
-    return (NULL);
 }
 
 flm_Buffer *
@@ -130,8 +222,9 @@ flm_BufferContent (flm_Buffer *         buffer)
     case FLM__BUFFER_TYPE_RAW:
         return (buffer->content.raw.content);
     case FLM__BUFFER_TYPE_VIEW:
-        return (&(flm_BufferContent (
-                      buffer->content.view.from)[buffer->content.view.off]));
+        /* views always point at a raw buffer, see flm__BufferInitView */
+        return (&(buffer->content.view.from->content.raw.content[
+                      buffer->content.view.off]));
     default:
         break;
     }
@@ -165,9 +258,11 @@ flm__BufferInitRaw (flm_Buffer *                   buffer,
         (flm__ObjPerfDestruct_f) flm__BufferPerfDestruct;
 
     buffer->type = FLM__BUFFER_TYPE_RAW;
+    buffer->pool = NULL;
     buffer->content.raw.len = len;
     buffer->content.raw.content = content;
     buffer->content.raw.fr.handler = fr_handler;
+    buffer->content.raw.map.addr = NULL;
     return ;
 }
 
@@ -185,6 +280,17 @@ flm__BufferInitView (flm_Buffer *                  buffer,
         (flm__ObjPerfDestruct_f) flm__BufferPerfDestruct;
 
     buffer->type = FLM__BUFFER_TYPE_VIEW;
+    buffer->pool = NULL;
+
+    /**
+     * A view of a view is a view of the root buffer, so that slicing
+     * repeatedly neither lengthens the access path nor the chain of
+     * references.
+     */
+    if (from->type == FLM__BUFFER_TYPE_VIEW) {
+        off += from->content.view.off;
+        from = from->content.view.from;
+    }
     buffer->content.view.from = flm_BufferRetain (from);
     buffer->content.view.off = off;
     buffer->content.view.count = count;
@@ -199,6 +305,10 @@ flm__BufferPerfDestruct (flm_Buffer *   buffer)
         if (buffer->content.raw.fr.handler) {
             buffer->content.raw.fr.handler (buffer->content.raw.content);
         }
+        if (buffer->content.raw.map.addr) {
+            munmap (buffer->content.raw.map.addr,
+                    buffer->content.raw.map.len);
+        }
         break;
     case FLM__BUFFER_TYPE_VIEW:
         flm_BufferRelease (buffer->content.view.from);
@@ -208,3 +318,136 @@ flm__BufferPerfDestruct (flm_Buffer *   buffer)
     }
     return ;
 }
+
+struct flm__BufferPool *
+flm__BufferPoolNew ()
+{
+    struct flm__BufferPool *    pool;
+    int                         class;
+
+    if ((pool = flm__Alloc (sizeof (struct flm__BufferPool))) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (NULL);
+    }
+    pool->refs = 1;
+    pool->owner = pthread_self ();
+    pool->closed = false;
+    for (class = 0; class < FLM__BUFFER_POOL_CLASSES; class++) {
+        pool->classes[class].count = 0;
+        SLIST_INIT (&pool->classes[class].free);
+    }
+    pool->hits = 0;
+    pool->misses = 0;
+    return (pool);
+}
+
+void
+flm__BufferPoolOwn (struct flm__BufferPool *    pool)
+{
+    pool->owner = pthread_self ();
+    return ;
+}
+
+flm_Buffer *
+flm__BufferPoolGet (struct flm__BufferPool *    pool,
+                    size_t                      length)
+{
+    struct flm__BufferPoolBlock *       block;
+    flm_Buffer *                        buffer;
+    int                                 class;
+
+    if (!pthread_equal (pool->owner, pthread_self ())) {
+        return (flm_BufferAlloc (length));
+    }
+    for (class = 0; class < FLM__BUFFER_POOL_CLASSES; class++) {
+        if (length <= (size_t) 1 << (FLM__BUFFER_POOL_SHIFT + class)) {
+            break ;
+        }
+    }
+    if (class == FLM__BUFFER_POOL_CLASSES) {
+        return (flm_BufferAlloc (length));
+    }
+
+    if ((block = SLIST_FIRST (&pool->classes[class].free)) != NULL) {
+        SLIST_REMOVE_HEAD (&pool->classes[class].free, entries);
+        pool->classes[class].count--;
+        pool->hits++;
+        buffer = (flm_Buffer *) block;
+    }
+    else {
+        buffer = flm__Alloc (sizeof (flm_Buffer) +                      \
+                             ((size_t) 1 << (FLM__BUFFER_POOL_SHIFT + class)));
+        if (buffer == NULL) {
+            flm__Error = FLM_ERR_NOMEM;
+            return (NULL);
+        }
+        pool->misses++;
+    }
+
+    flm__BufferInitRaw (buffer, (char *) &buffer[1], length, NULL);
+    buffer->obj.perf.release =                                          \
+        (flm__ObjPerfRelease_f) flm__BufferPerfReleasePooled;
+    buffer->pool = pool;
+    buffer->class = class;
+    __sync_fetch_and_add (&pool->refs, 1);
+    return (buffer);
+}
+
+void
+flm__BufferPoolPut (struct flm__BufferPool *    pool,
+                    flm_Buffer *                buffer)
+{
+    int class;
+
+    class = buffer->class;
+    if (!pool->closed &&                                                \
+        pthread_equal (pool->owner, pthread_self ()) &&                 \
+        pool->classes[class].count < FLM__BUFFER_POOL_KEEP) {
+        SLIST_INSERT_HEAD (&pool->classes[class].free,                  \
+                           (struct flm__BufferPoolBlock *) buffer,      \
+                           entries);
+        pool->classes[class].count++;
+    }
+    else {
+        flm__Free (buffer);
+    }
+    flm__BufferPoolDrop (pool);
+    return ;
+}
+
+void
+flm__BufferPoolClose (struct flm__BufferPool *  pool)
+{
+    struct flm__BufferPoolBlock *       block;
+    int                                 class;
+
+    pool->closed = true;
+    for (class = 0; class < FLM__BUFFER_POOL_CLASSES; class++) {
+        while ((block = SLIST_FIRST (&pool->classes[class].free)) != NULL) {
+            SLIST_REMOVE_HEAD (&pool->classes[class].free, entries);
+            flm__Free (block);
+        }
+        pool->classes[class].count = 0;
+    }
+    flm__BufferPoolDrop (pool);
+    return ;
+}
+
+void
+flm__BufferPoolDrop (struct flm__BufferPool *   pool)
+{
+    if (__sync_sub_and_fetch (&pool->refs, 1) == 0) {
+        flm__Free (pool);
+    }
+    return ;
+}
+
+void
+flm__BufferPerfReleasePooled (flm_Buffer *      buffer)
+{
+    buffer->obj.stat.refcount--;
+    if (buffer->obj.stat.refcount == 0) {
+        flm__BufferPoolPut (buffer->pool, buffer);
+    }
+    return ;
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/buffer.h"
+#include "flm/core/private/buffer_builder.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/obj.h"
+
+flm_BufferBuilder *
+flm_BufferBuilderNew (size_t            hint)
+{
+    flm_BufferBuilder * builder;
+
+    if ((builder = flm__Alloc (sizeof (flm_BufferBuilder))) == NULL) {
+        return (NULL);
+    }
+    if (flm__BufferBuilderInit (builder, hint) == -1) {
+        flm__Free (builder);
+        return (NULL);
+    }
+    return (builder);
+}
+
+int
+flm_BufferBuilderAppend (flm_BufferBuilder *    builder,
+                         const void *           data,
+                         size_t                 length)
+{
+    char * room;
+
+    if ((room = flm_BufferBuilderReserve (builder, length)) == NULL) {
+        return (-1);
+    }
+    memcpy (room, data, length);
+    builder->length += length;
+    return (0);
+}
+
+char *
+flm_BufferBuilderReserve (flm_BufferBuilder *   builder,
+                          size_t                length)
+{
+    if (builder->block == NULL || builder->size - builder->length < length) {
+        if (flm__BufferBuilderGrow (builder, length) == -1) {
+            return (NULL);
+        }
+    }
+    return (&((char *) &builder->block[1])[builder->length]);
+}
+
+int
+flm_BufferBuilderCommit (flm_BufferBuilder *    builder,
+                         size_t                 length)
+{
+    if (builder->size - builder->length < length) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+    builder->length += length;
+    return (0);
+}
+
+char *
+flm_BufferBuilderContent (flm_BufferBuilder *   builder)
+{
+    if (builder->block == NULL) {
+        return (NULL);
+    }
+    return ((char *) &builder->block[1]);
+}
+
+size_t
+flm_BufferBuilderLength (flm_BufferBuilder *    builder)
+{
+    return (builder->length);
+}
+
+flm_Buffer *
+flm_BufferBuilderFinish (flm_BufferBuilder *    builder)
+{
+    flm_Buffer * buffer;
+
+    if (builder->block == NULL) {
+        if (flm__BufferBuilderGrow (builder, 0) == -1) {
+            return (NULL);
+        }
+    }
+
+    /**
+     * The buffer is freed at once with its content, just as if it came
+     * from flm_BufferAlloc().
+     */
+    buffer = builder->block;
+    flm__BufferInitRaw (buffer,
+                        (char *) &buffer[1],
+                        builder->length,
+                        NULL);
+
+    builder->block = NULL;
+    builder->length = 0;
+    builder->size = 0;
+    return (buffer);
+}
+
+flm_BufferBuilder *
+flm_BufferBuilderRetain (flm_BufferBuilder *    builder)
+{
+    return (flm__Retain (&builder->obj));
+}
+
+void
+flm_BufferBuilderRelease (flm_BufferBuilder *   builder)
+{
+    flm__Release (&builder->obj);
+    return ;
+}
+
+int
+flm__BufferBuilderInit (flm_BufferBuilder *     builder,
+                        size_t                  hint)
+{
+    flm__ObjInit (&builder->obj);
+
+    builder->obj.type = FLM__TYPE_BUFFER_BUILDER;
+
+    builder->obj.perf.destruct =                                \
+        (flm__ObjPerfDestruct_f) flm__BufferBuilderPerfDestruct;
+
+    builder->block = NULL;
+    builder->length = 0;
+    builder->size = 0;
+    if (hint && flm__BufferBuilderGrow (builder, hint) == -1) {
+        return (-1);
+    }
+    return (0);
+}
+
+void
+flm__BufferBuilderPerfDestruct (flm_BufferBuilder *     builder)
+{
+    if (builder->block) {
+        flm__Free (builder->block);
+    }
+    return ;
+}
+
+int
+flm__BufferBuilderGrow (flm_BufferBuilder *     builder,
+                        size_t                  length)
+{
+    flm_Buffer *        block;
+    size_t              size;
+
+    if (length > SIZE_MAX - sizeof (flm_Buffer) - builder->length) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (-1);
+    }
+
+    /**
+     * The first room fits what is asked for, then doubling it each time
+     * keeps the number of copies logarithmic in the final length.
+     */
+    size = builder->size;
+    if (size == 0) {
+        size = length > FLM__BUFFER_BUILDER_MIN ?                    \
+            length : FLM__BUFFER_BUILDER_MIN;
+    }
+    while (size < builder->length + length) {
+        if (size > (SIZE_MAX - sizeof (flm_Buffer)) / 2) {
+            size = builder->length + length;
+            break ;
+        }
+        size *= 2;
+    }
+
+    if (flm__HasRealloc ()) {
+        block = flm__Realloc (builder->block, sizeof (flm_Buffer) + size);
+        if (block == NULL) {
+            return (-1);
+        }
+    }
+    else {
+        /**
+         * The allocator has no realloc handler, move the content by hand
+         */
+        if ((block = flm__Alloc (sizeof (flm_Buffer) + size)) == NULL) {
+            return (-1);
+        }
+        if (builder->block) {
+            memcpy (&block[1], &builder->block[1], builder->length);
+            flm__Free (builder->block);
+        }
+    }
+    builder->block = block;
+    builder->size = size;
+    return (0);
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/queue.h>
+#include <sys/types.h>
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/buffer.h"
+#include "flm/core/private/buffer_chain.h"
+#include "flm/core/private/obj.h"
+
+flm_BufferChain *
+flm_BufferChainNew ()
+{
+    flm_BufferChain * chain;
+
+    if ((chain = flm__Alloc (sizeof (flm_BufferChain))) == NULL) {
+        return (NULL);
+    }
+    if (flm__BufferChainInit (chain) == -1) {
+        flm__Free (chain);
+        return (NULL);
+    }
+    return (chain);
+}
+
+int
+flm_BufferChainAppend (flm_BufferChain *        chain,
+                       flm_Buffer *             buffer,
+                       off_t                    off,
+                       size_t                   count)
+{
+    struct flm__BufferChainSegment * segment;
+
+    if ((segment = flm__BufferChainSegment (buffer, off, count)) == NULL) {
+        return (-1);
+    }
+    chain->length += segment->count;
+    chain->count++;
+    TAILQ_INSERT_TAIL (&chain->segments, segment, entries);
+    return (0);
+}
+
+int
+flm_BufferChainPrepend (flm_BufferChain *       chain,
+                        flm_Buffer *            buffer,
+                        off_t                   off,
+                        size_t                  count)
+{
+    struct flm__BufferChainSegment * segment;
+
+    if ((segment = flm__BufferChainSegment (buffer, off, count)) == NULL) {
+        return (-1);
+    }
+    chain->length += segment->count;
+    chain->count++;
+    TAILQ_INSERT_HEAD (&chain->segments, segment, entries);
+    return (0);
+}
+
+flm_BufferChain *
+flm_BufferChainSplit (flm_BufferChain *         chain,
+                      size_t                    off)
+{
+    flm_BufferChain *                   tail;
+    struct flm__BufferChainSegment *    segment;
+    struct flm__BufferChainSegment *    part;
+    size_t                              pos;
+
+    if ((tail = flm_BufferChainNew ()) == NULL) {
+        goto error;
+    }
+    if (off >= chain->length) {
+        return (tail);
+    }
+
+    /**
+     * Find the segment the offset falls in
+     */
+    pos = 0;
+    TAILQ_FOREACH (segment, &chain->segments, entries) {
+        if (pos + segment->count > off) {
+            break ;
+        }
+        pos += segment->count;
+    }
+
+    /**
+     * Cut in the middle of a segment, the second part goes first in the
+     * new chain and shares the buffer.
+     */
+    if (pos < off) {
+        part = flm__BufferChainSegment (segment->buffer,
+                                        segment->off + (off - pos),
+                                        segment->count - (off - pos));
+        if (part == NULL) {
+            goto release_tail;
+        }
+        segment->count = off - pos;
+        TAILQ_INSERT_TAIL (&tail->segments, part, entries);
+        tail->count++;
+        segment = TAILQ_NEXT (segment, entries);
+    }
+
+    while (segment) {
+        part = TAILQ_NEXT (segment, entries);
+        TAILQ_REMOVE (&chain->segments, segment, entries);
+        TAILQ_INSERT_TAIL (&tail->segments, segment, entries);
+        chain->count--;
+        tail->count++;
+        segment = part;
+    }
+    tail->length = chain->length - off;
+    chain->length = off;
+    return (tail);
+
+  release_tail:
+    flm_BufferChainRelease (tail);
+  error:
+    return (NULL);
+}
+
+int
+flm_BufferChainForEach (flm_BufferChain *       chain,
+                        flm_BufferChainHandler  handler,
+                        void *                  state)
+{
+    struct flm__BufferChainSegment *    segment;
+    int                                 ret;
+
+    TAILQ_FOREACH (segment, &chain->segments, entries) {
+        ret = handler (state,
+                       &flm_BufferContent (segment->buffer)[segment->off],
+                       segment->count);
+        if (ret != 0) {
+            return (ret);
+        }
+    }
+    return (0);
+}
+
+size_t
+flm_BufferChainLength (flm_BufferChain *        chain)
+{
+    return (chain->length);
+}
+
+size_t
+flm_BufferChainCount (flm_BufferChain *         chain)
+{
+    return (chain->count);
+}
+
+flm_BufferChain *
+flm_BufferChainRetain (flm_BufferChain *        chain)
+{
+    return (flm__Retain (&chain->obj));
+}
+
+void
+flm_BufferChainRelease (flm_BufferChain *       chain)
+{
+    flm__Release (&chain->obj);
+    return ;
+}
+
+int
+flm__BufferChainInit (flm_BufferChain *         chain)
+{
+    flm__ObjInit (&chain->obj);
+
+    chain->obj.type = FLM__TYPE_BUFFER_CHAIN;
+
+    chain->obj.perf.destruct =                                  \
+        (flm__ObjPerfDestruct_f) flm__BufferChainPerfDestruct;
+
+    chain->length = 0;
+    chain->count = 0;
+    TAILQ_INIT (&chain->segments);
+    return (0);
+}
+
+void
+flm__BufferChainPerfDestruct (flm_BufferChain *         chain)
+{
+    struct flm__BufferChainSegment * segment;
+
+    while ((segment = TAILQ_FIRST (&chain->segments)) != NULL) {
+        TAILQ_REMOVE (&chain->segments, segment, entries);
+        flm_BufferRelease (segment->buffer);
+        flm__Free (segment);
+    }
+    return ;
+}
+
+struct flm__BufferChainSegment *
+flm__BufferChainSegment (flm_Buffer *           buffer,
+                         off_t                  off,
+                         size_t                 count)
+{
+    struct flm__BufferChainSegment * segment;
+
+    if (off < 0) {
+        off = 0;
+    }
+    if (off > (off_t) flm_BufferLength (buffer)) {
+        off = flm_BufferLength (buffer);
+    }
+    if (count == 0 || count > flm_BufferLength (buffer) - off) {
+        count = flm_BufferLength (buffer) - off;
+    }
+
+    segment = flm__Alloc (sizeof (struct flm__BufferChainSegment));
+    if (segment == NULL) {
+        return (NULL);
+    }
+    segment->buffer = flm_BufferRetain (buffer);
+    segment->off = off;
+    segment->count = count;
+    return (segment);
+}
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "flm/core/public/error.h"
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/conn_pool.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/stream.h"
+
+flm_ConnPool *
+flm_ConnPoolNew (flm_Monitor *		monitor,
+                 size_t			max,
+                 uint32_t		timeout)
+{
+    flm_ConnPool * pool;
+
+    pool = flm__Alloc (sizeof (flm_ConnPool));
+    if (pool == NULL) {
+        return (NULL);
+    }
+    if (flm__ConnPoolInit (pool, monitor, max, timeout) == -1) {
+        flm__Free (pool);
+        return (NULL);
+    }
+    return (pool);
+}
+
+int
+flm_ConnPoolLimit (flm_ConnPool *	pool,
+                   const char *		address,
+                   uint16_t		port,
+                   size_t		max)
+{
+    struct flm__ConnPoolDest * dest;
+
+    if ((dest = flm__ConnPoolFind (pool, address, port, true)) == NULL) {
+        return (-1);
+    }
+    dest->max = max;
+    while (dest->count > dest->max) {
+        pool->stats.evictions++;
+        flm__ConnPoolDrop (TAILQ_LAST (&dest->idle, cpid));
+    }
+    return (0);
+}
+
+flm_Stream *
+flm_ConnPoolGet (flm_ConnPool *		pool,
+                 const char *		address,
+                 uint16_t		port,
+                 void *			state)
+{
+    struct flm__ConnPoolDest * dest;
+    struct flm__ConnPoolEntry * entry;
+    flm_Stream * stream;
+    ssize_t len;
+    char byte;
+
+    dest = flm__ConnPoolFind (pool, address, port, false);
+    while (dest && (entry = TAILQ_FIRST (&dest->idle)) != NULL) {
+        /**
+         * The monitor may not have reported yet that the peer closed the
+         * connection, or sent something it should not have. A TLS peer
+         * sends records of its own, like session tickets, only the end
+         * of file tells it is gone.
+         */
+        len = recv (entry->stream->io.sys.fd,			\
+                    &byte,					\
+                    1,						\
+                    MSG_PEEK | MSG_DONTWAIT);
+        if (len == 0 ||						\
+            (len > 0 && entry->stream->tls.obj == NULL) ||	\
+            (len == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            pool->stats.closed++;
+            flm__ConnPoolDrop (entry);
+            continue ;
+        }
+
+        /* the reference of the pool goes to the caller */
+        stream = flm__ConnPoolUnpark (entry);
+        stream->io.state = state;
+        pool->stats.hits++;
+        return (stream);
+    }
+    pool->stats.misses++;
+    return (NULL);
+}
+
+int
+flm_ConnPoolPut (flm_ConnPool *		pool,
+                 const char *		address,
+                 uint16_t		port,
+                 flm_Stream *		stream)
+{
+    struct flm__ConnPoolDest * dest;
+    struct flm__ConnPoolEntry * entry;
+
+    if (stream->io.monitor != pool->monitor ||			\
+        stream->io.cl.shutdown ||				\
+        !TAILQ_EMPTY (&stream->inputs)) {
+        flm__Error = FLM_ERR_BUG;
+        goto close;
+    }
+    if ((dest = flm__ConnPoolFind (pool, address, port, true)) == NULL) {
+        goto close;
+    }
+    if (dest->max == 0) {
+        pool->stats.evictions++;
+        flm_StreamClose (stream);
+        return (0);
+    }
+
+    if ((entry = flm__Alloc (sizeof (struct flm__ConnPoolEntry))) == NULL) {
+        goto close;
+    }
+    entry->timer = NULL;
+    if (pool->timeout) {
+        entry->timer = flm_TimerNew (pool->monitor,		\
+                                     flm__ConnPoolIdleTimeout,	\
+                                     entry,			\
+                                     pool->timeout);
+        if (entry->timer == NULL) {
+            goto free_entry;
+        }
+    }
+
+    /**
+     * Any data or end of file on an idle connection closes it
+     */
+    flm_StreamFrameRead (stream, NULL);
+    flm_StreamHTTPRead (stream, NULL);
+    flm_StreamOnRead (stream, flm__ConnPoolIdleRead);
+    flm_StreamOnWrite (stream, NULL);
+    flm_StreamOnClose (stream, flm__ConnPoolIdleClose);
+    flm_StreamOnError (stream, NULL);
+    stream->io.state = entry;
+    flm_StreamResumeRead (stream);
+
+    entry->stream = flm_StreamRetain (stream);
+    entry->pool = pool;
+    entry->dest = dest;
+    TAILQ_INSERT_HEAD (&dest->idle, entry, entries);
+    dest->count++;
+    pool->stats.idle++;
+
+    if (dest->count > dest->max) {
+        pool->stats.evictions++;
+        flm__ConnPoolDrop (TAILQ_LAST (&dest->idle, cpid));
+    }
+    return (0);
+
+  free_entry:
+    flm__Free (entry);
+  close:
+    flm_StreamClose (stream);
+    return (-1);
+}
+
+void
+flm_ConnPoolClear (flm_ConnPool *	pool)
+{
+    struct flm__ConnPoolDest * dest;
+    size_t i;
+
+    for (i = 0; i < FLM__CONN_POOL_BUCKETS; i++) {
+        LIST_FOREACH (dest, &pool->buckets[i], bucket) {
+            while (!TAILQ_EMPTY (&dest->idle)) {
+                flm__ConnPoolDrop (TAILQ_FIRST (&dest->idle));
+            }
+        }
+    }
+    return ;
+}
+
+void
+flm_ConnPoolStats (flm_ConnPool *		pool,
+                   struct flm_ConnPoolStats *	stats)
+{
+    *stats = pool->stats;
+    return ;
+}
+
+flm_ConnPool *
+flm_ConnPoolRetain (flm_ConnPool *	pool)
+{
+    return (flm__Retain (&pool->obj));
+}
+
+void
+flm_ConnPoolRelease (flm_ConnPool *	pool)
+{
+    flm__Release (&pool->obj);
+    return ;
+}
+
+int
+flm__ConnPoolInit (flm_ConnPool *	pool,
+                   flm_Monitor *	monitor,
+                   size_t		max,
+                   uint32_t		timeout)
+{
+    size_t i;
+
+    flm__ObjInit (&pool->obj);
+    pool->obj.type = FLM__TYPE_CONN_POOL;
+    pool->obj.perf.destruct =					\
+        (flm__ObjPerfDestruct_f) flm__ConnPoolPerfDestruct;
+
+    pool->monitor = monitor;
+    pool->max = max;
+    pool->timeout = timeout;
+
+    for (i = 0; i < FLM__CONN_POOL_BUCKETS; i++) {
+        LIST_INIT (&pool->buckets[i]);
+    }
+    memset (&pool->stats, 0, sizeof (pool->stats));
+    return (0);
+}
+
+void
+flm__ConnPoolPerfDestruct (flm_ConnPool *	pool)
+{
+    struct flm__ConnPoolDest * dest;
+    size_t i;
+
+    flm_ConnPoolClear (pool);
+    for (i = 0; i < FLM__CONN_POOL_BUCKETS; i++) {
+        while ((dest = LIST_FIRST (&pool->buckets[i])) != NULL) {
+            LIST_REMOVE (dest, bucket);
+            flm__Free (dest);
+        }
+    }
+    return ;
+}
+
+uint32_t
+flm__ConnPoolHash (const char *		address,
+                   uint16_t		port)
+{
+    uint32_t hash;
+
+    /**
+     * FNV-1a over the address then the port
+     */
+    hash = 2166136261U;
+    for (; *address; address++) {
+        hash ^= (unsigned char) *address;
+        hash *= 16777619U;
+    }
+    hash ^= port & 0xff;
+    hash *= 16777619U;
+    hash ^= port >> 8;
+    hash *= 16777619U;
+    return (hash);
+}
+
+struct flm__ConnPoolDest *
+flm__ConnPoolFind (flm_ConnPool *	pool,
+                   const char *		address,
+                   uint16_t		port,
+                   bool			create)
+{
+    struct flm__ConnPoolDest * dest;
+    uint32_t hash;
+    size_t len;
+
+    hash = flm__ConnPoolHash (address, port);
+    LIST_FOREACH (dest,						\
+                  &pool->buckets[hash & (FLM__CONN_POOL_BUCKETS - 1)],	\
+                  bucket) {
+        if (dest->hash == hash &&				\
+            dest->port == port &&				\
+            strcmp (dest->address, address) == 0) {
+            return (dest);
+        }
+    }
+    if (!create) {
+        return (NULL);
+    }
+
+    /**
+     * Destinations are kept until the pool is destroyed, with their
+     * limit.
+     */
+    len = strlen (address) + 1;
+    dest = flm__Alloc (sizeof (struct flm__ConnPoolDest) + len);
+    if (dest == NULL) {
+        return (NULL);
+    }
+    dest->hash = hash;
+    dest->port = port;
+    dest->count = 0;
+    dest->max = pool->max;
+    TAILQ_INIT (&dest->idle);
+    memcpy (dest->address, address, len);
+    LIST_INSERT_HEAD (&pool->buckets[hash & (FLM__CONN_POOL_BUCKETS - 1)],	\
+                      dest,						\
+                      bucket);
+    return (dest);
+}
+
+flm_Stream *
+flm__ConnPoolUnpark (struct flm__ConnPoolEntry *	entry)
+{
+    flm_Stream * stream;
+
+    stream = entry->stream;
+
+    TAILQ_REMOVE (&entry->dest->idle, entry, entries);
+    entry->dest->count--;
+    entry->pool->stats.idle--;
+
+    if (entry->timer) {
+        flm_TimerCancel (entry->timer);
+        flm_TimerRelease (entry->timer);
+    }
+    flm__Free (entry);
+
+    flm_StreamOnRead (stream, NULL);
+    flm_StreamOnClose (stream, NULL);
+    stream->io.state = NULL;
+    return (stream);
+}
+
+void
+flm__ConnPoolDrop (struct flm__ConnPoolEntry *	entry)
+{
+    flm_Stream * stream;
+
+    stream = flm__ConnPoolUnpark (entry);
+    flm_StreamClose (stream);
+    flm_StreamRelease (stream);
+    return ;
+}
+
+void
+flm__ConnPoolIdleRead (flm_Stream *	stream,
+                       void *		state,
+                       flm_Buffer *	buffer)
+{
+    struct flm__ConnPoolEntry * entry;
+
+    (void) stream;
+
+    entry = state;
+    flm_BufferRelease (buffer);
+
+    entry->pool->stats.closed++;
+    flm__ConnPoolDrop (entry);
+    return ;
+}
+
+void
+flm__ConnPoolIdleClose (flm_Stream *	stream,
+                        void *		state)
+{
+    struct flm__ConnPoolEntry * entry;
+
+    (void) stream;
+
+    entry = state;
+    entry->pool->stats.closed++;
+    flm__ConnPoolDrop (entry);
+    return ;
+}
+
+void
+flm__ConnPoolIdleTimeout (flm_Timer *	timer,
+                          void *	state)
+{
+    struct flm__ConnPoolEntry * entry;
+
+    (void) timer;
+
+    entry = state;
+    entry->pool->stats.expirations++;
+    flm__ConnPoolDrop (entry);
+    return ;
+}
@@ -101,6 +101,7 @@ flm__EpollInit (flm__Epoll * epoll)
         (flm__MonitorWait_f) flm__EpollPerfWait;
 
     epoll->size = FLM__EPOLL_MAXEVENTS_DEFAULT;
+    epoll->ready = 0;
 
     if (epollCreateHandler == NULL) {
         flm__setEpollCreateHandler (epoll_create);
@@ -154,7 +155,17 @@ flm__EpollCtl (flm__Epoll * epoll,
     event.data.u64 = 0; /* makes valgrind happy */
     event.data.ptr = io;
 
-    event.events = EPOLLET | EPOLLIN | EPOLLRDHUP | EPOLLOUT;
+    /**
+     * Do not poll for events the IO is not interested in, they will be
+     * reported as soon as the IO is reset with the flags cleared.
+     */
+    event.events = EPOLLET | EPOLLRDHUP;
+    if (io->rd.want && !io->rd.hold) {
+        event.events |= EPOLLIN;
+    }
+    if (!io->wr.hold && !io->wr.pause) {
+        event.events |= EPOLLOUT;
+    }
     if (epollCtlHandler (epoll->epfd, op, io->sys.fd, &event) == -1) {
         flm__Error = FLM_ERR_ERRNO;
         return (-1);
@@ -177,6 +188,16 @@ int
 flm__EpollPerfDel (flm__Epoll * epoll,
                    flm_IO * io)
 {
+    int ev_count;
+
+    /**
+     * The IO may be freed before its own events are dispatched
+     */
+    for (ev_count = 0; ev_count < epoll->ready; ev_count++) {
+        if (epoll->events[ev_count].data.ptr == io) {
+            epoll->events[ev_count].data.ptr = NULL;
+        }
+    }
     if (flm__EpollCtl (epoll, io, EPOLL_CTL_DEL) == -1) {
         flm__Error = FLM_ERR_ERRNO;
         return (-1);
@@ -222,17 +243,36 @@ flm__EpollPerfWait (flm__Epoll * epoll)
         return (-1);
     }
 
+    epoll->ready = ev_max;
     for (ev_count = 0; ev_count < ev_max; ev_count++) {
         event = &epoll->events[ev_count];
         if ((io = ((flm_IO *) (event->data.ptr))) == NULL) {
             continue ;
         }
+        /**
+         * Handlers may close the IO and drop the last reference to it
+         */
+        flm_IORetain (io);
+        /**
+         * Something is waiting on the error queue of the socket
+         */
+        if ((event->events & EPOLLERR) && io->perf.error) {
+            io->perf.error (io, &epoll->monitor);
+        }
         if ((event->events & (EPOLLIN | EPOLLRDHUP)) &&                    \
             flm__IORead (io, &epoll->monitor) == io->rd.limit &&   \
             io->rd.can &&                                                  \
             flm__EpollPerfReset (epoll, io) == -1) {
             ret = -1;
         }
+        /**
+         * The hangup edge comes along with the last data, a short read
+         * must not hide it or the end of file would never be read.
+         */
+        if ((event->events & (EPOLLRDHUP | EPOLLHUP)) &&                   \
+            io->rd.want && !io->rd.hold && !io->cl.closed) {
+            flm__IORead (io, &epoll->monitor);
+        }
         if ((event->events & EPOLLOUT) &&                                  \
             flm__IOWrite (io, &epoll->monitor) == io->wr.limit &&  \
             io->wr.can &&                                                  \
@@ -243,6 +283,8 @@ flm__EpollPerfWait (flm__Epoll * epoll)
         if (io->cl.shutdown && !io->wr.want && !io->cl.closed) {
             flm__IOClose (io, &epoll->monitor);
         }
+        flm_IORelease (io);
     }
+    epoll->ready = 0;
     return (0);
 }
@@ -14,11 +14,17 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#if defined(linux)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
 #include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "flm/core/private/alloc.h"
+#include "flm/core/private/error.h"
 #include "flm/core/private/file.h"
 #include "flm/core/private/io.h"
 
@@ -56,6 +62,26 @@ flm_FileOpen (const char *      root,
     return (file);
 }
 
+int
+flm_FileDirect (flm_File *      file)
+{
+#if defined (O_DIRECT)
+    int flags;
+
+    if ((flags = fcntl (file->io.sys.fd, F_GETFL)) == -1 ||     \
+        fcntl (file->io.sys.fd, F_SETFL, flags | O_DIRECT) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (-1);
+    }
+    file->direct = true;
+    return (0);
+#else
+    (void) file;
+    flm__Error = FLM_ERR_NOSYS;
+    return (-1);
+#endif
+}
+
 flm_File *
 flm_FileRetain (flm_File * file)
 {
@@ -77,6 +103,9 @@ flm__FileInit (flm_File *       file,
         return (-1);
     }
     file->io.obj.type = FLM__TYPE_FILE;
+    file->sized = false;
+    file->size = 0;
+    file->direct = false;
     return (0);
 }
 
@@ -86,10 +115,40 @@ flm__FileInitOpen (flm_File *   file,
                    const char * path,
                    const char * mode)
 {
+    int dirfd;
     int fd;
-    int flags;
 
-    (void) root;
+    dirfd = AT_FDCWD;
+    if (root && *root) {
+        dirfd = open (root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirfd == -1) {
+            goto error;
+        }
+    }
+    fd = flm__FileOpenAt (dirfd, path, mode);
+    if (dirfd != AT_FDCWD) {
+        close (dirfd);
+    }
+    if (fd == -1) {
+        goto error;
+    }
+    if (flm__FileInit (file, fd) == -1) {
+        goto close_fd;
+    }
+    return (0);
+
+  close_fd:
+    close (fd);
+  error:
+    return (-1);
+}
+
+int
+flm__FileOpenAt (int            dirfd,
+                 const char *   path,
+                 const char *   mode)
+{
+    int flags;
 
     if (!strcmp (mode, "r")) {
         flags = O_RDONLY;
@@ -110,7 +169,8 @@ flm__FileInitOpen (flm_File *   file,
         flags = O_RDWR | O_APPEND | O_CREAT;
     }
     else {
-        goto error;
+        errno = EINVAL;
+        return (-1);
     }
 
 #ifdef O_CLOEXEC
@@ -118,24 +178,10 @@ flm__FileInitOpen (flm_File *   file,
 #endif
 
     if (flags & O_CREAT) {
-        fd = open (path, flags,        \
-                   S_IRUSR | S_IWUSR | \
-                   S_IRGRP | S_IWGRP | \
-                   S_IROTH | S_IWOTH);
-    }
-    else {
-        fd = open (path, flags);
+        return (openat (dirfd, path, flags,     \
+                        S_IRUSR | S_IWUSR |     \
+                        S_IRGRP | S_IWGRP |     \
+                        S_IROTH | S_IWOTH));
     }
-    if (fd == -1) {
-        goto error;
-    }
-    if (flm__FileInit (file, fd) == -1) {
-        goto close_fd;
-    }
-    return (0);
-
-  close_fd:
-    close (fd);
-  error:
-    return (-1);
+    return (openat (dirfd, path, flags));
 }
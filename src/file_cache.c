@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/queue.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(linux)
+# include <sys/syscall.h>
+# include <linux/openat2.h>
+#endif
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/file.h"
+#include "flm/core/private/file_cache.h"
+#include "flm/core/private/monitor.h"
+
+#if defined (SYS_openat2) && defined (RESOLVE_BENEATH)
+# define FLM_FILE_CACHE__BENEATH
+#endif
+
+flm_FileCache *
+flm_FileCacheNew (flm_Monitor *		monitor,
+                  const char *		root,
+                  size_t		max,
+                  uint32_t		validity)
+{
+    flm_FileCache * cache;
+
+    cache = flm__Alloc (sizeof (flm_FileCache));
+    if (cache == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (NULL);
+    }
+    if (flm__FileCacheInit (cache, monitor, root, max, validity) == -1) {
+        flm__Free (cache);
+        return (NULL);
+    }
+    return (cache);
+}
+
+flm_File *
+flm_FileCacheOpen (flm_FileCache *	cache,
+                   const char *		path,
+                   struct stat *	stat)
+{
+    struct flm__FileCacheEntry * entry;
+    uint32_t hash;
+
+    if (!flm__FileCacheValidPath (path)) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EINVAL;
+        return (NULL);
+    }
+
+    hash = flm__FileCacheHash (path);
+    entry = flm__FileCacheFind (cache, path, hash);
+    if (entry && flm__FileCacheCheck (cache, entry) == -1) {
+        cache->stats.stale++;
+        flm__FileCacheDrop (cache, entry);
+        entry = NULL;
+    }
+
+    if (entry) {
+        cache->stats.hits++;
+        TAILQ_REMOVE (&cache->lru, entry, lru);
+        TAILQ_INSERT_HEAD (&cache->lru, entry, lru);
+    }
+    else {
+        cache->stats.misses++;
+        if ((entry = flm__FileCacheAdd (cache, path, hash)) == NULL) {
+            return (NULL);
+        }
+    }
+
+    if (stat) {
+        memcpy (stat, &entry->stat, sizeof (struct stat));
+    }
+    return (flm_FileRetain (entry->file));
+}
+
+void
+flm_FileCacheClear (flm_FileCache *	cache)
+{
+    struct flm__FileCacheEntry * entry;
+
+    while ((entry = TAILQ_FIRST (&cache->lru)) != NULL) {
+        flm__FileCacheDrop (cache, entry);
+    }
+    return ;
+}
+
+void
+flm_FileCacheStats (flm_FileCache *		cache,
+                    struct flm_FileCacheStats *	stats)
+{
+    memcpy (stats, &cache->stats, sizeof (struct flm_FileCacheStats));
+    return ;
+}
+
+flm_FileCache *
+flm_FileCacheRetain (flm_FileCache *	cache)
+{
+    return (flm__Retain (&cache->obj));
+}
+
+void
+flm_FileCacheRelease (flm_FileCache *	cache)
+{
+    flm__Release (&cache->obj);
+    return ;
+}
+
+int
+flm__FileCacheInit (flm_FileCache *	cache,
+                    flm_Monitor *	monitor,
+                    const char *	root,
+                    size_t		max,
+                    uint32_t		validity)
+{
+    size_t nb_buckets;
+    size_t i;
+
+    if (max == 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EINVAL;
+        goto error;
+    }
+
+    flm__ObjInit (&cache->obj);
+
+    cache->obj.type = FLM__TYPE_FILE_CACHE;
+
+    cache->obj.perf.destruct =                                  \
+        (flm__ObjPerfDestruct_f) flm__FileCachePerfDestruct;
+
+    /**
+     * At most one entry per bucket on average
+     */
+    for (nb_buckets = 1; nb_buckets < max; nb_buckets <<= 1) {
+        continue ;
+    }
+    cache->buckets = flm__Alloc (nb_buckets * sizeof (*cache->buckets));
+    if (cache->buckets == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        goto error;
+    }
+    for (i = 0; i < nb_buckets; i++) {
+        LIST_INIT (&cache->buckets[i]);
+    }
+    cache->mask = nb_buckets - 1;
+    TAILQ_INIT (&cache->lru);
+
+    cache->dirfd = open (root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cache->dirfd == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto free_buckets;
+    }
+
+    cache->monitor = monitor;
+    cache->max = max;
+    cache->validity = validity;
+    memset (&cache->stats, 0, sizeof (cache->stats));
+    return (0);
+
+  free_buckets:
+    flm__Free (cache->buckets);
+  error:
+    return (-1);
+}
+
+void
+flm__FileCachePerfDestruct (flm_FileCache *	cache)
+{
+    flm_FileCacheClear (cache);
+    flm__Free (cache->buckets);
+    close (cache->dirfd);
+    return ;
+}
+
+bool
+flm__FileCacheValidPath (const char *	path)
+{
+    const char * component;
+
+    if (*path == '\0' || *path == '/') {
+        return (false);
+    }
+
+    /**
+     * Nothing above the root
+     */
+    for (component = path; component; component = strchr (component, '/')) {
+        if (*component == '/') {
+            component++;
+        }
+        if (component[0] == '.' && component[1] == '.' &&     \
+            (component[2] == '/' || component[2] == '\0')) {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+int
+flm__FileCacheOpenAt (flm_FileCache *	cache,
+                      const char *	path)
+{
+#if defined (FLM_FILE_CACHE__BENEATH)
+    struct open_how how;
+    int fd;
+
+    /**
+     * The kernel refuses anything resolved out of the root, symbolic
+     * links included. Older kernels follow them as openat(2) does.
+     */
+    memset (&how, 0, sizeof (how));
+    how.flags = O_RDONLY | O_CLOEXEC;
+    how.resolve = RESOLVE_BENEATH;
+    fd = syscall (SYS_openat2, cache->dirfd, path, &how, sizeof (how));
+    if (fd != -1 || errno != ENOSYS) {
+        return (fd);
+    }
+#endif
+    return (flm__FileOpenAt (cache->dirfd, path, "r"));
+}
+
+uint32_t
+flm__FileCacheHash (const char *	path)
+{
+    uint32_t hash;
+
+    /**
+     * FNV-1a
+     */
+    hash = 2166136261U;
+    for (; *path; path++) {
+        hash ^= (unsigned char) *path;
+        hash *= 16777619U;
+    }
+    return (hash);
+}
+
+uint64_t
+flm__FileCacheNow (flm_FileCache *	cache)
+{
+    struct timespec * current;
+
+    /**
+     * Updated once per loop iteration, this does not cost any syscall
+     */
+    current = &cache->monitor->tm.current;
+    return ((current->tv_sec * 1000) + (current->tv_nsec / 1000000));
+}
+
+struct flm__FileCacheEntry *
+flm__FileCacheFind (flm_FileCache *	cache,
+                    const char *	path,
+                    uint32_t		hash)
+{
+    struct flm__FileCacheEntry * entry;
+
+    LIST_FOREACH (entry, &cache->buckets[hash & cache->mask], bucket) {
+        if (entry->hash == hash && strcmp (entry->path, path) == 0) {
+            return (entry);
+        }
+    }
+    return (NULL);
+}
+
+int
+flm__FileCacheCheck (flm_FileCache *			cache,
+                     struct flm__FileCacheEntry *	entry)
+{
+    struct stat stat;
+    uint64_t now;
+
+    if (cache->validity == 0) {
+        return (0);
+    }
+    now = flm__FileCacheNow (cache);
+    if (now - entry->checked < cache->validity) {
+        return (0);
+    }
+
+    cache->stats.revalidations++;
+    if (fstatat (cache->dirfd, entry->path, &stat, 0) == -1 ||  \
+        stat.st_dev != entry->stat.st_dev ||                    \
+        stat.st_ino != entry->stat.st_ino) {
+        return (-1);
+    }
+
+    /**
+     * Modified in place, the descriptor still points to the right file
+     */
+    memcpy (&entry->stat, &stat, sizeof (struct stat));
+    entry->file->size = stat.st_size;
+    entry->checked = now;
+    return (0);
+}
+
+struct flm__FileCacheEntry *
+flm__FileCacheAdd (flm_FileCache *	cache,
+                   const char *		path,
+                   uint32_t		hash)
+{
+    struct flm__FileCacheEntry * entry;
+    size_t len;
+    int fd;
+
+    len = strlen (path);
+    entry = flm__Alloc (sizeof (struct flm__FileCacheEntry) + len + 1);
+    if (entry == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        goto error;
+    }
+
+    if ((fd = flm__FileCacheOpenAt (cache, path)) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto free_entry;
+    }
+    if (fstat (fd, &entry->stat) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto close_fd;
+    }
+    if (!S_ISREG (entry->stat.st_mode)) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = S_ISDIR (entry->stat.st_mode) ? EISDIR : EINVAL;
+        goto close_fd;
+    }
+    if ((entry->file = flm_FileNew (fd)) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        goto close_fd;
+    }
+    entry->file->sized = true;
+    entry->file->size = entry->stat.st_size;
+
+    if (cache->stats.open == cache->max) {
+        cache->stats.evictions++;
+        flm__FileCacheDrop (cache, TAILQ_LAST (&cache->lru, fclr));
+    }
+
+    entry->checked = cache->validity ? flm__FileCacheNow (cache) : 0;
+    entry->hash = hash;
+    memcpy (entry->path, path, len + 1);
+    LIST_INSERT_HEAD (&cache->buckets[hash & cache->mask], entry, bucket);
+    TAILQ_INSERT_HEAD (&cache->lru, entry, lru);
+    cache->stats.open++;
+    return (entry);
+
+  close_fd:
+    close (fd);
+  free_entry:
+    flm__Free (entry);
+  error:
+    return (NULL);
+}
+
+void
+flm__FileCacheDrop (flm_FileCache *			cache,
+                    struct flm__FileCacheEntry *	entry)
+{
+    LIST_REMOVE (entry, bucket);
+    TAILQ_REMOVE (&cache->lru, entry, lru);
+    cache->stats.open--;
+    flm_FileRelease (entry->file);
+    flm__Free (entry);
+    return ;
+}
@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if defined(linux)
+#define _GNU_SOURCE
+#endif
+
+#include <sys/queue.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/buffer.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/file.h"
+#include "flm/core/private/file_queue.h"
+#include "flm/core/private/io.h"
+#include "flm/core/private/monitor.h"
+#include "flm/core/private/obj.h"
+
+flm_FileQueue *
+flm_FileQueueNew (flm_Monitor *         monitor,
+                  uint32_t              threads)
+{
+    flm_FileQueue * file_queue;
+
+    if ((file_queue = flm__Alloc (sizeof (flm_FileQueue))) == NULL) {
+        return (NULL);
+    }
+    if (flm__FileQueueInit (file_queue, monitor, threads) == -1) {
+        flm__Free (file_queue);
+        return (NULL);
+    }
+    return (file_queue);
+}
+
+int
+flm_FileQueueRead (flm_FileQueue *              file_queue,
+                   flm_File *                   file,
+                   flm_Buffer *                 buffer,
+                   off_t                        off,
+                   flm_FileQueueHandler         handler,
+                   void *                       state)
+{
+    return (flm__FileQueuePush (file_queue,
+                                FLM__FILE_QUEUE_READ,
+                                file,
+                                buffer,
+                                off,
+                                0,
+                                handler,
+                                state));
+}
+
+int
+flm_FileQueueWrite (flm_FileQueue *             file_queue,
+                    flm_File *                  file,
+                    flm_Buffer *                buffer,
+                    off_t                       off,
+                    flm_FileQueueHandler        handler,
+                    void *                      state)
+{
+    return (flm__FileQueuePush (file_queue,
+                                FLM__FILE_QUEUE_WRITE,
+                                file,
+                                buffer,
+                                off,
+                                0,
+                                handler,
+                                state));
+}
+
+int
+flm_FileQueueSync (flm_FileQueue *              file_queue,
+                   flm_File *                   file,
+                   flm_FileQueueHandler         handler,
+                   void *                       state)
+{
+    return (flm__FileQueuePush (file_queue,
+                                FLM__FILE_QUEUE_SYNC,
+                                file,
+                                NULL,
+                                0,
+                                0,
+                                handler,
+                                state));
+}
+
+int
+flm_FileQueuePrefetch (flm_FileQueue *          file_queue,
+                       flm_File *               file,
+                       off_t                    off,
+                       size_t                   count,
+                       flm_FileQueueHandler     handler,
+                       void *                   state)
+{
+    return (flm__FileQueuePush (file_queue,
+                                FLM__FILE_QUEUE_PREFETCH,
+                                file,
+                                NULL,
+                                off,
+                                count,
+                                handler,
+                                state));
+}
+
+void
+flm_FileQueueStats (flm_FileQueue *             file_queue,
+                    struct flm_FileQueueStats * stats)
+{
+    memcpy (stats, &file_queue->stats, sizeof (struct flm_FileQueueStats));
+    stats->pending = file_queue->pending;
+    return ;
+}
+
+flm_FileQueue *
+flm_FileQueueRetain (flm_FileQueue *            file_queue)
+{
+    return (flm__Retain (&file_queue->obj));
+}
+
+void
+flm_FileQueueRelease (flm_FileQueue *           file_queue)
+{
+    flm__Release (&file_queue->obj);
+    return ;
+}
+
+int
+flm__FileQueueInit (flm_FileQueue *     file_queue,
+                    flm_Monitor *       monitor,
+                    uint32_t            threads)
+{
+    int wakeup[2];
+    uint32_t count;
+
+    if (threads == 0) {
+        threads = FLM__FILE_QUEUE_THREADS;
+    }
+    if (threads > FLM__FILE_QUEUE_THREADS_MAX) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EINVAL;
+        goto error;
+    }
+
+    flm__ObjInit (&file_queue->obj);
+
+    file_queue->obj.type = FLM__TYPE_FILE_QUEUE;
+
+    file_queue->obj.perf.destruct =                             \
+        (flm__ObjPerfDestruct_f) flm__FileQueuePerfDestruct;
+
+    file_queue->monitor = monitor;
+    file_queue->pending = 0;
+    memset (&file_queue->stats, 0, sizeof (file_queue->stats));
+    file_queue->stop = false;
+    file_queue->count = threads;
+    TAILQ_INIT (&file_queue->jobs);
+    TAILQ_INIT (&file_queue->done);
+
+    if (pipe (wakeup) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto error;
+    }
+    if (fcntl (wakeup[0], F_SETFL, O_NONBLOCK) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto close_pipe;
+    }
+
+    /**
+     * Not watched by the monitor until something is queued
+     */
+    if ((file_queue->wk.io = flm_IONew (NULL, wakeup[0], file_queue)) == NULL) {
+        goto close_pipe;
+    }
+    flm_IOOnRead (file_queue->wk.io, flm__FileQueueComplete);
+    file_queue->wk.in = wakeup[1];
+    file_queue->wk.watched = false;
+
+    file_queue->threads = flm__Alloc (threads * sizeof (pthread_t));
+    if (file_queue->threads == NULL) {
+        goto release_io;
+    }
+    if (pthread_mutex_init (&file_queue->lock, NULL) != 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto free_threads;
+    }
+    if (pthread_cond_init (&file_queue->cond, NULL) != 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto destroy_lock;
+    }
+    for (count = 0; count < threads; count++) {
+        if ((errno = pthread_create (&file_queue->threads[count],
+                                     NULL,
+                                     flm__FileQueueRoutine,
+                                     file_queue)) != 0) {
+            flm__Error = FLM_ERR_ERRNO;
+            goto stop_threads;
+        }
+    }
+    return (0);
+
+  stop_threads:
+    flm__FileQueueStop (file_queue, count);
+    pthread_cond_destroy (&file_queue->cond);
+  destroy_lock:
+    pthread_mutex_destroy (&file_queue->lock);
+  free_threads:
+    flm__Free (file_queue->threads);
+  release_io:
+    flm_IORelease (file_queue->wk.io);
+    close (wakeup[1]);
+    goto error;
+  close_pipe:
+    close (wakeup[0]);
+    close (wakeup[1]);
+  error:
+    return (-1);
+}
+
+void
+flm__FileQueuePerfDestruct (flm_FileQueue *     file_queue)
+{
+    /**
+     * Every pending job holds a reference to the queue, the helper
+     * threads are all waiting.
+     */
+    flm__FileQueueStop (file_queue, file_queue->count);
+    pthread_cond_destroy (&file_queue->cond);
+    pthread_mutex_destroy (&file_queue->lock);
+    flm__Free (file_queue->threads);
+
+    if (file_queue->wk.watched) {
+        flm__MonitorIODelete (file_queue->monitor, file_queue->wk.io);
+    }
+    flm_IORelease (file_queue->wk.io);
+    close (file_queue->wk.in);
+    return ;
+}
+
+int
+flm__FileQueuePush (flm_FileQueue *             file_queue,
+                    enum flm__FileQueueOp       op,
+                    flm_File *                  file,
+                    flm_Buffer *                buffer,
+                    off_t                       off,
+                    size_t                      count,
+                    flm_FileQueueHandler        handler,
+                    void *                      state)
+{
+    struct flm__FileQueueJob * job;
+
+    if ((job = flm__Alloc (sizeof (struct flm__FileQueueJob))) == NULL) {
+        goto error;
+    }
+    if (!file_queue->wk.watched) {
+        if (flm__MonitorIOAdd (file_queue->monitor, file_queue->wk.io) == -1) {
+            goto free_job;
+        }
+        file_queue->wk.io->monitor = file_queue->monitor;
+        file_queue->wk.watched = true;
+    }
+
+    job->op = op;
+    job->file = flm_FileRetain (file);
+    job->buffer = buffer ? flm_BufferRetain (buffer) : NULL;
+    job->off = off;
+    job->count = count;
+    job->handler = handler;
+    job->state = state;
+    job->result = 0;
+    job->error = 0;
+
+    flm_FileQueueRetain (file_queue);
+    file_queue->pending++;
+    file_queue->stats.operations++;
+
+    pthread_mutex_lock (&file_queue->lock);
+    TAILQ_INSERT_TAIL (&file_queue->jobs, job, entries);
+    pthread_cond_signal (&file_queue->cond);
+    pthread_mutex_unlock (&file_queue->lock);
+    return (0);
+
+  free_job:
+    flm__Free (job);
+  error:
+    return (-1);
+}
+
+void
+flm__FileQueueStop (flm_FileQueue *     file_queue,
+                    uint32_t            count)
+{
+    pthread_mutex_lock (&file_queue->lock);
+    file_queue->stop = true;
+    pthread_cond_broadcast (&file_queue->cond);
+    pthread_mutex_unlock (&file_queue->lock);
+
+    while (count) {
+        pthread_join (file_queue->threads[--count], NULL);
+    }
+    return ;
+}
+
+void *
+flm__FileQueueRoutine (void *   _file_queue)
+{
+    flm_FileQueue *             file_queue;
+    struct flm__FileQueueJob *  job;
+    bool                        wake;
+
+    file_queue = _file_queue;
+    for (;;) {
+        pthread_mutex_lock (&file_queue->lock);
+        while (!file_queue->stop && TAILQ_EMPTY (&file_queue->jobs)) {
+            pthread_cond_wait (&file_queue->cond, &file_queue->lock);
+        }
+        if (file_queue->stop) {
+            pthread_mutex_unlock (&file_queue->lock);
+            break ;
+        }
+        job = TAILQ_FIRST (&file_queue->jobs);
+        TAILQ_REMOVE (&file_queue->jobs, job, entries);
+        pthread_mutex_unlock (&file_queue->lock);
+
+        flm__FileQueueRun (job);
+
+        /**
+         * The monitor takes every completed job at once, it only has to be
+         * woken up for the first one.
+         */
+        pthread_mutex_lock (&file_queue->lock);
+        wake = TAILQ_EMPTY (&file_queue->done);
+        TAILQ_INSERT_TAIL (&file_queue->done, job, entries);
+        pthread_mutex_unlock (&file_queue->lock);
+
+        while (wake && write (file_queue->wk.in, "0", 1) == -1) {
+            if (errno != EINTR) {
+                break ;
+            }
+        }
+    }
+    return (NULL);
+}
+
+void
+flm__FileQueueRun (struct flm__FileQueueJob *   job)
+{
+    ssize_t     count;
+    size_t      length;
+    char *      content;
+    int         fd;
+
+    fd = job->file->io.sys.fd;
+    if (job->op == FLM__FILE_QUEUE_SYNC) {
+        while ((job->result = fsync (fd)) == -1 && errno == EINTR);
+        job->error = errno;
+        return ;
+    }
+    if (job->op == FLM__FILE_QUEUE_PREFETCH) {
+        flm__FileQueuePrefetchRange (job);
+        return ;
+    }
+
+    content = flm_BufferContent (job->buffer);
+    length = flm_BufferLength (job->buffer);
+    job->result = 0;
+    while ((size_t) job->result < length) {
+        if (job->op == FLM__FILE_QUEUE_READ) {
+            count = pread (fd,
+                           content + job->result,
+                           length - job->result,
+                           job->off + job->result);
+        }
+        else {
+            count = pwrite (fd,
+                            content + job->result,
+                            length - job->result,
+                            job->off + job->result);
+        }
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue ;
+            }
+            /**
+             * Keep what was done before the error
+             */
+            if (job->result == 0) {
+                job->result = -1;
+                job->error = errno;
+            }
+            break ;
+        }
+        if (count == 0) {
+            /* end of file */
+            break ;
+        }
+        job->result += count;
+    }
+    return ;
+}
+
+void
+flm__FileQueuePrefetchRange (struct flm__FileQueueJob *        job)
+{
+    char        scratch[FLM__FILE_QUEUE_PREFETCH_SIZE];
+    ssize_t     count;
+    size_t      size;
+    int         fd;
+
+    fd = job->file->io.sys.fd;
+
+    /**
+     * Start the reads of the whole range at once, then wait for them by
+     * reading the range for real, the data is thrown away.
+     */
+#if defined(linux)
+    readahead (fd, job->off, job->count);
+#else
+    posix_fadvise (fd, job->off, job->count, POSIX_FADV_WILLNEED);
+#endif
+    job->result = 0;
+    while ((size_t) job->result < job->count) {
+        size = job->count - job->result;
+        if (size > sizeof (scratch)) {
+            size = sizeof (scratch);
+        }
+        count = pread (fd, scratch, size, job->off + job->result);
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue ;
+            }
+            if (job->result == 0) {
+                job->result = -1;
+                job->error = errno;
+            }
+            break ;
+        }
+        if (count == 0) {
+            break ;
+        }
+        job->result += count;
+    }
+    return ;
+}
+
+void
+flm__FileQueueComplete (flm_IO *        io,
+                        void *          _file_queue)
+{
+    flm_FileQueue *             file_queue;
+    struct flm__FileQueueJob *  job;
+    TAILQ_HEAD (fqcp, flm__FileQueueJob) done;
+    char                        drain[64];
+
+    file_queue = _file_queue;
+
+    while (read (io->sys.fd, drain, sizeof (drain)) > 0);
+
+    TAILQ_INIT (&done);
+    pthread_mutex_lock (&file_queue->lock);
+    while ((job = TAILQ_FIRST (&file_queue->done)) != NULL) {
+        TAILQ_REMOVE (&file_queue->done, job, entries);
+        TAILQ_INSERT_TAIL (&done, job, entries);
+    }
+    pthread_mutex_unlock (&file_queue->lock);
+
+    /**
+     * Every job holds a reference to the queue, the last one may be
+     * dropped by the handlers.
+     */
+    flm_FileQueueRetain (file_queue);
+    while ((job = TAILQ_FIRST (&done)) != NULL) {
+        TAILQ_REMOVE (&done, job, entries);
+        file_queue->pending--;
+
+        if (job->handler) {
+            errno = job->error;
+            job->handler (job->file, job->state, job->buffer, job->result);
+        }
+        if (job->buffer) {
+            flm_BufferRelease (job->buffer);
+        }
+        flm_FileRelease (job->file);
+        flm__Free (job);
+        flm_FileQueueRelease (file_queue);
+    }
+
+    /**
+     * Let the monitor return once nothing is pending
+     */
+    if (file_queue->pending == 0 && file_queue->wk.watched) {
+        file_queue->wk.watched = false;
+        flm__MonitorIODelete (file_queue->monitor, io);
+        io->monitor = NULL;
+    }
+    flm_FileQueueRelease (file_queue);
+    return ;
+}
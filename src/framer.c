@@ -0,0 +1,571 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/buffer.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/framer.h"
+#include "flm/core/private/obj.h"
+#include "flm/core/private/scan.h"
+
+flm_Framer *
+flm_FramerLengthNew (size_t             width,
+                     size_t             max)
+{
+    flm_Framer * framer;
+
+    if (width != 1 && width != 2 && width != 4 && width != 8) {
+        flm__Error = FLM_ERR_BUG;
+        return (NULL);
+    }
+    if ((framer = flm__Alloc (sizeof (flm_Framer))) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (NULL);
+    }
+    if (flm__FramerInit (framer, FLM__FRAMER_TYPE_LENGTH, max) == -1) {
+        flm__Free (framer);
+        return (NULL);
+    }
+    framer->format.length.width = width;
+    return (framer);
+}
+
+flm_Framer *
+flm_FramerVarintNew (size_t             max)
+{
+    flm_Framer * framer;
+
+    if ((framer = flm__Alloc (sizeof (flm_Framer))) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (NULL);
+    }
+    if (flm__FramerInit (framer, FLM__FRAMER_TYPE_VARINT, max) == -1) {
+        flm__Free (framer);
+        return (NULL);
+    }
+    return (framer);
+}
+
+flm_Framer *
+flm_FramerDelimiterNew (const char *    delimiter,
+                        size_t          length,
+                        size_t          max)
+{
+    flm_Framer * framer;
+
+    if (length == 0) {
+        flm__Error = FLM_ERR_BUG;
+        goto error;
+    }
+    if ((framer = flm__Alloc (sizeof (flm_Framer))) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        goto error;
+    }
+    if (flm__FramerInit (framer, FLM__FRAMER_TYPE_DELIMITER, max) == -1) {
+        goto free_framer;
+    }
+    framer->format.delimiter.content = flm__Alloc (length);
+    if (framer->format.delimiter.content == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        goto free_framer;
+    }
+    memcpy (framer->format.delimiter.content, delimiter, length);
+    framer->format.delimiter.len = length;
+    return (framer);
+
+  free_framer:
+    flm__Free (framer);
+  error:
+    return (NULL);
+}
+
+flm_Framer *
+flm_FramerLineNew (size_t               max)
+{
+    flm_Framer * framer;
+
+    if ((framer = flm_FramerDelimiterNew ("\n", 1, max)) == NULL) {
+        return (NULL);
+    }
+    framer->type = FLM__FRAMER_TYPE_LINE;
+    return (framer);
+}
+
+int
+flm_FramerFeed (flm_Framer *            framer,
+                flm_Buffer *            buffer,
+                flm_FramerHandler       handler,
+                void *                  state)
+{
+    int ret;
+
+    if (framer->failed) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+
+    /**
+     * The handler may drop the last reference to the framer
+     */
+    flm_FramerRetain (framer);
+    if (framer->type == FLM__FRAMER_TYPE_DELIMITER ||
+        framer->type == FLM__FRAMER_TYPE_LINE) {
+        ret = flm__FramerFeedDelimiter (framer, buffer, handler, state);
+    }
+    else {
+        ret = flm__FramerFeedLength (framer, buffer, handler, state);
+    }
+    if (ret == -1) {
+        flm__FramerFail (framer);
+    }
+    flm_FramerRelease (framer);
+    return (ret);
+}
+
+flm_Framer *
+flm_FramerRetain (flm_Framer *          framer)
+{
+    return (flm__Retain (&framer->obj));
+}
+
+void
+flm_FramerRelease (flm_Framer *         framer)
+{
+    flm__Release (&framer->obj);
+    return ;
+}
+
+int
+flm__FramerInit (flm_Framer *           framer,
+                 int                    type,
+                 size_t                 max)
+{
+    if (max == 0) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+
+    flm__ObjInit (&framer->obj);
+
+    framer->obj.type = FLM__TYPE_FRAMER;
+
+    framer->obj.perf.destruct =                                 \
+        (flm__ObjPerfDestruct_f) flm__FramerPerfDestruct;
+
+    framer->type = type;
+    framer->max = max;
+    framer->failed = false;
+
+    framer->format.delimiter.content = NULL;
+    framer->format.delimiter.len = 0;
+
+    framer->partial.header_len = 0;
+    framer->partial.content = NULL;
+    framer->partial.len = 0;
+    framer->partial.size = 0;
+    framer->partial.need = 0;
+    return (0);
+}
+
+void
+flm__FramerPerfDestruct (flm_Framer *   framer)
+{
+    if (framer->type == FLM__FRAMER_TYPE_DELIMITER ||
+        framer->type == FLM__FRAMER_TYPE_LINE) {
+        flm__Free (framer->format.delimiter.content);
+    }
+    if (framer->partial.content) {
+        flm__Free (framer->partial.content);
+    }
+    return ;
+}
+
+int
+flm__FramerHeader (flm_Framer *                 framer,
+                   const unsigned char *        content,
+                   size_t                       len,
+                   size_t *                     header_len,
+                   uint64_t *                   frame_len)
+{
+    uint64_t    value;
+    size_t      i;
+
+    value = 0;
+    if (framer->type == FLM__FRAMER_TYPE_LENGTH) {
+        if (len < framer->format.length.width) {
+            return (0);
+        }
+        for (i = 0; i < framer->format.length.width; i++) {
+            value = (value << 8) | content[i];
+        }
+        *header_len = framer->format.length.width;
+        *frame_len = value;
+        return (1);
+    }
+
+    for (i = 0; i < len && i < FLM__FRAMER_HEADER_SIZE; i++) {
+        value |= (uint64_t)(content[i] & 0x7F) << (7 * i);
+        if ((content[i] & 0x80) == 0) {
+            /**
+             * The tenth byte can only hold the last bit of a 64 bits
+             * length.
+             */
+            if (i == FLM__FRAMER_HEADER_SIZE - 1 && content[i] > 1) {
+                return (-1);
+            }
+            *header_len = i + 1;
+            *frame_len = value;
+            return (1);
+        }
+    }
+    return (i == FLM__FRAMER_HEADER_SIZE ? -1 : 0);
+}
+
+int
+flm__FramerFeedLength (flm_Framer *             framer,
+                       flm_Buffer *             buffer,
+                       flm_FramerHandler        handler,
+                       void *                   state)
+{
+    const unsigned char *       content;
+    size_t                      len;
+    size_t                      off;
+
+    size_t                      count;
+    size_t                      header_len;
+    uint64_t                    frame_len;
+    int                         ret;
+
+    flm_Buffer *                frame;
+
+    content = (const unsigned char *) flm_BufferContent (buffer);
+    len = flm_BufferLength (buffer);
+
+    for (off = 0; off < len; ) {
+        if (framer->partial.content) {
+            /**
+             * Copy the rest of a frame started in a previous buffer
+             */
+            count = framer->partial.need - framer->partial.len;
+            if (count > len - off) {
+                count = len - off;
+            }
+            memcpy (&framer->partial.content[framer->partial.len],
+                    &content[off],
+                    count);
+            framer->partial.len += count;
+            off += count;
+            if (framer->partial.len < framer->partial.need) {
+                break ;
+            }
+            frame = flm_BufferNew (framer->partial.content,
+                                   framer->partial.len,
+                                   flm__Free);
+            if (frame == NULL) {
+                return (-1);
+            }
+            framer->partial.content = NULL;
+            framer->partial.len = 0;
+            framer->partial.size = 0;
+            handler (state, frame);
+            continue ;
+        }
+
+        if (framer->partial.header_len == 0) {
+            ret = flm__FramerHeader (framer,
+                                     &content[off],
+                                     len - off,
+                                     &header_len,
+                                     &frame_len);
+            if (ret == 0) {
+                /* the prefix itself is cut, it cannot be longer than this */
+                memcpy (framer->partial.header, &content[off], len - off);
+                framer->partial.header_len = len - off;
+                break ;
+            }
+        }
+        else {
+            framer->partial.header[framer->partial.header_len++] =  \
+                content[off];
+            ret = flm__FramerHeader (framer,
+                                     framer->partial.header,
+                                     framer->partial.header_len,
+                                     &header_len,
+                                     &frame_len);
+            if (ret == 0) {
+                off++;
+                continue ;
+            }
+            /* only the last byte of the prefix comes from this buffer */
+            framer->partial.header_len = 0;
+            header_len = 1;
+        }
+        if (ret == -1 || frame_len > framer->max) {
+            flm__Error = FLM_ERR_ERRNO;
+            errno = EMSGSIZE;
+            return (-1);
+        }
+        off += header_len;
+
+        if (frame_len <= len - off) {
+            /**
+             * The whole frame is in this buffer, no copy needed
+             */
+            if ((frame = flm_BufferView (buffer, off, frame_len)) == NULL) {
+                return (-1);
+            }
+            off += frame_len;
+            handler (state, frame);
+            continue ;
+        }
+
+        /**
+         * The frame crosses the end of the buffer, its length is known
+         * so it is allocated once.
+         */
+        if (flm__FramerReserve (framer, frame_len) == -1) {
+            return (-1);
+        }
+        framer->partial.need = frame_len;
+    }
+    return (0);
+}
+
+int
+flm__FramerFeedDelimiter (flm_Framer *          framer,
+                          flm_Buffer *          buffer,
+                          flm_FramerHandler     handler,
+                          void *                state)
+{
+    const char *        content;
+    size_t              len;
+    size_t              off;
+
+    const char *        delimiter;
+    size_t              delimiter_len;
+
+    const char *        found;
+    size_t              scan;
+    size_t              count;
+    size_t              frame_len;
+    size_t              trim_len;
+    size_t              bound;
+
+    flm_Buffer *        frame;
+
+    content = flm_BufferContent (buffer);
+    len = flm_BufferLength (buffer);
+
+    delimiter = framer->format.delimiter.content;
+    delimiter_len = framer->format.delimiter.len;
+
+    /**
+     * The most a frame can hold before its delimiter is complete, the
+     * carriage return of a line is not counted in its length.
+     */
+    bound = framer->max + delimiter_len - 1;
+    if (framer->type == FLM__FRAMER_TYPE_LINE) {
+        bound++;
+    }
+
+    for (off = 0; off < len; ) {
+        found = flm__FramerSearch (&content[off],
+                                   len - off,
+                                   delimiter,
+                                   delimiter_len);
+
+        if (framer->partial.content == NULL) {
+            if (found) {
+                /**
+                 * The whole frame is in this buffer, no copy needed
+                 */
+                frame_len = found - &content[off];
+                trim_len = flm__FramerTrim (framer, &content[off], frame_len);
+                if (trim_len > framer->max) {
+                    goto too_long;
+                }
+                if ((frame = flm_BufferView (buffer, off, trim_len)) == NULL) {
+                    return (-1);
+                }
+                off += frame_len + delimiter_len;
+                handler (state, frame);
+                continue ;
+            }
+            /**
+             * The end of the buffer may be the beginning of the delimiter
+             */
+            if (len - off > bound) {
+                goto too_long;
+            }
+            if (flm__FramerReserve (framer, len - off) == -1) {
+                return (-1);
+            }
+            memcpy (framer->partial.content, &content[off], len - off);
+            framer->partial.len = len - off;
+            break ;
+        }
+
+        /**
+         * Append up to the first delimiter of this buffer, the delimiter
+         * may also have been cut between the two buffers so the search
+         * starts a bit before the new data.
+         */
+        count = found ? (size_t)(found - &content[off]) + delimiter_len : \
+            len - off;
+        scan = framer->partial.len >= delimiter_len ?                   \
+            framer->partial.len - delimiter_len + 1 : 0;
+
+        if (flm__FramerReserve (framer, framer->partial.len + count) == -1) {
+            return (-1);
+        }
+        memcpy (&framer->partial.content[framer->partial.len],
+                &content[off],
+                count);
+
+        found = flm__FramerSearch (&framer->partial.content[scan],
+                                   framer->partial.len + count - scan,
+                                   delimiter,
+                                   delimiter_len);
+        if (found == NULL) {
+            framer->partial.len += count;
+            off += count;
+            if (framer->partial.len > bound) {
+                goto too_long;
+            }
+            continue ;
+        }
+        frame_len = found - framer->partial.content;
+        trim_len = flm__FramerTrim (framer, framer->partial.content, frame_len);
+        if (trim_len > framer->max) {
+            goto too_long;
+        }
+        off += frame_len + delimiter_len - framer->partial.len;
+
+        frame = flm_BufferNew (framer->partial.content, trim_len, flm__Free);
+        if (frame == NULL) {
+            return (-1);
+        }
+        framer->partial.content = NULL;
+        framer->partial.len = 0;
+        framer->partial.size = 0;
+        handler (state, frame);
+    }
+    return (0);
+
+  too_long:
+    flm__Error = FLM_ERR_ERRNO;
+    errno = EMSGSIZE;
+    return (-1);
+}
+
+int
+flm__FramerReserve (flm_Framer *        framer,
+                    size_t              size)
+{
+    char *      content;
+    size_t      alloc;
+
+    if (size <= framer->partial.size) {
+        return (0);
+    }
+
+    /**
+     * Delimited frames grow until their end is found, the length
+     * prefixed ones are allocated at their final size.
+     */
+    alloc = size;
+    if (framer->type != FLM__FRAMER_TYPE_LENGTH &&
+        framer->type != FLM__FRAMER_TYPE_VARINT) {
+        alloc = framer->partial.size ? framer->partial.size * 2 :    \
+            FLM__FRAMER_PARTIAL_SIZE;
+        if (alloc < size) {
+            alloc = size;
+        }
+    }
+    if ((content = flm__Alloc (alloc ? alloc : 1)) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (-1);
+    }
+    if (framer->partial.content) {
+        memcpy (content, framer->partial.content, framer->partial.len);
+        flm__Free (framer->partial.content);
+    }
+    framer->partial.content = content;
+    framer->partial.size = alloc;
+    return (0);
+}
+
+const char *
+flm__FramerSearch (const char *         content,
+                   size_t               len,
+                   const char *         delimiter,
+                   size_t               delimiter_len)
+{
+    const char *        cur;
+    const char *        end;
+
+    if (delimiter_len == 1) {
+        return (flm_ScanByte (content, len, delimiter[0]));
+    }
+
+    /**
+     * Look for the first two bytes, then check the rest
+     */
+    end = content + len;
+    for (cur = content;
+         (cur = flm_ScanPair (cur, end - cur, delimiter[0], delimiter[1]));
+         cur++) {
+        if ((size_t)(end - cur) < delimiter_len) {
+            return (NULL);
+        }
+        if (memcmp (cur + 2, delimiter + 2, delimiter_len - 2) == 0) {
+            return (cur);
+        }
+    }
+    return (NULL);
+}
+
+size_t
+flm__FramerTrim (flm_Framer *           framer,
+                 const char *           content,
+                 size_t                 len)
+{
+    if (framer->type == FLM__FRAMER_TYPE_LINE && len &&     \
+        content[len - 1] == '\r') {
+        return (len - 1);
+    }
+    return (len);
+}
+
+void
+flm__FramerFail (flm_Framer *           framer)
+{
+    framer->failed = true;
+    if (framer->partial.content) {
+        flm__Free (framer->partial.content);
+        framer->partial.content = NULL;
+    }
+    framer->partial.header_len = 0;
+    framer->partial.len = 0;
+    framer->partial.size = 0;
+    return ;
+}
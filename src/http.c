@@ -0,0 +1,959 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/buffer.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/http.h"
+#include "flm/core/private/obj.h"
+#include "flm/core/private/scan.h"
+
+/**
+ * The characters allowed in a token (RFC 9110), one bit per character
+ */
+static const uint32_t flm__HTTPTokens[8] = {
+    0x00000000, 0x03ff6cfa, 0xc7fffffe, 0x57ffffff,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000
+};
+
+flm_HTTPParser *
+flm_HTTPParserNew (int                  type,
+                   size_t               max_head,
+                   size_t               max_headers,
+                   void *               state)
+{
+    flm_HTTPParser * parser;
+
+    if ((parser = flm__Alloc (sizeof (flm_HTTPParser))) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (NULL);
+    }
+    if (flm__HTTPParserInit (parser,                            \
+                             type,                              \
+                             max_head,                          \
+                             max_headers,                       \
+                             state) == -1) {
+        flm__Free (parser);
+        return (NULL);
+    }
+    return (parser);
+}
+
+void
+flm_HTTPParserOnHead (flm_HTTPParser *          parser,
+                      flm_HTTPHeadHandler       handler)
+{
+    parser->handlers.head = handler;
+    return ;
+}
+
+void
+flm_HTTPParserOnBody (flm_HTTPParser *          parser,
+                      flm_HTTPBodyHandler       handler)
+{
+    parser->handlers.body = handler;
+    return ;
+}
+
+void
+flm_HTTPParserOnEnd (flm_HTTPParser *           parser,
+                     flm_HTTPEndHandler         handler)
+{
+    parser->handlers.end = handler;
+    return ;
+}
+
+int
+flm_HTTPParserFeed (flm_HTTPParser *    parser,
+                    flm_Buffer *        buffer)
+{
+    const char *        content;
+    size_t              len;
+    ssize_t             used;
+    int                 ret;
+
+    if (parser->state == FLM__HTTP_FAILED) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+
+    content = flm_BufferContent (buffer);
+    len = flm_BufferLength (buffer);
+
+    /**
+     * The handlers may drop the last reference to the parser
+     */
+    flm_HTTPParserRetain (parser);
+    ret = 0;
+    while (len) {
+        switch (parser->state) {
+        case FLM__HTTP_HEAD:
+            used = flm__HTTPParserFeedHead (parser, content, len);
+            break ;
+        case FLM__HTTP_BODY:
+        case FLM__HTTP_BODY_EOF:
+            used = flm__HTTPParserFeedBody (parser, content, len);
+            break ;
+        default:
+            used = flm__HTTPParserFeedChunked (parser, content, len);
+            break ;
+        }
+        if (used == -1) {
+            ret = -1;
+            break ;
+        }
+        content += used;
+        len -= used;
+    }
+    flm_HTTPParserRelease (parser);
+    return (ret);
+}
+
+int
+flm_HTTPParserFinish (flm_HTTPParser *  parser)
+{
+    switch (parser->state) {
+    case FLM__HTTP_FAILED:
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+
+    case FLM__HTTP_BODY_EOF:
+        flm__HTTPParserEnd (parser);
+        return (0);
+
+    case FLM__HTTP_HEAD:
+        /**
+         * Nothing but empty lines after the last message
+         */
+        if (!parser->partial.started) {
+            parser->partial.len = 0;
+            parser->partial.scanned = 0;
+            return (0);
+        }
+        /* fall through */
+
+    default:
+        return (flm__HTTPParserFail (parser, EPROTO));
+    }
+}
+
+void
+flm_HTTPParserSkipBody (flm_HTTPParser *        parser)
+{
+    parser->skip_body = true;
+    return ;
+}
+
+const struct flm_HTTPHeader *
+flm_HTTPHeadFind (const struct flm_HTTPHead *   head,
+                  const char *                  name)
+{
+    size_t i;
+
+    for (i = 0; i < head->count; i++) {
+        if (flm__HTTPParserEquals (head->headers[i].name.content,     \
+                                   head->headers[i].name.len,         \
+                                   name)) {
+            return (&head->headers[i]);
+        }
+    }
+    return (NULL);
+}
+
+flm_HTTPParser *
+flm_HTTPParserRetain (flm_HTTPParser *          parser)
+{
+    return (flm__Retain (&parser->obj));
+}
+
+void
+flm_HTTPParserRelease (flm_HTTPParser *         parser)
+{
+    flm__Release (&parser->obj);
+    return ;
+}
+
+int
+flm__HTTPParserInit (flm_HTTPParser *           parser,
+                     int                        type,
+                     size_t                     max_head,
+                     size_t                     max_headers,
+                     void *                     state)
+{
+    if ((type != FLM_HTTP_REQUEST && type != FLM_HTTP_RESPONSE) ||
+        max_head == 0 || max_headers == 0) {
+        flm__Error = FLM_ERR_BUG;
+        goto error;
+    }
+
+    parser->partial.content = flm__Alloc (max_head);
+    if (parser->partial.content == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        goto error;
+    }
+    parser->head.headers =                                      \
+        flm__Alloc (max_headers * sizeof (struct flm_HTTPHeader));
+    if (parser->head.headers == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        goto free_partial;
+    }
+
+    flm__ObjInit (&parser->obj);
+
+    parser->obj.type = FLM__TYPE_HTTP_PARSER;
+
+    parser->obj.perf.destruct =                                 \
+        (flm__ObjPerfDestruct_f) flm__HTTPParserPerfDestruct;
+
+    parser->type = type;
+    parser->state = FLM__HTTP_HEAD;
+    parser->data = state;
+
+    parser->max_head = max_head;
+    parser->max_headers = max_headers;
+
+    parser->handlers.head = NULL;
+    parser->handlers.body = NULL;
+    parser->handlers.end = NULL;
+
+    parser->head.count = 0;
+    parser->skip_body = false;
+
+    parser->remaining = 0;
+    parser->digits = false;
+    parser->line_len = 0;
+
+    parser->partial.len = 0;
+    parser->partial.scanned = 0;
+    parser->partial.started = false;
+    return (0);
+
+  free_partial:
+    flm__Free (parser->partial.content);
+  error:
+    return (-1);
+}
+
+void
+flm__HTTPParserPerfDestruct (flm_HTTPParser *   parser)
+{
+    flm__Free (parser->head.headers);
+    flm__Free (parser->partial.content);
+    return ;
+}
+
+ssize_t
+flm__HTTPParserFeedHead (flm_HTTPParser *       parser,
+                         const char *           content,
+                         size_t                 len)
+{
+    ssize_t     end;
+    size_t      copy;
+    size_t      old;
+
+    /**
+     * The whole head is in the buffer, it is parsed in place.
+     */
+    if (parser->partial.len == 0) {
+        copy = len < parser->max_head ? len : parser->max_head;
+        if ((end = flm__HTTPParserHead (parser, content, copy)) == -1) {
+            return (-1);
+        }
+        if (end) {
+            flm__HTTPParserHeadDone (parser);
+            return (end);
+        }
+        if (len >= parser->max_head) {
+            return (flm__HTTPParserFail (parser, EMSGSIZE));
+        }
+        memcpy (parser->partial.content, content, len);
+        parser->partial.len = len;
+        parser->partial.scanned = 0;
+        parser->partial.started = false;
+        flm__HTTPParserHeadEnd (parser->partial.content,        \
+                                parser->partial.len,            \
+                                &parser->partial.scanned,       \
+                                &parser->partial.started);
+        return (len);
+    }
+
+    /**
+     * Join the rest of the head to its beginning, the scan starts again
+     * at the last incomplete line and the head is parsed once complete.
+     */
+    copy = parser->max_head - parser->partial.len;
+    if (copy > len) {
+        copy = len;
+    }
+    memcpy (parser->partial.content + parser->partial.len, content, copy);
+    old = parser->partial.len;
+    parser->partial.len += copy;
+
+    if ((end = flm__HTTPParserHeadEnd (parser->partial.content,      \
+                                       parser->partial.len,          \
+                                       &parser->partial.scanned,     \
+                                       &parser->partial.started))) {
+        parser->partial.len = 0;
+        parser->partial.scanned = 0;
+        parser->partial.started = false;
+        if (flm__HTTPParserHead (parser,                        \
+                                 parser->partial.content,       \
+                                 end) == -1) {
+            return (-1);
+        }
+        flm__HTTPParserHeadDone (parser);
+        return (end - old);
+    }
+    if (parser->partial.len == parser->max_head) {
+        return (flm__HTTPParserFail (parser, EMSGSIZE));
+    }
+    return (copy);
+}
+
+ssize_t
+flm__HTTPParserFeedBody (flm_HTTPParser *       parser,
+                         const char *           content,
+                         size_t                 len)
+{
+    if (parser->state == FLM__HTTP_BODY && len > parser->remaining) {
+        len = parser->remaining;
+    }
+    if (parser->handlers.body) {
+        parser->handlers.body (parser, parser->data, content, len);
+    }
+    if (parser->state == FLM__HTTP_BODY) {
+        parser->remaining -= len;
+        if (parser->remaining == 0) {
+            flm__HTTPParserEnd (parser);
+        }
+    }
+    return (len);
+}
+
+ssize_t
+flm__HTTPParserFeedChunked (flm_HTTPParser *    parser,
+                            const char *        content,
+                            size_t              len)
+{
+    size_t      used;
+    size_t      count;
+    ssize_t     skipped;
+    int         digit;
+    char        c;
+
+    for (used = 0; used < len; ) {
+        c = content[used];
+        switch (parser->state) {
+        case FLM__HTTP_CHUNK_SIZE:
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            }
+            else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+                digit = (c | 0x20) - 'a' + 10;
+            }
+            else {
+                digit = -1;
+            }
+            if (digit >= 0) {
+                if (parser->remaining >> 60) {
+                    return (flm__HTTPParserFail (parser, EPROTO));
+                }
+                parser->remaining = (parser->remaining << 4) | digit;
+                parser->digits = true;
+                used++;
+                break ;
+            }
+            if (!parser->digits) {
+                return (flm__HTTPParserFail (parser, EPROTO));
+            }
+            if (c == ';' || c == ' ' || c == '\t') {
+                parser->state = FLM__HTTP_CHUNK_EXT;
+                parser->line_len = 0;
+            }
+            else if (c == '\r') {
+                parser->state = FLM__HTTP_CHUNK_SIZE_LF;
+                used++;
+            }
+            else if (c == '\n') {
+                parser->state = FLM__HTTP_CHUNK_SIZE_LF;
+            }
+            else {
+                return (flm__HTTPParserFail (parser, EPROTO));
+            }
+            break ;
+
+        case FLM__HTTP_CHUNK_EXT:
+            /**
+             * The extensions are ignored, the line end is left for the
+             * next state.
+             */
+            skipped = flm__HTTPParserSkipLine (parser,          \
+                                               content + used,  \
+                                               len - used);
+            if (skipped == -1) {
+                return (-1);
+            }
+            used += skipped;
+            if (used < len) {
+                parser->state = FLM__HTTP_CHUNK_SIZE_LF;
+            }
+            break ;
+
+        case FLM__HTTP_CHUNK_SIZE_LF:
+            if (c != '\n') {
+                return (flm__HTTPParserFail (parser, EPROTO));
+            }
+            used++;
+            parser->line_len = 0;
+            if (parser->remaining == 0) {
+                parser->state = FLM__HTTP_TRAILER;
+            }
+            else {
+                parser->state = FLM__HTTP_CHUNK_DATA;
+            }
+            break ;
+
+        case FLM__HTTP_CHUNK_DATA:
+            count = len - used;
+            if (count > parser->remaining) {
+                count = parser->remaining;
+            }
+            if (parser->handlers.body) {
+                parser->handlers.body (parser,                  \
+                                       parser->data,            \
+                                       content + used,          \
+                                       count);
+            }
+            parser->remaining -= count;
+            used += count;
+            if (parser->remaining == 0) {
+                parser->state = FLM__HTTP_CHUNK_CR;
+            }
+            break ;
+
+        case FLM__HTTP_CHUNK_CR:
+        case FLM__HTTP_CHUNK_LF:
+            if (c == '\r' && parser->state == FLM__HTTP_CHUNK_CR) {
+                parser->state = FLM__HTTP_CHUNK_LF;
+                used++;
+                break ;
+            }
+            if (c != '\n') {
+                return (flm__HTTPParserFail (parser, EPROTO));
+            }
+            used++;
+            parser->state = FLM__HTTP_CHUNK_SIZE;
+            parser->digits = false;
+            break ;
+
+        case FLM__HTTP_TRAILER:
+            if (c == '\r') {
+                parser->state = FLM__HTTP_TRAILER_LF;
+                used++;
+            }
+            else if (c == '\n') {
+                flm__HTTPParserEnd (parser);
+                return (used + 1);
+            }
+            else {
+                parser->state = FLM__HTTP_TRAILER_LINE;
+            }
+            break ;
+
+        case FLM__HTTP_TRAILER_LINE:
+            /**
+             * The trailers are ignored
+             */
+            skipped = flm__HTTPParserSkipLine (parser,          \
+                                               content + used,  \
+                                               len - used);
+            if (skipped == -1) {
+                return (-1);
+            }
+            used += skipped;
+            if (used < len) {
+                /* skip the line end */
+                used++;
+                parser->state = FLM__HTTP_TRAILER;
+            }
+            break ;
+
+        case FLM__HTTP_TRAILER_LF:
+            if (c != '\n') {
+                return (flm__HTTPParserFail (parser, EPROTO));
+            }
+            flm__HTTPParserEnd (parser);
+            return (used + 1);
+
+        default:
+            flm__Error = FLM_ERR_BUG;
+            return (-1);
+        }
+    }
+    return (used);
+}
+
+ssize_t
+flm__HTTPParserSkipLine (flm_HTTPParser *       parser,
+                         const char *           content,
+                         size_t                 len)
+{
+    const char *        eol;
+    size_t              count;
+
+    /**
+     * Counts the bytes before the line end
+     */
+    if ((eol = flm_ScanByte (content, len, '\n'))) {
+        count = eol - content;
+    }
+    else {
+        count = len;
+    }
+    parser->line_len += count;
+    if (parser->line_len > parser->max_head) {
+        return (flm__HTTPParserFail (parser, EMSGSIZE));
+    }
+    return (count);
+}
+
+size_t
+flm__HTTPParserHeadEnd (const char *    content,
+                        size_t          len,
+                        size_t *        scanned,
+                        bool *          started)
+{
+    const char *        line;
+    const char *        eol;
+    const char *        end;
+    size_t              line_len;
+
+    end = content + len;
+    for (line = content + *scanned;
+         (eol = flm_ScanByte (line, end - line, '\n'));
+         line = eol + 1) {
+        line_len = eol - line;
+        if (line_len == 0 || (line_len == 1 && line[0] == '\r')) {
+            /**
+             * The empty lines before a message are ignored
+             */
+            if (*started) {
+                return (eol + 1 - content);
+            }
+        }
+        else {
+            *started = true;
+        }
+    }
+    *scanned = line - content;
+    return (0);
+}
+
+ssize_t
+flm__HTTPParserHead (flm_HTTPParser *   parser,
+                     const char *       content,
+                     size_t             len)
+{
+    struct flm_HTTPHead *       head;
+    const char *                line;
+    const char *                eol;
+    const char *                end;
+    size_t                      line_len;
+    bool                        started;
+    bool                        has_encoding;
+
+    head = &parser->head;
+    head->method.content = NULL;
+    head->method.len = 0;
+    head->target.content = NULL;
+    head->target.len = 0;
+    head->status = 0;
+    head->reason.content = NULL;
+    head->reason.len = 0;
+    head->count = 0;
+    head->chunked = false;
+    head->has_length = false;
+    head->length = 0;
+
+    /**
+     * The lines are parsed as they are found, a head without its empty
+     * line is incomplete.
+     */
+    started = false;
+    has_encoding = false;
+    end = content + len;
+    for (line = content;
+         (eol = flm_ScanByte (line, end - line, '\n'));
+         line = eol + 1) {
+        line_len = eol - line;
+        if (line_len && line[line_len - 1] == '\r') {
+            line_len--;
+        }
+        if (line_len == 0) {
+            if (started) {
+                goto complete;
+            }
+            continue ;
+        }
+        if (!started) {
+            if (flm__HTTPParserStartLine (parser, line, line_len) == -1) {
+                return (-1);
+            }
+            started = true;
+            continue ;
+        }
+        if (flm__HTTPParserHeader (parser,                      \
+                                   line,                        \
+                                   line_len,                    \
+                                   &has_encoding) == -1) {
+            return (-1);
+        }
+    }
+    return (0);
+
+  complete:
+    /**
+     * A transfer encoding other than chunked leaves no way to find the
+     * end of a request, and a length along with it is a smuggling
+     * attempt. A response is read until the end of the flow instead.
+     */
+    if (has_encoding) {
+        if (parser->type == FLM_HTTP_REQUEST &&
+            (!head->chunked || head->has_length)) {
+            return (flm__HTTPParserFail (parser, EPROTO));
+        }
+        head->has_length = false;
+        head->length = 0;
+    }
+    return (eol + 1 - content);
+}
+
+void
+flm__HTTPParserHeadDone (flm_HTTPParser *       parser)
+{
+    parser->skip_body = false;
+    if (parser->handlers.head) {
+        parser->handlers.head (parser, parser->data, &parser->head);
+    }
+    flm__HTTPParserBody (parser);
+    return ;
+}
+
+int
+flm__HTTPParserStartLine (flm_HTTPParser *      parser,
+                          const char *          line,
+                          size_t                len)
+{
+    struct flm_HTTPHead *       head;
+    const char *                sp;
+    const char *                end;
+
+    head = &parser->head;
+    end = line + len;
+
+    if (parser->type == FLM_HTTP_REQUEST) {
+        /**
+         * method SP target SP version
+         */
+        if ((sp = flm_ScanByte (line, len, ' ')) == NULL || sp == line) {
+            goto error;
+        }
+        head->method.content = line;
+        head->method.len = sp - line;
+
+        line = sp + 1;
+        if ((sp = flm_ScanByte (line, end - line, ' ')) == NULL || sp == line) {
+            goto error;
+        }
+        head->target.content = line;
+        head->target.len = sp - line;
+
+        line = sp + 1;
+        if ((head->minor = flm__HTTPParserVersion (line, end - line)) == -1) {
+            goto error;
+        }
+    }
+    else {
+        /**
+         * version SP status [SP reason]
+         */
+        if (len < 12 ||
+            (head->minor = flm__HTTPParserVersion (line, 8)) == -1 ||
+            line[8] != ' ' ||
+            line[9] < '1' || line[9] > '9' ||
+            line[10] < '0' || line[10] > '9' ||
+            line[11] < '0' || line[11] > '9') {
+            goto error;
+        }
+        head->status = (line[9] - '0') * 100 +                  \
+            (line[10] - '0') * 10 +                             \
+            (line[11] - '0');
+        if (len > 12) {
+            if (line[12] != ' ') {
+                goto error;
+            }
+            head->reason.content = line + 13;
+            head->reason.len = len - 13;
+        }
+    }
+
+    /**
+     * Persistent by default since HTTP/1.1
+     */
+    head->keep_alive = head->minor >= 1;
+    return (0);
+
+  error:
+    return (flm__HTTPParserFail (parser, EPROTO));
+}
+
+int
+flm__HTTPParserHeader (flm_HTTPParser *         parser,
+                       const char *             line,
+                       size_t                   len,
+                       bool *                   has_encoding)
+{
+    struct flm_HTTPHead *       head;
+    struct flm_HTTPHeader *     header;
+    const char *                colon;
+    const char *                value;
+    size_t                      value_len;
+    size_t                      name_len;
+    uint64_t                    length;
+    size_t                      i;
+
+    head = &parser->head;
+
+    /**
+     * Folded lines are obsolete, and the name is a token: no space is
+     * allowed before the colon.
+     */
+    if (line[0] == ' ' || line[0] == '\t') {
+        goto error;
+    }
+    if ((colon = flm_ScanByte (line, len, ':')) == NULL || colon == line) {
+        goto error;
+    }
+    name_len = colon - line;
+    for (i = 0; i < name_len; i++) {
+        if (!flm__HTTPParserIsToken (line[i])) {
+            goto error;
+        }
+    }
+
+    value = colon + 1;
+    value_len = len - name_len - 1;
+    while (value_len && (value[0] == ' ' || value[0] == '\t')) {
+        value++;
+        value_len--;
+    }
+    while (value_len &&
+           (value[value_len - 1] == ' ' || value[value_len - 1] == '\t')) {
+        value_len--;
+    }
+
+    if (head->count == parser->max_headers) {
+        return (flm__HTTPParserFail (parser, EMSGSIZE));
+    }
+    header = &head->headers[head->count++];
+    header->name.content = line;
+    header->name.len = name_len;
+    header->value.content = value;
+    header->value.len = value_len;
+
+    /**
+     * The headers defining the end of the message
+     */
+    if (flm__HTTPParserEquals (line, name_len, "content-length")) {
+        if (value_len == 0) {
+            goto error;
+        }
+        length = 0;
+        for (i = 0; i < value_len; i++) {
+            if (value[i] < '0' || value[i] > '9' ||
+                length > (UINT64_MAX - 9) / 10) {
+                goto error;
+            }
+            length = length * 10 + (value[i] - '0');
+        }
+        if (head->has_length && head->length != length) {
+            goto error;
+        }
+        head->has_length = true;
+        head->length = length;
+    }
+    else if (flm__HTTPParserEquals (line, name_len, "transfer-encoding")) {
+        *has_encoding = true;
+        head->chunked = flm__HTTPParserChunked (value, value_len);
+    }
+    else if (flm__HTTPParserEquals (line, name_len, "connection")) {
+        if (flm__HTTPParserToken (value, value_len, "close")) {
+            head->keep_alive = false;
+        }
+        else if (flm__HTTPParserToken (value, value_len, "keep-alive")) {
+            head->keep_alive = true;
+        }
+    }
+    return (0);
+
+  error:
+    return (flm__HTTPParserFail (parser, EPROTO));
+}
+
+int
+flm__HTTPParserVersion (const char *    content,
+                        size_t          len)
+{
+    if (len != 8 || memcmp (content, "HTTP/1.", 7) != 0 ||
+        content[7] < '0' || content[7] > '9') {
+        return (-1);
+    }
+    return (content[7] == '0' ? 0 : 1);
+}
+
+bool
+flm__HTTPParserIsToken (char          c)
+{
+    unsigned char byte;
+
+    byte = (unsigned char) c;
+    return (flm__HTTPTokens[byte >> 5] & (1U << (byte & 31)));
+}
+
+bool
+flm__HTTPParserChunked (const char *    content,
+                        size_t          len)
+{
+    size_t last;
+
+    /**
+     * Only the last coding matters
+     */
+    for (last = len; last && content[last - 1] != ','; last--)
+        ;
+    while (last < len && (content[last] == ' ' || content[last] == '\t')) {
+        last++;
+    }
+    return (flm__HTTPParserEquals (content + last, len - last, "chunked"));
+}
+
+bool
+flm__HTTPParserToken (const char *      content,
+                      size_t            len,
+                      const char *      token)
+{
+    const char *        comma;
+    size_t              item_len;
+
+    while (len) {
+        while (len && (content[0] == ' ' || content[0] == '\t')) {
+            content++;
+            len--;
+        }
+        if ((comma = flm_ScanByte (content, len, ','))) {
+            item_len = comma - content;
+        }
+        else {
+            item_len = len;
+        }
+        while (item_len &&
+               (content[item_len - 1] == ' ' ||
+                content[item_len - 1] == '\t')) {
+            item_len--;
+        }
+        if (flm__HTTPParserEquals (content, item_len, token)) {
+            return (true);
+        }
+        if (comma == NULL) {
+            break ;
+        }
+        len -= comma + 1 - content;
+        content = comma + 1;
+    }
+    return (false);
+}
+
+bool
+flm__HTTPParserEquals (const char *     content,
+                       size_t           len,
+                       const char *     name)
+{
+    return (strlen (name) == len && strncasecmp (content, name, len) == 0);
+}
+
+void
+flm__HTTPParserBody (flm_HTTPParser *   parser)
+{
+    struct flm_HTTPHead * head;
+
+    head = &parser->head;
+
+    /**
+     * Interim responses, and responses which never have a body
+     */
+    if (parser->type == FLM_HTTP_RESPONSE &&
+        (parser->skip_body ||
+         head->status / 100 == 1 ||
+         head->status == 204 ||
+         head->status == 304)) {
+        flm__HTTPParserEnd (parser);
+        return ;
+    }
+
+    if (head->chunked) {
+        parser->state = FLM__HTTP_CHUNK_SIZE;
+        parser->remaining = 0;
+        parser->digits = false;
+    }
+    else if (head->has_length && head->length) {
+        parser->state = FLM__HTTP_BODY;
+        parser->remaining = head->length;
+    }
+    else if (parser->type == FLM_HTTP_RESPONSE && !head->has_length) {
+        parser->state = FLM__HTTP_BODY_EOF;
+    }
+    else {
+        flm__HTTPParserEnd (parser);
+    }
+    return ;
+}
+
+void
+flm__HTTPParserEnd (flm_HTTPParser *    parser)
+{
+    parser->state = FLM__HTTP_HEAD;
+    if (parser->handlers.end) {
+        parser->handlers.end (parser, parser->data);
+    }
+    return ;
+}
+
+int
+flm__HTTPParserFail (flm_HTTPParser *   parser,
+                     int                error)
+{
+    parser->state = FLM__HTTP_FAILED;
+    flm__Error = FLM_ERR_ERRNO;
+    errno = error;
+    return (-1);
+}
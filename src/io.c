@@ -69,6 +69,12 @@ flm_IOClose (flm_IO *           io)
     return ;
 }
 
+int
+flm_IODescriptor (flm_IO *      io)
+{
+    return (io->sys.fd);
+}
+
 void
 flm_IOOnRead (flm_IO *                  io,
               flm_IOReadHandler         handler)
@@ -131,10 +137,13 @@ flm__IOInit (flm_IO *                   io,
 
     io->rd.can                  =       false;
     io->rd.want                 =       true;
+    io->rd.hold                 =       false;
     io->rd.limit                =       4;
 
     io->wr.can                  =       false;
     io->wr.want                 =       false;
+    io->wr.hold                 =       false;
+    io->wr.pause                =       false;
     io->wr.limit                =       4;
 
     io->cl.shutdown             =       false;
@@ -148,6 +157,7 @@ flm__IOInit (flm_IO *                   io,
     io->perf.read               =       flm__IOPerfRead;
     io->perf.write              =       flm__IOPerfWrite;
     io->perf.close              =       flm__IOPerfClose;
+    io->perf.error              =       NULL;
 
     io->monitor         =       monitor;
     if (io->monitor && flm__MonitorIOAdd (io->monitor, io) == -1) {
@@ -186,7 +196,7 @@ flm__IORead (flm_IO *           io,
     uint8_t count;
 
     for (count = 0; true; count++) {
-        if (!io->rd.want) {
+        if (!io->rd.want || io->rd.hold) {
             break ;
         }
         if (io->perf.read) {
@@ -206,7 +216,7 @@ flm__IOWrite (flm_IO *          io,
     uint8_t count;
 
     for (count = 0; true; count++) {
-        if (!io->wr.want) {
+        if (!io->wr.want || io->wr.hold || io->wr.pause) {
             break ;
         }
         if (io->perf.write) {
@@ -223,9 +233,16 @@ void
 flm__IOClose (flm_IO *          io,
               flm_Monitor *     monitor)
 {
+    if (io->cl.closed) {
+        return ;
+    }
     if (io->perf.close) {
-        io->perf.close (io, monitor);
+        /**
+         * The monitor drops its reference while closing, it may be the
+         * last one.
+         */
         io->cl.closed = true;
+        io->perf.close (io, monitor);
     }
     return ;
 }
@@ -97,6 +97,12 @@ flm_MonitorWait (flm_Monitor * monitor)
      * The monitor will wait until a fatal error occurs or there
      * is no more IO to wait for.
      */
+    /**
+     * The buffers of the pool are handed out by the thread of the loop
+     */
+    if (monitor->buffers) {
+        flm__BufferPoolOwn (monitor->buffers);
+    }
     while ((monitor->tm.count + monitor->io.count) > 0) {
         if (monitor->wait && monitor->wait (monitor)) {
             return (-1);
@@ -208,6 +214,11 @@ flm__MonitorInit (flm_Monitor * monitor)
     for (count = 0; count < monitor->tm.size; count++) {
         TAILQ_INIT (&(monitor->tm.wheel[count]));
     }
+
+    monitor->chunks.count = 0;
+    SLIST_INIT (&monitor->chunks.free);
+
+    monitor->buffers = NULL;
     return (0);
 }
 
@@ -217,6 +228,7 @@ flm__MonitorPerfDestruct (flm_Monitor * monitor)
     size_t      pos;
     flm_Timer * timer;
     flm_IO *    io;
+    struct flm__MonitorChunk * chunk;
 
     for (pos = 0; pos < monitor->tm.size; pos++) {
         TAILQ_FOREACH (timer, &(monitor->tm.wheel[pos]), wh.entries) {
@@ -228,6 +240,18 @@ flm__MonitorPerfDestruct (flm_Monitor * monitor)
     TAILQ_FOREACH (io, &(monitor->io.list), entries) {
         flm__MonitorIODelete (monitor, io);
     }
+
+    while ((chunk = SLIST_FIRST (&monitor->chunks.free)) != NULL) {
+        SLIST_REMOVE_HEAD (&monitor->chunks.free, entries);
+        flm__FreeAligned (chunk);
+    }
+
+    /**
+     * Buffers still alive keep the pool until they are released
+     */
+    if (monitor->buffers) {
+        flm__BufferPoolClose (monitor->buffers);
+    }
     return ;
 }
 
@@ -280,7 +304,7 @@ flm__MonitorTimerTick (flm_Monitor * monitor)
     uint32_t            pos;
 
     flm_Timer *         timer;
-    struct flm_Timer    temp;
+    struct tmwh *       bucket;
 
     if (clockGettimeHandler (CLOCK_MONOTONIC, &current) == -1) {
         flm__Error = FLM_ERR_ERRNO;
@@ -298,16 +322,31 @@ flm__MonitorTimerTick (flm_Monitor * monitor)
     monitor->tm.pos = (curpos + diff) % monitor->tm.size;
 
     for (pos = 0; pos <= diff; pos++) {
-        TAILQ_FOREACH (timer,
-                       &(monitor->tm.wheel[(curpos + pos) %
-                                           monitor->tm.size]),
-                       wh.entries) {
+        bucket = &(monitor->tm.wheel[(curpos + pos) % monitor->tm.size]);
+
+        /**
+         * Mark the expired timers first: a handler may cancel or reset any
+         * other timer of the bucket, so the list cannot be walked while
+         * the handlers are called.
+         */
+        TAILQ_FOREACH (timer, bucket, wh.entries) {
             if (timer->wh.rounds > 0) {
                 timer->wh.rounds--;
                 continue ;
+            }
+            timer->wh.expired = true;
+        }
 
+        for (;;) {
+            TAILQ_FOREACH (timer, bucket, wh.entries) {
+                if (timer->wh.expired) {
+                    break ;
+                }
+            }
+            if (timer == NULL) {
+                break ;
             }
-            temp.wh.entries = timer->wh.entries;
+            timer->wh.expired = false;
 
             flm_TimerRetain (timer);
             flm_TimerCancel (timer);
@@ -315,7 +354,6 @@ flm__MonitorTimerTick (flm_Monitor * monitor)
                 timer->handler (timer, timer->state);
             }
             flm_TimerRelease (timer);
-            timer = &temp;
         }
     }
     flm__MonitorTimerRearm (monitor);
@@ -338,6 +376,7 @@ flm__MonitorTimerAdd (flm_Monitor *     monitor,
      * Get the number of rounds needed
      */
     timer->wh.rounds = delay / monitor->tm.size;
+    timer->wh.expired = false;
 
     /**
      * Get the position in the wheel
@@ -430,3 +469,49 @@ flm__MonitorTimerRearm (flm_Monitor * monitor)
     }
     return ;
 }
+
+void *
+flm__MonitorChunkGet (flm_Monitor *     monitor)
+{
+    struct flm__MonitorChunk * chunk;
+
+    if (monitor && (chunk = SLIST_FIRST (&monitor->chunks.free)) != NULL) {
+        SLIST_REMOVE_HEAD (&monitor->chunks.free, entries);
+        monitor->chunks.count--;
+        return (chunk);
+    }
+    return (flm__AllocAligned (FLM__MONITOR_CHUNK_SIZE,        \
+                               FLM__MONITOR_CHUNK_ALIGN));
+}
+
+void
+flm__MonitorChunkPut (flm_Monitor *     monitor,
+                      void *            chunk)
+{
+    /**
+     * Only the thread of the monitor may reach its pool
+     */
+    if (monitor == NULL || monitor->chunks.count == FLM__MONITOR_CHUNK_POOL) {
+        flm__FreeAligned (chunk);
+        return ;
+    }
+    SLIST_INSERT_HEAD (&monitor->chunks.free,                   \
+                       (struct flm__MonitorChunk *) chunk,      \
+                       entries);
+    monitor->chunks.count++;
+    return ;
+}
+
+flm_Buffer *
+flm__MonitorBuffer (flm_Monitor *       monitor,
+                    size_t              length)
+{
+    if (monitor == NULL) {
+        return (flm_BufferAlloc (length));
+    }
+    if (monitor->buffers == NULL &&                                     \
+        (monitor->buffers = flm__BufferPoolNew ()) == NULL) {
+        return (NULL);
+    }
+    return (flm__BufferPoolGet (monitor->buffers, length));
+}
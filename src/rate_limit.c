@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "flm/core/public/timer.h"
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/io.h"
+#include "flm/core/private/monitor.h"
+#include "flm/core/private/obj.h"
+#include "flm/core/private/rate_limit.h"
+#include "flm/core/private/timer.h"
+
+flm_RateLimit *
+flm_RateLimitNew (flm_Monitor *         monitor,
+                  uint32_t              rate,
+                  uint32_t              burst)
+{
+    flm_RateLimit * limit;
+
+    if ((limit = flm__Alloc (sizeof (flm_RateLimit))) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (NULL);
+    }
+    if (flm__RateLimitInit (limit, monitor, rate, burst) == -1) {
+        flm__Free (limit);
+        return (NULL);
+    }
+    return (limit);
+}
+
+flm_RateLimit *
+flm_RateLimitRetain (flm_RateLimit *    limit)
+{
+    return (flm__Retain (&limit->obj));
+}
+
+void
+flm_RateLimitRelease (flm_RateLimit *   limit)
+{
+    flm__Release (&limit->obj);
+    return ;
+}
+
+int
+flm__RateLimitInit (flm_RateLimit *     limit,
+                    flm_Monitor *       monitor,
+                    uint32_t            rate,
+                    uint32_t            burst)
+{
+    if (rate == 0) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+
+    flm__ObjInit (&limit->obj);
+
+    limit->obj.type = FLM__TYPE_RATE_LIMIT;
+
+    limit->obj.perf.destruct =                                  \
+        (flm__ObjPerfDestruct_f) flm__RateLimitPerfDestruct;
+
+    limit->monitor = monitor;
+
+    limit->rate = rate;
+    limit->burst = burst ? burst : rate;
+
+    /**
+     * The bucket starts full
+     */
+    limit->tokens = limit->burst;
+    limit->last = monitor->tm.current;
+
+    limit->timer = NULL;
+    TAILQ_INIT (&limit->waits);
+
+    return (0);
+}
+
+void
+flm__RateLimitPerfDestruct (flm_RateLimit *     limit)
+{
+    /**
+     * Every waiting IO holds a reference to the bucket through its
+     * stream, so there is nothing left to wake up here.
+     */
+    if (limit->timer) {
+        flm_TimerCancel (limit->timer);
+        flm_TimerRelease (limit->timer);
+    }
+    return ;
+}
+
+size_t
+flm__RateLimitAvailable (flm_RateLimit *        limit)
+{
+    struct timespec *   current;
+    uint64_t            elapsed;
+    uint64_t            tokens;
+
+    /**
+     * Refill lazily using the clock of the monitor, it is updated once
+     * per loop iteration so this does not cost any syscall.
+     */
+    current = &limit->monitor->tm.current;
+    elapsed = ((current->tv_sec * 1000) + (current->tv_nsec / 1000000)) -
+        ((limit->last.tv_sec * 1000) + (limit->last.tv_nsec / 1000000));
+
+    tokens = (elapsed * limit->rate) / 1000;
+    if (tokens) {
+        limit->tokens += tokens;
+        if (limit->tokens > limit->burst) {
+            limit->tokens = limit->burst;
+        }
+        limit->last = *current;
+    }
+    return (limit->tokens);
+}
+
+void
+flm__RateLimitConsume (flm_RateLimit *          limit,
+                       size_t                   count)
+{
+    if (count > limit->tokens) {
+        count = limit->tokens;
+    }
+    limit->tokens -= count;
+    return ;
+}
+
+void
+flm__RateLimitWait (struct flm__RateLimitWait * wait)
+{
+    flm_RateLimit * limit;
+
+    limit = wait->limit;
+
+    if (wait->waiting) {
+        return ;
+    }
+
+    /**
+     * Stop polling the IO until the next refill, the waiting list keeps
+     * a reference to it.
+     */
+    *wait->hold = true;
+    wait->waiting = true;
+    flm_IORetain (wait->io);
+    TAILQ_INSERT_TAIL (&limit->waits, wait, entries);
+
+    if (limit->timer == NULL) {
+        limit->timer = flm_TimerNew (limit->monitor,
+                                     flm__RateLimitRefill,
+                                     limit,
+                                     limit->monitor->tm.res);
+        /**
+         * Without a timer the IO would never be woken up again, so
+         * give up throttling it.
+         */
+        if (limit->timer == NULL) {
+            flm__RateLimitCancel (wait);
+        }
+    }
+    else if (!limit->timer->set) {
+        flm_TimerReset (limit->timer, limit->monitor->tm.res);
+    }
+    return ;
+}
+
+void
+flm__RateLimitCancel (struct flm__RateLimitWait *       wait)
+{
+    flm_IO *    io;
+
+    if (!wait->waiting) {
+        return ;
+    }
+    io = wait->io;
+
+    TAILQ_REMOVE (&wait->limit->waits, wait, entries);
+    wait->waiting = false;
+    *wait->hold = false;
+
+    /**
+     * Reset the IO so the monitor reports the events that occured while
+     * it was held.
+     */
+    if (io->monitor && !io->cl.closed) {
+        flm__MonitorIOReset (io->monitor, io);
+    }
+    flm_IORelease (io);
+    return ;
+}
+
+void
+flm__RateLimitAttach (struct flm__RateLimitWait *       wait,
+                      flm_RateLimit *                   limit)
+{
+    if (wait->limit == limit) {
+        return ;
+    }
+    if (wait->limit) {
+        flm__RateLimitCancel (wait);
+        flm_RateLimitRelease (wait->limit);
+    }
+    wait->limit = limit ? flm_RateLimitRetain (limit) : NULL;
+    return ;
+}
+
+void
+flm__RateLimitRefill (flm_Timer *       timer,
+                      void *            _limit)
+{
+    flm_RateLimit *                     limit;
+    struct flm__RateLimitWait *         wait;
+
+    (void) timer;
+
+    limit = _limit;
+
+    /**
+     * Waking up the IO may release the last references to the bucket
+     */
+    flm_RateLimitRetain (limit);
+
+    if (flm__RateLimitAvailable (limit) == 0) {
+        flm_TimerReset (limit->timer, limit->monitor->tm.res);
+    }
+    else {
+        /**
+         * Wake up the waiting IO in order, the first one to be woken up
+         * will be the first one to consume the new tokens, the others
+         * will wait again if nothing is left.
+         */
+        while ((wait = TAILQ_FIRST (&limit->waits)) != NULL) {
+            flm__RateLimitCancel (wait);
+        }
+    }
+
+    flm_RateLimitRelease (limit);
+    return ;
+}
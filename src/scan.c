@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "flm/core/private/scan.h"
+
+#if defined(FLM__SCAN_X86)
+#include <immintrin.h>
+#endif
+
+struct flm__ScanOps flm__ScanCurrent;
+pthread_once_t flm__ScanInitOnce = PTHREAD_ONCE_INIT;
+
+const char *
+flm_ScanByte (const char *      content,
+              size_t            len,
+              char              byte)
+{
+    pthread_once (&flm__ScanInitOnce, flm__ScanInit);
+    return (flm__ScanCurrent.byte (content, len, byte));
+}
+
+const char *
+flm_ScanPair (const char *      content,
+              size_t            len,
+              char              first,
+              char              second)
+{
+    pthread_once (&flm__ScanInitOnce, flm__ScanInit);
+    return (flm__ScanCurrent.pair (content, len, first, second));
+}
+
+const char *
+flm_ScanSet (const char *       content,
+             size_t             len,
+             const char *       set,
+             size_t             count)
+{
+    pthread_once (&flm__ScanInitOnce, flm__ScanInit);
+    return (flm__ScanCurrent.set (content, len, set, count));
+}
+
+void
+flm__ScanInit ()
+{
+    if (flm__ScanUse (FLM__SCAN_AVX2) == 0 ||
+        flm__ScanUse (FLM__SCAN_SSE2) == 0) {
+        return ;
+    }
+    flm__ScanUse (FLM__SCAN_SCALAR);
+    return ;
+}
+
+int
+flm__ScanUse (int               level)
+{
+    switch (level) {
+    case FLM__SCAN_SCALAR:
+        flm__ScanCurrent.byte = flm__ScanByteScalar;
+        flm__ScanCurrent.pair = flm__ScanPairScalar;
+        flm__ScanCurrent.set = flm__ScanSetScalar;
+        break ;
+#if defined(FLM__SCAN_X86)
+    case FLM__SCAN_SSE2:
+        __builtin_cpu_init ();
+        if (!__builtin_cpu_supports ("sse2")) {
+            return (-1);
+        }
+        flm__ScanCurrent.byte = flm__ScanByteScalar;
+        flm__ScanCurrent.pair = flm__ScanPairScalar;
+        flm__ScanCurrent.set = flm__ScanSetSSE2;
+        break ;
+    case FLM__SCAN_AVX2:
+        __builtin_cpu_init ();
+        if (!__builtin_cpu_supports ("avx2")) {
+            return (-1);
+        }
+        flm__ScanCurrent.byte = flm__ScanByteScalar;
+        flm__ScanCurrent.pair = flm__ScanPairScalar;
+        flm__ScanCurrent.set = flm__ScanSetAVX2;
+        break ;
+#endif
+    default:
+        return (-1);
+    }
+    flm__ScanCurrent.level = level;
+    return (0);
+}
+
+int
+flm__ScanSetLevel (int          level)
+{
+    pthread_once (&flm__ScanInitOnce, flm__ScanInit);
+    return (flm__ScanUse (level));
+}
+
+int
+flm__ScanGetLevel ()
+{
+    pthread_once (&flm__ScanInitOnce, flm__ScanInit);
+    return (flm__ScanCurrent.level);
+}
+
+const char *
+flm__ScanByteScalar (const char *       content,
+                     size_t             len,
+                     char               byte)
+{
+    return (memchr (content, byte, len));
+}
+
+const char *
+flm__ScanPairScalar (const char *       content,
+                     size_t             len,
+                     char               first,
+                     char               second)
+{
+    const char *        cur;
+    const char *        end;
+
+    if (len < 2) {
+        return (NULL);
+    }
+    end = content + len - 1;
+    for (cur = content; (cur = memchr (cur, first, end - cur)); cur++) {
+        if (cur[1] == second) {
+            return (cur);
+        }
+    }
+    return (NULL);
+}
+
+const char *
+flm__ScanSetScalar (const char *        content,
+                    size_t              len,
+                    const char *        set,
+                    size_t              count)
+{
+    bool        table[256];
+    size_t      i;
+
+    memset (table, 0, sizeof (table));
+    for (i = 0; i < count; i++) {
+        table[(unsigned char) set[i]] = true;
+    }
+    for (i = 0; i < len; i++) {
+        if (table[(unsigned char) content[i]]) {
+            return (&content[i]);
+        }
+    }
+    return (NULL);
+}
+
+#if defined(FLM__SCAN_X86)
+
+/**
+ * Only the sets are compared here: the libc memchr() is already
+ * vectorized and unrolled further than these loops, so the single byte
+ * and the pair searches, which mostly wait for a rare first byte, are
+ * faster on top of it (see tests/scan_bench.c).
+ *
+ * The vectors are loaded unaligned since the buffers come from anywhere,
+ * and the bytes left after the last full vector are handled by the
+ * smaller version.
+ */
+
+__attribute__ ((target ("sse2")))
+const char *
+flm__ScanSetSSE2 (const char *          content,
+                  size_t                len,
+                  const char *          set,
+                  size_t                count)
+{
+    const char *        cur;
+    const char *        end;
+    __m128i             needles[FLM__SCAN_SET_SIZE];
+    __m128i             input;
+    __m128i             found;
+    uint32_t            mask;
+    size_t              i;
+
+    if (count == 0 || count > FLM__SCAN_SET_SIZE) {
+        return (flm__ScanSetScalar (content, len, set, count));
+    }
+    for (i = 0; i < count; i++) {
+        needles[i] = _mm_set1_epi8 (set[i]);
+    }
+
+    end = content + len;
+    for (cur = content; end - cur >= 16; cur += 16) {
+        input = _mm_loadu_si128 ((const __m128i *) cur);
+        found = _mm_cmpeq_epi8 (input, needles[0]);
+        for (i = 1; i < count; i++) {
+            found = _mm_or_si128 (found, _mm_cmpeq_epi8 (input, needles[i]));
+        }
+        if ((mask = _mm_movemask_epi8 (found))) {
+            return (cur + __builtin_ctz (mask));
+        }
+    }
+    return (flm__ScanSetScalar (cur, end - cur, set, count));
+}
+
+__attribute__ ((target ("avx2")))
+const char *
+flm__ScanSetAVX2 (const char *          content,
+                  size_t                len,
+                  const char *          set,
+                  size_t                count)
+{
+    const char *        cur;
+    const char *        end;
+    __m256i             needles[FLM__SCAN_SET_SIZE];
+    __m256i             input;
+    __m256i             found;
+    uint32_t            mask;
+    size_t              i;
+
+    if (count == 0 || count > FLM__SCAN_SET_SIZE) {
+        return (flm__ScanSetScalar (content, len, set, count));
+    }
+    for (i = 0; i < count; i++) {
+        needles[i] = _mm256_set1_epi8 (set[i]);
+    }
+
+    end = content + len;
+    for (cur = content; end - cur >= 32; cur += 32) {
+        input = _mm256_loadu_si256 ((const __m256i *) cur);
+        found = _mm256_cmpeq_epi8 (input, needles[0]);
+        for (i = 1; i < count; i++) {
+            found = _mm256_or_si256 (found,
+                                     _mm256_cmpeq_epi8 (input, needles[i]));
+        }
+        if ((mask = _mm256_movemask_epi8 (found))) {
+            return (cur + __builtin_ctz (mask));
+        }
+    }
+    return (flm__ScanSetSSE2 (cur, end - cur, set, count));
+}
+
+#endif /* FLM__SCAN_X86 */
@@ -150,10 +150,10 @@ flm__SelectPerfWait (flm__Select * _select)
             flm__IOClose (io, &_select->monitor);
             continue ;
         }
-        if (io->rd.want) {
+        if (io->rd.want && !io->rd.hold) {
             FD_SET (io->sys.fd, &rset);
         }
-        if (io->wr.want) {
+        if (io->wr.want && !io->wr.hold && !io->wr.pause) {
             FD_SET (io->sys.fd, &wset);
         }
 
@@ -191,12 +191,17 @@ flm__SelectPerfWait (flm__Select * _select)
             break ;
         }
 
+        /**
+         * Handlers may close the IO and drop the last reference to it
+         */
+        flm_IORetain (io);
         if (FD_ISSET (fd, &rset)) {
             flm__IORead (io, &_select->monitor);
         }
         if (FD_ISSET (fd, &wset)) {
             flm__IOWrite (io, &_select->monitor);
         }
+        flm_IORelease (io);
     }
     return (0);
 }
@@ -17,6 +17,7 @@
 #if defined(linux)
 #define _GNU_SOURCE
 #include <sys/socket.h>
+#include <linux/errqueue.h>
 #endif
 
 #include <sys/uio.h>
@@ -30,20 +31,43 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <openssl/err.h>
 #include <openssl/ssl.h>
 
 #include "flm/core/private/alloc.h"
 #include "flm/core/private/buffer.h"
+#include "flm/core/private/buffer_chain.h"
 #include "flm/core/private/error.h"
 #include "flm/core/private/file.h"
+#include "flm/core/private/file_queue.h"
+#include "flm/core/private/framer.h"
+#include "flm/core/private/http.h"
 #include "flm/core/private/io.h"
 #include "flm/core/private/monitor.h"
 #include "flm/core/private/obj.h"
+#include "flm/core/private/rate_limit.h"
 #include "flm/core/private/stream.h"
+#include "flm/core/private/timer.h"
+
+#include "config.h"
+
+#if defined (SO_ZEROCOPY) && defined (MSG_ZEROCOPY) &&         \
+    defined (SO_EE_ORIGIN_ZEROCOPY)
+# define FLM_STREAM__ZEROCOPY
+#endif
+
+#if defined (SSL_OP_ENABLE_KTLS) && !defined (OPENSSL_NO_KTLS)
+# define FLM_STREAM__KTLS
+#endif
+
+#if defined (RWF_NOWAIT)
+# define FLM_STREAM__PREFETCH
+#endif
 
 flm_Stream *
 flm_StreamNew (flm_Monitor *		monitor,
@@ -69,39 +93,19 @@ flm_StreamPrintf (flm_Stream *	stream,
 {
     flm_Buffer * buffer;
 
-    char * content;
-    int len;
-    size_t alloc;
-
     va_list ap;
 
+    /**
+     * The content is formatted right after the buffer object
+     */
     va_start (ap, format);
-    len = vsnprintf (NULL, 0, format, ap);
+    buffer = flm_BufferVPrintf (format, ap);
     va_end (ap);
 
-    if (len < 0) {
-        goto error;
-    }
-
-    alloc = len + 1;
-
-    content = flm__Alloc (alloc * sizeof (char));
-    if (content == NULL) {
+    if (buffer == NULL) {
         goto error;
     }
 
-    va_start (ap, format);
-    len = vsnprintf (content, alloc, format, ap);
-    va_end (ap);
-
-    if (len < 0) {
-        goto free_content;
-    }
-
-    if ((buffer = flm_BufferNew (content, len, flm__Free)) == NULL) {
-        goto free_content;
-    }
-
     if (flm_StreamPushBuffer (stream, buffer, 0, 0) == -1) {
         goto release_buffer;
     }
@@ -111,9 +115,6 @@ flm_StreamPrintf (flm_Stream *	stream,
 
   release_buffer:
     flm_BufferRelease (buffer);
-    return (-1);
-  free_content:
-    flm__Free (content);
   error:
     return (-1);
 }
@@ -150,6 +151,7 @@ flm_StreamPushBuffer (flm_Stream *	stream,
     input->type = FLM__STREAM_TYPE_BUFFER;
     input->off = off;
     input->count = count;
+    input->fd = -1;
     TAILQ_INSERT_TAIL (&(stream->inputs), input, entries);
 
     return (0);
@@ -160,6 +162,58 @@ flm_StreamPushBuffer (flm_Stream *	stream,
     return (-1);
 }
 
+int
+flm_StreamPushChain (flm_Stream *       stream,
+                     flm_BufferChain *  chain)
+{
+    struct flm__StreamInput *           input;
+    struct flm__BufferChainSegment *    segment;
+    TAILQ_HEAD (flpc, flm__StreamInput) inputs;
+
+    /**
+     * One input per segment, all of them or none: they are gathered back
+     * by the writes.
+     */
+    TAILQ_INIT (&inputs);
+    TAILQ_FOREACH (segment, &chain->segments, entries) {
+        if (segment->count == 0) {
+            continue ;
+        }
+        if ((input = flm__Alloc (sizeof (struct flm__StreamInput))) == NULL) {
+            goto free_inputs;
+        }
+        input->class.buffer = flm_BufferRetain (segment->buffer);
+        input->type = FLM__STREAM_TYPE_BUFFER;
+        input->off = segment->off;
+        input->count = segment->count;
+        input->fd = -1;
+        TAILQ_INSERT_TAIL (&inputs, input, entries);
+    }
+    if (TAILQ_EMPTY (&inputs)) {
+        return (0);
+    }
+
+    stream->io.wr.want = true;
+    if (stream->io.monitor &&                                   \
+        flm__MonitorIOReset (stream->io.monitor, &stream->io) == -1) {
+        goto free_inputs;
+    }
+
+    while ((input = TAILQ_FIRST (&inputs)) != NULL) {
+        TAILQ_REMOVE (&inputs, input, entries);
+        TAILQ_INSERT_TAIL (&(stream->inputs), input, entries);
+    }
+    return (0);
+
+  free_inputs:
+    while ((input = TAILQ_FIRST (&inputs)) != NULL) {
+        TAILQ_REMOVE (&inputs, input, entries);
+        flm_BufferRelease (input->class.buffer);
+        flm__Free (input);
+    }
+    return (-1);
+}
+
 int
 flm_StreamPushFile (flm_Stream *	stream,
 		    flm_File *		file,
@@ -168,20 +222,27 @@ flm_StreamPushFile (flm_Stream *	stream,
 {
     struct flm__StreamInput * input;
     struct stat stat;
+    off_t size;
 
     if (count == 0) {
-        if (fstat (file->io.sys.fd, &stat) == -1) {
-            return (-1);
+        size = file->size;
+        if (!file->sized) {
+            if (fstat (file->io.sys.fd, &stat) == -1) {
+                return (-1);
+            }
+            size = stat.st_size;
         }
-        if (off > stat.st_size) {
-            off = stat.st_size;
+        if (off > size) {
+            off = size;
         }
-        count = stat.st_size - off;
+        count = size - off;
     }
 
     if ((input = flm__Alloc (sizeof (struct flm__StreamInput))) == NULL) {
         goto error;
     }
+
+    stream->io.wr.want = true;
     if (stream->io.monitor &&                           \
         flm__MonitorIOReset (stream->io.monitor, &stream->io) == -1) {
         goto free_input;
@@ -191,9 +252,9 @@ flm_StreamPushFile (flm_Stream *	stream,
     input->type = FLM__STREAM_TYPE_FILE;
     input->off = off;
     input->count = count;
+    input->fd = -1;
     TAILQ_INSERT_TAIL (&(stream->inputs), input, entries);
 
-    stream->io.wr.want = true;
     return (0);
 
   free_input:
@@ -202,6 +263,27 @@ flm_StreamPushFile (flm_Stream *	stream,
     return (-1);
 }
 
+int
+flm_StreamPushDescriptor (flm_Stream *	stream,
+			  flm_Buffer *	buffer,
+			  int		fd)
+{
+    /**
+     * Ancillary data needs at least one byte to travel with, and would be
+     * lost inside a TLS record.
+     */
+    if (flm_BufferLength (buffer) == 0 || stream->tls.obj || fd < 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EINVAL;
+        return (-1);
+    }
+    if (flm_StreamPushBuffer (stream, buffer, 0, 0) == -1) {
+        return (-1);
+    }
+    TAILQ_LAST (&stream->inputs, flin)->fd = fd;
+    return (0);
+}
+
 void
 flm_StreamShutdown (flm_Stream *        stream)
 {
@@ -211,182 +293,975 @@ flm_StreamShutdown (flm_Stream *        stream)
 void
 flm_StreamClose (flm_Stream *           stream)
 {
+    /**
+     * No close_notify, the peer may be gone already
+     */
+    stream->tls.quiet = true;
     flm_IOClose (&stream->io);
 }
 
+int
+flm_StreamPauseRead (flm_Stream *       stream)
+{
+    if (!stream->io.rd.want) {
+        return (0);
+    }
+    stream->io.rd.want = false;
+    if (stream->io.monitor &&                                   \
+        flm__MonitorIOReset (stream->io.monitor, &stream->io) == -1) {
+        return (-1);
+    }
+    return (0);
+}
+
+int
+flm_StreamResumeRead (flm_Stream *      stream)
+{
+    /**
+     * A shutdown is permanent
+     */
+    if (stream->io.cl.shutdown || stream->io.rd.want) {
+        return (0);
+    }
+    stream->io.rd.want = true;
+    if (stream->io.monitor &&                                   \
+        flm__MonitorIOReset (stream->io.monitor, &stream->io) == -1) {
+        return (-1);
+    }
+    return (0);
+}
+
 void
-flm_StreamOnRead (flm_Stream *		stream,
-		  flm_StreamReadHandler	handler)
+flm_StreamLimitRead (flm_Stream *       stream,
+                     flm_RateLimit *    limit)
 {
-    stream->rd.handler = handler;
+    flm__RateLimitAttach (&stream->rd.rate, limit);
     return ;
 }
 
 void
-flm_StreamOnWrite (flm_Stream *			stream,
-		   flm_StreamWriteHandler	handler)
+flm_StreamLimitWrite (flm_Stream *      stream,
+                      flm_RateLimit *   limit)
 {
-    stream->wr.handler = handler;
+    flm__RateLimitAttach (&stream->wr.rate, limit);
     return ;
 }
 
 void
-flm_StreamOnClose (flm_Stream *                 stream,
-                   flm_StreamCloseHandler       handler)
+flm_StreamFrameRead (flm_Stream *       stream,
+                     flm_Framer *       framer)
 {
-    flm_IOOnClose (&stream->io, (flm_IOCloseHandler) handler);
+    if (framer) {
+        flm_FramerRetain (framer);
+    }
+    if (stream->rd.framer) {
+        flm_FramerRelease (stream->rd.framer);
+    }
+    stream->rd.framer = framer;
+    return ;
 }
 
 void
-flm_StreamOnError (flm_Stream *                 stream,
-                   flm_StreamErrorHandler       handler)
+flm_StreamHTTPRead (flm_Stream *        stream,
+                    flm_HTTPParser *    parser)
 {
-    flm_IOOnError (&stream->io, (flm_IOErrorHandler) handler);
+    if (parser) {
+        flm_HTTPParserRetain (parser);
+    }
+    if (stream->rd.http) {
+        flm_HTTPParserRelease (stream->rd.http);
+    }
+    stream->rd.http = parser;
+    return ;
 }
 
 int
-flm_StreamStartTLSServer (flm_Stream *               stream,
-                          SSL_CTX *                  context)
+flm_StreamReadLines (flm_Stream *       stream,
+                     size_t             max)
 {
-    /**
-     * TODO: don't forget to flush the existing buffers, since an
-     * attacker could easily inject some clear-text data right after the
-     * TLS negociation.
-     */
-    if (flm__StreamInitTLS (stream, context) == -1) {
-        goto error;
-    }
+    flm_Framer * framer;
 
-    if (SSL_accept (stream->tls.obj) < 0) {
-        goto shutdown_tls;
+    if ((framer = flm_FramerLineNew (max)) == NULL) {
+        return (-1);
     }
+    flm_StreamFrameRead (stream, framer);
+    flm_FramerRelease (framer);
+    return (0);
+}
 
+int
+flm_StreamZeroCopy (flm_Stream *        stream,
+                    size_t              threshold)
+{
+#if defined (FLM_STREAM__ZEROCOPY)
+    int one;
+
+    if (threshold && stream->zc.threshold == 0) {
+        one = 1;
+        if (setsockopt (stream->io.sys.fd,                      \
+                        SOL_SOCKET,                             \
+                        SO_ZEROCOPY,                            \
+                        &one,                                   \
+                        sizeof (one)) == -1) {
+            flm__Error = FLM_ERR_ERRNO;
+            return (-1);
+        }
+    }
+    stream->zc.threshold = threshold;
     return (0);
+#else
+    (void) stream;
+    (void) threshold;
 
-  shutdown_tls:
-    flm__StreamShutdownTLS (stream);
-  error:
+    flm__Error = FLM_ERR_NOSYS;
     return (-1);
+#endif
 }
 
-flm_Stream *
-flm_StreamRetain (flm_Stream * stream)
+int
+flm_StreamPrefetch (flm_Stream *        stream,
+                    flm_FileQueue *     file_queue)
 {
-    return (flm__Retain (&stream->io.obj));
-}
+#if defined (FLM_STREAM__PREFETCH)
+    if (file_queue && file_queue->monitor != stream->io.monitor) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+    if (file_queue) {
+        flm_FileQueueRetain (file_queue);
+    }
+    if (stream->pf.queue) {
+        flm_FileQueueRelease (stream->pf.queue);
+    }
+    stream->pf.queue = file_queue;
+    return (0);
+#else
+    (void) stream;
+    (void) file_queue;
 
-void
-flm_StreamRelease (flm_Stream * stream)
-{
-    flm__Release (&stream->io.obj);
-    return ;
+    flm__Error = FLM_ERR_NOSYS;
+    return (-1);
+#endif
 }
 
 int
-flm__StreamInit (flm_Stream *	stream,
-		 flm_Monitor *	monitor,
-		 int		fd,
-		 void *		state)
+flm_StreamRelay (flm_Stream *           from,
+                 flm_Stream *           to)
 {
-    if (flm__IOInit (&stream->io, monitor, fd, state) == -1) {
+#if defined (HAVE_SPLICE)
+    struct flm__StreamRelay * relay;
+
+    /**
+     * TLS records have to go through user space
+     */
+    if (from->relay.obj || from->tls.obj || to->tls.obj) {
+        flm__Error = FLM_ERR_BUG;
         return (-1);
     }
-    stream->io.obj.type = FLM__TYPE_STREAM;
-
-    stream->io.obj.perf.destruct =                              \
-        (flm__ObjPerfDestruct_f) flm__StreamPerfDestruct;
-
-    stream->io.perf.read	=                       \
-        (flm__IOSysRead_f) flm__StreamPerfRead;
 
-    stream->io.perf.write	=                       \
-        (flm__IOSysWrite_f) flm__StreamPerfWrite;
+    if ((relay = flm__Alloc (sizeof (struct flm__StreamRelay))) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (-1);
+    }
+    if (flm__StreamRelayInit (relay, from, to) == -1) {
+        flm__Free (relay);
+        return (-1);
+    }
+    from->relay.obj = relay;
+    return (0);
+#else
+    (void) from;
+    (void) to;
 
-    TAILQ_INIT (&stream->inputs);
+    flm__Error = FLM_ERR_NOSYS;
+    return (-1);
+#endif
+}
 
-    flm_StreamOnRead (stream, NULL);
-    flm_StreamOnWrite (stream, NULL);
+int
+flm_StreamMigrate (flm_Stream *                 stream,
+                   flm_Thread *                 thread,
+                   flm_StreamMigrateHandler     handler)
+{
+    flm_Timer * timer;
 
-    stream->perf.alloc = flm__StreamPerfAlloc;
+    if (stream->io.cl.shutdown || stream->io.cl.closed) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EINVAL;
+        return (-1);
+    }
 
-    stream->tls.obj = NULL;
+    /**
+     * Relays, rate limits and file queues are bound to the monitor of the
+     * stream
+     */
+    if (stream->mg.thread || stream->relay.obj ||               \
+        stream->rd.rate.limit || stream->wr.rate.limit ||       \
+        stream->pf.queue) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EBUSY;
+        return (-1);
+    }
 
-    return (0);
-}
+    /**
+     * The reference of the caller goes along with the stream, and the
+     * thread is only retained and released from this side.
+     */
+    stream->mg.thread = flm_ThreadRetain (thread);
+    stream->mg.handler = handler;
 
-int
-flm__StreamInitTLS (flm_Stream *                stream,
-                    SSL_CTX *                   context)
-{
-    stream->tls.obj = SSL_new (context);
-    if (stream->tls.obj == NULL) {
-        goto error;
+    /**
+     * The monitor may still be dispatching the events of the stream, it
+     * is only detached once its timers are run. Held until then so that
+     * nothing is read or written anymore.
+     */
+    stream->io.rd.hold = true;
+    stream->io.wr.hold = true;
+    if (stream->io.monitor == NULL) {
+        flm__StreamMigrateDetach (NULL, stream);
+        return (0);
     }
-    if (!SSL_set_fd (stream->tls.obj, stream->io.sys.fd)) {
-        goto free_obj;
+    if ((timer = flm_TimerNew (stream->io.monitor,              \
+                               flm__StreamMigrateDetach,        \
+                               stream,                          \
+                               0)) == NULL) {
+        goto error;
     }
+    flm_TimerRelease (timer);
     return (0);
 
-  free_obj:
-    SSL_free (stream->tls.obj);
-    stream->tls.obj = NULL;
   error:
+    stream->io.rd.hold = false;
+    stream->io.wr.hold = false;
+    flm_ThreadRelease (stream->mg.thread);
+    stream->mg.thread = NULL;
     return (-1);
 }
 
-void
-flm__StreamShutdownTLS (flm_Stream *    stream)
+uint64_t
+flm_StreamRelayed (flm_Stream *         stream)
 {
-    if (stream->tls.obj) {
-        SSL_free (stream->tls.obj);
-        stream->tls.obj = NULL;
+    if (stream->relay.obj == NULL) {
+        return (0);
     }
-    return ;
+    return (stream->relay.obj->count);
 }
 
 void
-flm__StreamPerfDestruct (flm_Stream * stream)
+flm_StreamOnRead (flm_Stream *		stream,
+		  flm_StreamReadHandler	handler)
 {
-    struct flm__StreamInput * input;
-    struct flm__StreamInput temp;
-
-    /**
-     * Remove remaining stuff to write
-     */
-    TAILQ_FOREACH (input, &stream->inputs, entries) {
-        temp.entries = input->entries;
-        flm__Release (input->class.obj);
-        TAILQ_REMOVE (&stream->inputs, input, entries);
-        flm__Free (input);
-        input = &temp;
-    }
-    flm__StreamShutdownTLS (stream);
-    flm__IOPerfDestruct (&stream->io);
+    stream->rd.handler = handler;
     return ;
 }
 
-flm_Buffer *
-flm__StreamPerfAlloc (flm_Stream *      stream)
+void
+flm_StreamOnWrite (flm_Stream *			stream,
+		   flm_StreamWriteHandler	handler)
 {
-    char *              content;
-    flm_Buffer *        buffer;
-
-    (void) stream;
-
-    content = flm__Alloc (FLM_STREAM__RBUFFER_SIZE);
-    if (content == NULL) {
-        goto error;
-    }
-    buffer = flm_BufferNew (content, FLM_STREAM__RBUFFER_SIZE, flm__Free);
-    if (buffer == NULL) {
-        goto free_content;
-    }
-    return (buffer);
-
-  free_content:
-    flm__Free (content);
-  error:
-    return (NULL);
+    stream->wr.handler = handler;
+    return ;
+}
+
+void
+flm_StreamOnClose (flm_Stream *                 stream,
+                   flm_StreamCloseHandler       handler)
+{
+    flm_IOOnClose (&stream->io, (flm_IOCloseHandler) handler);
+}
+
+void
+flm_StreamOnDescriptor (flm_Stream *			stream,
+                        flm_StreamDescriptorHandler	handler)
+{
+    stream->rd.descriptor = handler;
+    return ;
+}
+
+void
+flm_StreamOnError (flm_Stream *                 stream,
+                   flm_StreamErrorHandler       handler)
+{
+    flm_IOOnError (&stream->io, (flm_IOErrorHandler) handler);
+}
+
+int
+flm_StreamStartTLSServer (flm_Stream *               stream,
+                          SSL_CTX *                  context)
+{
+    if (flm__StreamInitTLS (stream, context) == -1) {
+        goto error;
+    }
+    SSL_set_accept_state (stream->tls.obj);
+
+    /**
+     * The rest of the handshake is driven by the monitor
+     */
+    if (flm__StreamTLSHandshake (stream) == -1) {
+        goto shutdown_tls;
+    }
+
+    return (0);
+
+  shutdown_tls:
+    flm__StreamShutdownTLS (stream);
+  error:
+    return (-1);
+}
+
+int
+flm_StreamStartTLSClient (flm_Stream *               stream,
+                          SSL_CTX *                  context)
+{
+    if (flm__StreamInitTLS (stream, context) == -1) {
+        goto error;
+    }
+    SSL_set_connect_state (stream->tls.obj);
+
+    if (flm__StreamTLSHandshake (stream) == -1) {
+        goto shutdown_tls;
+    }
+
+    return (0);
+
+  shutdown_tls:
+    flm__StreamShutdownTLS (stream);
+  error:
+    return (-1);
+}
+
+int
+flm_StreamKernelTLS (flm_Stream *               stream)
+{
+#if defined (FLM_STREAM__KTLS)
+    if (stream->tls.obj) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+    stream->tls.kernel = true;
+    return (0);
+#else
+    (void) stream;
+
+    flm__Error = FLM_ERR_NOSYS;
+    return (-1);
+#endif
+}
+
+int
+flm_StreamTLSOffload (flm_Stream *              stream)
+{
+    return (stream->tls.offload);
+}
+
+int
+flm_StreamTLSResume (flm_Stream *               stream,
+                     SSL_SESSION *              session)
+{
+    if (stream->tls.obj) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+    SSL_SESSION_up_ref (session);
+    if (stream->tls.session) {
+        SSL_SESSION_free (stream->tls.session);
+    }
+    stream->tls.session = session;
+    return (0);
+}
+
+SSL_SESSION *
+flm_StreamTLSSession (flm_Stream *              stream)
+{
+    if (stream->tls.obj == NULL || stream->tls.handshake) {
+        return (NULL);
+    }
+    return (SSL_get1_session (stream->tls.obj));
+}
+
+int
+flm_StreamTLSResumed (flm_Stream *              stream)
+{
+    if (stream->tls.obj == NULL || stream->tls.handshake) {
+        return (0);
+    }
+    return (SSL_session_reused (stream->tls.obj) ? 1 : 0);
+}
+
+flm_Stream *
+flm_StreamRetain (flm_Stream * stream)
+{
+    return (flm__Retain (&stream->io.obj));
+}
+
+void
+flm_StreamRelease (flm_Stream * stream)
+{
+    flm__Release (&stream->io.obj);
+    return ;
+}
+
+int
+flm__StreamInit (flm_Stream *	stream,
+		 flm_Monitor *	monitor,
+		 int		fd,
+		 void *		state)
+{
+    if (flm__IOInit (&stream->io, monitor, fd, state) == -1) {
+        return (-1);
+    }
+    stream->io.obj.type = FLM__TYPE_STREAM;
+
+    stream->io.obj.perf.destruct =                              \
+        (flm__ObjPerfDestruct_f) flm__StreamPerfDestruct;
+
+    stream->io.perf.read	=                       \
+        (flm__IOSysRead_f) flm__StreamPerfRead;
+
+    stream->io.perf.write	=                       \
+        (flm__IOSysWrite_f) flm__StreamPerfWrite;
+
+    stream->io.perf.close	=                       \
+        (flm__IOSysClose_f) flm__StreamPerfClose;
+
+    stream->io.perf.error	=                       \
+        (flm__IOSysError_f) flm__StreamPerfError;
+
+    TAILQ_INIT (&stream->inputs);
+
+    flm_StreamOnRead (stream, NULL);
+    flm_StreamOnWrite (stream, NULL);
+    flm_StreamOnDescriptor (stream, NULL);
+
+    stream->perf.alloc = flm__StreamPerfAlloc;
+
+    stream->rd.framer = NULL;
+    stream->rd.http = NULL;
+
+    stream->rd.rate.limit = NULL;
+    stream->rd.rate.io = &stream->io;
+    stream->rd.rate.hold = &stream->io.rd.hold;
+    stream->rd.rate.waiting = false;
+
+    stream->wr.rate.limit = NULL;
+    stream->wr.rate.io = &stream->io;
+    stream->wr.rate.hold = &stream->io.wr.hold;
+    stream->wr.rate.waiting = false;
+
+    stream->tls.obj = NULL;
+    stream->tls.flush = false;
+    stream->tls.quiet = false;
+    stream->tls.kernel = false;
+    stream->tls.offload = FLM_STREAM_TLS_USER;
+    stream->tls.session = NULL;
+
+    stream->relay.obj = NULL;
+
+    stream->mg.thread = NULL;
+    stream->mg.handler = NULL;
+
+    stream->zc.threshold = 0;
+    stream->zc.seq = 0;
+    TAILQ_INIT (&stream->zc.pending);
+
+    stream->fc.data = NULL;
+    stream->fc.input = NULL;
+    stream->fc.off = 0;
+    stream->fc.len = 0;
+
+    stream->dr.data[0] = NULL;
+    stream->dr.data[1] = NULL;
+    stream->dr.reading = false;
+    stream->dr.input = NULL;
+
+    stream->pf.queue = NULL;
+    stream->pf.warm = false;
+    stream->pf.file = NULL;
+    stream->pf.next = 0;
+
+    return (0);
+}
+
+int
+flm__StreamInitTLS (flm_Stream *                stream,
+                    SSL_CTX *                   context)
+{
+    if (stream->tls.obj || stream->relay.obj) {
+        flm__Error = FLM_ERR_BUG;
+        goto error;
+    }
+
+    stream->tls.obj = SSL_new (context);
+    if (stream->tls.obj == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        goto error;
+    }
+    if (!SSL_set_fd (stream->tls.obj, stream->io.sys.fd)) {
+        flm__Error = FLM_ERR_BUG;
+        goto free_obj;
+    }
+
+    /**
+     * Records are written straight from the queued buffers, a write
+     * interrupted by EAGAIN is retried with the same data but maybe from
+     * another buffer if the stream was drained in the meantime.
+     */
+    SSL_set_mode (stream->tls.obj,                              \
+                  SSL_MODE_ENABLE_PARTIAL_WRITE |               \
+                  SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#if defined (SSL_OP_IGNORE_UNEXPECTED_EOF)
+    SSL_set_options (stream->tls.obj, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+#if defined (FLM_STREAM__KTLS)
+    /**
+     * OpenSSL installs the keys on the socket when they are negotiated
+     * and keeps them in user space if the kernel cannot handle them.
+     */
+    if (stream->tls.kernel) {
+        SSL_set_options (stream->tls.obj, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+    if (stream->tls.session) {
+        SSL_set_session (stream->tls.obj, stream->tls.session);
+        SSL_SESSION_free (stream->tls.session);
+        stream->tls.session = NULL;
+    }
+
+    stream->tls.handshake = true;
+    stream->tls.flush = false;
+    stream->tls.failed = false;
+    stream->tls.rd_blocked = false;
+    stream->tls.wr_blocked = false;
+    stream->tls.retry = 0;
+    return (0);
+
+  free_obj:
+    SSL_free (stream->tls.obj);
+    stream->tls.obj = NULL;
+  error:
+    return (-1);
+}
+
+void
+flm__StreamShutdownTLS (flm_Stream *    stream)
+{
+    if (stream->tls.obj) {
+        SSL_free (stream->tls.obj);
+        stream->tls.obj = NULL;
+    }
+    if (stream->tls.session) {
+        SSL_SESSION_free (stream->tls.session);
+        stream->tls.session = NULL;
+    }
+    return ;
+}
+
+int
+flm__StreamTLSHandshake (flm_Stream *   stream)
+{
+    int ret;
+
+    stream->tls.flush = false;
+
+    ERR_clear_error ();
+    ret = SSL_do_handshake (stream->tls.obj);
+    if (ret == 1) {
+        stream->tls.handshake = false;
+        flm__StreamTLSOffload (stream);
+        /**
+         * Both directions were waiting for the handshake, records may
+         * already be buffered and the queued data can be sent.
+         */
+        stream->io.rd.can = true;
+        if (TAILQ_FIRST (&stream->inputs)) {
+            stream->io.wr.want = true;
+        }
+        if (stream->io.monitor) {
+            flm__MonitorIOReset (stream->io.monitor, &stream->io);
+        }
+        return (0);
+    }
+
+    switch (SSL_get_error (stream->tls.obj, ret)) {
+    case SSL_ERROR_WANT_READ:
+        return (0);
+
+    case SSL_ERROR_WANT_WRITE:
+        stream->tls.flush = true;
+        if (!stream->io.wr.want) {
+            stream->io.wr.want = true;
+            if (stream->io.monitor) {
+                flm__MonitorIOReset (stream->io.monitor, &stream->io);
+            }
+        }
+        return (0);
+    }
+
+    stream->tls.failed = true;
+    flm__Error = FLM_ERR_ERRNO;
+    errno = EPROTO;
+    return (-1);
+}
+
+void
+flm__StreamTLSOffload (flm_Stream *     stream)
+{
+    stream->tls.offload = FLM_STREAM_TLS_USER;
+#if defined (FLM_STREAM__KTLS)
+    if (BIO_get_ktls_send (SSL_get_wbio (stream->tls.obj))) {
+        stream->tls.offload |= FLM_STREAM_TLS_KERNEL_SEND;
+    }
+    if (BIO_get_ktls_recv (SSL_get_rbio (stream->tls.obj))) {
+        stream->tls.offload |= FLM_STREAM_TLS_KERNEL_RECV;
+    }
+#endif
+    return ;
+}
+
+void
+flm__StreamTLSRead (flm_Stream *        stream,
+                    size_t              max)
+{
+    flm_Buffer *        input;
+    flm_Buffer *        buffer;
+    size_t              size;
+    int                 nb_read;
+
+    /**
+     * A write was waiting for the peer, the socket has to be polled
+     * again for the write to be retried.
+     */
+    if (stream->tls.wr_blocked) {
+        stream->tls.wr_blocked = false;
+        if (stream->io.monitor) {
+            flm__MonitorIOReset (stream->io.monitor, &stream->io);
+        }
+    }
+
+    if (stream->tls.handshake) {
+        if (flm__StreamTLSHandshake (stream) == -1) {
+            goto fatal;
+        }
+        if (stream->tls.handshake) {
+            stream->io.rd.can = false;
+            return ;
+        }
+    }
+
+    if ((input = stream->perf.alloc (stream)) == NULL) {
+        stream->io.rd.can = false;
+        return ;
+    }
+    size = flm_BufferLength (input);
+    if (size > max) {
+        size = max;
+    }
+
+    ERR_clear_error ();
+    nb_read = SSL_read (stream->tls.obj, flm_BufferContent (input), size);
+    if (nb_read <= 0) {
+        flm_BufferRelease (input);
+        stream->io.rd.can = false;
+
+        switch (SSL_get_error (stream->tls.obj, nb_read)) {
+        case SSL_ERROR_WANT_READ:
+            return ;
+
+        case SSL_ERROR_WANT_WRITE:
+            /**
+             * The peer asked for a new key or a renegociation
+             */
+            stream->tls.rd_blocked = true;
+            stream->io.wr.want = true;
+            if (stream->io.monitor) {
+                flm__MonitorIOReset (stream->io.monitor, &stream->io);
+            }
+            return ;
+
+        case SSL_ERROR_ZERO_RETURN:
+            /* close */
+            stream->tls.quiet = true;
+            flm__StreamReadEnd (stream);
+            flm_IOShutdown (&stream->io);
+            return ;
+
+        case SSL_ERROR_SYSCALL:
+            if (errno == EINTR) {
+                stream->io.rd.can = true;
+                return ;
+            }
+            stream->tls.failed = true;
+            flm__Error = FLM_ERR_ERRNO;
+            goto fatal;
+
+        default:
+            stream->tls.failed = true;
+            flm__Error = FLM_ERR_ERRNO;
+            errno = EPROTO;
+            goto fatal;
+        }
+    }
+
+    /**
+     * Keep reading until the kernel buffer is empty, records may have
+     * been split across reads.
+     */
+    stream->io.rd.can = true;
+    if (stream->rd.rate.limit) {
+        flm__RateLimitConsume (stream->rd.rate.limit, nb_read);
+    }
+
+    buffer = flm_BufferView (input, 0, nb_read);
+    flm_BufferRelease (input);
+    if (buffer == NULL) {
+        if (stream->io.er.handler) {
+            stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
+        }
+        return ;
+    }
+    flm__StreamReadBuffer (stream, buffer);
+    return ;
+
+  fatal:
+    flm_IOClose (&stream->io);
+    if (stream->io.er.handler) {
+        stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
+    }
+    return ;
+}
+
+ssize_t
+flm__StreamTLSWrite (flm_Stream *       stream,
+                     size_t             max)
+{
+    struct flm__StreamInput *   input;
+    char *                      content;
+    size_t                      available;
+    size_t                      size;
+    int                         nb_write;
+
+    /**
+     * A read was waiting to send something
+     */
+    if (stream->tls.rd_blocked) {
+        stream->tls.rd_blocked = false;
+        if (stream->io.monitor) {
+            flm__MonitorIOReset (stream->io.monitor, &stream->io);
+        }
+    }
+
+    if (stream->tls.handshake) {
+        if (flm__StreamTLSHandshake (stream) == -1) {
+            return (-1);
+        }
+        if (stream->tls.handshake) {
+            errno = EAGAIN;
+            return (-1);
+        }
+    }
+
+    if ((input = TAILQ_FIRST (&stream->inputs)) == NULL) {
+        return (0);
+    }
+
+    /**
+     * An interrupted write must be retried with the same length
+     */
+    size = stream->tls.retry;
+    if (size == 0) {
+        size = FLM_STREAM__TLS_RECORD_SIZE;
+        if (size > input->count) {
+            size = input->count;
+        }
+        if (size > max) {
+            size = max;
+        }
+    }
+
+    switch (input->type) {
+    case FLM__STREAM_TYPE_BUFFER:
+        content = &(flm_BufferContent (input->class.buffer)[input->off]);
+        break ;
+
+    case FLM__STREAM_TYPE_FILE:
+        /**
+         * Files have to be encrypted in user space, an interrupted record
+         * is still in the chunk when it is retried.
+         */
+        if (input->class.file->direct) {
+            content = flm__StreamDirectChunk (stream, input, &available);
+        }
+        else {
+            content = flm__StreamFileChunk (stream, input, &available);
+        }
+        if (content == NULL) {
+            return (-1);
+        }
+        if (size > available) {
+            size = available;
+        }
+        break ;
+
+    default:
+        errno = EINVAL;
+        return (-1);
+    }
+
+    input->tried = size;
+
+    ERR_clear_error ();
+    nb_write = SSL_write (stream->tls.obj, content, size);
+    if (nb_write > 0) {
+        stream->tls.retry = 0;
+        return (nb_write);
+    }
+
+    switch (SSL_get_error (stream->tls.obj, nb_write)) {
+    case SSL_ERROR_WANT_READ:
+        stream->tls.wr_blocked = true;
+        /* FALLTHROUGH */
+    case SSL_ERROR_WANT_WRITE:
+        stream->tls.retry = size;
+        if (input->type == FLM__STREAM_TYPE_FILE) {
+            if (input->class.file->direct) {
+                flm__StreamDirectAhead (stream);
+            }
+            else {
+                flm__StreamFileFill (stream);
+            }
+        }
+        errno = EAGAIN;
+        break ;
+
+    case SSL_ERROR_SYSCALL:
+        stream->tls.failed = true;
+        if (errno == 0) {
+            errno = EPIPE;
+        }
+        break ;
+
+    default:
+        stream->tls.failed = true;
+        errno = EPROTO;
+        break ;
+    }
+    return (-1);
+}
+
+void
+flm__StreamPerfDestruct (flm_Stream * stream)
+{
+    struct flm__StreamInput * input;
+    struct flm__StreamInput temp;
+    struct flm__StreamZeroCopy * zc;
+    struct flm__StreamZeroCopy zc_temp;
+
+    /**
+     * Remove remaining stuff to write
+     */
+    TAILQ_FOREACH (input, &stream->inputs, entries) {
+        temp.entries = input->entries;
+        if (input->fd != -1) {
+            close (input->fd);
+        }
+        flm__Release (input->class.obj);
+        TAILQ_REMOVE (&stream->inputs, input, entries);
+        flm__Free (input);
+        input = &temp;
+    }
+    TAILQ_FOREACH (zc, &stream->zc.pending, entries) {
+        zc_temp.entries = zc->entries;
+        flm_BufferRelease (zc->buffer);
+        TAILQ_REMOVE (&stream->zc.pending, zc, entries);
+        flm__Free (zc);
+        zc = &zc_temp;
+    }
+    if (stream->relay.obj) {
+        flm__StreamRelayStop (stream);
+        flm__Release (&stream->relay.obj->obj);
+    }
+    /**
+     * The monitor may be gone already, the chunk cannot go back to it
+     */
+    if (stream->fc.data) {
+        flm__FreeAligned (stream->fc.data);
+    }
+    if (stream->dr.data[0]) {
+        flm__FreeAligned (stream->dr.data[0]);
+    }
+    if (stream->dr.data[1]) {
+        flm__FreeAligned (stream->dr.data[1]);
+    }
+    if (stream->pf.queue) {
+        flm_FileQueueRelease (stream->pf.queue);
+    }
+    flm__RateLimitAttach (&stream->rd.rate, NULL);
+    flm__RateLimitAttach (&stream->wr.rate, NULL);
+    flm_StreamFrameRead (stream, NULL);
+    flm_StreamHTTPRead (stream, NULL);
+    flm__StreamShutdownTLS (stream);
+    flm__IOPerfDestruct (&stream->io);
+    return ;
+}
+
+void
+flm__StreamPerfClose (flm_Stream *      stream,
+                      flm_Monitor *     monitor)
+{
+    /**
+     * Two streams relayed to each other retain each other, the cycle is
+     * broken here.
+     */
+    if (stream->relay.obj) {
+        flm__StreamRelayStop (stream);
+    }
+
+    /**
+     * Best effort close_notify after a shutdown, the socket may not be
+     * writable anymore. A quiet close is still a clean one, OpenSSL would
+     * drop the session from the cache otherwise.
+     */
+    if (stream->tls.obj &&                                      \
+        !stream->tls.handshake &&                               \
+        !stream->tls.failed) {
+        if (stream->tls.quiet) {
+            SSL_set_shutdown (stream->tls.obj,                  \
+                              SSL_get_shutdown (stream->tls.obj) | \
+                              SSL_SENT_SHUTDOWN);
+        }
+        else {
+            SSL_shutdown (stream->tls.obj);
+        }
+    }
+    flm__IOPerfClose (&stream->io, monitor);
+    return ;
+}
+
+void
+flm__StreamPerfError (flm_Stream *      stream,
+                      flm_Monitor *     monitor)
+{
+    (void) monitor;
+
+    if (TAILQ_FIRST (&stream->zc.pending) == NULL) {
+        return ;
+    }
+    flm__StreamZeroCopyComplete (stream);
+
+    /**
+     * The stream was only kept open for the completions
+     */
+    if (TAILQ_FIRST (&stream->inputs) == NULL &&                \
+        TAILQ_FIRST (&stream->zc.pending) == NULL) {
+        stream->io.wr.want = false;
+    }
+    return ;
+}
+
+flm_Buffer *
+flm__StreamPerfAlloc (flm_Stream *      stream)
+{
+    return (flm__MonitorBuffer (stream->io.monitor, FLM_STREAM__RBUFFER_SIZE));
 }
 
 void
@@ -394,315 +1269,1568 @@ flm__StreamPerfRead (flm_Stream *	stream,
 		     flm_Monitor *	monitor,
 		     uint8_t		count)
 {
-    struct iovec        iovec[count];
-    int                 iov_count;
-    int                 drain_count;
+    struct iovec        iovec[count];
+    int                 iov_count;
+    int                 drain_count;
+
+    flm_Buffer **       inputs;
+
+    ssize_t             nb_read;
+    size_t              drain;
+
+    flm_Buffer *        buffer;
+    size_t              iov_read;
+    size_t              allowed;
+
+    (void) monitor;
+
+    /**
+     * Do not read more than what the rate limit allows
+     */
+    allowed = SIZE_MAX;
+    if (stream->rd.rate.limit &&                                        \
+        (allowed = flm__RateLimitAvailable (stream->rd.rate.limit)) == 0) {
+        stream->io.rd.can = false;
+        flm__RateLimitWait (&stream->rd.rate);
+        return ;
+    }
+
+    if (stream->relay.obj) {
+        flm__StreamRelayRead (stream, allowed);
+        return ;
+    }
+
+    if (stream->tls.obj) {
+        flm__StreamTLSRead (stream, allowed);
+        return ;
+    }
+
+    inputs = flm__Alloc (count * sizeof (flm_Buffer *));
+    if (inputs == NULL) {
+        return ;
+    }
+    for (iov_count = 0; iov_count < count && allowed; iov_count++) {
+        inputs[iov_count] = stream->perf.alloc (stream);
+        if (inputs[iov_count] == NULL) {
+            /* no more memory */
+            count = iov_count;
+            break ;
+
+        }
+        iovec[iov_count].iov_base = flm_BufferContent (inputs[iov_count]);
+        iovec[iov_count].iov_len = flm_BufferLength (inputs[iov_count]);
+        if (iovec[iov_count].iov_len > allowed) {
+            iovec[iov_count].iov_len = allowed;
+        }
+        allowed -= iovec[iov_count].iov_len;
+    }
+    if (iov_count == 0) {
+        goto free_inputs;
+    }
+
+    nb_read = flm__StreamSysReadv (stream, iovec, iov_count);
+
+    drain_count = 0;
+    if (nb_read == 0) {
+        /* close */
+        stream->io.rd.can = false;
+        flm__StreamReadEnd (stream);
+        flm_IOShutdown (&stream->io);
+        goto out;
+    }
+    else if (nb_read < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            /**
+             * the kernel buffer was empty
+             */
+            stream->io.rd.can = false;
+        }
+        else if (errno == EINTR) {
+            /**
+             * interrupted by a signal, just retry
+             */
+            stream->io.rd.can = true;
+        }
+        else {
+            /* fatal error */
+            flm__Error = FLM_ERR_ERRNO;
+            flm_IOClose (&stream->io);
+            /**
+             * Call the error handler
+             */
+            if (stream->io.er.handler) {
+                stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
+            }
+        }
+        goto out;
+    }
+    /* read event */
+    ((flm_IO *)(stream))->rd.can = true;
+    if (stream->rd.rate.limit) {
+        flm__RateLimitConsume (stream->rd.rate.limit, nb_read);
+    }
+    for (drain = nb_read; drain; drain_count++) {
+
+        iov_read = drain < iovec[drain_count].iov_len ?		   \
+            drain : iovec[drain_count].iov_len;
+
+        if ((buffer = flm_BufferView (inputs[drain_count],         \
+                                      0,                           \
+                                      iov_read)) == NULL) {
+            /**
+             * Call the error handler
+             */
+            if (stream->io.er.handler) {
+                stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
+            }
+            goto out;
+        }
+
+        /**
+         * Call the read handler with the new buffer
+         */
+        if (flm__StreamReadBuffer (stream, buffer) == -1) {
+            goto out;
+        }
+
+        if (drain < iovec[drain_count].iov_len) {
+            stream->io.rd.can = false;
+            drain = 0;
+        }
+        else {
+            drain -= iovec[drain_count].iov_len;
+        }
+    }
+
+  out:
+  free_inputs:
+    for (iov_count--; iov_count >= 0; iov_count--) {
+        flm_BufferRelease (inputs[iov_count]);
+    }
+    flm__Free (inputs);
+    return ;
+}
+
+void
+flm__StreamMigrateDetach (flm_Timer *   _timer,
+                          void *        _stream)
+{
+    flm_Stream *        stream;
+    flm_Monitor *       monitor;
+    flm_Thread *        thread;
+
+    (void) _timer;
+
+    stream = _stream;
+    monitor = stream->io.monitor;
+    thread = stream->mg.thread;
+
+    /**
+     * Closed in the meantime
+     */
+    if (stream->io.cl.closed) {
+        stream->mg.thread = NULL;
+        flm_ThreadRelease (thread);
+        flm_StreamRelease (stream);
+        return ;
+    }
+
+    if (monitor) {
+        flm__MonitorIODelete (monitor, &stream->io);
+        stream->io.monitor = NULL;
+    }
+    if (flm_ThreadCall (thread, flm__StreamMigrateAttach, stream) == 0) {
+        /* the stream belongs to the other thread now, do not touch it */
+        flm_ThreadRelease (thread);
+        return ;
+    }
+
+    /**
+     * Back to where it was
+     */
+    stream->mg.thread = NULL;
+    flm_ThreadRelease (thread);
+    stream->io.rd.hold = false;
+    stream->io.wr.hold = false;
+    if (monitor && flm__MonitorIOAdd (monitor, &stream->io) == 0) {
+        stream->io.monitor = monitor;
+    }
+    else {
+        flm__StreamMigrateAbort (stream);
+    }
+    if (stream->io.er.handler) {
+        stream->io.er.handler (&stream->io, stream->io.state, flm_Error ());
+    }
+    flm_StreamRelease (stream);
+    return ;
+}
+
+void
+flm__StreamMigrateAttach (flm_Thread *  thread,
+                          flm_Monitor * monitor,
+                          void *        _state,
+                          void *        _stream)
+{
+    flm_Stream *        stream;
+
+    (void) _state;
+
+    (void) thread;
+
+    stream = _stream;
+    stream->mg.thread = NULL;
+    stream->io.rd.hold = false;
+    stream->io.wr.hold = false;
+    stream->io.monitor = monitor;
+
+    /**
+     * The monitor reports what happened while the stream was detached as
+     * soon as it is added.
+     */
+    if (flm__MonitorIOAdd (monitor, &stream->io) == -1) {
+        stream->io.monitor = NULL;
+        flm__StreamMigrateAbort (stream);
+        if (stream->io.er.handler) {
+            stream->io.er.handler (&stream->io, stream->io.state, flm_Error ());
+        }
+    }
+    else if (stream->mg.handler) {
+        /* the reference given to flm_StreamMigrate() goes to the handler */
+        stream->mg.handler (stream, stream->io.state, monitor);
+        return ;
+    }
+    flm_StreamRelease (stream);
+    return ;
+}
+
+void
+flm__StreamMigrateAbort (flm_Stream *   stream)
+{
+    /**
+     * Watched by no monitor anymore, there is nothing to delete it from.
+     * The descriptor is closed with the stream.
+     */
+    stream->io.rd.can = false;
+    stream->io.rd.want = false;
+    stream->io.wr.can = false;
+    stream->io.wr.want = false;
+    stream->io.cl.shutdown = true;
+    stream->io.cl.closed = true;
+    return ;
+}
+
+ssize_t
+flm__StreamSysReadv (flm_Stream *       stream,
+                     struct iovec *     iovec,
+                     int                iov_count)
+{
+    struct msghdr       msg;
+    struct cmsghdr *    cmsg;
+    ssize_t             nb_read;
+    int *               fds;
+    size_t              fd_count;
+    size_t              i;
+    union {
+        char            buf[CMSG_SPACE (FLM_STREAM__DESCRIPTOR_COUNT *  \
+                                        sizeof (int))];
+        struct cmsghdr  align;
+    } control;
+
+    if (stream->rd.descriptor == NULL) {
+        return (readv (stream->io.sys.fd, iovec, iov_count));
+    }
+
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = iovec;
+    msg.msg_iovlen = iov_count;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof (control.buf);
+
+    /**
+     * The descriptors beyond the size of the control buffer are closed by
+     * the kernel.
+     */
+    if ((nb_read = recvmsg (stream->io.sys.fd, &msg, MSG_CMSG_CLOEXEC)) <= 0) {
+        return (nb_read);
+    }
+    for (cmsg = CMSG_FIRSTHDR (&msg);
+         cmsg != NULL;
+         cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET ||                   \
+            cmsg->cmsg_type != SCM_RIGHTS) {
+            continue ;
+        }
+        fds = (int *) CMSG_DATA (cmsg);
+        fd_count = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+        for (i = 0; i < fd_count; i++) {
+            /**
+             * The handler may have been removed by a previous call
+             */
+            if (stream->rd.descriptor) {
+                stream->rd.descriptor (stream, stream->io.state, fds[i]);
+            }
+            else {
+                close (fds[i]);
+            }
+        }
+    }
+    return (nb_read);
+}
+
+int
+flm__StreamReadBuffer (flm_Stream *     stream,
+                       flm_Buffer *     buffer)
+{
+    int         ret;
+
+    if (stream->rd.http) {
+        /**
+         * The views given to the handlers are only valid during the call
+         */
+        ret = flm_HTTPParserFeed (stream->rd.http, buffer);
+    }
+    else if (stream->rd.framer) {
+        /**
+         * The frames are views of the buffer, they keep it alive
+         */
+        ret = flm_FramerFeed (stream->rd.framer,
+                              buffer,
+                              flm__StreamReadFrame,
+                              stream);
+    }
+    else {
+        if (stream->rd.handler) {
+            stream->rd.handler (stream, stream->io.state, buffer);
+        }
+        return (0);
+    }
+    flm_BufferRelease (buffer);
+    if (ret == -1) {
+        /**
+         * The rest of the flow cannot be parsed anymore, the monitor may
+         * drop its reference to the stream while closing it.
+         */
+        flm_StreamRetain (stream);
+        flm_IOClose (&stream->io);
+        if (stream->io.er.handler) {
+            stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
+        }
+        flm_StreamRelease (stream);
+        return (-1);
+    }
+    return (0);
+}
+
+void
+flm__StreamReadFrame (void *            _stream,
+                      flm_Buffer *      frame)
+{
+    flm_Stream * stream;
+
+    stream = _stream;
+    if (stream->rd.handler) {
+        stream->rd.handler (stream, stream->io.state, frame);
+    }
+    else {
+        flm_BufferRelease (frame);
+    }
+    return ;
+}
+
+void
+flm__StreamReadEnd (flm_Stream *        stream)
+{
+    /**
+     * A response may be terminated by the end of the flow
+     */
+    if (stream->rd.http == NULL ||
+        flm_HTTPParserFinish (stream->rd.http) == 0) {
+        return ;
+    }
+    if (stream->io.er.handler) {
+        stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
+    }
+    return ;
+}
+
+void
+flm__StreamPerfWrite (flm_Stream *	stream,
+		      flm_Monitor *	monitor,
+		      uint8_t		count)
+{
+    struct flm__StreamInput * input;
+    struct flm__StreamInput temp;
+    ssize_t nb_write;
+    ssize_t drain;
+    size_t allowed;
+
+    (void) monitor;
+    (void) count;
+
+    /**
+     * Do not write more than what the rate limit allows, the stream
+     * still wants to write so it will not be closed in the meantime.
+     */
+    allowed = SIZE_MAX;
+    if (stream->wr.rate.limit &&                                        \
+        (allowed = flm__RateLimitAvailable (stream->wr.rate.limit)) == 0) {
+        stream->io.wr.can = false;
+        flm__RateLimitWait (&stream->wr.rate);
+        return ;
+    }
+
+    nb_write = flm__StreamWrite (stream, allowed);
+    if (nb_write < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            /* kernel buffer was full */
+            stream->io.wr.can = false;
+            return ;
+        }
+        else if (errno == EINTR) {
+            /* interrupted by a signal, just retry */
+            stream->io.wr.can = true;
+            return ;
+        }
+        else {
+            /* fatal error */
+            flm__Error = FLM_ERR_ERRNO;
+            flm_IOClose (&stream->io);
+
+            /**
+             * Call the error handler
+             */
+            if (stream->io.er.handler) {
+                stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
+            }
+            return ;
+        }
+    }
+
+    if (stream->wr.rate.limit) {
+        flm__RateLimitConsume (stream->wr.rate.limit, nb_write);
+    }
+
+    /**
+     * Call the write handler with the number of bytes written
+     */
+    if (stream->wr.handler) {
+        stream->wr.handler (stream, stream->io.state, nb_write);
+    }
+
+    drain = nb_write;
+    stream->io.wr.can = true;
+    TAILQ_FOREACH (input, &(stream->inputs), entries) {
+        if (drain == 0) {
+            break ;
+        }
+        if (input->type == FLM__STREAM_TYPE_PIPE) {
+            flm__StreamRelayDrain (stream,
+                                   input->class.relay,
+                                   drain < input->tried ? drain : input->tried);
+        }
+        if (drain < input->tried) {
+            input->off += drain;
+            input->count -= drain;
+            stream->io.wr.can = false;
+            break ;
+        }
+
+        input->off += input->tried;
+        input->count -= input->tried;
+        drain -= input->tried;
+
+        if (input->count == 0) {
+            if (stream->fc.input == input) {
+                flm__StreamFileRelease (stream);
+            }
+            if (stream->dr.input == input) {
+                flm__StreamDirectRelease (stream);
+            }
+            temp.entries = input->entries;
+            flm__Release (input->class.obj);
+            TAILQ_REMOVE (&(stream->inputs), input, entries);
+            flm__Free (input);
+            input = &temp;
+        }
+    }
+
+    if (TAILQ_FIRST (&stream->inputs) == NULL) {
+        /**
+         * Do not let the stream be closed while the kernel may still
+         * read the zero-copy buffers.
+         */
+        if (TAILQ_FIRST (&stream->zc.pending)) {
+            flm__StreamZeroCopyComplete (stream);
+        }
+        if (TAILQ_FIRST (&stream->zc.pending) || stream->tls.flush) {
+            stream->io.wr.can = false;
+        }
+        else {
+            stream->io.wr.want = false;
+        }
+    }
+    return ;
+}
+
+ssize_t
+flm__StreamWrite (flm_Stream *  stream,
+                  size_t        max)
+{
+    struct flm__StreamInput * input;
+    ssize_t nb_write;
+
+    /**
+     * The handshake may have to write before anything is queued. Once the
+     * kernel encrypts the records the plain paths are used, unless OpenSSL
+     * itself has something to write.
+     */
+    if (stream->tls.obj &&                                              \
+        (!(stream->tls.offload & FLM_STREAM_TLS_KERNEL_SEND) ||         \
+         stream->tls.retry ||                                           \
+         stream->tls.rd_blocked)) {
+        return (flm__StreamTLSWrite (stream, max));
+    }
+
+    if ((input = TAILQ_FIRST (&stream->inputs)) == NULL) {
+        return (0);
+    }
+
+    nb_write = 0;
+    switch (input->type) {
+    case FLM__STREAM_TYPE_BUFFER:
+        if (stream->zc.threshold && !stream->tls.obj &&                 \
+            input->count >= stream->zc.threshold && input->fd == -1) {
+            nb_write = flm__StreamSysSendZeroCopy (stream, max);
+        }
+        else {
+            nb_write = flm__StreamSysWritev (stream, max);
+        }
+        break ;
+
+    case FLM__STREAM_TYPE_FILE:
+        if (input->class.file->direct) {
+            nb_write = flm__StreamSysReadWriteTo (stream, max);
+            break ;
+        }
+        if (stream->pf.queue && flm__StreamFileCold (stream, input, &max)) {
+            errno = EAGAIN;
+            return (-1);
+        }
+#if defined (HAVE_SENDFILE)
+        nb_write = flm__StreamSysSendFile (stream, max);
+#else
+        nb_write = flm__StreamSysReadWriteTo (stream, max);
+#endif
+        break ;
+
+    case FLM__STREAM_TYPE_PIPE:
+        nb_write = flm__StreamSysSplice (stream, max);
+        break ;
+    }
+    return (nb_write);
+}
+
+ssize_t
+flm__StreamSysWritev (flm_Stream *      stream,
+                      size_t            max)
+{
+    struct flm__StreamInput * input;
+
+    struct iovec iovec[FLM_STREAM__IOVEC_SIZE];
+    size_t iov_count;
+    struct msghdr msg;
+    struct cmsghdr * cmsg;
+    ssize_t nb_write;
+    union {
+        char buf[CMSG_SPACE (sizeof (int))];
+        struct cmsghdr align;
+    } control;
+
+    iov_count = 0;
+    TAILQ_FOREACH (input, &stream->inputs, entries) {
+        if (iov_count == FLM_STREAM__IOVEC_SIZE || max == 0) {
+            break ;
+        }
+        if (input->type != FLM__STREAM_TYPE_BUFFER) {
+            break ;
+        }
+        /**
+         * One descriptor per message, the receiver gets them one by one
+         */
+        if (iov_count && input->fd != -1) {
+            break ;
+        }
+        if (iov_count && stream->zc.threshold && !stream->tls.obj &&    \
+            input->count >= stream->zc.threshold) {
+            break ;
+        }
+
+        iovec[iov_count].iov_base =
+            &(flm_BufferContent (input->class.buffer)[input->off]);
+        iovec[iov_count].iov_len = input->tried =                      \
+            input->count < max ? input->count : max;
+        max -= iovec[iov_count].iov_len;
+        iov_count++;
+    }
+
+    input = TAILQ_FIRST (&stream->inputs);
+    if (iov_count == 0 || input->fd == -1) {
+        return (writev (stream->io.sys.fd, iovec, iov_count));
+    }
+
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = iovec;
+    msg.msg_iovlen = iov_count;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof (control.buf);
+
+    cmsg = CMSG_FIRSTHDR (&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+    memcpy (CMSG_DATA (cmsg), &input->fd, sizeof (int));
+
+    /**
+     * The peer has its own copy as soon as a byte went through
+     */
+    if ((nb_write = sendmsg (stream->io.sys.fd, &msg, 0)) > 0) {
+        close (input->fd);
+        input->fd = -1;
+    }
+    return (nb_write);
+}
+
+char *
+flm__StreamFileChunk (flm_Stream *                      stream,
+                      struct flm__StreamInput *         input,
+                      size_t *                          size)
+{
+    size_t available;
+
+    if (stream->fc.data == NULL) {
+        stream->fc.data = flm__MonitorChunkGet (stream->io.monitor);
+        if (stream->fc.data == NULL) {
+            errno = ENOMEM;
+            return (NULL);
+        }
+        stream->fc.input = NULL;
+    }
+
+    if (stream->fc.input != input ||                                    \
+        input->off < stream->fc.off ||                                  \
+        input->off > stream->fc.off + (off_t) stream->fc.len) {
+        stream->fc.input = input;
+        stream->fc.off = input->off;
+        stream->fc.len = 0;
+    }
+
+    /**
+     * Top the chunk up before it runs too low to fill the socket
+     */
+    available = stream->fc.off + stream->fc.len - input->off;
+    if (available < FLM__MONITOR_CHUNK_SIZE / 4 && available < input->count) {
+        if (flm__StreamFileFill (stream) == -1 && available == 0) {
+            return (NULL);
+        }
+        available = stream->fc.off + stream->fc.len - input->off;
+    }
+
+    *size = available < input->count ? available : input->count;
+    return (&stream->fc.data[input->off - stream->fc.off]);
+}
+
+int
+flm__StreamFileFill (flm_Stream *       stream)
+{
+    struct flm__StreamInput *   input;
+    size_t                      sent;
+    size_t                      size;
+    ssize_t                     rcount;
+
+    input = stream->fc.input;
+
+    /**
+     * Keep only what was not sent yet
+     */
+    sent = input->off - stream->fc.off;
+    if (sent) {
+        memmove (stream->fc.data,
+                 &stream->fc.data[sent],
+                 stream->fc.len - sent);
+        stream->fc.off += sent;
+        stream->fc.len -= sent;
+    }
+
+    size = FLM__MONITOR_CHUNK_SIZE - stream->fc.len;
+    if (size > input->count - stream->fc.len) {
+        size = input->count - stream->fc.len;
+    }
+    if (size == 0) {
+        return (0);
+    }
+
+    do {
+        rcount = pread (input->class.file->io.sys.fd,
+                        &stream->fc.data[stream->fc.len],
+                        size,
+                        stream->fc.off + stream->fc.len);
+    } while (rcount == -1 && errno == EINTR);
+
+    if (rcount == -1) {
+        return (-1);
+    }
+    if (rcount == 0 && stream->fc.len == 0) {
+        /* truncated under our feet */
+        errno = EIO;
+        return (-1);
+    }
+    stream->fc.len += rcount;
+    return (0);
+}
+
+void
+flm__StreamFileRelease (flm_Stream *    stream)
+{
+    if (stream->fc.data) {
+        flm__MonitorChunkPut (stream->io.monitor, stream->fc.data);
+        stream->fc.data = NULL;
+    }
+    stream->fc.input = NULL;
+    return ;
+}
+
+char *
+flm__StreamDirectChunk (flm_Stream *                    stream,
+                        struct flm__StreamInput *       input,
+                        size_t *                        size)
+{
+    int         pos;
+    off_t       end;
+
+    /**
+     * A read still queued for the previous input has to complete first
+     */
+    if (stream->dr.reading && stream->dr.input != input) {
+        stream->io.wr.pause = true;
+        errno = EAGAIN;
+        return (NULL);
+    }
+
+    if (stream->dr.data[0] == NULL) {
+        stream->dr.data[0] = flm__MonitorChunkGet (stream->io.monitor);
+        stream->dr.data[1] = flm__MonitorChunkGet (stream->io.monitor);
+        if (stream->dr.data[0] == NULL || stream->dr.data[1] == NULL) {
+            flm__StreamDirectRelease (stream);
+            errno = ENOMEM;
+            return (NULL);
+        }
+        stream->dr.input = NULL;
+    }
+    if (stream->dr.input != input) {
+        stream->dr.input = input;
+        stream->dr.off[0] = 0;
+        stream->dr.off[1] = 0;
+        stream->dr.len[0] = 0;
+        stream->dr.len[1] = 0;
+        stream->dr.cur = 0;
+        stream->dr.error = 0;
+    }
+
+    /**
+     * Move on to the next chunk once the current one is sent, the first
+     * one is read from the loop.
+     */
+    pos = stream->dr.cur;
+    if (input->off < stream->dr.off[pos] ||                             \
+        input->off >= stream->dr.off[pos] + (off_t) stream->dr.len[pos]) {
+        if (stream->dr.reading) {
+            stream->io.wr.pause = true;
+            errno = EAGAIN;
+            return (NULL);
+        }
+        if (stream->dr.error) {
+            errno = stream->dr.error;
+            return (NULL);
+        }
+        pos = 1 - pos;
+        if (input->off < stream->dr.off[pos] ||                         \
+            input->off >= stream->dr.off[pos] + (off_t) stream->dr.len[pos]) {
+            end = input->off & ~((off_t) FLM__FILE_DIRECT_ALIGN - 1);
+            if (flm__StreamDirectRead (stream, pos, end) == -1) {
+                return (NULL);
+            }
+        }
+        stream->dr.cur = pos;
+    }
+
+    if (stream->pf.queue) {
+        flm__StreamDirectAhead (stream);
+    }
+
+    end = stream->dr.off[pos] + stream->dr.len[pos];
+    *size = end - input->off < (off_t) input->count ?                   \
+        (size_t) (end - input->off) : input->count;
+    return (&stream->dr.data[pos][input->off - stream->dr.off[pos]]);
+}
+
+int
+flm__StreamDirectRead (flm_Stream *     stream,
+                       int              pos,
+                       off_t            off)
+{
+    ssize_t rcount;
+
+    do {
+        rcount = pread (stream->dr.input->class.file->io.sys.fd,
+                        stream->dr.data[pos],
+                        FLM__MONITOR_CHUNK_SIZE,
+                        off);
+    } while (rcount == -1 && errno == EINTR);
+
+    if (rcount == -1) {
+        return (-1);
+    }
+    if (off + rcount <= stream->dr.input->off) {
+        /* truncated under our feet */
+        errno = EIO;
+        return (-1);
+    }
+    stream->dr.off[pos] = off;
+    stream->dr.len[pos] = rcount;
+    return (0);
+}
+
+void
+flm__StreamDirectAhead (flm_Stream *    stream)
+{
+    struct flm__StreamInput *   input;
+    flm_Buffer *                buffer;
+    off_t                       end;
+    int                         pos;
+
+    input = stream->dr.input;
+    if (input == NULL || stream->dr.reading || stream->dr.error) {
+        return ;
+    }
+
+    /**
+     * Nothing left to read after the current chunk, or read already
+     */
+    pos = 1 - stream->dr.cur;
+    end = stream->dr.off[stream->dr.cur] + stream->dr.len[stream->dr.cur];
+    if (stream->dr.len[stream->dr.cur] < FLM__MONITOR_CHUNK_SIZE ||     \
+        end >= input->off + (off_t) input->count ||                     \
+        (stream->dr.len[pos] && stream->dr.off[pos] == end)) {
+        return ;
+    }
+
+    if (stream->pf.queue == NULL) {
+        if (flm__StreamDirectRead (stream, pos, end) == -1) {
+            stream->dr.error = errno;
+        }
+        return ;
+    }
+
+    /**
+     * The stream is kept alive, and the chunk in place, until the helper
+     * thread is done with it.
+     */
+    buffer = flm_BufferNew (stream->dr.data[pos],
+                            FLM__MONITOR_CHUNK_SIZE,
+                            NULL);
+    if (buffer == NULL) {
+        return ;
+    }
+    stream->dr.off[pos] = end;
+    stream->dr.len[pos] = 0;
+    if (flm_FileQueueRead (stream->pf.queue,
+                           input->class.file,
+                           buffer,
+                           end,
+                           flm__StreamDirectDone,
+                           stream) == 0) {
+        stream->dr.reading = true;
+        flm_StreamRetain (stream);
+    }
+    flm_BufferRelease (buffer);
+    return ;
+}
+
+void
+flm__StreamDirectDone (flm_File *       file,
+                       void *           _stream,
+                       flm_Buffer *     buffer,
+                       ssize_t          count)
+{
+    flm_Stream * stream;
+
+    (void) file;
+    (void) buffer;
+
+    stream = _stream;
+    stream->dr.reading = false;
+
+    /**
+     * The input was sent, or dropped, while the chunk was read
+     */
+    if (stream->dr.input == NULL) {
+        flm__StreamDirectRelease (stream);
+    }
+    else if (count <= 0) {
+        stream->dr.error = count == 0 ? EIO : errno;
+    }
+    else {
+        stream->dr.len[1 - stream->dr.cur] = count;
+    }
+
+    if (stream->io.wr.pause) {
+        stream->io.wr.pause = false;
+        if (stream->io.monitor && !stream->io.cl.closed) {
+            flm__MonitorIOReset (stream->io.monitor, &stream->io);
+        }
+    }
+    flm_StreamRelease (stream);
+    return ;
+}
+
+void
+flm__StreamDirectRelease (flm_Stream *  stream)
+{
+    stream->dr.input = NULL;
+
+    /**
+     * The helper thread may still be reading into the chunks
+     */
+    if (stream->dr.reading) {
+        return ;
+    }
+    if (stream->dr.data[0]) {
+        flm__MonitorChunkPut (stream->io.monitor, stream->dr.data[0]);
+    }
+    if (stream->dr.data[1]) {
+        flm__MonitorChunkPut (stream->io.monitor, stream->dr.data[1]);
+    }
+    stream->dr.data[0] = NULL;
+    stream->dr.data[1] = NULL;
+    return ;
+}
+
+bool
+flm__StreamFileCold (flm_Stream *                       stream,
+                     struct flm__StreamInput *          input,
+                     size_t *                           max)
+{
+#if defined (FLM_STREAM__PREFETCH)
+    struct iovec        iovec;
+    size_t              size;
+    char                byte;
+    int                 fd;
+
+    if (*max > FLM_STREAM__PREFETCH_WINDOW) {
+        *max = FLM_STREAM__PREFETCH_WINDOW;
+    }
+    size = input->count < *max ? input->count : *max;
+
+    /**
+     * Just brought in, do not check it twice
+     */
+    if (stream->pf.warm) {
+        stream->pf.warm = false;
+        return (false);
+    }
+
+    /**
+     * The first and the last pages of the range tell if it was read
+     * recently, the read ahead of the kernel fills what is in between.
+     * Without support from the file system, send it as before.
+     */
+    stream->pf.queue->stats.probes++;
+    fd = input->class.file->io.sys.fd;
+    iovec.iov_base = &byte;
+    iovec.iov_len = 1;
+    if ((preadv2 (fd, &iovec, 1, input->off, RWF_NOWAIT) != -1 &&      \
+         preadv2 (fd, &iovec, 1, input->off + size - 1, RWF_NOWAIT) != -1) || \
+        errno != EAGAIN) {
+        flm__StreamPrefetchAhead (stream, input);
+        return (false);
+    }
+
+    /**
+     * Let a helper thread wait for the disk, the writes are held until
+     * then and the stream is kept alive by the pending prefetch.
+     */
+    size = input->count < FLM_STREAM__PREFETCH_SIZE ?                  \
+        input->count : FLM_STREAM__PREFETCH_SIZE;
+    if (flm__FileQueuePush (stream->pf.queue,
+                            FLM__FILE_QUEUE_PREFETCH,
+                            input->class.file,
+                            NULL,
+                            input->off,
+                            size,
+                            flm__StreamPrefetched,
+                            stream) == -1) {
+        return (false);
+    }
+    stream->pf.file = input->class.file;
+    stream->pf.next = input->off + size;
+    stream->pf.queue->stats.stalls_avoided++;
+    stream->io.wr.pause = true;
+    flm_StreamRetain (stream);
+    return (true);
+#else
+    (void) stream;
+    (void) input;
+    (void) max;
+
+    return (false);
+#endif
+}
+
+void
+flm__StreamPrefetchAhead (flm_Stream *                  stream,
+                          struct flm__StreamInput *     input)
+{
+    off_t end;
+    size_t size;
+
+    /**
+     * Keep the disk busy with the next range while this one is sent, the
+     * file is only compared and never dereferenced.
+     */
+    if (stream->pf.file != input->class.file || stream->pf.next < input->off) {
+        stream->pf.file = input->class.file;
+        stream->pf.next = input->off;
+    }
+    end = input->off + input->count;
+    if (stream->pf.next >= end ||                                       \
+        stream->pf.next >= input->off + FLM_STREAM__PREFETCH_SIZE) {
+        return ;
+    }
+
+    size = FLM_STREAM__PREFETCH_SIZE;
+    if (size > (size_t) (end - stream->pf.next)) {
+        size = end - stream->pf.next;
+    }
+    if (flm__FileQueuePush (stream->pf.queue,
+                            FLM__FILE_QUEUE_PREFETCH,
+                            input->class.file,
+                            NULL,
+                            stream->pf.next,
+                            size,
+                            NULL,
+                            NULL) == 0) {
+        stream->pf.next += size;
+    }
+    return ;
+}
+
+void
+flm__StreamPrefetched (flm_File *       file,
+                       void *           _stream,
+                       flm_Buffer *     buffer,
+                       ssize_t          count)
+{
+    flm_Stream * stream;
+
+    (void) file;
+    (void) buffer;
+    (void) count;
+
+    /**
+     * On error the write finds out by itself
+     */
+    stream = _stream;
+    stream->pf.warm = true;
+    stream->io.wr.pause = false;
+    if (stream->io.monitor && !stream->io.cl.closed) {
+        flm__MonitorIOReset (stream->io.monitor, &stream->io);
+    }
+    flm_StreamRelease (stream);
+    return ;
+}
+
+ssize_t
+flm__StreamSysReadWriteTo (flm_Stream * stream,
+                           size_t       max)
+{
+    struct flm__StreamInput *   input;
+    char *                      content;
+    ssize_t                     wcount;
+    size_t                      size;
+
+    if ((input = TAILQ_FIRST (&stream->inputs)) == NULL) {
+        return (0);
+    }
+
+    if (input->class.file->direct) {
+        content = flm__StreamDirectChunk (stream, input, &size);
+    }
+    else {
+        content = flm__StreamFileChunk (stream, input, &size);
+    }
+    if (content == NULL) {
+        return (-1);
+    }
+    if (size > max) {
+        size = max;
+    }
+
+    /**
+     * What the socket does not take stays in the chunk for the next try
+     */
+    input->tried = size;
+    wcount = write (stream->io.sys.fd, content, size);
+    if (wcount == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        /**
+         * Read ahead while the socket drains
+         */
+        if (input->class.file->direct) {
+            flm__StreamDirectAhead (stream);
+        }
+        else {
+            flm__StreamFileFill (stream);
+        }
+        errno = EAGAIN;
+    }
+    return (wcount);
+}
+
+ssize_t
+flm__StreamSysSendFile (flm_Stream *    stream,
+                        size_t          max)
+{
+    struct flm__StreamInput *   input;
+    off_t                       off;
+
+    if ((input = TAILQ_FIRST (&stream->inputs)) == NULL) {
+        return (0);
+    }
+
+    off = input->off;
+    input->tried = input->count < max ? input->count : max;
+    return (sendfile (stream->io.sys.fd,              \
+                      input->class.file->io.sys.fd,   \
+                      &off,                           \
+                      input->tried));
+}
+
+ssize_t
+flm__StreamSysSplice (flm_Stream *      stream,
+                      size_t            max)
+{
+#if defined (HAVE_SPLICE)
+    struct flm__StreamInput *   input;
+
+    if ((input = TAILQ_FIRST (&stream->inputs)) == NULL) {
+        return (0);
+    }
+
+    input->tried = input->count < max ? input->count : max;
+    return (splice (input->class.relay->pipe[0],                \
+                    NULL,                                       \
+                    stream->io.sys.fd,                          \
+                    NULL,                                       \
+                    input->tried,                               \
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK));
+#else
+    (void) stream;
+    (void) max;
+
+    errno = ENOSYS;
+    return (-1);
+#endif
+}
+
+ssize_t
+flm__StreamSysSendZeroCopy (flm_Stream *        stream,
+                            size_t              max)
+{
+#if defined (FLM_STREAM__ZEROCOPY)
+    struct flm__StreamInput *           input;
+    struct flm__StreamZeroCopy *        zc;
+    struct iovec                        iovec;
+    struct msghdr                       msg;
+    ssize_t                             nb_write;
+
+    if ((input = TAILQ_FIRST (&stream->inputs)) == NULL) {
+        return (0);
+    }
+
+    /**
+     * Copying is still better than not sending anything
+     */
+    if ((zc = flm__Alloc (sizeof (struct flm__StreamZeroCopy))) == NULL) {
+        return (flm__StreamSysWritev (stream, max));
+    }
+
+    iovec.iov_base = &(flm_BufferContent (input->class.buffer)[input->off]);
+    iovec.iov_len = input->tried = input->count < max ? input->count : max;
+
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = &iovec;
+    msg.msg_iovlen = 1;
+
+    nb_write = sendmsg (stream->io.sys.fd, &msg, MSG_ZEROCOPY);
+    if (nb_write == -1) {
+        flm__Free (zc);
+        /**
+         * Too many notifications are waiting in the socket
+         */
+        if (errno == ENOBUFS) {
+            return (flm__StreamSysWritev (stream, max));
+        }
+        return (-1);
+    }
+
+    /**
+     * The kernel numbers every successful call, the buffer is released
+     * once the completion of its number is reported.
+     */
+    zc->buffer = flm_BufferRetain (input->class.buffer);
+    zc->seq = stream->zc.seq++;
+    TAILQ_INSERT_TAIL (&stream->zc.pending, zc, entries);
+    return (nb_write);
+#else
+    return (flm__StreamSysWritev (stream, max));
+#endif
+}
+
+void
+flm__StreamZeroCopyComplete (flm_Stream *       stream)
+{
+#if defined (FLM_STREAM__ZEROCOPY)
+    struct flm__StreamZeroCopy *        zc;
+    struct flm__StreamZeroCopy          temp;
+    struct sock_extended_err *          err;
+    struct cmsghdr *                    cmsg;
+    struct msghdr                       msg;
+    char                                control[128];
+
+    for (;;) {
+        memset (&msg, 0, sizeof (msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof (control);
+
+        if (recvmsg (stream->io.sys.fd, &msg, MSG_ERRQUEUE) == -1) {
+            if (errno == EINTR) {
+                continue ;
+            }
+            /* nothing left */
+            break ;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR (&msg);                               \
+             cmsg != NULL;                                              \
+             cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP &&                         \
+                  cmsg->cmsg_type == IP_RECVERR) &&                     \
+                !(cmsg->cmsg_level == SOL_IPV6 &&                       \
+                  cmsg->cmsg_type == IPV6_RECVERR)) {
+                continue ;
+            }
+            err = (struct sock_extended_err *) CMSG_DATA (cmsg);
+            if (err->ee_errno != 0 ||                                   \
+                err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue ;
+            }
+
+            /**
+             * [ee_info, ee_data] is the range of completed calls, the
+             * comparison works across the wrap of the counter.
+             */
+            TAILQ_FOREACH (zc, &stream->zc.pending, entries) {
+                if ((uint32_t) (zc->seq - err->ee_info) >               \
+                    (uint32_t) (err->ee_data - err->ee_info)) {
+                    continue ;
+                }
+                temp.entries = zc->entries;
+                flm_BufferRelease (zc->buffer);
+                TAILQ_REMOVE (&stream->zc.pending, zc, entries);
+                flm__Free (zc);
+                zc = &temp;
+            }
+        }
+    }
+#else
+    (void) stream;
+#endif
+    return ;
+}
+
+int
+flm__StreamRelayInit (struct flm__StreamRelay * relay,
+                      flm_Stream *              from,
+                      flm_Stream *              to)
+{
+#if defined (F_GETPIPE_SZ)
+    int size;
+#endif
+
+    flm__ObjInit (&relay->obj);
+
+    relay->obj.type = FLM__TYPE_STREAM_RELAY;
+
+    relay->obj.perf.destruct =                                  \
+        (flm__ObjPerfDestruct_f) flm__StreamRelayPerfDestruct;
+
+#if defined (HAVE_SPLICE)
+    if (pipe2 (relay->pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (-1);
+    }
+#else
+    flm__Error = FLM_ERR_NOSYS;
+    return (-1);
+#endif
+
+    relay->size = FLM_STREAM__RELAY_PIPE_SIZE;
+#if defined (F_GETPIPE_SZ)
+    if ((size = fcntl (relay->pipe[1], F_GETPIPE_SZ)) > 0) {
+        relay->size = size;
+    }
+#endif
+
+    relay->from = from;
+    relay->to = flm_StreamRetain (to);
+
+    relay->pending = 0;
+    relay->count = 0;
+
+    relay->paused = false;
+    relay->starved = false;
+    relay->eof = false;
+
+    return (0);
+}
+
+void
+flm__StreamRelayPerfDestruct (struct flm__StreamRelay * relay)
+{
+    close (relay->pipe[0]);
+    close (relay->pipe[1]);
+    return ;
+}
 
-    flm_Buffer **       inputs;
+void
+flm__StreamRelayStop (flm_Stream *      stream)
+{
+    struct flm__StreamRelay * relay;
 
-    ssize_t             nb_read;
-    size_t              drain;
+    relay = stream->relay.obj;
+    if (relay->to == NULL) {
+        return ;
+    }
 
-    flm_Buffer *        buffer;
-    size_t              iov_read;
+    /**
+     * What is still in the pipe will be written by the destination
+     */
+    relay->from = NULL;
+    flm_StreamRelease (relay->to);
+    relay->to = NULL;
+    return ;
+}
 
-    (void) monitor;
+void
+flm__StreamRelayRead (flm_Stream *      stream,
+                      size_t            max)
+{
+#if defined (HAVE_SPLICE)
+    struct flm__StreamRelay *   relay;
+    ssize_t                     nb_read;
 
-    inputs = flm__Alloc (count * sizeof (flm_Buffer *));
-    if (inputs == NULL) {
+    relay = stream->relay.obj;
+
+    /**
+     * Nowhere to write to anymore
+     */
+    if (relay->to == NULL || relay->to->io.cl.closed) {
+        stream->io.rd.can = false;
+        flm_IOShutdown (&stream->io);
         return ;
     }
-    for (iov_count = 0; iov_count < count; iov_count++) {
-        inputs[iov_count] = stream->perf.alloc (stream);
-        if (inputs[iov_count] == NULL) {
-            /* no more memory */
-            count = iov_count;
-            break ;
 
-        }
-        iovec[iov_count].iov_base = flm_BufferContent (inputs[iov_count]);
-        iovec[iov_count].iov_len = flm_BufferLength (inputs[iov_count]);
+    /**
+     * Stop reading while the pipe is full, the destination will resume
+     * the stream once it has written something.
+     */
+    if (relay->pending >= relay->size) {
+        stream->io.rd.can = false;
+        relay->paused = true;
+        flm_StreamPauseRead (stream);
+        return ;
     }
-    if (iov_count == 0) {
-        goto free_inputs;
+    if (max > relay->size - relay->pending) {
+        max = relay->size - relay->pending;
     }
 
-    nb_read = readv (((flm_IO *)(stream))->sys.fd, iovec, iov_count);
-
-    drain_count = 0;
+    nb_read = splice (stream->io.sys.fd,                        \
+                      NULL,                                     \
+                      relay->pipe[1],                           \
+                      NULL,                                     \
+                      max,                                      \
+                      SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
     if (nb_read == 0) {
-        /* close */
         stream->io.rd.can = false;
-        flm_IOShutdown (&stream->io);
-        goto out;
+        flm__StreamRelayEnd (stream);
+        return ;
     }
     else if (nb_read < 0) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
             /**
-             * the kernel buffer was empty
+             * Either the source is empty or the pipe has no free slot
+             * left, in the latter case the edge is lost so the stream
+             * has to be reset once the pipe is drained.
              */
             stream->io.rd.can = false;
+            relay->starved = relay->pending > 0;
         }
         else if (errno == EINTR) {
-            /**
-             * interrupted by a signal, just retry
-             */
             stream->io.rd.can = true;
         }
         else {
-            /* fatal error */
             flm__Error = FLM_ERR_ERRNO;
             flm_IOClose (&stream->io);
-            /**
-             * Call the error handler
-             */
             if (stream->io.er.handler) {
                 stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
             }
         }
-        goto out;
+        return ;
     }
-    /* read event */
-    ((flm_IO *)(stream))->rd.can = true;
-    for (drain = nb_read; drain; drain_count++) {
-
-        iov_read = drain < iovec[drain_count].iov_len ?		   \
-            drain : iovec[drain_count].iov_len;
 
-        if ((buffer = flm_BufferView (inputs[drain_count],         \
-                                      0,                           \
-                                      iov_read)) == NULL) {
-            /**
-             * Call the error handler
-             */
-            if (stream->io.er.handler) {
-                stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
-            }
-            goto out;
-        }
+    stream->io.rd.can = true;
+    if (stream->rd.rate.limit) {
+        flm__RateLimitConsume (stream->rd.rate.limit, nb_read);
+    }
+    relay->pending += nb_read;
 
+    if (flm__StreamRelayPush (relay->to, relay, nb_read) == -1) {
         /**
-         * Call the read handler with the new buffer
+         * The destination cannot keep track of the pipe anymore
          */
-        if (stream->rd.handler) {
-            stream->rd.handler (stream, &stream->io.state, buffer);
-        }
-
-        if (drain < iovec[drain_count].iov_len) {
-            stream->io.rd.can = false;
-            drain = 0;
-        }
-        else {
-            drain -= iovec[drain_count].iov_len;
+        flm_IOClose (&relay->to->io);
+        flm_IOClose (&stream->io);
+        if (stream->io.er.handler) {
+            stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
         }
     }
+#else
+    (void) max;
 
-  out:
-    /* free remaining iov_bases */
-    for (iov_count = drain_count; iov_count < count; iov_count++) {
-        flm__Free (iovec[iov_count].iov_base);
-    }
-
-  free_inputs:
-    for (iov_count--; iov_count >= 0; iov_count--) {
-        flm_BufferRelease (inputs[iov_count]);
-    }
-    flm__Free (inputs);
+    stream->io.rd.can = false;
+#endif
     return ;
 }
 
 void
-flm__StreamPerfWrite (flm_Stream *	stream,
-		      flm_Monitor *	monitor,
-		      uint8_t		count)
+flm__StreamRelayEnd (flm_Stream *       stream)
 {
-    struct flm__StreamInput * input;
-    struct flm__StreamInput temp;
-    ssize_t nb_write;
-    ssize_t drain;
-
-    (void) monitor;
-    (void) count;
+    struct flm__StreamRelay *   relay;
+    struct flm__StreamRelay *   reverse;
+    flm_Stream *                to;
 
-    nb_write = flm__StreamWrite (stream);
-    if (nb_write < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            /* kernel buffer was full */
-            stream->io.wr.can = false;
-            return ;
-        }
-        else if (errno == EINTR) {
-            /* interrupted by a signal, just retry */
-            stream->io.wr.can = true;
-            return ;
-        }
-        else {
-            /* fatal error */
-            flm__Error = FLM_ERR_ERRNO;
-            flm_IOClose (&stream->io);
+    relay = stream->relay.obj;
+    relay->eof = true;
 
-            /**
-             * Call the error handler
-             */
-            if (stream->io.er.handler) {
-                stream->io.er.handler (&stream->io, stream->io.state, flm_Error());
-            }
-            return ;
-        }
-    }
+    /**
+     * Shutting down the streams below may close them and stop the relays
+     */
+    to = flm_StreamRetain (relay->to);
 
     /**
-     * Call the write handler with the number of bytes written
+     * Forward the half-close once everything has been written
      */
-    if (stream->wr.handler) {
-        stream->wr.handler (stream, stream->io.state, nb_write);
+    if (relay->pending == 0) {
+        shutdown (to->io.sys.fd, SHUT_WR);
     }
 
-    drain = nb_write;
-    stream->io.wr.can = true;
-    TAILQ_FOREACH (input, &(stream->inputs), entries) {
-        if (drain == 0) {
-            break ;
-        }
-        if (drain < input->tried) {
-            input->off += drain;
-            input->count -= drain;
-            stream->io.wr.can = false;
-            break ;
-        }
-
-        input->off += input->tried;
-        input->count -= input->tried;
-        drain -= input->tried;
-
-        if (input->count == 0) {
-            temp.entries = input->entries;
-            flm__Release (input->class.obj);
-            TAILQ_REMOVE (&(stream->inputs), input, entries);
-            flm__Free (input);
-            input = &temp;
+    reverse = to->relay.obj;
+    if (reverse && reverse->to == stream) {
+        if (!reverse->eof) {
+            /**
+             * The other direction is still open
+             */
+            flm_StreamPauseRead (stream);
+            flm_StreamRelease (to);
+            return ;
         }
+        flm_IOShutdown (&to->io);
     }
-
-    if (TAILQ_FIRST (&stream->inputs) == NULL) {
-        stream->io.wr.want = false;
-    }
+    flm_IOShutdown (&stream->io);
+    flm_StreamRelease (to);
     return ;
 }
 
-ssize_t
-flm__StreamWrite (flm_Stream * stream)
-{
-    struct flm__StreamInput * input;
-    ssize_t nb_write;
-
-    if ((input = TAILQ_FIRST (&stream->inputs)) == NULL) {
-        return (0);
-    }
-
-    nb_write = 0;
-    switch (input->type) {
-    case FLM__STREAM_TYPE_BUFFER:
-        nb_write = flm__StreamSysWritev (stream);
-        break ;
-
-    case FLM__STREAM_TYPE_FILE:
-#if defined (HAVE_SENDFILE)
-        nb_write = flm__StreamSysSendFile (stream);
-#else
-        nb_write = flm__StreamSysReadWriteTo (stream);
-#endif
-        break ;
-    }
-    return (nb_write);
-}
-
-ssize_t
-flm__StreamSysWritev (flm_Stream * stream)
+int
+flm__StreamRelayPush (flm_Stream *              stream,
+                      struct flm__StreamRelay * relay,
+                      size_t                    count)
 {
     struct flm__StreamInput * input;
 
-    struct iovec iovec[FLM_STREAM__IOVEC_SIZE];
-    size_t iov_count;
-
-    iov_count = 0;
-    TAILQ_FOREACH (input, &stream->inputs, entries) {
-        if (iov_count == FLM_STREAM__IOVEC_SIZE) {
-            break ;
-        }
-        if (input->type != FLM__STREAM_TYPE_BUFFER) {
-            break ;
-        }
-
-        iovec[iov_count].iov_base =
-            &(flm_BufferContent (input->class.buffer)[input->off]);
-        iovec[iov_count].iov_len = input->tried = input->count;
-        iov_count++;
-    }
-    return (writev (stream->io.sys.fd, iovec, iov_count));
-}
-
-ssize_t
-flm__StreamSysReadWriteTo (flm_Stream * stream)
-{
-    struct flm__StreamInput *   input;
-    char *                      buffer;
-    ssize_t                     rcount;
-    ssize_t                     wcount;
-
-    if ((input = TAILQ_FIRST (&stream->inputs)) == NULL) {
+    /**
+     * Consecutive reads only grow the last input
+     */
+    input = TAILQ_LAST (&stream->inputs, flin);
+    if (input &&                                        \
+        input->type == FLM__STREAM_TYPE_PIPE &&         \
+        input->class.relay == relay) {
+        input->count += count;
         return (0);
     }
 
-    if (lseek (input->class.file->io.sys.fd,
-               input->off,
-               SEEK_SET) == -1) {
-        goto error;
-    }
-
-    buffer = flm__Alloc (FLM_STREAM__READ_FILE_SIZE * sizeof (char));
-    if (buffer == NULL) {
+    if ((input = flm__Alloc (sizeof (struct flm__StreamInput))) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
         goto error;
     }
 
-    rcount = read (input->class.file->io.sys.fd,
-                   buffer,
-                   FLM_STREAM__READ_FILE_SIZE);
-    if (rcount == -1) {
-        goto free_buffer;
-    }
-
-    input->tried = rcount;
-
-    wcount = write (stream->io.sys.fd, buffer, rcount);
-    if (wcount == -1) {
-        goto free_buffer;
+    stream->io.wr.want = true;
+    if (stream->io.monitor &&                                   \
+        flm__MonitorIOReset (stream->io.monitor, &stream->io) == -1) {
+        goto free_input;
     }
 
-    flm__Free (buffer);
+    input->class.relay = flm__Retain (&relay->obj);
+    input->type = FLM__STREAM_TYPE_PIPE;
+    input->off = 0;
+    input->count = count;
+    input->fd = -1;
+    TAILQ_INSERT_TAIL (&(stream->inputs), input, entries);
 
-    return (wcount);
+    return (0);
 
-  free_buffer:
-    flm__Free (buffer);
+  free_input:
+    flm__Free (input);
   error:
     return (-1);
 }
 
-ssize_t
-flm__StreamSysSendFile (flm_Stream * stream)
+void
+flm__StreamRelayDrain (flm_Stream *                     stream,
+                       struct flm__StreamRelay *        relay,
+                       size_t                           count)
 {
-    struct flm__StreamInput *   input;
-    off_t                       off;
+    flm_Stream * from;
 
-    if ((input = TAILQ_FIRST (&stream->inputs)) == NULL) {
-        return (0);
+    relay->pending -= count;
+    relay->count += count;
+
+    if (relay->pending == 0 && relay->eof) {
+        shutdown (stream->io.sys.fd, SHUT_WR);
     }
 
-    off = input->off;
-    input->tried = input->count;
-    return (sendfile (stream->io.sys.fd,              \
-                      input->class.file->io.sys.fd,   \
-                      &off,                           \
-                      input->tried));
+    if ((from = relay->from) == NULL) {
+        return ;
+    }
+    if (relay->paused) {
+        relay->paused = false;
+        relay->starved = false;
+        flm_StreamResumeRead (from);
+    }
+    else if (relay->starved) {
+        relay->starved = false;
+        if (from->io.monitor) {
+            flm__MonitorIOReset (from->io.monitor, &from->io);
+        }
+    }
+    return ;
 }
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include "flm/core/public/error.h"
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/stream.h"
+#include "flm/core/private/tcp_client.h"
+
+/**
+ * Linux sends the data of the first write with the SYN when this option
+ * is set, the connect() call itself returns at once.
+ */
+#if defined (TCP_FASTOPEN_CONNECT)
+# define FLM_TCP_CLIENT__FASTOPEN
+#endif
+
+flm_TCPClient *
+flm_TCPClientNew (flm_Monitor *		monitor,
+                  const char *		address,
+                  uint16_t		port,
+                  void *		state)
+{
+    flm_TCPClient * tcp_client;
+
+    tcp_client = flm__Alloc (sizeof (flm_TCPClient));
+    if (tcp_client == NULL) {
+        return (NULL);
+    }
+    if (flm__TCPClientInit (tcp_client, monitor, address, port, state) == -1) {
+        flm__Free (tcp_client);
+        return (NULL);
+    }
+    return (tcp_client);
+}
+
+void
+flm_TCPClientTimeout (flm_TCPClient *	tcp_client,
+                      uint32_t		delay)
+{
+    tcp_client->to.delay = delay;
+    return ;
+}
+
+int
+flm_TCPClientFastOpen (flm_TCPClient *	tcp_client)
+{
+#if defined (FLM_TCP_CLIENT__FASTOPEN)
+    if (tcp_client->connecting) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+    if (setsockopt (tcp_client->io.sys.fd,		\
+                    IPPROTO_TCP,			\
+                    TCP_FASTOPEN_CONNECT,		\
+                    (int[]){1},				\
+                    sizeof (int)) == -1) {
+        /* built with the option but running on an older kernel */
+        if (errno == ENOPROTOOPT || errno == EOPNOTSUPP) {
+            flm__Error = FLM_ERR_NOSYS;
+        }
+        else {
+            flm__Error = FLM_ERR_ERRNO;
+        }
+        return (-1);
+    }
+    return (0);
+#else
+    (void) tcp_client;
+
+    flm__Error = FLM_ERR_NOSYS;
+    return (-1);
+#endif
+}
+
+int
+flm_TCPClientConnect (flm_TCPClient *	tcp_client)
+{
+    if (tcp_client->connecting || tcp_client->io.cl.closed) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+
+    if (connect (tcp_client->io.sys.fd,			\
+                 (struct sockaddr *) &tcp_client->peer.addr,	\
+                 tcp_client->peer.len) == -1 &&		\
+        errno != EINPROGRESS) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (-1);
+    }
+
+    /**
+     * The socket becomes writable once the handshake is over, whatever
+     * its outcome.
+     */
+    tcp_client->io.rd.want = false;
+    tcp_client->io.wr.want = true;
+    if (flm__MonitorIOAdd (tcp_client->io.monitor, &tcp_client->io) == -1) {
+        return (-1);
+    }
+    tcp_client->connecting = true;
+
+    if (tcp_client->to.delay) {
+        tcp_client->to.timer = flm_TimerNew (tcp_client->io.monitor,	\
+                                             flm__TCPClientTimeout,	\
+                                             tcp_client,		\
+                                             tcp_client->to.delay);
+        if (tcp_client->to.timer == NULL) {
+            flm_TCPClientClose (tcp_client);
+            return (-1);
+        }
+    }
+    return (0);
+}
+
+void
+flm_TCPClientClose (flm_TCPClient *	tcp_client)
+{
+    if (!tcp_client->connecting) {
+        return ;
+    }
+    tcp_client->connecting = false;
+
+    if (tcp_client->to.timer) {
+        flm_TimerCancel (tcp_client->to.timer);
+        flm_TimerRelease (tcp_client->to.timer);
+        tcp_client->to.timer = NULL;
+    }
+    flm_IOClose (&tcp_client->io);
+    return ;
+}
+
+void
+flm_TCPClientOnConnect (flm_TCPClient *			tcp_client,
+                        flm_TCPClientConnectHandler	handler)
+{
+    tcp_client->co.handler = handler;
+    return ;
+}
+
+void
+flm_TCPClientOnError (flm_TCPClient *			tcp_client,
+                      flm_TCPClientErrorHandler		handler)
+{
+    tcp_client->er.handler = handler;
+    return ;
+}
+
+flm_TCPClient *
+flm_TCPClientRetain (flm_TCPClient *	tcp_client)
+{
+    return (flm__Retain (&tcp_client->io.obj));
+}
+
+void
+flm_TCPClientRelease (flm_TCPClient *	tcp_client)
+{
+    flm__Release (&tcp_client->io.obj);
+    return ;
+}
+
+int
+flm__TCPClientInit (flm_TCPClient *	tcp_client,
+                    flm_Monitor *	monitor,
+                    const char *	address,
+                    uint16_t		port,
+                    void *		state)
+{
+    struct addrinfo     hints;
+    struct addrinfo *   result;
+    char                str_port[6];
+    int                 fd;
+    long                flags;
+
+    memset (&hints, 0, sizeof (struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    /* never ask the resolver, it would block */
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+    if (snprintf (str_port, sizeof (str_port), "%d", port) < 0) {
+        goto error;
+    }
+    if (getaddrinfo (address, str_port, &hints, &result) != 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EINVAL;
+        goto error;
+    }
+    memcpy (&tcp_client->peer.addr, result->ai_addr, result->ai_addrlen);
+    tcp_client->peer.len = result->ai_addrlen;
+
+    fd = socket (result->ai_family, result->ai_socktype, result->ai_protocol);
+    freeaddrinfo (result);
+    if (fd == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto error;
+    }
+
+    if ((flags = fcntl (fd, F_GETFL, NULL)) < 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto close_fd;
+    }
+    if (fcntl (fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto close_fd;
+    }
+
+    /**
+     * The IO is only given to the monitor by flm_TCPClientConnect()
+     */
+    if (flm__IOInit (&tcp_client->io,		\
+                     NULL,			\
+                     fd,			\
+                     state) == -1) {
+        goto close_fd;
+    }
+    tcp_client->io.obj.type = FLM__TYPE_TCP_CLIENT;
+    tcp_client->io.monitor = monitor;
+
+    tcp_client->io.obj.perf.destruct =			\
+        (flm__ObjPerfDestruct_f) flm__TCPClientPerfDestruct;
+
+    tcp_client->io.perf.write =				\
+        (flm__IOSysWrite_f) flm__TCPClientPerfWrite;
+    tcp_client->io.perf.error =				\
+        (flm__IOSysError_f) flm__TCPClientPerfError;
+
+    tcp_client->connecting = false;
+    tcp_client->to.delay = 0;
+    tcp_client->to.timer = NULL;
+
+    flm_TCPClientOnConnect (tcp_client, NULL);
+    flm_TCPClientOnError (tcp_client, NULL);
+
+    return (0);
+
+  close_fd:
+    close (fd);
+  error:
+    return (-1);
+}
+
+void
+flm__TCPClientPerfDestruct (flm_TCPClient *	tcp_client)
+{
+    if (tcp_client->to.timer) {
+        flm_TimerRelease (tcp_client->to.timer);
+    }
+    flm__IOPerfDestruct (&tcp_client->io);
+    return ;
+}
+
+void
+flm__TCPClientPerfWrite (flm_TCPClient *	tcp_client,
+                         flm_Monitor *		monitor,
+                         uint8_t		count)
+{
+    flm_Stream * stream;
+    socklen_t len;
+    int error;
+    int fd;
+
+    (void) count;
+
+    fd = tcp_client->io.sys.fd;
+    tcp_client->io.wr.can = false;
+
+    len = sizeof (error);
+    if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+        error = errno;
+    }
+    if (error) {
+        errno = error;
+        flm__Error = FLM_ERR_ERRNO;
+        flm__TCPClientFail (tcp_client);
+        return ;
+    }
+
+    /**
+     * The socket now belongs to the stream, the client must not close it
+     * when it is destroyed.
+     */
+    flm_TCPClientRetain (tcp_client);
+    flm_TCPClientClose (tcp_client);
+    tcp_client->io.sys.fd = -1;
+
+    if ((stream = flm_StreamNew (monitor, fd, tcp_client->io.state)) == NULL) {
+        close (fd);
+        if (tcp_client->er.handler) {
+            tcp_client->er.handler (tcp_client,
+                                    tcp_client->io.state,
+                                    flm_Error ());
+        }
+        goto out;
+    }
+    if (tcp_client->co.handler) {
+        tcp_client->co.handler (tcp_client, tcp_client->io.state, stream);
+    }
+    flm_StreamRelease (stream);
+
+  out:
+    flm_TCPClientRelease (tcp_client);
+    return ;
+}
+
+void
+flm__TCPClientPerfError (flm_TCPClient *	tcp_client,
+                         flm_Monitor *		monitor)
+{
+    if (tcp_client->connecting) {
+        flm__TCPClientPerfWrite (tcp_client, monitor, 1);
+    }
+    return ;
+}
+
+void
+flm__TCPClientTimeout (flm_Timer *	timer,
+                       void *		state)
+{
+    (void) timer;
+
+    errno = ETIMEDOUT;
+    flm__Error = FLM_ERR_ERRNO;
+    flm__TCPClientFail (state);
+    return ;
+}
+
+void
+flm__TCPClientFail (flm_TCPClient *	tcp_client)
+{
+    int error;
+    int sys_error;
+
+    error = flm__Error;
+    sys_error = errno;
+
+    flm_TCPClientRetain (tcp_client);
+    flm_TCPClientClose (tcp_client);
+
+    flm__Error = error;
+    errno = sys_error;
+    if (tcp_client->er.handler) {
+        tcp_client->er.handler (tcp_client,
+                                tcp_client->io.state,
+                                flm_Error ());
+    }
+    flm_TCPClientRelease (tcp_client);
+    return ;
+}
@@ -108,7 +108,6 @@ flm__TCPServerInit (flm_TCPServer *	tcp_server,
     char                str_port[6];
     int                 fd;
     int                 error;
-    long                flags;
 
     (void) interface;
 
@@ -143,15 +142,6 @@ flm__TCPServerInit (flm_TCPServer *	tcp_server,
         goto error;
     }
 
-    if ((flags = fcntl (fd, F_GETFL, NULL)) < 0) {
-        flm__Error = FLM_ERR_ERRNO;
-        goto close_fd;
-    }
-    if (fcntl (fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        flm__Error = FLM_ERR_ERRNO;
-        goto close_fd;
-    }
-
     if (setsockopt (fd,                                 \
                     SOL_SOCKET,                         \
                     SO_REUSEADDR,			\
@@ -160,16 +150,44 @@ flm__TCPServerInit (flm_TCPServer *	tcp_server,
         goto close_fd;
     }
 
+    if (flm__TCPServerListen (tcp_server, monitor, fd, state) == -1) {
+        goto close_fd;
+    }
+    return (0);
+
+  close_fd:
+    close (fd);
+  error:
+    return (-1);
+}
+
+int
+flm__TCPServerListen (flm_TCPServer *	tcp_server,
+		      flm_Monitor *	monitor,
+		      int		fd,
+		      void *		state)
+{
+    long                flags;
+
+    if ((flags = fcntl (fd, F_GETFL, NULL)) < 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (-1);
+    }
+    if (fcntl (fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (-1);
+    }
+
     if (listen (fd, 1024) == -1) {
         flm__Error = FLM_ERR_ERRNO;
-        goto close_fd;
+        return (-1);
     }
 
     if (flm__IOInit (&tcp_server->io,           \
                      monitor,			\
                      fd,                        \
                      state) == -1) {
-        goto close_fd;
+        return (-1);
     }
     tcp_server->io.obj.type = FLM__TYPE_TCP_SERVER;
 
@@ -179,11 +197,6 @@ flm__TCPServerInit (flm_TCPServer *	tcp_server,
     flm_TCPServerOnAccept (tcp_server, NULL);
 
     return (0);
-
-  close_fd:
-    close (fd);
-  error:
-    return (-1);
 }
 
 int
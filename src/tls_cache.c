@@ -0,0 +1,669 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/queue.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
+
+#include "flm/core/public/timer.h"
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/obj.h"
+#include "flm/core/private/tls_cache.h"
+
+static void flm__TLSCacheIndexInit (void);
+
+pthread_once_t  flm__TLSCacheIndexOnce = PTHREAD_ONCE_INIT;
+int             flm__TLSCacheExIndex = -1;
+
+flm_TLSCache *
+flm_TLSCacheNew (size_t                 size)
+{
+    flm_TLSCache * cache;
+
+    if ((cache = flm__Alloc (sizeof (flm_TLSCache))) == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (NULL);
+    }
+    if (flm__TLSCacheInit (cache, size) == -1) {
+        flm__Free (cache);
+        return (NULL);
+    }
+    return (cache);
+}
+
+int
+flm_TLSCacheAttach (flm_TLSCache *      cache,
+                    SSL_CTX *           context)
+{
+    int index;
+
+    if ((index = flm__TLSCacheIndex ()) == -1) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (-1);
+    }
+    if (SSL_CTX_get_ex_data (context, index)) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+    if (!SSL_CTX_set_ex_data (context, index, cache)) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (-1);
+    }
+    /**
+     * Released with the context, see flm__TLSCacheExFree()
+     */
+    flm_TLSCacheRetain (cache);
+
+    SSL_CTX_set_session_cache_mode (context,                    \
+                                    SSL_SESS_CACHE_SERVER |     \
+                                    SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb (context, flm__TLSCachePerfNew);
+    SSL_CTX_sess_set_get_cb (context, flm__TLSCachePerfGet);
+    SSL_CTX_sess_set_remove_cb (context, flm__TLSCachePerfRemove);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb (context, flm__TLSCachePerfTicket);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb (context, flm__TLSCachePerfTicket);
+#endif
+    return (0);
+}
+
+int
+flm_TLSCacheRotateKeys (flm_TLSCache *  cache)
+{
+    struct flm__TLSCacheKey key;
+    size_t slot;
+
+    if (RAND_bytes (key.name, sizeof (key.name)) != 1 ||        \
+        RAND_bytes (key.aes, sizeof (key.aes)) != 1 ||          \
+        RAND_bytes (key.hmac, sizeof (key.hmac)) != 1) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (-1);
+    }
+
+    pthread_rwlock_wrlock (&cache->tickets.lock);
+    slot = cache->tickets.current;
+    if (cache->tickets.count) {
+        slot = (slot + 1) % FLM__TLS_CACHE_KEYS;
+    }
+    memcpy (&cache->tickets.keys[slot], &key, sizeof (key));
+    cache->tickets.current = slot;
+    if (cache->tickets.count < FLM__TLS_CACHE_KEYS) {
+        cache->tickets.count++;
+    }
+    pthread_rwlock_unlock (&cache->tickets.lock);
+
+    OPENSSL_cleanse (&key, sizeof (key));
+    __sync_fetch_and_add (&cache->tickets.rotations, 1);
+    return (0);
+}
+
+int
+flm_TLSCacheRotate (flm_TLSCache *      cache,
+                    flm_Monitor *       monitor,
+                    uint32_t            interval)
+{
+    if (cache->tickets.timer) {
+        flm_TimerCancel (cache->tickets.timer);
+        flm_TimerRelease (cache->tickets.timer);
+        cache->tickets.timer = NULL;
+    }
+    cache->tickets.interval = interval;
+    if (interval == 0) {
+        return (0);
+    }
+
+    cache->tickets.timer = flm_TimerNew (monitor,
+                                         flm__TLSCacheRotateHandler,
+                                         cache,
+                                         interval);
+    if (cache->tickets.timer == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (-1);
+    }
+    return (0);
+}
+
+void
+flm_TLSCacheStats (flm_TLSCache *               cache,
+                   struct flm_TLSCacheStats *   stats)
+{
+    struct flm__TLSCacheShard * shard;
+    size_t i;
+
+    memset (stats, 0, sizeof (struct flm_TLSCacheStats));
+    for (i = 0; i < FLM__TLS_CACHE_SHARDS; i++) {
+        shard = &cache->shards[i];
+
+        pthread_mutex_lock (&shard->lock);
+        stats->lookups += shard->lookups;
+        stats->hits += shard->hits;
+        stats->stores += shard->stores;
+        stats->evictions += shard->evictions;
+        pthread_mutex_unlock (&shard->lock);
+    }
+    stats->tickets = __sync_fetch_and_add (&cache->tickets.decrypted, 0);
+    stats->bad_tickets = __sync_fetch_and_add (&cache->tickets.unknown, 0);
+    stats->rotations = __sync_fetch_and_add (&cache->tickets.rotations, 0);
+    return ;
+}
+
+flm_TLSCache *
+flm_TLSCacheRetain (flm_TLSCache *      cache)
+{
+    return (flm__Retain (&cache->obj));
+}
+
+void
+flm_TLSCacheRelease (flm_TLSCache *     cache)
+{
+    flm__Release (&cache->obj);
+    return ;
+}
+
+int
+flm__TLSCacheInit (flm_TLSCache *       cache,
+                   size_t               size)
+{
+    struct flm__TLSCacheShard * shard;
+    size_t nb_buckets;
+    size_t i;
+    size_t j;
+
+    if (size == 0) {
+        flm__Error = FLM_ERR_BUG;
+        goto error;
+    }
+
+    flm__ObjInit (&cache->obj);
+
+    cache->obj.type = FLM__TYPE_TLS_CACHE;
+
+    cache->obj.perf.destruct =                                  \
+        (flm__ObjPerfDestruct_f) flm__TLSCachePerfDestruct;
+
+    for (i = 0; i < FLM__TLS_CACHE_SHARDS; i++) {
+        shard = &cache->shards[i];
+
+        shard->max = (size + FLM__TLS_CACHE_SHARDS - 1) / FLM__TLS_CACHE_SHARDS;
+        shard->count = 0;
+
+        /**
+         * At most one entry per bucket on average
+         */
+        for (nb_buckets = 1; nb_buckets < shard->max; nb_buckets <<= 1) {
+            continue ;
+        }
+        shard->buckets = flm__Alloc (nb_buckets * sizeof (*shard->buckets));
+        if (shard->buckets == NULL) {
+            flm__Error = FLM_ERR_NOMEM;
+            goto free_shards;
+        }
+        for (j = 0; j < nb_buckets; j++) {
+            LIST_INIT (&shard->buckets[j]);
+        }
+        shard->mask = nb_buckets - 1;
+        TAILQ_INIT (&shard->lru);
+
+        if (pthread_mutex_init (&shard->lock, NULL) != 0) {
+            flm__Free (shard->buckets);
+            flm__Error = FLM_ERR_ERRNO;
+            goto free_shards;
+        }
+
+        shard->lookups = 0;
+        shard->hits = 0;
+        shard->stores = 0;
+        shard->evictions = 0;
+    }
+
+    if (pthread_rwlock_init (&cache->tickets.lock, NULL) != 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto free_shards;
+    }
+    cache->tickets.current = 0;
+    cache->tickets.count = 0;
+    cache->tickets.timer = NULL;
+    cache->tickets.interval = 0;
+    cache->tickets.decrypted = 0;
+    cache->tickets.unknown = 0;
+    cache->tickets.rotations = 0;
+
+    if (flm_TLSCacheRotateKeys (cache) == -1) {
+        goto destroy_lock;
+    }
+    return (0);
+
+  destroy_lock:
+    pthread_rwlock_destroy (&cache->tickets.lock);
+  free_shards:
+    while (i--) {
+        pthread_mutex_destroy (&cache->shards[i].lock);
+        flm__Free (cache->shards[i].buckets);
+    }
+  error:
+    return (-1);
+}
+
+void
+flm__TLSCachePerfDestruct (flm_TLSCache *       cache)
+{
+    struct flm__TLSCacheShard * shard;
+    struct flm__TLSCacheEntry * entry;
+    size_t i;
+
+    if (cache->tickets.timer) {
+        flm_TimerCancel (cache->tickets.timer);
+        flm_TimerRelease (cache->tickets.timer);
+    }
+
+    for (i = 0; i < FLM__TLS_CACHE_SHARDS; i++) {
+        shard = &cache->shards[i];
+
+        while ((entry = TAILQ_FIRST (&shard->lru)) != NULL) {
+            flm__TLSCacheUnlink (shard, entry);
+            SSL_SESSION_free (entry->session);
+            flm__Free (entry);
+        }
+        pthread_mutex_destroy (&shard->lock);
+        flm__Free (shard->buckets);
+    }
+
+    OPENSSL_cleanse (cache->tickets.keys, sizeof (cache->tickets.keys));
+    pthread_rwlock_destroy (&cache->tickets.lock);
+    return ;
+}
+
+static void
+flm__TLSCacheIndexInit (void)
+{
+    flm__TLSCacheExIndex = SSL_CTX_get_ex_new_index (0,
+                                                     NULL,
+                                                     NULL,
+                                                     NULL,
+                                                     flm__TLSCacheExFree);
+    return ;
+}
+
+int
+flm__TLSCacheIndex (void)
+{
+    pthread_once (&flm__TLSCacheIndexOnce, flm__TLSCacheIndexInit);
+    return (flm__TLSCacheExIndex);
+}
+
+void
+flm__TLSCacheExFree (void *             parent,
+                     void *             ptr,
+                     CRYPTO_EX_DATA *   ad,
+                     int                idx,
+                     long               argl,
+                     void *             argp)
+{
+    (void) parent;
+    (void) ad;
+    (void) idx;
+    (void) argl;
+    (void) argp;
+
+    if (ptr) {
+        flm_TLSCacheRelease (ptr);
+    }
+    return ;
+}
+
+uint32_t
+flm__TLSCacheHash (const unsigned char *        id,
+                   unsigned int                 id_len)
+{
+    uint32_t hash;
+    unsigned int i;
+
+    /**
+     * FNV-1a, the session IDs are random anyway
+     */
+    hash = 2166136261U;
+    for (i = 0; i < id_len; i++) {
+        hash ^= id[i];
+        hash *= 16777619U;
+    }
+    return (hash);
+}
+
+void
+flm__TLSCacheUnlink (struct flm__TLSCacheShard *        shard,
+                     struct flm__TLSCacheEntry *        entry)
+{
+    LIST_REMOVE (entry, bucket);
+    TAILQ_REMOVE (&shard->lru, entry, lru);
+    shard->count--;
+    return ;
+}
+
+struct flm__TLSCacheEntry *
+flm__TLSCacheFind (struct flm__TLSCacheShard *  shard,
+                   const unsigned char *        id,
+                   unsigned int                 id_len,
+                   uint32_t                     hash)
+{
+    struct flm__TLSCacheEntry * entry;
+
+    LIST_FOREACH (entry, &shard->buckets[(hash >> 4) & shard->mask], bucket) {
+        if (entry->hash == hash &&                              \
+            entry->id_len == id_len &&                          \
+            memcmp (entry->id, id, id_len) == 0) {
+            return (entry);
+        }
+    }
+    return (NULL);
+}
+
+flm_TLSCache *
+flm__TLSCacheGet (SSL_CTX *             context)
+{
+    return (SSL_CTX_get_ex_data (context, flm__TLSCacheIndex ()));
+}
+
+int
+flm__TLSCachePerfNew (SSL *             ssl,
+                      SSL_SESSION *     session)
+{
+    flm_TLSCache * cache;
+    struct flm__TLSCacheShard * shard;
+    struct flm__TLSCacheEntry * entry;
+    struct flm__TLSCacheEntry * old;
+    const unsigned char * id;
+    unsigned int id_len;
+
+    if ((cache = flm__TLSCacheGet (SSL_get_SSL_CTX (ssl))) == NULL) {
+        return (0);
+    }
+    id = SSL_SESSION_get_id (session, &id_len);
+    if (id_len == 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH) {
+        return (0);
+    }
+
+    if ((entry = flm__Alloc (sizeof (struct flm__TLSCacheEntry))) == NULL) {
+        return (0);
+    }
+    memcpy (entry->id, id, id_len);
+    entry->id_len = id_len;
+    entry->hash = flm__TLSCacheHash (id, id_len);
+    entry->session = session;
+    entry->expire = SSL_SESSION_get_time (session) +            \
+        SSL_SESSION_get_timeout (session);
+
+    shard = &cache->shards[entry->hash & (FLM__TLS_CACHE_SHARDS - 1)];
+
+    /**
+     * Only unlink under the lock, sessions are freed once it is released
+     */
+    old = NULL;
+    pthread_mutex_lock (&shard->lock);
+    if ((old = flm__TLSCacheFind (shard, id, id_len, entry->hash)) != NULL) {
+        flm__TLSCacheUnlink (shard, old);
+    }
+    else if (shard->count == shard->max) {
+        old = TAILQ_LAST (&shard->lru, tclr);
+        flm__TLSCacheUnlink (shard, old);
+        shard->evictions++;
+    }
+    LIST_INSERT_HEAD (&shard->buckets[(entry->hash >> 4) & shard->mask],  \
+                      entry, bucket);
+    TAILQ_INSERT_HEAD (&shard->lru, entry, lru);
+    shard->count++;
+    shard->stores++;
+    pthread_mutex_unlock (&shard->lock);
+
+    if (old) {
+        SSL_SESSION_free (old->session);
+        flm__Free (old);
+    }
+
+    /**
+     * The reference given by OpenSSL is kept by the entry
+     */
+    return (1);
+}
+
+SSL_SESSION *
+flm__TLSCachePerfGet (SSL *                     ssl,
+                      const unsigned char *     id,
+                      int                       id_len,
+                      int *                     copy)
+{
+    flm_TLSCache * cache;
+    struct flm__TLSCacheShard * shard;
+    struct flm__TLSCacheEntry * entry;
+    SSL_SESSION * session;
+    uint32_t hash;
+
+    *copy = 0;
+    if ((cache = flm__TLSCacheGet (SSL_get_SSL_CTX (ssl))) == NULL) {
+        return (NULL);
+    }
+    if (id_len <= 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH) {
+        return (NULL);
+    }
+
+    hash = flm__TLSCacheHash (id, id_len);
+    shard = &cache->shards[hash & (FLM__TLS_CACHE_SHARDS - 1)];
+
+    session = NULL;
+    pthread_mutex_lock (&shard->lock);
+    shard->lookups++;
+    entry = flm__TLSCacheFind (shard, id, id_len, hash);
+    if (entry && entry->expire <= time (NULL)) {
+        flm__TLSCacheUnlink (shard, entry);
+    }
+    else if (entry) {
+        TAILQ_REMOVE (&shard->lru, entry, lru);
+        TAILQ_INSERT_HEAD (&shard->lru, entry, lru);
+        /**
+         * Referenced before unlocking, another thread may evict it right
+         * after. OpenSSL takes this reference since copy is not set.
+         */
+        SSL_SESSION_up_ref (entry->session);
+        session = entry->session;
+        entry = NULL;
+        shard->hits++;
+    }
+    pthread_mutex_unlock (&shard->lock);
+
+    if (entry) {
+        SSL_SESSION_free (entry->session);
+        flm__Free (entry);
+    }
+    return (session);
+}
+
+void
+flm__TLSCachePerfRemove (SSL_CTX *      context,
+                         SSL_SESSION *  session)
+{
+    flm_TLSCache * cache;
+    struct flm__TLSCacheShard * shard;
+    struct flm__TLSCacheEntry * entry;
+    const unsigned char * id;
+    unsigned int id_len;
+    uint32_t hash;
+
+    if ((cache = flm__TLSCacheGet (context)) == NULL) {
+        return ;
+    }
+    id = SSL_SESSION_get_id (session, &id_len);
+    hash = flm__TLSCacheHash (id, id_len);
+    shard = &cache->shards[hash & (FLM__TLS_CACHE_SHARDS - 1)];
+
+    pthread_mutex_lock (&shard->lock);
+    entry = flm__TLSCacheFind (shard, id, id_len, hash);
+    if (entry && entry->session == session) {
+        flm__TLSCacheUnlink (shard, entry);
+    }
+    else {
+        entry = NULL;
+    }
+    pthread_mutex_unlock (&shard->lock);
+
+    if (entry) {
+        SSL_SESSION_free (entry->session);
+        flm__Free (entry);
+    }
+    return ;
+}
+
+int
+flm__TLSCacheFindKey (flm_TLSCache *            cache,
+                      const unsigned char *     name,
+                      int                       enc,
+                      struct flm__TLSCacheKey * key)
+{
+    size_t slot;
+    size_t i;
+    int ret;
+
+    ret = 0;
+    pthread_rwlock_rdlock (&cache->tickets.lock);
+    if (enc) {
+        memcpy (key, &cache->tickets.keys[cache->tickets.current],     \
+                sizeof (struct flm__TLSCacheKey));
+        ret = 1;
+    }
+    else {
+        for (i = 0; i < cache->tickets.count; i++) {
+            slot = (cache->tickets.current + FLM__TLS_CACHE_KEYS - i) %   \
+                FLM__TLS_CACHE_KEYS;
+            if (memcmp (cache->tickets.keys[slot].name,                 \
+                        name,                                           \
+                        FLM__TLS_CACHE_KEY_NAME_SIZE) == 0) {
+                memcpy (key, &cache->tickets.keys[slot],                \
+                        sizeof (struct flm__TLSCacheKey));
+                /**
+                 * Tickets from a previous key are renewed
+                 */
+                ret = (i == 0) ? 1 : 2;
+                break ;
+            }
+        }
+    }
+    pthread_rwlock_unlock (&cache->tickets.lock);
+    return (ret);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int
+flm__TLSCachePerfTicket (SSL *                  ssl,
+                         unsigned char *        name,
+                         unsigned char *        iv,
+                         EVP_CIPHER_CTX *       cipher,
+                         EVP_MAC_CTX *          mac,
+                         int                    enc)
+#else
+int
+flm__TLSCachePerfTicket (SSL *                  ssl,
+                         unsigned char *        name,
+                         unsigned char *        iv,
+                         EVP_CIPHER_CTX *       cipher,
+                         HMAC_CTX *             mac,
+                         int                    enc)
+#endif
+{
+    flm_TLSCache * cache;
+    struct flm__TLSCacheKey key;
+    int ret;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    OSSL_PARAM params[3];
+#endif
+
+    if ((cache = flm__TLSCacheGet (SSL_get_SSL_CTX (ssl))) == NULL) {
+        return (-1);
+    }
+
+    if ((ret = flm__TLSCacheFindKey (cache, name, enc, &key)) == 0) {
+        /* full handshake */
+        __sync_fetch_and_add (&cache->tickets.unknown, 1);
+        return (0);
+    }
+
+    if (enc) {
+        if (RAND_bytes (iv, EVP_CIPHER_iv_length (EVP_aes_256_cbc ())) != 1) {
+            ret = -1;
+            goto cleanse;
+        }
+        memcpy (name, key.name, FLM__TLS_CACHE_KEY_NAME_SIZE);
+        if (!EVP_EncryptInit_ex (cipher, EVP_aes_256_cbc (), NULL, key.aes, iv)) {
+            ret = -1;
+            goto cleanse;
+        }
+    }
+    else {
+        __sync_fetch_and_add (&cache->tickets.decrypted, 1);
+        if (!EVP_DecryptInit_ex (cipher, EVP_aes_256_cbc (), NULL, key.aes, iv)) {
+            ret = -1;
+            goto cleanse;
+        }
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    params[0] = OSSL_PARAM_construct_octet_string (OSSL_MAC_PARAM_KEY,
+                                                   key.hmac,
+                                                   sizeof (key.hmac));
+    params[1] = OSSL_PARAM_construct_utf8_string (OSSL_MAC_PARAM_DIGEST,
+                                                  "SHA256",
+                                                  0);
+    params[2] = OSSL_PARAM_construct_end ();
+    if (!EVP_MAC_CTX_set_params (mac, params)) {
+        ret = -1;
+    }
+#else
+    if (!HMAC_Init_ex (mac, key.hmac, sizeof (key.hmac), EVP_sha256 (), NULL)) {
+        ret = -1;
+    }
+#endif
+
+  cleanse:
+    OPENSSL_cleanse (&key, sizeof (key));
+    return (ret);
+}
+
+void
+flm__TLSCacheRotateHandler (flm_Timer *         timer,
+                            void *              _cache)
+{
+    flm_TLSCache * cache;
+
+    cache = _cache;
+
+    /**
+     * On failure the current key is simply kept a bit longer
+     */
+    flm_TLSCacheRotateKeys (cache);
+    flm_TimerReset (timer, cache->tickets.interval);
+    return ;
+}
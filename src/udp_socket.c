@@ -0,0 +1,706 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+
+#include "flm/core/public/error.h"
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/buffer.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/udp_socket.h"
+
+/**
+ * Linux coalesces the datagrams of the same size into a single message,
+ * on the way out since 4.18 and on the way in since 5.0.
+ */
+#if defined (UDP_SEGMENT)
+# define FLM_UDP_SOCKET__GSO
+#endif
+
+#if defined (UDP_GRO)
+# define FLM_UDP_SOCKET__GRO
+#endif
+
+flm_UDPSocket *
+flm_UDPSocketNew (flm_Monitor *		monitor,
+                  const char *		address,
+                  uint16_t		port,
+                  void *		state)
+{
+    flm_UDPSocket * udp_socket;
+
+    udp_socket = flm__Alloc (sizeof (flm_UDPSocket));
+    if (udp_socket == NULL) {
+        return (NULL);
+    }
+    if (flm__UDPSocketInit (udp_socket, monitor, address, port, state) == -1) {
+        flm__Free (udp_socket);
+        return (NULL);
+    }
+    return (udp_socket);
+}
+
+int
+flm_UDPSocketBatch (flm_UDPSocket *	udp_socket,
+                    size_t		count,
+                    size_t		size)
+{
+    if (count == 0 || count > FLM__UDP_SOCKET_BATCH_MAX ||	\
+        size == 0 || size > UINT16_MAX) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EINVAL;
+        return (-1);
+    }
+    if (flm__UDPSocketAlloc (udp_socket, count) == -1) {
+        return (-1);
+    }
+    udp_socket->batch.count = count;
+    udp_socket->batch.size = size;
+    if (!udp_socket->rd.gro) {
+        udp_socket->rd.stride = size;
+    }
+    return (0);
+}
+
+int
+flm_UDPSocketGSO (flm_UDPSocket *	udp_socket)
+{
+#if defined (FLM_UDP_SOCKET__GSO)
+    /**
+     * The size of the segments is given with each message, a null
+     * default only checks that the kernel knows about the option.
+     */
+    if (setsockopt (udp_socket->io.sys.fd,		\
+                    SOL_UDP,				\
+                    UDP_SEGMENT,			\
+                    (int[]){0},				\
+                    sizeof (int)) == -1) {
+        flm__Error = (errno == ENOPROTOOPT) ? FLM_ERR_NOSYS : FLM_ERR_ERRNO;
+        return (-1);
+    }
+    udp_socket->wr.gso = true;
+    if (flm__UDPSocketAlloc (udp_socket, udp_socket->batch.count) == -1) {
+        udp_socket->wr.gso = false;
+        return (-1);
+    }
+    return (0);
+#else
+    (void) udp_socket;
+
+    flm__Error = FLM_ERR_NOSYS;
+    return (-1);
+#endif
+}
+
+int
+flm_UDPSocketGRO (flm_UDPSocket *	udp_socket)
+{
+#if defined (FLM_UDP_SOCKET__GRO)
+    if (setsockopt (udp_socket->io.sys.fd,		\
+                    SOL_UDP,				\
+                    UDP_GRO,				\
+                    (int[]){1},				\
+                    sizeof (int)) == -1) {
+        flm__Error = (errno == ENOPROTOOPT) ? FLM_ERR_NOSYS : FLM_ERR_ERRNO;
+        return (-1);
+    }
+    udp_socket->rd.gro = true;
+    udp_socket->rd.stride = FLM__UDP_SOCKET_GRO_SIZE;
+    return (0);
+#else
+    (void) udp_socket;
+
+    flm__Error = FLM_ERR_NOSYS;
+    return (-1);
+#endif
+}
+
+int
+flm_UDPSocketSend (flm_UDPSocket *		udp_socket,
+                   flm_Buffer *			datagram,
+                   const struct sockaddr *	addr,
+                   socklen_t			addr_len)
+{
+    struct flm__UDPSocketOutput * output;
+
+    if (udp_socket->io.cl.closed) {
+        flm__Error = FLM_ERR_BUG;
+        return (-1);
+    }
+    if (addr_len > sizeof (struct sockaddr_storage)) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EINVAL;
+        return (-1);
+    }
+    if (udp_socket->wr.queue == NULL) {
+        udp_socket->wr.queue =						\
+            flm__Alloc (FLM__UDP_SOCKET_QUEUE_SIZE *			\
+                        sizeof (struct flm__UDPSocketOutput));
+        if (udp_socket->wr.queue == NULL) {
+            flm__Error = FLM_ERR_NOMEM;
+            return (-1);
+        }
+    }
+    if (udp_socket->wr.count == FLM__UDP_SOCKET_QUEUE_SIZE) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = ENOBUFS;
+        return (-1);
+    }
+
+    output = &udp_socket->wr.queue[(udp_socket->wr.head + udp_socket->wr.count) % \
+                                   FLM__UDP_SOCKET_QUEUE_SIZE];
+    output->buffer = flm_BufferRetain (datagram);
+    memcpy (&output->addr, addr, addr_len);
+    output->addr_len = addr_len;
+
+    /**
+     * Asking the monitor again for the write event makes it report it on
+     * its next iteration, the whole queue is flushed then.
+     */
+    if (udp_socket->wr.count++ == 0) {
+        udp_socket->io.wr.want = true;
+        if (udp_socket->io.monitor &&					\
+            flm__MonitorIOReset (udp_socket->io.monitor, &udp_socket->io) == -1) {
+            return (-1);
+        }
+    }
+    return (0);
+}
+
+void
+flm_UDPSocketClose (flm_UDPSocket *	udp_socket)
+{
+    flm_IOClose (&udp_socket->io);
+    return ;
+}
+
+void
+flm_UDPSocketOnRead (flm_UDPSocket *		udp_socket,
+                     flm_UDPSocketReadHandler	handler)
+{
+    udp_socket->rd.handler = handler;
+    return ;
+}
+
+void
+flm_UDPSocketOnError (flm_UDPSocket *		udp_socket,
+                      flm_UDPSocketErrorHandler	handler)
+{
+    flm_IOOnError (&udp_socket->io, (flm_IOErrorHandler) handler);
+    return ;
+}
+
+flm_UDPSocket *
+flm_UDPSocketRetain (flm_UDPSocket *	udp_socket)
+{
+    return (flm__Retain (&udp_socket->io.obj));
+}
+
+void
+flm_UDPSocketRelease (flm_UDPSocket *	udp_socket)
+{
+    flm__Release (&udp_socket->io.obj);
+    return ;
+}
+
+int
+flm__UDPSocketInit (flm_UDPSocket *	udp_socket,
+                    flm_Monitor *	monitor,
+                    const char *	address,
+                    uint16_t		port,
+                    void *		state)
+{
+    struct addrinfo     hints;
+    struct addrinfo *   result;
+    struct addrinfo *   rp;
+    char                str_port[6];
+    int                 fd;
+    long                flags;
+
+    memset (&hints, 0, sizeof (struct addrinfo));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+
+    if (snprintf (str_port, sizeof (str_port), "%d", port) < 0) {
+        goto error;
+    }
+    if (getaddrinfo (address, str_port, &hints, &result) != 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EINVAL;
+        goto error;
+    }
+
+    for (rp = result; rp != NULL; rp = rp->ai_next) {
+        if ((fd = socket (rp->ai_family,
+                          rp->ai_socktype,
+                          rp->ai_protocol)) == -1) {
+            continue;
+        }
+        if (bind (fd, rp->ai_addr, rp->ai_addrlen) == 0) {
+            break;
+        }
+        close (fd);
+    }
+    freeaddrinfo (result);
+    if (rp == NULL) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto error;
+    }
+
+    if ((flags = fcntl (fd, F_GETFL, NULL)) < 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto close_fd;
+    }
+    if (fcntl (fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto close_fd;
+    }
+
+    udp_socket->rd.addrs = NULL;
+    udp_socket->rd.gro = false;
+    udp_socket->wr.gso = false;
+    if (flm_UDPSocketBatch (udp_socket,				\
+                            FLM__UDP_SOCKET_BATCH_COUNT,	\
+                            FLM__UDP_SOCKET_BATCH_SIZE) == -1) {
+        goto close_fd;
+    }
+    udp_socket->rd.slab = NULL;
+    udp_socket->wr.queue = NULL;
+    udp_socket->wr.head = 0;
+    udp_socket->wr.count = 0;
+
+    if (flm__IOInit (&udp_socket->io,		\
+                     monitor,			\
+                     fd,			\
+                     state) == -1) {
+        goto free_batch;
+    }
+    udp_socket->io.obj.type = FLM__TYPE_UDP_SOCKET;
+
+    udp_socket->io.obj.perf.destruct =			\
+        (flm__ObjPerfDestruct_f) flm__UDPSocketPerfDestruct;
+
+    udp_socket->io.perf.read =				\
+        (flm__IOSysRead_f) flm__UDPSocketPerfRead;
+    udp_socket->io.perf.write =				\
+        (flm__IOSysWrite_f) flm__UDPSocketPerfWrite;
+
+    flm_UDPSocketOnRead (udp_socket, NULL);
+
+    return (0);
+
+  free_batch:
+    flm__Free (udp_socket->rd.addrs);
+  close_fd:
+    close (fd);
+  error:
+    return (-1);
+}
+
+void
+flm__UDPSocketPerfDestruct (flm_UDPSocket *	udp_socket)
+{
+    flm__UDPSocketDrop (udp_socket, udp_socket->wr.count);
+    if (udp_socket->wr.queue) {
+        flm__Free (udp_socket->wr.queue);
+    }
+    if (udp_socket->rd.slab) {
+        flm_BufferRelease (udp_socket->rd.slab);
+    }
+    flm__Free (udp_socket->rd.addrs);
+    flm__IOPerfDestruct (&udp_socket->io);
+    return ;
+}
+
+int
+flm__UDPSocketAlloc (flm_UDPSocket *	udp_socket,
+                     size_t		count)
+{
+    size_t segments;
+    char * mem;
+
+    /**
+     * The message headers of both directions in a single allocation,
+     * each message sent may carry a whole train of segments.
+     */
+    segments = udp_socket->wr.gso ? FLM__UDP_SOCKET_GSO_SEGMENTS : 1;
+    mem = flm__Alloc (count * (sizeof (struct sockaddr_storage) +	\
+                               2 * sizeof (struct mmsghdr) +	\
+                               (1 + segments) * sizeof (struct iovec) + \
+                               sizeof (size_t) +			\
+                               2 * FLM__UDP_SOCKET_CTRL_SIZE));
+    if (mem == NULL) {
+        flm__Error = FLM_ERR_NOMEM;
+        return (-1);
+    }
+    if (udp_socket->rd.addrs) {
+        flm__Free (udp_socket->rd.addrs);
+    }
+    udp_socket->rd.addrs = (struct sockaddr_storage *) mem;
+    udp_socket->rd.msgs = (struct mmsghdr *) (udp_socket->rd.addrs + count);
+    udp_socket->wr.msgs = udp_socket->rd.msgs + count;
+    udp_socket->rd.iov = (struct iovec *) (udp_socket->wr.msgs + count);
+    udp_socket->wr.iov = udp_socket->rd.iov + count;
+    udp_socket->wr.segs = (size_t *) (udp_socket->wr.iov + count * segments);
+    udp_socket->rd.ctrl = (char *) (udp_socket->wr.segs + count);
+    udp_socket->wr.ctrl = udp_socket->rd.ctrl + count * FLM__UDP_SOCKET_CTRL_SIZE;
+    return (0);
+}
+
+flm_Buffer *
+flm__UDPSocketSlab (flm_UDPSocket *	udp_socket)
+{
+    flm_Buffer * slab;
+    size_t size;
+
+    /**
+     * Reused as long as no datagram of the previous batch is still alive
+     */
+    size = udp_socket->batch.count * udp_socket->rd.stride;
+    if ((slab = udp_socket->rd.slab) != NULL) {
+        if (slab->obj.stat.refcount == 1 && flm_BufferLength (slab) >= size) {
+            return (slab);
+        }
+        flm_BufferRelease (slab);
+        udp_socket->rd.slab = NULL;
+    }
+
+    if ((slab = flm_BufferAlloc (size)) == NULL) {
+        return (NULL);
+    }
+    udp_socket->rd.slab = slab;
+    return (slab);
+}
+
+void
+flm__UDPSocketPerfRead (flm_UDPSocket *	udp_socket,
+                        flm_Monitor *	monitor,
+                        uint8_t		count)
+{
+    struct mmsghdr * msg;
+    struct cmsghdr * cmsg;
+    flm_Buffer * slab;
+    flm_Buffer * datagram;
+    char * content;
+    size_t stride;
+    size_t segment;
+    size_t off;
+    size_t len;
+    size_t i;
+    int nb_read;
+    int gso_size;
+
+    (void) monitor;
+    (void) count;
+
+    if ((slab = flm__UDPSocketSlab (udp_socket)) == NULL) {
+        udp_socket->io.rd.can = false;
+        flm__UDPSocketError (udp_socket);
+        return ;
+    }
+    content = flm_BufferContent (slab);
+    stride = udp_socket->rd.stride;
+
+    for (i = 0; i < udp_socket->batch.count; i++) {
+        udp_socket->rd.iov[i].iov_base = content + i * stride;
+        udp_socket->rd.iov[i].iov_len = stride;
+
+        msg = &udp_socket->rd.msgs[i];
+        msg->msg_hdr.msg_name = &udp_socket->rd.addrs[i];
+        msg->msg_hdr.msg_namelen = sizeof (struct sockaddr_storage);
+        msg->msg_hdr.msg_iov = &udp_socket->rd.iov[i];
+        msg->msg_hdr.msg_iovlen = 1;
+        if (udp_socket->rd.gro) {
+            msg->msg_hdr.msg_control =					\
+                udp_socket->rd.ctrl + i * FLM__UDP_SOCKET_CTRL_SIZE;
+            msg->msg_hdr.msg_controllen = FLM__UDP_SOCKET_CTRL_SIZE;
+        }
+        else {
+            msg->msg_hdr.msg_control = NULL;
+            msg->msg_hdr.msg_controllen = 0;
+        }
+        msg->msg_hdr.msg_flags = 0;
+    }
+
+    nb_read = recvmmsg (udp_socket->io.sys.fd,			\
+                        udp_socket->rd.msgs,			\
+                        udp_socket->batch.count,		\
+                        MSG_DONTWAIT,				\
+                        NULL);
+    if (nb_read == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            udp_socket->io.rd.can = false;
+        }
+        else if (errno == EINTR) {
+            udp_socket->io.rd.can = true;
+        }
+        else {
+            /**
+             * An ICMP error reported for a previous datagram, it is
+             * cleared now and the next datagrams can still be read.
+             */
+            udp_socket->io.rd.can = (errno == ECONNREFUSED ||	\
+                                     errno == EHOSTUNREACH ||	\
+                                     errno == ENETUNREACH);
+            flm__Error = FLM_ERR_ERRNO;
+            flm__UDPSocketError (udp_socket);
+        }
+        return ;
+    }
+
+    /**
+     * A short batch means the receive queue is empty
+     */
+    udp_socket->io.rd.can = ((size_t) nb_read == udp_socket->batch.count);
+
+    for (i = 0; i < (size_t) nb_read && !udp_socket->io.cl.closed; i++) {
+        msg = &udp_socket->rd.msgs[i];
+        if (msg->msg_hdr.msg_flags & MSG_TRUNC) {
+            continue ;
+        }
+
+        /**
+         * A coalesced message holds datagrams of the size given by the
+         * kernel, only the last one may be shorter.
+         */
+        segment = msg->msg_len;
+#if defined (FLM_UDP_SOCKET__GRO)
+        if (udp_socket->rd.gro) {
+            for (cmsg = CMSG_FIRSTHDR (&msg->msg_hdr);
+                 cmsg != NULL;
+                 cmsg = CMSG_NXTHDR (&msg->msg_hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP &&		\
+                    cmsg->cmsg_type == UDP_GRO) {
+                    memcpy (&gso_size, CMSG_DATA (cmsg), sizeof (int));
+                    if (gso_size > 0) {
+                        segment = gso_size;
+                    }
+                }
+            }
+        }
+#else
+        (void) cmsg;
+        (void) gso_size;
+#endif
+
+        off = 0;
+        do {
+            len = msg->msg_len - off < segment ? msg->msg_len - off : segment;
+            if (len > udp_socket->batch.size) {
+                off += segment;
+                continue ;
+            }
+            datagram = flm_BufferView (slab, i * stride + off, len);
+            if (datagram == NULL) {
+                flm__UDPSocketError (udp_socket);
+                break ;
+            }
+            if (udp_socket->rd.handler) {
+                udp_socket->rd.handler (udp_socket,
+                                        udp_socket->io.state,
+                                        datagram,
+                                        msg->msg_hdr.msg_name,
+                                        msg->msg_hdr.msg_namelen);
+            }
+            flm_BufferRelease (datagram);
+            off += segment;
+        } while (off < msg->msg_len && !udp_socket->io.cl.closed);
+    }
+    return ;
+}
+
+void
+flm__UDPSocketPerfWrite (flm_UDPSocket *	udp_socket,
+                         flm_Monitor *		monitor,
+                         uint8_t		count)
+{
+    struct flm__UDPSocketOutput * output;
+    struct mmsghdr * msg;
+    struct cmsghdr * cmsg;
+    struct iovec * iov;
+    size_t nb_msgs;
+    size_t first;
+    size_t segs;
+    size_t i;
+    int nb_sent;
+
+    (void) monitor;
+    (void) count;
+
+    while (udp_socket->wr.count) {
+        first = 0;
+        iov = udp_socket->wr.iov;
+        for (nb_msgs = 0;
+             nb_msgs < udp_socket->batch.count && first < udp_socket->wr.count;
+             nb_msgs++) {
+            output = &udp_socket->wr.queue[(udp_socket->wr.head + first) % \
+                                           FLM__UDP_SOCKET_QUEUE_SIZE];
+            segs = flm__UDPSocketTrain (udp_socket, first, iov);
+
+            msg = &udp_socket->wr.msgs[nb_msgs];
+            msg->msg_hdr.msg_name = &output->addr;
+            msg->msg_hdr.msg_namelen = output->addr_len;
+            msg->msg_hdr.msg_iov = iov;
+            msg->msg_hdr.msg_iovlen = segs;
+            msg->msg_hdr.msg_control = NULL;
+            msg->msg_hdr.msg_controllen = 0;
+            msg->msg_hdr.msg_flags = 0;
+#if defined (FLM_UDP_SOCKET__GSO)
+            if (segs > 1) {
+                /**
+                 * The kernel cuts the message in datagrams of the size
+                 * of the first one.
+                 */
+                msg->msg_hdr.msg_control =				\
+                    udp_socket->wr.ctrl + nb_msgs * FLM__UDP_SOCKET_CTRL_SIZE;
+                msg->msg_hdr.msg_controllen = CMSG_SPACE (sizeof (uint16_t));
+                cmsg = CMSG_FIRSTHDR (&msg->msg_hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN (sizeof (uint16_t));
+                *((uint16_t *) CMSG_DATA (cmsg)) = iov[0].iov_len;
+            }
+#else
+            (void) cmsg;
+#endif
+            udp_socket->wr.segs[nb_msgs] = segs;
+            first += segs;
+            iov += segs;
+        }
+
+        nb_sent = sendmmsg (udp_socket->io.sys.fd,		\
+                            udp_socket->wr.msgs,		\
+                            nb_msgs,				\
+                            MSG_DONTWAIT);
+        if (nb_sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                /* the next write event comes when there is room */
+                udp_socket->io.wr.can = false;
+                return ;
+            }
+            if (errno == EINTR) {
+                continue ;
+            }
+            /**
+             * Only the first message failed, its datagrams are dropped
+             * and the others are tried again.
+             */
+            flm__Error = FLM_ERR_ERRNO;
+            flm__UDPSocketDrop (udp_socket, udp_socket->wr.segs[0]);
+            flm__UDPSocketError (udp_socket);
+            if (udp_socket->io.cl.closed) {
+                return ;
+            }
+            continue ;
+        }
+        for (i = 0; i < (size_t) nb_sent; i++) {
+            flm__UDPSocketDrop (udp_socket, udp_socket->wr.segs[i]);
+        }
+    }
+    udp_socket->io.wr.want = false;
+    udp_socket->io.wr.can = false;
+    return ;
+}
+
+size_t
+flm__UDPSocketTrain (flm_UDPSocket *	udp_socket,
+                     size_t		first,
+                     struct iovec *	iov)
+{
+    struct flm__UDPSocketOutput * head;
+    struct flm__UDPSocketOutput * output;
+    size_t total;
+    size_t len;
+    size_t segs;
+
+    head = &udp_socket->wr.queue[(udp_socket->wr.head + first) %	\
+                                 FLM__UDP_SOCKET_QUEUE_SIZE];
+    iov[0].iov_base = flm_BufferContent (head->buffer);
+    iov[0].iov_len = flm_BufferLength (head->buffer);
+    if (!udp_socket->wr.gso || iov[0].iov_len == 0) {
+        return (1);
+    }
+
+    /**
+     * The following datagrams to the same destination go with it as long
+     * as they have the same size, a shorter one ends the train.
+     */
+    total = iov[0].iov_len;
+    for (segs = 1;
+         segs < FLM__UDP_SOCKET_GSO_SEGMENTS && first + segs < udp_socket->wr.count;
+         segs++) {
+        output = &udp_socket->wr.queue[(udp_socket->wr.head + first + segs) % \
+                                       FLM__UDP_SOCKET_QUEUE_SIZE];
+        len = flm_BufferLength (output->buffer);
+        if (len == 0 || len > iov[0].iov_len ||			\
+            total + len > FLM__UDP_SOCKET_GSO_SIZE ||		\
+            output->addr_len != head->addr_len ||		\
+            memcmp (&output->addr, &head->addr, head->addr_len)) {
+            break ;
+        }
+        iov[segs].iov_base = flm_BufferContent (output->buffer);
+        iov[segs].iov_len = len;
+        total += len;
+        if (len < iov[0].iov_len) {
+            segs++;
+            break ;
+        }
+    }
+    return (segs);
+}
+
+void
+flm__UDPSocketDrop (flm_UDPSocket *	udp_socket,
+                    size_t		count)
+{
+    struct flm__UDPSocketOutput * output;
+
+    while (count--) {
+        output = &udp_socket->wr.queue[udp_socket->wr.head];
+        flm_BufferRelease (output->buffer);
+        udp_socket->wr.head = (udp_socket->wr.head + 1) %	\
+            FLM__UDP_SOCKET_QUEUE_SIZE;
+        udp_socket->wr.count--;
+    }
+    return ;
+}
+
+void
+flm__UDPSocketError (flm_UDPSocket *	udp_socket)
+{
+    if (udp_socket->io.er.handler) {
+        udp_socket->io.er.handler (&udp_socket->io,
+                                   udp_socket->io.state,
+                                   flm_Error ());
+    }
+    return ;
+}
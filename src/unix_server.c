@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2010-2011, Victor Goya <phorque@libflm.me>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/error.h"
+#include "flm/core/private/obj.h"
+#include "flm/core/private/tcp_server.h"
+#include "flm/core/private/unix_server.h"
+
+flm_UnixServer *
+flm_UnixServerNew (flm_Monitor *	monitor,
+		   const char *		path,
+		   void *		state)
+{
+    flm_UnixServer * unix_server;
+
+    unix_server = flm__Alloc (sizeof (flm_UnixServer));
+    if (unix_server == NULL) {
+        return (NULL);
+    }
+    if (flm__UnixServerInit (unix_server, monitor, path, state) == -1) {
+        flm__Free (unix_server);
+        return (NULL);
+    }
+    return (unix_server);
+}
+
+void
+flm_UnixServerClose (flm_UnixServer *	unix_server)
+{
+    flm_TCPServerClose (&unix_server->tcp_server);
+}
+
+void
+flm_UnixServerOnClose (flm_UnixServer *			unix_server,
+                       flm_UnixServerCloseHandler	handler)
+{
+    flm_TCPServerOnClose (&unix_server->tcp_server,
+                          (flm_TCPServerCloseHandler) handler);
+}
+
+void
+flm_UnixServerOnError (flm_UnixServer *			unix_server,
+                       flm_UnixServerErrorHandler	handler)
+{
+    flm_TCPServerOnError (&unix_server->tcp_server,
+                          (flm_TCPServerErrorHandler) handler);
+}
+
+void
+flm_UnixServerOnAccept (flm_UnixServer *		unix_server,
+			flm_UnixServerAcceptHandler	handler)
+{
+    flm_TCPServerOnAccept (&unix_server->tcp_server,
+                           (flm_TCPServerAcceptHandler) handler);
+}
+
+flm_UnixServer *
+flm_UnixServerRetain (flm_UnixServer *	unix_server)
+{
+    return (flm__Retain (&unix_server->tcp_server.io.obj));
+}
+
+void
+flm_UnixServerRelease (flm_UnixServer *	unix_server)
+{
+    flm__Release (&unix_server->tcp_server.io.obj);
+    return ;
+}
+
+int
+flm__UnixServerInit (flm_UnixServer *	unix_server,
+		     flm_Monitor *	monitor,
+		     const char *	path,
+		     void *		state)
+{
+    size_t      length;
+    int         fd;
+
+    length = strlen (path);
+    if (length == 0) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EINVAL;
+        goto error;
+    }
+    if (length >= sizeof (unix_server->addr.sun_path)) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = ENAMETOOLONG;
+        goto error;
+    }
+
+    /**
+     * Abstract names are not terminated, their length is given by the
+     * length of the address.
+     */
+    memset (&unix_server->addr, 0, sizeof (unix_server->addr));
+    unix_server->addr.sun_family = AF_UNIX;
+    memcpy (unix_server->addr.sun_path, path, length);
+    unix_server->len = offsetof (struct sockaddr_un, sun_path) + length;
+    if (path[0] == '@') {
+        unix_server->addr.sun_path[0] = '\0';
+    }
+    else {
+        unix_server->len++;
+    }
+
+    if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        goto error;
+    }
+    if (flm__UnixServerBind (unix_server, fd) == -1) {
+        goto close_fd;
+    }
+
+    if (flm__TCPServerListen (&unix_server->tcp_server,         \
+                              monitor,                          \
+                              fd,                               \
+                              state) == -1) {
+        goto unlink_path;
+    }
+    unix_server->tcp_server.io.obj.type = FLM__TYPE_UNIX_SERVER;
+
+    unix_server->tcp_server.io.obj.perf.destruct =              \
+        (flm__ObjPerfDestruct_f) flm__UnixServerPerfDestruct;
+
+    return (0);
+
+  unlink_path:
+    if (unix_server->addr.sun_path[0]) {
+        unlink (unix_server->addr.sun_path);
+    }
+  close_fd:
+    close (fd);
+  error:
+    return (-1);
+}
+
+int
+flm__UnixServerBind (flm_UnixServer *	unix_server,
+		     int		fd)
+{
+    struct stat stat;
+    int probe;
+
+    if (bind (fd,
+              (struct sockaddr *) &unix_server->addr,
+              unix_server->len) == 0) {
+        return (0);
+    }
+    if (errno != EADDRINUSE || unix_server->addr.sun_path[0] == '\0') {
+        flm__Error = FLM_ERR_ERRNO;
+        return (-1);
+    }
+
+    /**
+     * The socket file outlives its server, only a server still accepting
+     * connections keeps the path. Anything else than a socket is left
+     * alone.
+     */
+    if (lstat (unix_server->addr.sun_path, &stat) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (-1);
+    }
+    if (!S_ISSOCK (stat.st_mode)) {
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EADDRINUSE;
+        return (-1);
+    }
+    if ((probe = socket (AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (-1);
+    }
+    if (connect (probe,
+                 (struct sockaddr *) &unix_server->addr,
+                 unix_server->len) == 0 || errno != ECONNREFUSED) {
+        close (probe);
+        flm__Error = FLM_ERR_ERRNO;
+        errno = EADDRINUSE;
+        return (-1);
+    }
+    close (probe);
+
+    if (unlink (unix_server->addr.sun_path) == -1 ||            \
+        bind (fd,
+              (struct sockaddr *) &unix_server->addr,
+              unix_server->len) == -1) {
+        flm__Error = FLM_ERR_ERRNO;
+        return (-1);
+    }
+    return (0);
+}
+
+void
+flm__UnixServerPerfDestruct (flm_UnixServer *	unix_server)
+{
+    if (unix_server->addr.sun_path[0]) {
+        unlink (unix_server->addr.sun_path);
+    }
+    flm__IOPerfDestruct (&unix_server->tcp_server.io);
+    return ;
+}
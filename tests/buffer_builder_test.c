@@ -0,0 +1,199 @@
+#include <string.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "flm/core/private/alloc.h"
+#include "flm/core/private/buffer_builder.h"
+
+#include "test_utils.h"
+
+START_TEST(test_buffer_builder_create)
+{
+    flm_BufferBuilder * builder;
+
+    setTestAlloc (0);
+
+    fail_if ((builder = flm_BufferBuilderNew (0)) == NULL);
+    fail_unless (flm_BufferBuilderLength (builder) == 0);
+    fail_unless (flm_BufferBuilderContent (builder) == NULL);
+    flm_BufferBuilderRelease (builder);
+
+    fail_if ((builder = flm_BufferBuilderNew (1000)) == NULL);
+    fail_unless (builder->size == 1000);
+    flm_BufferBuilderRelease (builder);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_builder_alloc_fail)
+{
+    flm_BufferBuilder * builder;
+    char data[100];
+
+    setTestAlloc (1);
+    fail_if (flm_BufferBuilderNew (0) != NULL);
+    fail_unless (getAllocSum () == 0);
+
+    setTestAlloc (2);
+    fail_if (flm_BufferBuilderNew (10) != NULL);
+    fail_unless (getAllocSum () == 0);
+
+    /**
+     * The content is left untouched when it cannot grow
+     */
+    setTestAlloc (3);
+    fail_if ((builder = flm_BufferBuilderNew (0)) == NULL);
+    fail_if (flm_BufferBuilderAppend (builder, "abc", 3) == -1);
+    memset (data, 'x', sizeof (data));
+    fail_unless (flm_BufferBuilderAppend (builder, data, sizeof (data)) == -1);
+    fail_unless (flm_BufferBuilderLength (builder) == 3);
+    fail_unless (strncmp (flm_BufferBuilderContent (builder), "abc", 3) == 0);
+    flm_BufferBuilderRelease (builder);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_builder_append)
+{
+    flm_BufferBuilder * builder;
+    flm_Buffer * buffer;
+    size_t grows;
+    size_t size;
+    char * content;
+    int i;
+
+    setTestAlloc (0);
+
+    fail_if ((builder = flm_BufferBuilderNew (0)) == NULL);
+
+    /**
+     * The room doubles, it is only made a handful of times
+     */
+    grows = 0;
+    size = 0;
+    for (i = 0; i < 100000; i++) {
+        fail_if (flm_BufferBuilderAppend (builder, &"0123456789"[i % 10], 1) == -1);
+        if (builder->size != size) {
+            size = builder->size;
+            grows++;
+        }
+    }
+    fail_unless (flm_BufferBuilderLength (builder) == 100000);
+    fail_unless (grows == 12);
+    fail_unless (builder->size < 2 * 100000);
+
+    /**
+     * The buffer takes the content over
+     */
+    content = flm_BufferBuilderContent (builder);
+    fail_if ((buffer = flm_BufferBuilderFinish (builder)) == NULL);
+    fail_unless (flm_BufferContent (buffer) == content);
+    fail_unless (flm_BufferLength (buffer) == 100000);
+    for (i = 0; i < 100000; i++) {
+        fail_unless (content[i] == '0' + i % 10);
+    }
+    fail_unless (flm_BufferBuilderLength (builder) == 0);
+    fail_unless (flm_BufferBuilderContent (builder) == NULL);
+
+    /**
+     * And stays alive once the builder is gone
+     */
+    flm_BufferBuilderRelease (builder);
+    fail_unless (content[99999] == '9');
+    flm_BufferRelease (buffer);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_builder_reserve)
+{
+    flm_BufferBuilder * builder;
+    flm_Buffer * buffer;
+    char * room;
+
+    setTestAlloc (0);
+
+    fail_if ((builder = flm_BufferBuilderNew (0)) == NULL);
+    fail_if (flm_BufferBuilderAppend (builder, "len:", 4) == -1);
+
+    fail_if ((room = flm_BufferBuilderReserve (builder, 16)) == NULL);
+    fail_unless (flm_BufferBuilderLength (builder) == 4);
+    fail_if (flm_BufferBuilderCommit (builder,
+                                      snprintf (room, 16, "%d", 42)) == -1);
+    fail_unless (flm_BufferBuilderLength (builder) == 6);
+
+    /**
+     * More than what was reserved
+     */
+    fail_unless (flm_BufferBuilderCommit (builder, builder->size) == -1);
+    fail_unless (flm_Error () == FLM_ERR_BUG);
+    fail_unless (flm_BufferBuilderLength (builder) == 6);
+
+    fail_if ((buffer = flm_BufferBuilderFinish (builder)) == NULL);
+    fail_unless (flm_BufferLength (buffer) == 6);
+    fail_unless (strncmp (flm_BufferContent (buffer), "len:42", 6) == 0);
+    flm_BufferRelease (buffer);
+
+    /**
+     * The builder can be used again, even to build an empty buffer
+     */
+    fail_if ((buffer = flm_BufferBuilderFinish (builder)) == NULL);
+    fail_unless (flm_BufferLength (buffer) == 0);
+    flm_BufferRelease (buffer);
+
+    flm_BufferBuilderRelease (builder);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_builder_no_realloc)
+{
+    flm_BufferBuilder * builder;
+    flm_Buffer * buffer;
+    int i;
+
+    /**
+     * Only allocation and free handlers, as given before realloc ones
+     * existed: every block still goes through them
+     */
+    setTestAlloc (0);
+    flm__SetRealloc (NULL);
+    fail_if (flm__HasRealloc ());
+    fail_unless (flm__Realloc (NULL, 10) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_NOSYS);
+
+    fail_if ((builder = flm_BufferBuilderNew (0)) == NULL);
+    for (i = 0; i < 1000; i++) {
+        fail_if (flm_BufferBuilderAppend (builder, &"0123456789"[i % 10], 1) == -1);
+    }
+    fail_if ((buffer = flm_BufferBuilderFinish (builder)) == NULL);
+    fail_unless (flm_BufferLength (buffer) == 1000);
+    for (i = 0; i < 1000; i++) {
+        fail_unless (flm_BufferContent (buffer)[i] == '0' + i % 10);
+    }
+    flm_BufferRelease (buffer);
+    flm_BufferBuilderRelease (builder);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+Suite *
+buffer_builder_suite (void)
+{
+  Suite * s = suite_create ("buffer_builder");
+
+  /* Buffer builder test case */
+  TCase *tc_core = tcase_create ("buffer_builder");
+
+  tcase_add_test (tc_core, test_buffer_builder_create);
+  tcase_add_test (tc_core, test_buffer_builder_alloc_fail);
+  tcase_add_test (tc_core, test_buffer_builder_append);
+  tcase_add_test (tc_core, test_buffer_builder_reserve);
+  tcase_add_test (tc_core, test_buffer_builder_no_realloc);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
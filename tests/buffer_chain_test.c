@@ -0,0 +1,260 @@
+#include <string.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "test_utils.h"
+
+struct _flatten
+{
+    char        content[64];
+    size_t      len;
+    int         seen;
+    int         stop;
+};
+
+static int
+_flatten_handler (void * state, char * content, size_t length)
+{
+    struct _flatten * flatten;
+
+    flatten = state;
+    memcpy (&flatten->content[flatten->len], content, length);
+    flatten->len += length;
+    flatten->content[flatten->len] = '\0';
+
+    if (++flatten->seen == flatten->stop) {
+        return (42);
+    }
+    return (0);
+}
+
+/**
+ * The content of a chain as a single string
+ */
+static char *
+_flatten (flm_BufferChain * chain, struct _flatten * flatten)
+{
+    flatten->len = 0;
+    flatten->seen = 0;
+    flatten->stop = 0;
+    flatten->content[0] = '\0';
+    flm_BufferChainForEach (chain, _flatten_handler, flatten);
+    return (flatten->content);
+}
+
+START_TEST(test_buffer_chain_create)
+{
+    flm_BufferChain * chain;
+
+    setTestAlloc (0);
+
+    fail_if ((chain = flm_BufferChainNew ()) == NULL);
+    fail_unless (flm_BufferChainLength (chain) == 0);
+    fail_unless (flm_BufferChainCount (chain) == 0);
+    flm_BufferChainRelease (chain);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_chain_alloc_fail)
+{
+    flm_BufferChain * chain;
+    flm_Buffer * buffer;
+
+    setTestAlloc (1);
+    fail_if (flm_BufferChainNew () != NULL);
+
+    /**
+     * The chain is left as it was
+     */
+    setTestAlloc (3);
+    fail_if ((chain = flm_BufferChainNew ()) == NULL);
+    fail_if ((buffer = flm_BufferNew ("test", 4, NULL)) == NULL);
+    fail_unless (flm_BufferChainAppend (chain, buffer, 0, 0) == -1);
+    fail_unless (flm_BufferChainLength (chain) == 0);
+    fail_unless (flm_BufferChainCount (chain) == 0);
+    flm_BufferRelease (buffer);
+    flm_BufferChainRelease (chain);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_chain_append)
+{
+    flm_BufferChain * chain;
+    flm_Buffer * hello;
+    flm_Buffer * world;
+    struct _flatten flatten;
+
+    setTestAlloc (0);
+
+    fail_if ((chain = flm_BufferChainNew ()) == NULL);
+    fail_if ((hello = flm_BufferNew ("hello", 5, NULL)) == NULL);
+    fail_if ((world = flm_BufferPrintf ("big %s!", "world")) == NULL);
+
+    fail_if (flm_BufferChainAppend (chain, world, 4, 5) == -1);
+    fail_if (flm_BufferChainPrepend (chain, hello, 0, 0) == -1);
+    fail_if (flm_BufferChainAppend (chain, world, 9, 0) == -1);
+    fail_if (flm_BufferChainPrepend (chain, world, 3, 1) == -1);
+
+    /**
+     * The chain holds its own references
+     */
+    flm_BufferRelease (hello);
+    flm_BufferRelease (world);
+
+    fail_unless (strcmp (_flatten (chain, &flatten), " helloworld!") == 0);
+    fail_unless (flm_BufferChainLength (chain) == 12);
+    fail_unless (flm_BufferChainCount (chain) == 4);
+
+    /**
+     * Out of range parts are clamped to the buffer
+     */
+    fail_if ((hello = flm_BufferNew ("hello", 5, NULL)) == NULL);
+    fail_if (flm_BufferChainAppend (chain, hello, 3, 100) == -1);
+    fail_if (flm_BufferChainAppend (chain, hello, 100, 0) == -1);
+    flm_BufferRelease (hello);
+    fail_unless (strcmp (_flatten (chain, &flatten), " helloworld!lo") == 0);
+    fail_unless (flm_BufferChainLength (chain) == 14);
+
+    flm_BufferChainRelease (chain);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_chain_split)
+{
+    flm_BufferChain * chain;
+    flm_BufferChain * tail;
+    flm_BufferChain * end;
+    flm_Buffer * buffer;
+    struct _flatten flatten;
+
+    setTestAlloc (0);
+
+    fail_if ((chain = flm_BufferChainNew ()) == NULL);
+    fail_if ((buffer = flm_BufferNew ("0123456789", 10, NULL)) == NULL);
+    fail_if (flm_BufferChainAppend (chain, buffer, 0, 4) == -1);
+    fail_if (flm_BufferChainAppend (chain, buffer, 4, 4) == -1);
+    fail_if (flm_BufferChainAppend (chain, buffer, 8, 2) == -1);
+    flm_BufferRelease (buffer);
+
+    /**
+     * In the middle of a segment, both chains get a part of it
+     */
+    fail_if ((tail = flm_BufferChainSplit (chain, 6)) == NULL);
+    fail_unless (strcmp (_flatten (chain, &flatten), "012345") == 0);
+    fail_unless (flm_BufferChainLength (chain) == 6);
+    fail_unless (flm_BufferChainCount (chain) == 2);
+    fail_unless (strcmp (_flatten (tail, &flatten), "6789") == 0);
+    fail_unless (flm_BufferChainLength (tail) == 4);
+    fail_unless (flm_BufferChainCount (tail) == 2);
+
+    /**
+     * Between two segments
+     */
+    fail_if ((end = flm_BufferChainSplit (tail, 2)) == NULL);
+    fail_unless (strcmp (_flatten (tail, &flatten), "67") == 0);
+    fail_unless (flm_BufferChainCount (tail) == 1);
+    fail_unless (strcmp (_flatten (end, &flatten), "89") == 0);
+    fail_unless (flm_BufferChainCount (end) == 1);
+    flm_BufferChainRelease (end);
+
+    /**
+     * Past the end
+     */
+    fail_if ((end = flm_BufferChainSplit (tail, 2)) == NULL);
+    fail_unless (flm_BufferChainLength (end) == 0);
+    fail_unless (flm_BufferChainLength (tail) == 2);
+    flm_BufferChainRelease (end);
+
+    /**
+     * From the start, everything moves
+     */
+    fail_if ((end = flm_BufferChainSplit (chain, 0)) == NULL);
+    fail_unless (flm_BufferChainLength (chain) == 0);
+    fail_unless (flm_BufferChainCount (chain) == 0);
+    fail_unless (strcmp (_flatten (end, &flatten), "012345") == 0);
+    flm_BufferChainRelease (end);
+
+    flm_BufferChainRelease (tail);
+    flm_BufferChainRelease (chain);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_chain_split_fail)
+{
+    flm_BufferChain * chain;
+    flm_Buffer * buffer;
+    struct _flatten flatten;
+
+    /**
+     * The new segment cannot be allocated
+     */
+    setTestAlloc (5);
+
+    fail_if ((chain = flm_BufferChainNew ()) == NULL);
+    fail_if ((buffer = flm_BufferNew ("0123456789", 10, NULL)) == NULL);
+    fail_if (flm_BufferChainAppend (chain, buffer, 0, 0) == -1);
+    flm_BufferRelease (buffer);
+
+    fail_unless (flm_BufferChainSplit (chain, 5) == NULL);
+    fail_unless (strcmp (_flatten (chain, &flatten), "0123456789") == 0);
+    fail_unless (flm_BufferChainCount (chain) == 1);
+
+    flm_BufferChainRelease (chain);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_chain_foreach_stop)
+{
+    flm_BufferChain * chain;
+    flm_Buffer * buffer;
+    struct _flatten flatten;
+    int i;
+
+    setTestAlloc (0);
+
+    fail_if ((chain = flm_BufferChainNew ()) == NULL);
+    fail_if ((buffer = flm_BufferNew ("abc", 3, NULL)) == NULL);
+    for (i = 0; i < 3; i++) {
+        fail_if (flm_BufferChainAppend (chain, buffer, i, 1) == -1);
+    }
+    flm_BufferRelease (buffer);
+
+    flatten.len = 0;
+    flatten.seen = 0;
+    flatten.stop = 2;
+    fail_unless (flm_BufferChainForEach (chain, _flatten_handler, &flatten) == 42);
+    fail_unless (strcmp (flatten.content, "ab") == 0);
+
+    flm_BufferChainRelease (chain);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+Suite *
+buffer_chain_suite (void)
+{
+  Suite * s = suite_create ("buffer_chain");
+
+  /* Buffer chain test case */
+  TCase *tc_core = tcase_create ("buffer_chain");
+
+  tcase_add_test (tc_core, test_buffer_chain_create);
+  tcase_add_test (tc_core, test_buffer_chain_alloc_fail);
+  tcase_add_test (tc_core, test_buffer_chain_append);
+  tcase_add_test (tc_core, test_buffer_chain_split);
+  tcase_add_test (tc_core, test_buffer_chain_split_fail);
+  tcase_add_test (tc_core, test_buffer_chain_foreach_stop);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
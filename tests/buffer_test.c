@@ -1,7 +1,15 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
 #include <check.h>
 
 #include "flm/flm.h"
 
+#include "flm/core/private/buffer.h"
+#include "flm/core/private/file.h"
+
 #include "test_utils.h"
 
 /**
@@ -84,6 +92,150 @@ START_TEST(test_buffer_view)
 }
 END_TEST
 
+START_TEST(test_buffer_view_nested)
+{
+    flm_Buffer * buffer;
+    flm_Buffer * views[3];
+    flm_Buffer * view;
+    int i;
+
+    setTestAlloc (0);
+
+    if ((buffer = flm_BufferPrintf ("TEST %d %s ", 42, "coucou")) == NULL) {
+        fail ("Buffer creation failed");
+    }
+
+    /**
+     * Every view refers to the root buffer, whatever the depth
+     */
+    view = buffer;
+    for (i = 0; i < 3; i++) {
+        fail_if ((views[i] = flm_BufferView (view, 1, 12 - 2 * i)) == NULL);
+        fail_unless (views[i]->content.view.from == buffer);
+        fail_unless (views[i]->content.view.off == i + 1);
+        view = views[i];
+    }
+    fail_unless (buffer->obj.stat.refcount == 4);
+
+    flm_BufferRelease (buffer);
+    flm_BufferRelease (views[0]);
+    flm_BufferRelease (views[1]);
+
+    fail_unless (flm_BufferLength (views[2]) == 8);
+    fail_unless (strncmp (flm_BufferContent (views[2]), "T 42 cou", 8) == 0);
+    flm_BufferRelease (views[2]);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_map)
+{
+    flm_File * file;
+    flm_Buffer * buffer;
+    flm_Buffer * view;
+    char block[10000];
+    char byte;
+    int raw_file;
+    int baseFD;
+    size_t i;
+
+    for (i = 0; i < sizeof (block); i++) {
+        block[i] = i % 251;
+    }
+    raw_file = open ("/tmp/_libflm_testfile", O_CREAT|O_TRUNC|O_WRONLY, 0600);
+    fail_if (raw_file == -1);
+    fail_unless (write (raw_file, block, sizeof (block)) == sizeof (block));
+    close (raw_file);
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    fail_if ((file = flm_FileOpen (NULL, "/tmp/_libflm_testfile", "r")) == NULL);
+
+    /**
+     * A range starting in the middle of a page
+     */
+    buffer = flm_BufferMap (file, 5000, 100, FLM_BUFFER_MAP_RANDOM |     \
+                            FLM_BUFFER_MAP_WILLNEED);
+    fail_if (buffer == NULL);
+    fail_unless (flm_BufferLength (buffer) == 100);
+    fail_unless (memcmp (flm_BufferContent (buffer), &block[5000], 100) == 0);
+
+    fail_if ((view = flm_BufferView (buffer, 10, 20)) == NULL);
+    flm_BufferRelease (buffer);
+    fail_unless (memcmp (flm_BufferContent (view), &block[5010], 20) == 0);
+
+    /**
+     * Changes to the content stay in the process
+     */
+    flm_BufferContent (view)[0] = ~block[5010];
+    flm_BufferRelease (view);
+    raw_file = open ("/tmp/_libflm_testfile", O_RDONLY);
+    fail_unless (pread (raw_file, &byte, 1, 5010) == 1);
+    fail_unless (byte == block[5010]);
+    close (raw_file);
+
+    /**
+     * The range stops at the end of the file
+     */
+    fail_if ((buffer = flm_BufferMap (file, 5000, 0, 0)) == NULL);
+    fail_unless (flm_BufferLength (buffer) == 5000);
+    flm_BufferRelease (buffer);
+    fail_if ((buffer = flm_BufferMap (file, 9000, 5000, 0)) == NULL);
+    fail_unless (flm_BufferLength (buffer) == 1000);
+    fail_unless (memcmp (flm_BufferContent (buffer), &block[9000], 1000) == 0);
+    flm_BufferRelease (buffer);
+    fail_if ((buffer = flm_BufferMap (file, 20000, 0, 0)) == NULL);
+    fail_unless (flm_BufferLength (buffer) == 0);
+    flm_BufferRelease (buffer);
+
+    /**
+     * Even when a file cache remembers it larger than it is now
+     */
+    file->sized = true;
+    file->size = 2 * sizeof (block);
+    fail_if ((buffer = flm_BufferMap (file, 0, 0, 0)) == NULL);
+    fail_unless (flm_BufferLength (buffer) == sizeof (block));
+    flm_BufferRelease (buffer);
+
+    fail_unless (flm_BufferMap (file, -1, 10, 0) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO);
+    fail_unless (errno == EINVAL);
+
+    flm_FileRelease (file);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_buffer_map_fail)
+{
+    flm_File * file;
+    int raw_file;
+
+    raw_file = open ("/tmp/_libflm_testfile", O_CREAT|O_TRUNC|O_WRONLY, 0600);
+    fail_if (raw_file == -1);
+    fail_unless (write (raw_file, "0123456789", 10) == 10);
+    close (raw_file);
+
+    /**
+     * Not opened for reading
+     */
+    setTestAlloc (0);
+    fail_if ((file = flm_FileOpen (NULL, "/tmp/_libflm_testfile", "a")) == NULL);
+    fail_unless (flm_BufferMap (file, 0, 0, 0) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO);
+    flm_FileRelease (file);
+    fail_unless (getAllocSum () == 0);
+
+    setTestAlloc (2);
+    fail_if ((file = flm_FileOpen (NULL, "/tmp/_libflm_testfile", "r")) == NULL);
+    fail_unless (flm_BufferMap (file, 0, 0, 0) == NULL);
+    flm_FileRelease (file);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
 int _has_freed;
 
 void
@@ -119,13 +271,78 @@ START_TEST(test_buffer_alloc_fail)
     fail_unless (getAllocSum () == 0);
     fail_unless (flm_Error () == FLM_ERR_NOMEM);
 
-    setTestAlloc (2);
-    fail_if (flm_BufferPrintf ("test") != NULL);
+    setTestAlloc (1);
+    fail_if (flm_BufferAlloc (16) != NULL);
     fail_unless (getAllocSum () == 0);
     fail_unless (flm_Error () == FLM_ERR_NOMEM);
 }
 END_TEST
 
+START_TEST(test_buffer_alloc)
+{
+    flm_Buffer * buffer;
+
+    /**
+     * The content comes with the buffer, in a single allocation
+     */
+    setTestAlloc (2);
+    fail_if ((buffer = flm_BufferAlloc (16)) == NULL);
+    fail_unless (flm_BufferLength (buffer) == 16);
+    memcpy (flm_BufferContent (buffer), "0123456789abcdef", 16);
+    fail_unless (memcmp (flm_BufferContent (buffer), "0123456789abcdef", 16) == 0);
+    flm_BufferRelease (buffer);
+    fail_unless (getAllocSum () == 0);
+
+    setTestAlloc (2);
+    fail_if ((buffer = flm_BufferPrintf ("TEST %d", 42)) == NULL);
+    fail_unless (strcmp (flm_BufferContent (buffer), "TEST 42") == 0);
+    fail_unless (flm_BufferLength (buffer) == 7);
+    flm_BufferRelease (buffer);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_buffer_pool)
+{
+    struct flm__BufferPool * pool;
+    flm_Buffer * small;
+    flm_Buffer * again;
+    flm_Buffer * large;
+
+    setTestAlloc (0);
+
+    fail_if ((pool = flm__BufferPoolNew ()) == NULL);
+
+    /**
+     * A released buffer is given back for the next one of its class
+     */
+    fail_if ((small = flm__BufferPoolGet (pool, 100)) == NULL);
+    fail_unless (flm_BufferLength (small) == 100);
+    flm_BufferRelease (small);
+    fail_if ((again = flm__BufferPoolGet (pool, 120)) == NULL);
+    fail_unless (again == small);
+    fail_unless (flm_BufferLength (again) == 120);
+    fail_unless (pool->hits == 1);
+    fail_unless (pool->misses == 1);
+
+    /**
+     * Too large to be kept
+     */
+    fail_if ((large = flm__BufferPoolGet (pool, 8192)) == NULL);
+    fail_unless (large->pool == NULL);
+    flm_BufferRelease (large);
+
+    /**
+     * Still alive after its pool is closed
+     */
+    flm__BufferPoolClose (pool);
+    memset (flm_BufferContent (again), 0, flm_BufferLength (again));
+    flm_BufferRelease (again);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
 START_TEST(test_buffer_destruct)
 {
     flm_Buffer * buffer;
@@ -158,8 +375,13 @@ buffer_suite (void)
   tcase_add_test (tc_core, test_buffer_length);
   tcase_add_test (tc_core, test_buffer_printf_length);
   tcase_add_test (tc_core, test_buffer_view);
+  tcase_add_test (tc_core, test_buffer_view_nested);
+  tcase_add_test (tc_core, test_buffer_map);
+  tcase_add_test (tc_core, test_buffer_map_fail);
   tcase_add_test (tc_core, test_buffer_free);
   tcase_add_test (tc_core, test_buffer_alloc_fail);
+  tcase_add_test (tc_core, test_buffer_alloc);
+  tcase_add_test (tc_core, test_buffer_pool);
   tcase_add_test (tc_core, test_buffer_destruct);
   suite_add_tcase (s, tc_core);
 
@@ -0,0 +1,433 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "flm/core/private/stream.h"
+
+#include "test_utils.h"
+#include "tls_utils.h"
+
+#define NB_CONNS        3
+
+/**
+ * A stream on one end of a socket pair, the other end is the peer
+ */
+static flm_Stream *
+_stream (flm_Monitor * monitor, int * peer)
+{
+    flm_Stream * stream;
+    int fds[2];
+
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        return (NULL);
+    }
+    fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+    if ((stream = flm_StreamNew (monitor, fds[0], NULL)) == NULL) {
+        close (fds[0]);
+        close (fds[1]);
+        return (NULL);
+    }
+    *peer = fds[1];
+    return (stream);
+}
+
+/**
+ * Park a new connection to the single destination of the tests
+ */
+static int
+_park (flm_ConnPool * pool, flm_Monitor * monitor, flm_Stream ** stream, int * peer)
+{
+    if ((*stream = _stream (monitor, peer)) == NULL) {
+        return (-1);
+    }
+    if (flm_ConnPoolPut (pool, "10.0.0.1", 80, *stream) == -1) {
+        return (-1);
+    }
+    flm_StreamRelease (*stream);
+    return (0);
+}
+
+START_TEST(test_conn_pool_create)
+{
+    flm_Monitor * monitor;
+    flm_ConnPool * pool;
+    struct flm_ConnPoolStats stats;
+
+    setTestAlloc (0);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((pool = flm_ConnPoolNew (monitor, 4, 1000)) == NULL);
+
+    fail_unless (flm_ConnPoolGet (pool, "10.0.0.1", 80, NULL) == NULL);
+    flm_ConnPoolStats (pool, &stats);
+    fail_unless (stats.misses == 1);
+    fail_unless (stats.hits == 0);
+    fail_unless (stats.idle == 0);
+
+    flm_ConnPoolRelease (pool);
+    flm_MonitorRelease (monitor);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_conn_pool_alloc_fail)
+{
+    setTestAlloc (1);
+    fail_if (flm_ConnPoolNew (NULL, 4, 1000) != NULL);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_conn_pool_lifo)
+{
+    flm_Monitor * monitor;
+    flm_ConnPool * pool;
+    flm_Stream * streams[NB_CONNS];
+    flm_Stream * stream;
+    struct flm_ConnPoolStats stats;
+    int peers[NB_CONNS];
+    int state;
+    int baseFD;
+    int i;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((pool = flm_ConnPoolNew (monitor, NB_CONNS, 0)) == NULL);
+
+    for (i = 0; i < NB_CONNS; i++) {
+        fail_if (_park (pool, monitor, &streams[i], &peers[i]) == -1);
+    }
+    flm_ConnPoolStats (pool, &stats);
+    fail_unless (stats.idle == NB_CONNS);
+
+    /**
+     * Other destinations do not share the connections
+     */
+    fail_unless (flm_ConnPoolGet (pool, "10.0.0.1", 81, NULL) == NULL);
+    fail_unless (flm_ConnPoolGet (pool, "10.0.0.2", 80, NULL) == NULL);
+
+    /**
+     * Last parked, first handed out
+     */
+    for (i = NB_CONNS - 1; i >= 0; i--) {
+        stream = flm_ConnPoolGet (pool, "10.0.0.1", 80, &state);
+        fail_unless (stream == streams[i]);
+        flm_StreamClose (stream);
+        flm_StreamRelease (stream);
+        close (peers[i]);
+    }
+    fail_unless (flm_ConnPoolGet (pool, "10.0.0.1", 80, NULL) == NULL);
+
+    flm_ConnPoolStats (pool, &stats);
+    fail_unless (stats.hits == NB_CONNS);
+    fail_unless (stats.misses == 3);
+    fail_unless (stats.idle == 0);
+
+    flm_ConnPoolRelease (pool);
+    flm_MonitorRelease (monitor);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_conn_pool_limit)
+{
+    flm_Monitor * monitor;
+    flm_ConnPool * pool;
+    flm_Stream * streams[NB_CONNS];
+    flm_Stream * stream;
+    struct flm_ConnPoolStats stats;
+    int peers[NB_CONNS];
+    char byte;
+    int i;
+
+    setTestAlloc (0);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((pool = flm_ConnPoolNew (monitor, NB_CONNS, 0)) == NULL);
+    fail_if (flm_ConnPoolLimit (pool, "10.0.0.1", 80, 2) == -1);
+
+    /**
+     * The oldest connection is closed to make room
+     */
+    for (i = 0; i < NB_CONNS; i++) {
+        fail_if (_park (pool, monitor, &streams[i], &peers[i]) == -1);
+    }
+    flm_ConnPoolStats (pool, &stats);
+    fail_unless (stats.evictions == 1);
+    fail_unless (stats.idle == 2);
+    fail_unless (read (peers[0], &byte, 1) == 0);
+
+    /**
+     * Lowering the limit closes the oldest ones as well
+     */
+    fail_if (flm_ConnPoolLimit (pool, "10.0.0.1", 80, 1) == -1);
+    flm_ConnPoolStats (pool, &stats);
+    fail_unless (stats.evictions == 2);
+    fail_unless (stats.idle == 1);
+    fail_unless (read (peers[1], &byte, 1) == 0);
+
+    stream = flm_ConnPoolGet (pool, "10.0.0.1", 80, NULL);
+    fail_unless (stream == streams[2]);
+    flm_StreamClose (stream);
+    flm_StreamRelease (stream);
+
+    flm_ConnPoolClear (pool);
+    flm_ConnPoolRelease (pool);
+    flm_MonitorRelease (monitor);
+    for (i = 0; i < NB_CONNS; i++) {
+        close (peers[i]);
+    }
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+static int              last_peer;
+
+static void
+_check_handler (flm_Timer * timer, void * state)
+{
+    flm_ConnPool * pool;
+    struct flm_ConnPoolStats stats;
+
+    (void) timer;
+
+    pool = state;
+
+    flm_ConnPoolStats (pool, &stats);
+    fail_unless (stats.closed == 2);
+    fail_unless (stats.idle == 1);
+
+    /**
+     * Not seen by the monitor yet, found when the connection is asked for
+     */
+    close (last_peer);
+    fail_unless (flm_ConnPoolGet (pool, "10.0.0.1", 80, NULL) == NULL);
+}
+
+START_TEST(test_conn_pool_peer_close)
+{
+    flm_Monitor * monitor;
+    flm_ConnPool * pool;
+    flm_Stream * streams[NB_CONNS];
+    flm_Timer * timer;
+    struct flm_ConnPoolStats stats;
+    int peers[NB_CONNS];
+    int baseFD;
+    int i;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((pool = flm_ConnPoolNew (monitor, NB_CONNS, 0)) == NULL);
+
+    for (i = 0; i < NB_CONNS; i++) {
+        fail_if (_park (pool, monitor, &streams[i], &peers[i]) == -1);
+    }
+
+    /**
+     * Closed by the peer, or given unexpected data
+     */
+    close (peers[0]);
+    fail_unless (write (peers[1], "x", 1) == 1);
+    last_peer = peers[2];
+
+    fail_if ((timer = flm_TimerNew (monitor, _check_handler, pool, 100)) == NULL);
+    flm_TimerRelease (timer);
+    flm_MonitorWait (monitor);
+
+    flm_ConnPoolStats (pool, &stats);
+    fail_unless (stats.closed == 3);
+    fail_unless (stats.misses == 1);
+    fail_unless (stats.idle == 0);
+
+    flm_ConnPoolRelease (pool);
+    flm_MonitorRelease (monitor);
+    close (peers[1]);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_conn_pool_timeout)
+{
+    flm_Monitor * monitor;
+    flm_ConnPool * pool;
+    flm_Stream * stream;
+    struct flm_ConnPoolStats stats;
+    int peer;
+
+    setTestAlloc (0);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((pool = flm_ConnPoolNew (monitor, NB_CONNS, 100)) == NULL);
+    fail_if (_park (pool, monitor, &stream, &peer) == -1);
+
+    flm_MonitorWait (monitor);
+
+    flm_ConnPoolStats (pool, &stats);
+    fail_unless (stats.expirations == 1);
+    fail_unless (stats.idle == 0);
+
+    flm_ConnPoolRelease (pool);
+    flm_MonitorRelease (monitor);
+    close (peer);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_conn_pool_reject)
+{
+    flm_Monitor * monitor;
+    flm_Monitor * other;
+    flm_ConnPool * pool;
+    flm_Stream * stream;
+    struct flm_ConnPoolStats stats;
+    int peer;
+
+    setTestAlloc (0);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((other = flm_MonitorNew ()) == NULL);
+    fail_if ((pool = flm_ConnPoolNew (monitor, NB_CONNS, 0)) == NULL);
+
+    /**
+     * A stream of another monitor is closed
+     */
+    fail_if ((stream = _stream (other, &peer)) == NULL);
+    fail_unless (flm_ConnPoolPut (pool, "10.0.0.1", 80, stream) == -1);
+    fail_unless (flm_Error () == FLM_ERR_BUG);
+    flm_StreamRelease (stream);
+    close (peer);
+
+    flm_ConnPoolStats (pool, &stats);
+    fail_unless (stats.idle == 0);
+
+    flm_ConnPoolRelease (pool);
+    flm_MonitorRelease (other);
+    flm_MonitorRelease (monitor);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+static flm_ConnPool *   tls_pool;
+static flm_Stream *     tls_server;
+static int              tls_reused;
+
+static void
+_tls_echo_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    (void) state;
+
+    fail_if (flm_StreamPushBuffer (stream, buffer, 0, 0) == -1);
+    flm_BufferRelease (buffer);
+}
+
+static void
+_tls_client_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    flm_Stream * pooled;
+
+    (void) state;
+
+    flm_BufferRelease (buffer);
+    fail_if (flm_ConnPoolPut (tls_pool, "10.0.0.1", 80, stream) == -1);
+
+    /**
+     * A record that is no application data, still unread on the client
+     * side when the connection is asked for
+     */
+    fail_unless (SSL_key_update (tls_server->tls.obj,
+                                 SSL_KEY_UPDATE_NOT_REQUESTED) == 1);
+    fail_unless (SSL_do_handshake (tls_server->tls.obj) == 1);
+
+    pooled = flm_ConnPoolGet (tls_pool, "10.0.0.1", 80, NULL);
+    fail_unless (pooled == stream);
+    tls_reused = 1;
+
+    flm_StreamClose (pooled);
+    flm_StreamRelease (pooled);
+    flm_StreamClose (tls_server);
+}
+
+START_TEST(test_conn_pool_tls)
+{
+    flm_Monitor * monitor;
+    flm_Stream * client;
+    SSL_CTX * client_context;
+    SSL_CTX * server_context;
+    struct flm_ConnPoolStats stats;
+    int fds[2];
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+    tls_reused = 0;
+
+    fail_if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == -1);
+    fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl (fds[1], F_SETFL, fcntl (fds[1], F_GETFL) | O_NONBLOCK);
+
+    fail_if ((server_context = getTestTLSContext (1)) == NULL);
+    fail_if ((client_context = getTestTLSContext (0)) == NULL);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((tls_pool = flm_ConnPoolNew (monitor, NB_CONNS, 0)) == NULL);
+    fail_if ((tls_server = flm_StreamNew (monitor, fds[0], NULL)) == NULL);
+    fail_if ((client = flm_StreamNew (monitor, fds[1], NULL)) == NULL);
+    flm_StreamOnRead (tls_server, _tls_echo_handler);
+    flm_StreamOnRead (client, _tls_client_handler);
+
+    fail_if (flm_StreamStartTLSServer (tls_server, server_context) == -1);
+    fail_if (flm_StreamStartTLSClient (client, client_context) == -1);
+    fail_if (flm_StreamPrintf (client, "ping") == -1);
+
+    flm_StreamRelease (client);
+    flm_StreamRelease (tls_server);
+
+    flm_MonitorWait (monitor);
+
+    fail_unless (tls_reused == 1);
+    flm_ConnPoolStats (tls_pool, &stats);
+    fail_unless (stats.hits == 1);
+    fail_unless (stats.closed == 0);
+
+    flm_ConnPoolRelease (tls_pool);
+    flm_MonitorRelease (monitor);
+    SSL_CTX_free (server_context);
+    SSL_CTX_free (client_context);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+Suite *
+conn_pool_suite (void)
+{
+  Suite * s = suite_create ("conn_pool");
+
+  /* Connection pool test case */
+  TCase *tc_core = tcase_create ("conn_pool");
+
+  tcase_add_test (tc_core, test_conn_pool_create);
+  tcase_add_test (tc_core, test_conn_pool_alloc_fail);
+  tcase_add_test (tc_core, test_conn_pool_lifo);
+  tcase_add_test (tc_core, test_conn_pool_limit);
+  tcase_add_test (tc_core, test_conn_pool_peer_close);
+  tcase_add_test (tc_core, test_conn_pool_timeout);
+  tcase_add_test (tc_core, test_conn_pool_reject);
+  tcase_add_test (tc_core, test_conn_pool_tls);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "flm/flm.h"
+
+/**
+ * Random reads of a file dropped from the page cache: pread(2) called
+ * from the loop, then the same reads through a file queue with a few
+ * helper threads. The file is created next to the benchmark and removed
+ * afterwards.
+ *
+ * usage: file_bench [reads] [size in MB] [block size]
+ */
+
+struct bench {
+    flm_FileQueue *     file_queue;
+    flm_File *          file;
+    char *              content;
+    size_t              block;
+    size_t              blocks;
+
+    size_t              total;
+    size_t              sent;
+    size_t              done;
+    size_t              window;
+    double              stall;
+};
+
+static double
+_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static off_t
+_offset (struct bench * bench)
+{
+    return ((off_t) (rand () % bench->blocks) * bench->block);
+}
+
+static void
+_cold (int fd)
+{
+    if (posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED) != 0) {
+        fprintf (stderr, "cannot drop the file from the page cache\n");
+    }
+}
+
+static void _read_handler (flm_File *, void *, flm_Buffer *, ssize_t);
+
+static void
+_fill (struct bench * bench)
+{
+    flm_Buffer * buffer;
+
+    while (bench->sent < bench->total &&
+           bench->sent - bench->done < bench->window) {
+        buffer = flm_BufferNew (bench->content + (bench->sent % bench->window) *
+                                bench->block,
+                                bench->block,
+                                NULL);
+        if (buffer == NULL ||
+            flm_FileQueueRead (bench->file_queue,
+                               bench->file,
+                               buffer,
+                               _offset (bench),
+                               _read_handler,
+                               bench) == -1) {
+            fprintf (stderr, "cannot queue a read\n");
+            exit (1);
+        }
+        flm_BufferRelease (buffer);
+        bench->sent++;
+    }
+}
+
+static void
+_read_handler (flm_File * file, void * state, flm_Buffer * buffer, ssize_t count)
+{
+    struct bench * bench;
+    double call;
+
+    (void) file;
+    (void) buffer;
+
+    call = _now ();
+    bench = state;
+    if (count != (ssize_t) bench->block) {
+        fprintf (stderr, "short read\n");
+        exit (1);
+    }
+    bench->done++;
+    _fill (bench);
+
+    call = _now () - call;
+    if (call > bench->stall) {
+        bench->stall = call;
+    }
+}
+
+static void
+_report (const char * name, size_t reads, size_t block, double elapsed, double stall)
+{
+    printf ("%-10s %6zu reads: %9.0f reads/s %7.1f MB/s, loop blocked up to %6.2f ms\n",
+            name,
+            reads,
+            reads / elapsed,
+            reads * block / elapsed / 1e6,
+            stall * 1e3);
+}
+
+static void
+_blocking (int fd, size_t reads, size_t block, size_t blocks)
+{
+    struct bench bench;
+    char * content;
+    double start;
+    double call;
+    double stall;
+    size_t count;
+
+    bench.block = block;
+    bench.blocks = blocks;
+    content = malloc (block);
+
+    _cold (fd);
+    srand (42);
+    stall = 0;
+    start = _now ();
+    for (count = 0; count < reads; count++) {
+        call = _now ();
+        if (pread (fd, content, block, _offset (&bench)) != (ssize_t) block) {
+            fprintf (stderr, "short read\n");
+            exit (1);
+        }
+        call = _now () - call;
+        if (call > stall) {
+            stall = call;
+        }
+    }
+    _report ("pread", reads, block, _now () - start, stall);
+    free (content);
+}
+
+static void
+_queue (const char * path, uint32_t threads, size_t reads, size_t block, size_t blocks)
+{
+    flm_Monitor * monitor;
+    struct bench bench;
+    double start;
+    char name[32];
+
+    memset (&bench, 0, sizeof (bench));
+    bench.block = block;
+    bench.blocks = blocks;
+    bench.total = reads;
+    bench.window = threads * 2;
+
+    monitor = flm_MonitorNew ();
+    bench.file_queue = flm_FileQueueNew (monitor, threads);
+    bench.file = flm_FileOpen (NULL, path, "r");
+    bench.content = malloc (bench.window * block);
+    if (monitor == NULL || bench.file_queue == NULL || bench.file == NULL) {
+        fprintf (stderr, "cannot create the file queue\n");
+        exit (1);
+    }
+
+    _cold (flm_IODescriptor ((flm_IO *) bench.file));
+    srand (42);
+    start = _now ();
+    _fill (&bench);
+    flm_MonitorWait (monitor);
+
+    snprintf (name, sizeof (name), "queue/%u", threads);
+    _report (name, reads, block, _now () - start, bench.stall);
+
+    free (bench.content);
+    flm_FileRelease (bench.file);
+    flm_FileQueueRelease (bench.file_queue);
+    flm_MonitorRelease (monitor);
+}
+
+int
+main (int argc, char ** argv)
+{
+    const char * path = "file_bench.tmp";
+    size_t reads;
+    size_t size;
+    size_t block;
+    size_t written;
+    char * content;
+    int fd;
+
+    reads = argc > 1 ? strtoul (argv[1], NULL, 10) : 4096;
+    size = (argc > 2 ? strtoul (argv[2], NULL, 10) : 256) * 1024 * 1024;
+    block = argc > 3 ? strtoul (argv[3], NULL, 10) : 4096;
+
+    if ((fd = open (path, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1) {
+        perror ("open");
+        return (1);
+    }
+    content = malloc (1024 * 1024);
+    memset (content, 'x', 1024 * 1024);
+    for (written = 0; written < size; written += 1024 * 1024) {
+        if (write (fd, content, 1024 * 1024) != 1024 * 1024) {
+            perror ("write");
+            return (1);
+        }
+    }
+    free (content);
+    fsync (fd);
+
+    _blocking (fd, reads, block, size / block);
+    _queue (path, 4, reads, block, size / block);
+    _queue (path, 16, reads, block, size / block);
+
+    close (fd);
+    unlink (path);
+    return (0);
+}
@@ -0,0 +1,372 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "test_utils.h"
+
+static char             root[64];
+
+static const char *
+_root (void)
+{
+    snprintf (root, sizeof (root), "/tmp/flm_test_%d.d", (int) getpid ());
+    mkdir (root, 0700);
+    return (root);
+}
+
+static void
+_write (const char * name, const char * content)
+{
+    char path[128];
+    int fd;
+
+    snprintf (path, sizeof (path), "%s/%s", root, name);
+    fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    fail_if (fd == -1);
+    fail_unless (write (fd, content, strlen (content)) == (ssize_t) strlen (content));
+    close (fd);
+}
+
+static void
+_remove (const char * name)
+{
+    char path[128];
+
+    snprintf (path, sizeof (path), "%s/%s", root, name);
+    if (unlink (path) == -1) {
+        rmdir (path);
+    }
+}
+
+START_TEST(test_file_cache_create)
+{
+    flm_Monitor * monitor;
+    flm_FileCache * cache;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+
+    fail_unless (flm_FileCacheNew (monitor, "/nonexistent/flm", 4, 0) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == ENOENT);
+    fail_unless (flm_FileCacheNew (monitor, _root (), 0, 0) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == EINVAL);
+
+    fail_if ((cache = flm_FileCacheNew (monitor, _root (), 4, 0)) == NULL);
+    flm_FileCacheRelease (cache);
+
+    flm_MonitorRelease (monitor);
+    rmdir (root);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_file_cache_alloc_fail)
+{
+    flm_FileCache * cache;
+    struct flm_FileCacheStats stats;
+    int baseFD;
+    int count;
+
+    baseFD = getFDCount ();
+    for (count = 1; count <= 2; count++) {
+        setTestAlloc (count);
+        fail_if (flm_FileCacheNew (NULL, _root (), 4, 0) != NULL);
+        fail_unless (getAllocSum () == 0);
+        fail_unless (getFDCount () == baseFD);
+    }
+
+    /**
+     * The entry, then the file
+     */
+    _write ("a", "a");
+    for (count = 3; count <= 4; count++) {
+        setTestAlloc (count);
+        fail_if ((cache = flm_FileCacheNew (NULL, root, 4, 0)) == NULL);
+        fail_unless (flm_FileCacheOpen (cache, "a", NULL) == NULL);
+        fail_unless (flm_Error () == FLM_ERR_NOMEM);
+        flm_FileCacheStats (cache, &stats);
+        fail_unless (stats.open == 0);
+        flm_FileCacheRelease (cache);
+        fail_unless (getAllocSum () == 0);
+        fail_unless (getFDCount () == baseFD);
+    }
+    _remove ("a");
+    rmdir (root);
+}
+END_TEST
+
+START_TEST(test_file_cache_open)
+{
+    flm_FileCache * cache;
+    flm_File * file;
+    flm_File * other;
+    struct flm_FileCacheStats stats;
+    struct stat stat;
+    char path[128];
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    _root ();
+    _write ("a", "hello");
+    snprintf (path, sizeof (path), "%s/sub", root);
+    fail_unless (mkdir (path, 0700) == 0);
+
+    fail_if ((cache = flm_FileCacheNew (NULL, root, 4, 0)) == NULL);
+
+    fail_if ((file = flm_FileCacheOpen (cache, "a", &stat)) == NULL);
+    fail_unless (stat.st_size == 5);
+    fail_if ((other = flm_FileCacheOpen (cache, "a", NULL)) == NULL);
+    fail_unless (other == file);
+    flm_FileRelease (other);
+
+    /**
+     * Only the cache keeps it open now
+     */
+    flm_FileRelease (file);
+    fail_unless (getFDCount () == baseFD + 2);
+
+    fail_unless (flm_FileCacheOpen (cache, "missing", NULL) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == ENOENT);
+    fail_unless (flm_FileCacheOpen (cache, "sub", NULL) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == EISDIR);
+
+    /**
+     * Nothing outside of the root
+     */
+    fail_unless (flm_FileCacheOpen (cache, "", NULL) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == EINVAL);
+    fail_unless (flm_FileCacheOpen (cache, "/etc/passwd", NULL) == NULL);
+    fail_unless (errno == EINVAL);
+    fail_unless (flm_FileCacheOpen (cache, "../a", NULL) == NULL);
+    fail_unless (errno == EINVAL);
+    fail_unless (flm_FileCacheOpen (cache, "sub/../../a", NULL) == NULL);
+    fail_unless (errno == EINVAL);
+    fail_unless (flm_FileCacheOpen (cache, "sub/..", NULL) == NULL);
+    fail_unless (errno == EINVAL);
+    fail_if ((file = flm_FileCacheOpen (cache, "./a", NULL)) == NULL);
+    flm_FileRelease (file);
+
+    /**
+     * Links are followed inside the root only, when the kernel can tell
+     */
+    snprintf (path, sizeof (path), "%s/in", root);
+    fail_unless (symlink ("sub/../a", path) == 0);
+    snprintf (path, sizeof (path), "%s/out", root);
+    fail_unless (symlink ("/etc/passwd", path) == 0);
+    fail_if ((file = flm_FileCacheOpen (cache, "in", NULL)) == NULL);
+    flm_FileRelease (file);
+    if ((file = flm_FileCacheOpen (cache, "out", NULL)) == NULL) {
+        fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == EXDEV);
+    }
+    else {
+        fail_unless (syscall (SYS_openat2, AT_FDCWD, "", NULL, 0) == -1 &&
+                     errno == ENOSYS);
+        flm_FileRelease (file);
+    }
+
+    flm_FileCacheStats (cache, &stats);
+    fail_unless (stats.hits == 1);
+    fail_unless (stats.misses == 6);
+    fail_unless (stats.open == 3);
+
+    flm_FileCacheRelease (cache);
+    _remove ("a");
+    _remove ("in");
+    _remove ("out");
+    _remove ("sub");
+    rmdir (root);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_file_cache_lru)
+{
+    flm_FileCache * cache;
+    flm_File * file;
+    struct flm_FileCacheStats stats;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    _root ();
+    _write ("a", "a");
+    _write ("b", "b");
+    _write ("c", "c");
+
+    fail_if ((cache = flm_FileCacheNew (NULL, root, 2, 0)) == NULL);
+
+    fail_if ((file = flm_FileCacheOpen (cache, "a", NULL)) == NULL);
+    flm_FileRelease (file);
+    fail_if ((file = flm_FileCacheOpen (cache, "b", NULL)) == NULL);
+    flm_FileRelease (file);
+
+    /**
+     * "a" is used again, "b" is the one to go
+     */
+    fail_if ((file = flm_FileCacheOpen (cache, "a", NULL)) == NULL);
+    flm_FileRelease (file);
+    fail_if ((file = flm_FileCacheOpen (cache, "c", NULL)) == NULL);
+
+    flm_FileCacheStats (cache, &stats);
+    fail_unless (stats.evictions == 1);
+    fail_unless (stats.open == 2);
+
+    /**
+     * Still open for its last user
+     */
+    flm_FileCacheClear (cache);
+    flm_FileCacheStats (cache, &stats);
+    fail_unless (stats.open == 0);
+    fail_unless (getFDCount () == baseFD + 1);
+    flm_FileRelease (file);
+
+    fail_if ((file = flm_FileCacheOpen (cache, "a", NULL)) == NULL);
+    flm_FileRelease (file);
+    flm_FileCacheStats (cache, &stats);
+    fail_unless (stats.hits == 1);
+    fail_unless (stats.misses == 4);
+
+    flm_FileCacheRelease (cache);
+    _remove ("a");
+    _remove ("b");
+    _remove ("c");
+    rmdir (root);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+struct _files {
+    flm_FileCache *     cache;
+    flm_File *          a;
+    flm_File *          b;
+};
+
+static void
+_check_handler (flm_Timer * timer, void * state)
+{
+    struct _files * files;
+    struct flm_FileCacheStats stats;
+    struct stat stat;
+    flm_File * file;
+    char path[128];
+    char other[128];
+
+    (void) timer;
+
+    files = state;
+
+    /**
+     * Modified in place, renamed over, and removed
+     */
+    _write ("a", "hello world");
+    _write ("tmp", "bye");
+    snprintf (path, sizeof (path), "%s/b", root);
+    snprintf (other, sizeof (other), "%s/tmp", root);
+    fail_unless (rename (other, path) == 0);
+    _remove ("c");
+
+    fail_if ((file = flm_FileCacheOpen (files->cache, "a", &stat)) == NULL);
+    fail_unless (file == files->a);
+    fail_unless (stat.st_size == 11);
+    flm_FileRelease (file);
+
+    fail_if ((file = flm_FileCacheOpen (files->cache, "b", &stat)) == NULL);
+    fail_unless (file != files->b);
+    fail_unless (stat.st_size == 3);
+    flm_FileRelease (file);
+
+    fail_unless (flm_FileCacheOpen (files->cache, "c", NULL) == NULL);
+    fail_unless (errno == ENOENT);
+
+    flm_FileCacheStats (files->cache, &stats);
+    fail_unless (stats.revalidations == 3);
+    fail_unless (stats.stale == 2);
+    fail_unless (stats.open == 2);
+}
+
+START_TEST(test_file_cache_validity)
+{
+    flm_Monitor * monitor;
+    flm_Timer * timer;
+    flm_File * file;
+    struct _files files;
+    struct stat stat;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    _root ();
+    _write ("a", "hello");
+    _write ("b", "hello");
+    _write ("c", "hello");
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((files.cache = flm_FileCacheNew (monitor, root, 4, 200)) == NULL);
+
+    fail_if ((files.a = flm_FileCacheOpen (files.cache, "a", NULL)) == NULL);
+    fail_if ((files.b = flm_FileCacheOpen (files.cache, "b", NULL)) == NULL);
+    fail_if ((file = flm_FileCacheOpen (files.cache, "c", NULL)) == NULL);
+    flm_FileRelease (file);
+
+    /**
+     * Not checked again before the delay
+     */
+    _write ("a", "hello world");
+    fail_if ((file = flm_FileCacheOpen (files.cache, "a", &stat)) == NULL);
+    fail_unless (stat.st_size == 5);
+    flm_FileRelease (file);
+
+    fail_if ((timer = flm_TimerNew (monitor, _check_handler, &files, 400)) == NULL);
+    flm_TimerRelease (timer);
+    flm_MonitorWait (monitor);
+
+    flm_FileRelease (files.a);
+    flm_FileRelease (files.b);
+    flm_FileCacheRelease (files.cache);
+    flm_MonitorRelease (monitor);
+    _remove ("a");
+    _remove ("b");
+    rmdir (root);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+Suite *
+file_cache_suite (void)
+{
+  Suite * s = suite_create ("file_cache");
+
+  /* File cache test case */
+  TCase *tc_core = tcase_create ("file_cache");
+
+  tcase_add_test (tc_core, test_file_cache_create);
+  tcase_add_test (tc_core, test_file_cache_alloc_fail);
+  tcase_add_test (tc_core, test_file_cache_open);
+  tcase_add_test (tc_core, test_file_cache_lru);
+  tcase_add_test (tc_core, test_file_cache_validity);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
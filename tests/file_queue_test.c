@@ -0,0 +1,318 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "test_utils.h"
+
+static char             path[64];
+
+static const char *
+_path (void)
+{
+    snprintf (path, sizeof (path), "/tmp/flm_test_%d.file", (int) getpid ());
+    return (path);
+}
+
+START_TEST(test_file_queue_create)
+{
+    flm_Monitor * monitor;
+    flm_FileQueue * file_queue;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((file_queue = flm_FileQueueNew (monitor, 2)) == NULL);
+    fail_unless (flm_FileQueueNew (monitor, 1000) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == EINVAL);
+
+    /**
+     * Nothing pending, nothing to wait for
+     */
+    flm_MonitorWait (monitor);
+
+    flm_FileQueueRelease (file_queue);
+    flm_MonitorRelease (monitor);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_file_queue_alloc_fail)
+{
+    int baseFD;
+    int count;
+
+    baseFD = getFDCount ();
+    for (count = 1; count <= 3; count++) {
+        setTestAlloc (count);
+        fail_if (flm_FileQueueNew (NULL, 2) != NULL);
+        fail_unless (getAllocSum () == 0);
+        fail_unless (getFDCount () == baseFD);
+    }
+}
+END_TEST
+
+struct _ops {
+    flm_FileQueue *     file_queue;
+    flm_Buffer *        read;
+    int                 written;
+    int                 synced;
+    ssize_t             count;
+};
+
+static void
+_read_handler (flm_File * file, void * state, flm_Buffer * buffer, ssize_t count)
+{
+    struct _ops * ops;
+
+    (void) file;
+
+    ops = state;
+    fail_unless (buffer == ops->read);
+    ops->count = count;
+}
+
+static void
+_sync_handler (flm_File * file, void * state, flm_Buffer * buffer, ssize_t count)
+{
+    struct _ops * ops;
+
+    ops = state;
+    fail_unless (buffer == NULL);
+    fail_unless (count == 0);
+    ops->synced++;
+
+    fail_if (flm_FileQueueRead (ops->file_queue,
+                                file,
+                                ops->read,
+                                0,
+                                _read_handler,
+                                ops) == -1);
+}
+
+static void
+_write_handler (flm_File * file, void * state, flm_Buffer * buffer, ssize_t count)
+{
+    struct _ops * ops;
+
+    ops = state;
+    fail_unless (count == (ssize_t) flm_BufferLength (buffer));
+
+    /**
+     * Writes are not ordered, the sync waits for both
+     */
+    if (++ops->written == 2) {
+        fail_if (flm_FileQueueSync (ops->file_queue,
+                                    file,
+                                    _sync_handler,
+                                    ops) == -1);
+    }
+}
+
+START_TEST(test_file_queue_ops)
+{
+    flm_Monitor * monitor;
+    struct _ops ops;
+    flm_File * file;
+    flm_Buffer * first;
+    flm_Buffer * second;
+    char content[32];
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    memset (&ops, 0, sizeof (ops));
+    memset (content, 0, sizeof (content));
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((ops.file_queue = flm_FileQueueNew (monitor, 0)) == NULL);
+    fail_if ((file = flm_FileOpen (NULL, _path (), "w+")) == NULL);
+    fail_if ((first = flm_BufferNew ("hello world", 11, NULL)) == NULL);
+    fail_if ((second = flm_BufferNew ("!!", 2, NULL)) == NULL);
+    fail_if ((ops.read = flm_BufferNew (content, sizeof (content), NULL)) == NULL);
+
+    fail_if (flm_FileQueueWrite (ops.file_queue,
+                                 file,
+                                 first,
+                                 0,
+                                 _write_handler,
+                                 &ops) == -1);
+    fail_if (flm_FileQueueWrite (ops.file_queue,
+                                 file,
+                                 second,
+                                 11,
+                                 _write_handler,
+                                 &ops) == -1);
+    flm_BufferRelease (first);
+    flm_BufferRelease (second);
+    flm_FileRelease (file);
+
+    /**
+     * Returns once every operation is done
+     */
+    flm_MonitorWait (monitor);
+
+    fail_unless (ops.written == 2);
+    fail_unless (ops.synced == 1);
+    fail_unless (ops.count == 13);
+    fail_unless (strcmp (content, "hello world!!") == 0);
+
+    flm_BufferRelease (ops.read);
+    flm_FileQueueRelease (ops.file_queue);
+    flm_MonitorRelease (monitor);
+    unlink (path);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+static int              failed;
+
+static void
+_error_handler (flm_File * file, void * state, flm_Buffer * buffer, ssize_t count)
+{
+    (void) file;
+    (void) state;
+    (void) buffer;
+
+    if (count == -1 && errno == EBADF) {
+        failed++;
+    }
+}
+
+START_TEST(test_file_queue_error)
+{
+    flm_Monitor * monitor;
+    flm_FileQueue * file_queue;
+    flm_File * file;
+    flm_Buffer * buffer;
+    char content[8];
+
+    setTestAlloc (0);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((file_queue = flm_FileQueueNew (monitor, 1)) == NULL);
+    fail_if ((file = flm_FileOpen (NULL, _path (), "w")) == NULL);
+    fail_if ((buffer = flm_BufferNew (content, sizeof (content), NULL)) == NULL);
+
+    /**
+     * Not opened for reading
+     */
+    failed = 0;
+    fail_if (flm_FileQueueRead (file_queue,
+                                file,
+                                buffer,
+                                0,
+                                _error_handler,
+                                NULL) == -1);
+
+    /**
+     * The queue is kept alive by the pending operation
+     */
+    flm_FileQueueRelease (file_queue);
+    flm_MonitorWait (monitor);
+    fail_unless (failed == 1);
+
+    flm_BufferRelease (buffer);
+    flm_FileRelease (file);
+    flm_MonitorRelease (monitor);
+    unlink (path);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+static ssize_t          prefetched;
+
+static void
+_prefetch_handler (flm_File * file, void * state, flm_Buffer * buffer, ssize_t count)
+{
+    (void) file;
+    (void) state;
+
+    fail_unless (buffer == NULL);
+    prefetched = count;
+}
+
+START_TEST(test_file_queue_prefetch)
+{
+    flm_Monitor * monitor;
+    flm_FileQueue * file_queue;
+    flm_File * file;
+    struct flm_FileQueueStats stats;
+    char content[1000];
+    int raw_file;
+    int i;
+
+    setTestAlloc (0);
+
+    raw_file = open (_path (), O_CREAT | O_TRUNC | O_WRONLY, 0600);
+    fail_if (raw_file == -1);
+    memset (content, 'a', sizeof (content));
+    for (i = 0; i < 100; i++) {
+        fail_unless (write (raw_file, content, sizeof (content)) == sizeof (content));
+    }
+    close (raw_file);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((file_queue = flm_FileQueueNew (monitor, 1)) == NULL);
+    fail_if ((file = flm_FileOpen (NULL, path, "r")) == NULL);
+
+    /**
+     * Stops at the end of the file
+     */
+    prefetched = 0;
+    fail_if (flm_FileQueuePrefetch (file_queue,
+                                    file,
+                                    1000,
+                                    1000000,
+                                    _prefetch_handler,
+                                    NULL) == -1);
+    flm_FileQueueStats (file_queue, &stats);
+    fail_unless (stats.operations == 1);
+    fail_unless (stats.pending == 1);
+
+    flm_MonitorWait (monitor);
+    fail_unless (prefetched == 99000);
+
+    flm_FileQueueStats (file_queue, &stats);
+    fail_unless (stats.pending == 0);
+    fail_unless (stats.probes == 0);
+
+    flm_FileRelease (file);
+    flm_FileQueueRelease (file_queue);
+    flm_MonitorRelease (monitor);
+    unlink (path);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+Suite *
+file_queue_suite (void)
+{
+  Suite * s = suite_create ("file_queue");
+
+  /* File queue test case */
+  TCase *tc_core = tcase_create ("file_queue");
+
+  tcase_add_test (tc_core, test_file_queue_create);
+  tcase_add_test (tc_core, test_file_queue_alloc_fail);
+  tcase_add_test (tc_core, test_file_queue_ops);
+  tcase_add_test (tc_core, test_file_queue_error);
+  tcase_add_test (tc_core, test_file_queue_prefetch);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
@@ -0,0 +1,485 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "test_utils.h"
+
+#define MAX_FRAMES      16
+
+struct _frames {
+    size_t      count;
+    char        content[MAX_FRAMES][64];
+    size_t      len[MAX_FRAMES];
+    bool        copied[MAX_FRAMES];
+    flm_Buffer * from;
+};
+
+static void
+_frame_handler (void * state, flm_Buffer * frame)
+{
+    struct _frames * frames;
+    char * content;
+
+    frames = state;
+
+    fail_if (frames->count == MAX_FRAMES);
+
+    content = flm_BufferContent (frame);
+    memcpy (frames->content[frames->count],
+            content,
+            flm_BufferLength (frame) < 64 ? flm_BufferLength (frame) : 64);
+    frames->len[frames->count] = flm_BufferLength (frame);
+
+    /**
+     * Not in the buffer being fed, so the framer copied it
+     */
+    frames->copied[frames->count] =                                     \
+        content < flm_BufferContent (frames->from) ||                   \
+        content >= flm_BufferContent (frames->from) +                   \
+        flm_BufferLength (frames->from);
+
+    frames->count++;
+    flm_BufferRelease (frame);
+}
+
+/**
+ * Feed the data in chunks of the given size
+ */
+static int
+_feed (flm_Framer * framer,
+       struct _frames * frames,
+       const char * data,
+       size_t len,
+       size_t chunk)
+{
+    flm_Buffer * buffer;
+    size_t off;
+    size_t count;
+    int ret;
+
+    for (off = 0; off < len; off += count) {
+        count = len - off < chunk ? len - off : chunk;
+        fail_if ((buffer = flm_BufferNew ((char *) &data[off], count, NULL)) == NULL);
+        frames->from = buffer;
+        ret = flm_FramerFeed (framer, buffer, _frame_handler, frames);
+        flm_BufferRelease (buffer);
+        if (ret == -1) {
+            return (-1);
+        }
+    }
+    return (0);
+}
+
+START_TEST(test_framer_create)
+{
+    flm_Framer * framer;
+
+    setTestAlloc (0);
+
+    fail_unless (flm_FramerLengthNew (3, 100) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_BUG);
+    fail_unless (flm_FramerLengthNew (2, 0) == NULL);
+    fail_unless (flm_FramerDelimiterNew ("", 0, 100) == NULL);
+
+    fail_if ((framer = flm_FramerLengthNew (4, 100)) == NULL);
+    flm_FramerRelease (framer);
+    fail_if ((framer = flm_FramerVarintNew (100)) == NULL);
+    flm_FramerRelease (framer);
+    fail_if ((framer = flm_FramerDelimiterNew ("\r\n", 2, 100)) == NULL);
+    flm_FramerRelease (framer);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_framer_alloc_fail)
+{
+    setTestAlloc (1);
+    fail_if (flm_FramerLengthNew (2, 100) != NULL);
+    fail_unless (getAllocSum () == 0);
+
+    setTestAlloc (2);
+    fail_if (flm_FramerDelimiterNew ("\n", 1, 100) != NULL);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_framer_length)
+{
+    const char data[] = "\x00\x05" "hello" "\x00\x00" "\x00\x03" "foo";
+    struct _frames frames;
+    flm_Framer * framer;
+    size_t chunk;
+
+    setTestAlloc (0);
+
+    /**
+     * Every way to cut the flow gives the same frames
+     */
+    for (chunk = 1; chunk <= sizeof (data) - 1; chunk++) {
+        memset (&frames, 0, sizeof (frames));
+        fail_if ((framer = flm_FramerLengthNew (2, 100)) == NULL);
+        fail_if (_feed (framer, &frames, data, sizeof (data) - 1, chunk) == -1);
+        flm_FramerRelease (framer);
+
+        fail_unless (frames.count == 3);
+        fail_unless (frames.len[0] == 5);
+        fail_unless (memcmp (frames.content[0], "hello", 5) == 0);
+        fail_unless (frames.len[1] == 0);
+        fail_unless (frames.len[2] == 3);
+        fail_unless (memcmp (frames.content[2], "foo", 3) == 0);
+    }
+
+    /**
+     * Not copied when the frames are not cut
+     */
+    fail_unless (frames.copied[0] == false);
+    fail_unless (frames.copied[2] == false);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_framer_varint)
+{
+    char data[2 + 300];
+    struct _frames frames;
+    flm_Framer * framer;
+    flm_Buffer * buffer;
+    size_t chunk;
+
+    setTestAlloc (0);
+
+    /* 300 = 0b10 0101100 */
+    data[0] = (char) 0xAC;
+    data[1] = 0x02;
+    memset (&data[2], 'x', 300);
+
+    for (chunk = 1; chunk <= sizeof (data); chunk += 7) {
+        memset (&frames, 0, sizeof (frames));
+        fail_if ((framer = flm_FramerVarintNew (1000)) == NULL);
+        fail_if (_feed (framer, &frames, data, sizeof (data), chunk) == -1);
+        flm_FramerRelease (framer);
+
+        fail_unless (frames.count == 1);
+        fail_unless (frames.len[0] == 300);
+        fail_unless (frames.content[0][63] == 'x');
+        fail_unless (frames.copied[0] == (chunk < sizeof (data)));
+    }
+
+    /**
+     * An endless varint is rejected
+     */
+    fail_if ((framer = flm_FramerVarintNew (1000)) == NULL);
+    memset (data, 0xFF, 16);
+    memset (&frames, 0, sizeof (frames));
+    fail_unless (_feed (framer, &frames, data, 16, 4) == -1);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == EMSGSIZE);
+
+    /**
+     * And the framer cannot be used anymore
+     */
+    fail_if ((buffer = flm_BufferNew ("\x01x", 2, NULL)) == NULL);
+    fail_unless (flm_FramerFeed (framer, buffer, _frame_handler, &frames) == -1);
+    flm_BufferRelease (buffer);
+    flm_FramerRelease (framer);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_framer_max)
+{
+    struct _frames frames;
+    flm_Framer * framer;
+
+    setTestAlloc (0);
+
+    /**
+     * The length is checked before waiting for the content
+     */
+    memset (&frames, 0, sizeof (frames));
+    fail_if ((framer = flm_FramerLengthNew (4, 10)) == NULL);
+    fail_unless (_feed (framer, &frames, "\x00\x00\x00\x0b", 4, 4) == -1);
+    fail_unless (errno == EMSGSIZE);
+    flm_FramerRelease (framer);
+
+    memset (&frames, 0, sizeof (frames));
+    fail_if ((framer = flm_FramerLengthNew (4, 10)) == NULL);
+    fail_if (_feed (framer, &frames, "\x00\x00\x00\x0a" "0123456789", 14, 3) == -1);
+    fail_unless (frames.count == 1);
+    flm_FramerRelease (framer);
+
+    /**
+     * A line without delimiter is rejected as soon as it is too long
+     */
+    memset (&frames, 0, sizeof (frames));
+    fail_if ((framer = flm_FramerDelimiterNew ("\r\n", 2, 10)) == NULL);
+    fail_if (_feed (framer, &frames, "0123456789\r", 11, 11) == -1);
+    fail_unless (_feed (framer, &frames, "0", 1, 1) == -1);
+    fail_unless (errno == EMSGSIZE);
+    flm_FramerRelease (framer);
+
+    memset (&frames, 0, sizeof (frames));
+    fail_if ((framer = flm_FramerDelimiterNew ("\r\n", 2, 10)) == NULL);
+    fail_unless (_feed (framer, &frames, "0123456789A\r\n", 13, 13) == -1);
+    fail_unless (frames.count == 0);
+    flm_FramerRelease (framer);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_framer_delimiter)
+{
+    const char data[] = "GET / HTTP/1.1\r\nHost: a\r\n\r\nend\r\n";
+    struct _frames frames;
+    flm_Framer * framer;
+    size_t chunk;
+
+    setTestAlloc (0);
+
+    for (chunk = 1; chunk <= sizeof (data) - 1; chunk++) {
+        memset (&frames, 0, sizeof (frames));
+        fail_if ((framer = flm_FramerDelimiterNew ("\r\n", 2, 100)) == NULL);
+        fail_if (_feed (framer, &frames, data, sizeof (data) - 1, chunk) == -1);
+        flm_FramerRelease (framer);
+
+        fail_unless (frames.count == 4);
+        fail_unless (frames.len[0] == 14);
+        fail_unless (memcmp (frames.content[0], "GET / HTTP/1.1", 14) == 0);
+        fail_unless (frames.len[1] == 7);
+        fail_unless (memcmp (frames.content[1], "Host: a", 7) == 0);
+        fail_unless (frames.len[2] == 0);
+        fail_unless (frames.len[3] == 3);
+        fail_unless (memcmp (frames.content[3], "end", 3) == 0);
+    }
+    fail_unless (frames.copied[0] == false);
+    fail_unless (frames.copied[3] == false);
+
+    /**
+     * Overlapping delimiter cut between two buffers
+     */
+    memset (&frames, 0, sizeof (frames));
+    fail_if ((framer = flm_FramerDelimiterNew ("aab", 3, 100)) == NULL);
+    fail_if (_feed (framer, &frames, "xaaaab", 6, 4) == -1);
+    flm_FramerRelease (framer);
+    fail_unless (frames.count == 1);
+    fail_unless (frames.len[0] == 3);
+    fail_unless (memcmp (frames.content[0], "xaa", 3) == 0);
+    fail_unless (frames.copied[0] == true);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_framer_line)
+{
+    const char data[] = "one\r\ntwo\n\r\n\rthree\r\n";
+    struct _frames frames;
+    flm_Framer * framer;
+    size_t chunk;
+
+    setTestAlloc (0);
+
+    for (chunk = 1; chunk <= sizeof (data) - 1; chunk++) {
+        memset (&frames, 0, sizeof (frames));
+        fail_if ((framer = flm_FramerLineNew (100)) == NULL);
+        fail_if (_feed (framer, &frames, data, sizeof (data) - 1, chunk) == -1);
+        flm_FramerRelease (framer);
+
+        fail_unless (frames.count == 4);
+        fail_unless (frames.len[0] == 3);
+        fail_unless (memcmp (frames.content[0], "one", 3) == 0);
+        fail_unless (frames.len[1] == 3);
+        fail_unless (memcmp (frames.content[1], "two", 3) == 0);
+        fail_unless (frames.len[2] == 0);
+
+        /* only the carriage return before the new line is removed */
+        fail_unless (frames.len[3] == 6);
+        fail_unless (memcmp (frames.content[3], "\rthree", 6) == 0);
+    }
+    fail_unless (frames.copied[0] == false);
+
+    /**
+     * The carriage return does not count in the maximum length
+     */
+    for (chunk = 1; chunk <= 12; chunk++) {
+        memset (&frames, 0, sizeof (frames));
+        fail_if ((framer = flm_FramerLineNew (10)) == NULL);
+        fail_if (_feed (framer, &frames, "0123456789\r\n", 12, chunk) == -1);
+        fail_if (_feed (framer, &frames, "0123456789\n", 11, chunk) == -1);
+        fail_unless (_feed (framer, &frames, "0123456789A\r\n", 13, chunk) == -1);
+        fail_unless (errno == EMSGSIZE);
+        flm_FramerRelease (framer);
+
+        fail_unless (frames.count == 2);
+        fail_unless (frames.len[0] == 10);
+        fail_unless (frames.len[1] == 10);
+    }
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+struct _stream_state {
+    size_t      frames;
+    size_t      errors;
+};
+
+static void
+_stream_frame_handler (flm_Stream * stream, void * state, flm_Buffer * frame)
+{
+    struct _stream_state * stream_state;
+
+    (void) stream;
+
+    stream_state = state;
+    fail_unless (flm_BufferLength (frame) == 3);
+    fail_unless (memcmp (flm_BufferContent (frame), "abc", 3) == 0);
+    stream_state->frames++;
+    flm_BufferRelease (frame);
+}
+
+static void
+_stream_error_handler (flm_IO * io, void * state, int error)
+{
+    struct _stream_state * stream_state;
+
+    (void) io;
+
+    stream_state = state;
+    fail_unless (error == FLM_ERR_ERRNO && errno == EMSGSIZE);
+    stream_state->errors++;
+}
+
+START_TEST(test_framer_stream)
+{
+    flm_Monitor * monitor;
+    flm_Stream * stream;
+    flm_Framer * framer;
+    struct _stream_state state;
+    int fds[2];
+    size_t i;
+
+    setTestAlloc (0);
+
+    fail_if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == -1);
+    fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+
+    /**
+     * Ten frames, then one too long for the framer
+     */
+    for (i = 0; i < 10; i++) {
+        fail_unless (write (fds[1], "\x03" "abc", 4) == 4);
+    }
+    fail_unless (write (fds[1], "\x7f", 1) == 1);
+    close (fds[1]);
+
+    state.frames = 0;
+    state.errors = 0;
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((stream = flm_StreamNew (monitor, fds[0], &state)) == NULL);
+    fail_if ((framer = flm_FramerVarintNew (16)) == NULL);
+
+    flm_StreamOnRead (stream, _stream_frame_handler);
+    flm_IOOnError ((flm_IO *) stream, _stream_error_handler);
+    flm_StreamFrameRead (stream, framer);
+    flm_FramerRelease (framer);
+    flm_StreamRelease (stream);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (state.frames == 10);
+    fail_unless (state.errors == 1);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+static void
+_line_handler (flm_Stream * stream, void * state, flm_Buffer * line)
+{
+    struct _stream_state * stream_state;
+
+    stream_state = state;
+    fail_unless (flm_BufferLength (line) == 5);
+    fail_unless (memcmp (flm_BufferContent (line), "hello", 5) == 0);
+    flm_BufferRelease (line);
+
+    if (++stream_state->frames == 1000) {
+        flm_StreamClose (stream);
+    }
+}
+
+START_TEST(test_framer_stream_lines)
+{
+    flm_Monitor * monitor;
+    flm_Stream * stream;
+    struct _stream_state state;
+    char data[7 * 1000];
+    int fds[2];
+    size_t i;
+
+    setTestAlloc (0);
+
+    fail_if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == -1);
+    fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+
+    /**
+     * More than a read buffer, so some lines are cut
+     */
+    for (i = 0; i < 1000; i++) {
+        memcpy (&data[i * 7], "hello\r\n", 7);
+    }
+    fail_unless (write (fds[1], data, sizeof (data)) == sizeof (data));
+    close (fds[1]);
+
+    state.frames = 0;
+    state.errors = 0;
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((stream = flm_StreamNew (monitor, fds[0], &state)) == NULL);
+    flm_StreamOnRead (stream, _line_handler);
+    fail_if (flm_StreamReadLines (stream, 80) == -1);
+    flm_StreamRelease (stream);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (state.frames == 1000);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+Suite *
+framer_suite (void)
+{
+  Suite * s = suite_create ("framer");
+
+  /* Framer test case */
+  TCase *tc_core = tcase_create ("framer");
+
+  tcase_add_test (tc_core, test_framer_create);
+  tcase_add_test (tc_core, test_framer_alloc_fail);
+  tcase_add_test (tc_core, test_framer_length);
+  tcase_add_test (tc_core, test_framer_varint);
+  tcase_add_test (tc_core, test_framer_max);
+  tcase_add_test (tc_core, test_framer_delimiter);
+  tcase_add_test (tc_core, test_framer_line);
+  tcase_add_test (tc_core, test_framer_stream);
+  tcase_add_test (tc_core, test_framer_stream_lines);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
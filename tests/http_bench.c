@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "flm/flm.h"
+
+/**
+ * Parse pipelined requests as a browser would send them, fed in buffers
+ * of different sizes. Small buffers cut most heads, so they measure the
+ * cost of joining them.
+ *
+ * usage: http_bench [requests] [rounds]
+ */
+
+#define BENCH_REQUEST                                                   \
+    "GET /static/images/logo.png?v=1234 HTTP/1.1\r\n"                   \
+    "Host: www.example.com\r\n"                                         \
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) "            \
+    "Gecko/20100101 Firefox/115.0\r\n"                                  \
+    "Accept: image/avif,image/webp,*/*\r\n"                             \
+    "Accept-Language: en-US,en;q=0.5\r\n"                               \
+    "Accept-Encoding: gzip, deflate, br\r\n"                            \
+    "Referer: https://www.example.com/index.html\r\n"                   \
+    "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark\r\n"  \
+    "Connection: keep-alive\r\n"                                        \
+    "\r\n"
+
+static char *   text;
+static size_t   text_size;
+static size_t   rounds;
+static size_t   requests;
+
+static void
+_end_handler (flm_HTTPParser * parser, void * state)
+{
+    (void) parser;
+
+    (*(size_t *) state)++;
+}
+
+static void
+_run (size_t chunk)
+{
+    struct timespec start;
+    struct timespec end;
+    flm_HTTPParser * parser;
+    flm_Buffer * buffer;
+    double elapsed;
+    size_t count;
+    size_t off;
+    size_t len;
+    size_t i;
+
+    count = 0;
+    if ((parser = flm_HTTPParserNew (FLM_HTTP_REQUEST, 8192, 64, &count)) == NULL) {
+        fprintf (stderr, "cannot create the parser\n");
+        exit (1);
+    }
+    flm_HTTPParserOnEnd (parser, _end_handler);
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    for (i = 0; i < rounds; i++) {
+        for (off = 0; off < text_size; off += len) {
+            len = text_size - off < chunk ? text_size - off : chunk;
+            if ((buffer = flm_BufferNew (text + off, len, NULL)) == NULL ||
+                flm_HTTPParserFeed (parser, buffer) == -1) {
+                fprintf (stderr, "cannot parse the requests\n");
+                exit (1);
+            }
+            flm_BufferRelease (buffer);
+        }
+    }
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    flm_HTTPParserRelease (parser);
+
+    elapsed = (end.tv_sec - start.tv_sec) +
+        (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf ("buffers of %6zu bytes: %10.0f requests/s %8.1f MB/s (%zu parsed)\n",
+            chunk,
+            count / elapsed,
+            (text_size * rounds) / elapsed / 1e6,
+            count / rounds);
+}
+
+int
+main (int argc, char ** argv)
+{
+    static const size_t chunks[] = { 1500, 16384, 65536 };
+    size_t len;
+    size_t i;
+
+    requests = argc > 1 ? strtoul (argv[1], NULL, 10) : 10000;
+    rounds = argc > 2 ? strtoul (argv[2], NULL, 10) : 50;
+
+    len = sizeof (BENCH_REQUEST) - 1;
+    text_size = requests * len;
+    if ((text = malloc (text_size)) == NULL) {
+        fprintf (stderr, "cannot allocate the requests\n");
+        return (1);
+    }
+    for (i = 0; i < requests; i++) {
+        memcpy (text + i * len, BENCH_REQUEST, len);
+    }
+
+    for (i = 0; i < sizeof (chunks) / sizeof (size_t); i++) {
+        _run (chunks[i]);
+    }
+    free (text);
+    return (0);
+}
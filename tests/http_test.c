@@ -0,0 +1,550 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "test_utils.h"
+
+/**
+ * Everything the handlers are called with, as text
+ */
+struct _log {
+    char        content[4096];
+    size_t      len;
+    size_t      messages;
+    bool        skip_body;
+};
+
+static void
+_append (struct _log * log, const char * content, size_t len)
+{
+    fail_if (log->len + len >= sizeof (log->content));
+    memcpy (log->content + log->len, content, len);
+    log->len += len;
+    log->content[log->len] = '\0';
+}
+
+static void
+_head_handler (flm_HTTPParser * parser,
+               void * state,
+               const struct flm_HTTPHead * head)
+{
+    struct _log * log;
+    char line[64];
+    size_t i;
+
+    log = state;
+    if (head->method.content) {
+        _append (log, "[", 1);
+        _append (log, head->method.content, head->method.len);
+        _append (log, " ", 1);
+        _append (log, head->target.content, head->target.len);
+    }
+    else {
+        snprintf (line, sizeof (line), "[%d ", head->status);
+        _append (log, line, strlen (line));
+        _append (log, head->reason.content, head->reason.len);
+    }
+    for (i = 0; i < head->count; i++) {
+        _append (log, "|", 1);
+        _append (log, head->headers[i].name.content, head->headers[i].name.len);
+        _append (log, "=", 1);
+        _append (log, head->headers[i].value.content, head->headers[i].value.len);
+    }
+    snprintf (line, sizeof (line), "|1.%d%s]",
+              head->minor,
+              head->keep_alive ? "" : " close");
+    _append (log, line, strlen (line));
+
+    if (log->skip_body) {
+        flm_HTTPParserSkipBody (parser);
+    }
+}
+
+static void
+_body_handler (flm_HTTPParser * parser,
+               void * state,
+               const char * content,
+               size_t len)
+{
+    (void) parser;
+
+    _append (state, content, len);
+}
+
+static void
+_end_handler (flm_HTTPParser * parser, void * state)
+{
+    struct _log * log;
+
+    (void) parser;
+
+    log = state;
+    _append (log, "$", 1);
+    log->messages++;
+}
+
+/**
+ * Parse the data in chunks of the given size
+ */
+static int
+_parse (int type, struct _log * log, const char * data, size_t chunk)
+{
+    flm_HTTPParser * parser;
+    flm_Buffer * buffer;
+    size_t len;
+    size_t off;
+    size_t count;
+    int ret;
+
+    memset (log->content, 0, sizeof (log->content));
+    log->len = 0;
+    log->messages = 0;
+
+    fail_if ((parser = flm_HTTPParserNew (type, 256, 8, log)) == NULL);
+    flm_HTTPParserOnHead (parser, _head_handler);
+    flm_HTTPParserOnBody (parser, _body_handler);
+    flm_HTTPParserOnEnd (parser, _end_handler);
+
+    ret = 0;
+    len = strlen (data);
+    for (off = 0; off < len && ret == 0; off += count) {
+        count = len - off < chunk ? len - off : chunk;
+        fail_if ((buffer = flm_BufferNew ((char *) &data[off], count, NULL)) == NULL);
+        ret = flm_HTTPParserFeed (parser, buffer);
+        flm_BufferRelease (buffer);
+    }
+    if (ret == 0) {
+        ret = flm_HTTPParserFinish (parser);
+    }
+    flm_HTTPParserRelease (parser);
+    return (ret);
+}
+
+/**
+ * The same result whatever the way the data are split
+ */
+static void
+_check (int type, const char * data, const char * expected)
+{
+    struct _log log;
+    size_t chunk;
+
+    log.skip_body = false;
+    for (chunk = 1; chunk <= strlen (data); chunk++) {
+        fail_if (_parse (type, &log, data, chunk) == -1);
+        fail_unless (strcmp (log.content, expected) == 0,
+                     "chunk %zu: %s", chunk, log.content);
+    }
+}
+
+static void
+_check_error (int type, const char * data, int error)
+{
+    struct _log log;
+    size_t chunk;
+
+    log.skip_body = false;
+    for (chunk = 1; chunk <= strlen (data); chunk++) {
+        errno = 0;
+        fail_unless (_parse (type, &log, data, chunk) == -1);
+        fail_unless (flm_Error () == FLM_ERR_ERRNO);
+        fail_unless (errno == error, "chunk %zu: %d", chunk, errno);
+    }
+}
+
+START_TEST(test_http_create)
+{
+    flm_HTTPParser * parser;
+
+    setTestAlloc (0);
+
+    fail_unless (flm_HTTPParserNew (2, 256, 8, NULL) == NULL);
+    fail_unless (flm_HTTPParserNew (FLM_HTTP_REQUEST, 0, 8, NULL) == NULL);
+    fail_unless (flm_HTTPParserNew (FLM_HTTP_REQUEST, 256, 0, NULL) == NULL);
+
+    fail_if ((parser = flm_HTTPParserNew (FLM_HTTP_REQUEST, 256, 8, NULL)) == NULL);
+    fail_unless (flm_HTTPParserFinish (parser) == 0);
+    flm_HTTPParserRelease (parser);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_http_alloc_fail)
+{
+    setTestAlloc (1);
+    fail_if (flm_HTTPParserNew (FLM_HTTP_REQUEST, 256, 8, NULL) != NULL);
+    fail_unless (getAllocSum () == 0);
+
+    setTestAlloc (2);
+    fail_if (flm_HTTPParserNew (FLM_HTTP_REQUEST, 256, 8, NULL) != NULL);
+    fail_unless (getAllocSum () == 0);
+
+    setTestAlloc (3);
+    fail_if (flm_HTTPParserNew (FLM_HTTP_REQUEST, 256, 8, NULL) != NULL);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_http_request)
+{
+    setTestAlloc (0);
+
+    _check (FLM_HTTP_REQUEST,
+            "GET /index.html HTTP/1.1\r\n"
+            "Host: example.com\r\n"
+            "Accept:  */*  \r\n"
+            "\r\n",
+            "[GET /index.html|Host=example.com|Accept=*/*|1.1]$");
+
+    /**
+     * Bare line feeds, empty lines before the request, HTTP/1.0
+     */
+    _check (FLM_HTTP_REQUEST,
+            "\r\n\nGET / HTTP/1.0\nEmpty:\n\n",
+            "[GET /|Empty=|1.0 close]$");
+
+    _check (FLM_HTTP_REQUEST,
+            "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n"
+            "GET / HTTP/1.1\r\nConnection: upgrade, close\r\n\r\n",
+            "[GET /|Connection=Keep-Alive|1.0]$"
+            "[GET /|Connection=upgrade, close|1.1 close]$");
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_http_pipelining)
+{
+    setTestAlloc (0);
+
+    _check (FLM_HTTP_REQUEST,
+            "POST /a HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+            "GET /b HTTP/1.1\r\n\r\n"
+            "PUT /c HTTP/1.1\r\ncontent-length: 0\r\n\r\n"
+            "POST /d HTTP/1.1\r\nContent-Length: 3\r\n\r\nbye",
+            "[POST /a|Content-Length=5|1.1]hello$"
+            "[GET /b|1.1]$"
+            "[PUT /c|content-length=0|1.1]$"
+            "[POST /d|Content-Length=3|1.1]bye$");
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_http_chunked)
+{
+    setTestAlloc (0);
+
+    _check (FLM_HTTP_REQUEST,
+            "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+            "5\r\nhello\r\n"
+            "1;name=value\r\n \r\n"
+            "A\r\n0123456789\r\n"
+            "0\r\n"
+            "Trailer: ignored\r\n"
+            "\r\n"
+            "GET /next HTTP/1.1\r\n\r\n",
+            "[POST /|Transfer-Encoding=chunked|1.1]hello 0123456789$"
+            "[GET /next|1.1]$");
+
+    /**
+     * Bare line feeds, and a response using the chunked encoding
+     */
+    _check (FLM_HTTP_RESPONSE,
+            "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"
+            "3\nabc\n0\n\n",
+            "[200 OK|Transfer-Encoding=gzip, chunked|1.1]abc$");
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_http_response)
+{
+    struct _log log;
+
+    setTestAlloc (0);
+
+    _check (FLM_HTTP_RESPONSE,
+            "HTTP/1.1 100 Continue\r\n\r\n"
+            "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok"
+            "HTTP/1.1 204 No Content\r\n\r\n"
+            "HTTP/1.1 304\r\nContent-Length: 10\r\n\r\n",
+            "[100 Continue|1.1]$"
+            "[200 OK|Content-Length=2|1.1]ok$"
+            "[204 No Content|1.1]$"
+            "[304 |Content-Length=10|1.1]$");
+
+    /**
+     * Without length, the body ends with the flow
+     */
+    _check (FLM_HTTP_RESPONSE,
+            "HTTP/1.0 200 OK\r\n\r\nuntil the end",
+            "[200 OK|1.0 close]until the end$");
+
+    /**
+     * The response to a HEAD request
+     */
+    log.skip_body = true;
+    fail_if (_parse (FLM_HTTP_RESPONSE,
+                     &log,
+                     "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n"
+                     "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n",
+                     7) == -1);
+    fail_unless (log.messages == 2);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_http_errors)
+{
+    setTestAlloc (0);
+
+    _check_error (FLM_HTTP_REQUEST, "GET\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST, "GET /\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST, "GET / HTTP/2.0\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST, "GET  / HTTP/1.1\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST, "GET / HTTP/1.1\r\nNoColon\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST, "GET / HTTP/1.1\r\nName : x\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST, "GET / HTTP/1.1\r\nA: b\r\n c\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_RESPONSE, "HTTP/1.1 20 OK\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_RESPONSE, "HTTP/1.1 200OK\r\n\r\n", EPROTO);
+
+    /**
+     * Ambiguous lengths
+     */
+    _check_error (FLM_HTTP_REQUEST,
+                  "POST / HTTP/1.1\r\nContent-Length: 1\r\n"
+                  "Content-Length: 2\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST,
+                  "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST,
+                  "POST / HTTP/1.1\r\nContent-Length: 99999999999999999999\r\n\r\n",
+                  EPROTO);
+    _check_error (FLM_HTTP_REQUEST,
+                  "POST / HTTP/1.1\r\nContent-Length: 1\r\n"
+                  "Transfer-Encoding: chunked\r\n\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST,
+                  "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", EPROTO);
+
+    /**
+     * Bad chunks, and messages cut by the end of the flow
+     */
+    _check_error (FLM_HTTP_REQUEST,
+                  "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                  "x\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST,
+                  "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                  "2\r\nabc\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST,
+                  "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                  "11111111111111111\r\n", EPROTO);
+    _check_error (FLM_HTTP_REQUEST,
+                  "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\nabc", EPROTO);
+    _check_error (FLM_HTTP_REQUEST, "GET / HTTP/1.1\r\n", EPROTO);
+
+    /**
+     * Limits: 8 headers and 256 bytes of head
+     */
+    _check_error (FLM_HTTP_REQUEST,
+                  "GET / HTTP/1.1\r\na: 1\r\nb: 2\r\nc: 3\r\nd: 4\r\ne: 5\r\n"
+                  "f: 6\r\ng: 7\r\nh: 8\r\ni: 9\r\n\r\n", EMSGSIZE);
+    _check_error (FLM_HTTP_REQUEST,
+                  "GET / HTTP/1.1\r\n"
+                  "Cookie: 0123456789012345678901234567890123456789"
+                  "0123456789012345678901234567890123456789"
+                  "0123456789012345678901234567890123456789"
+                  "0123456789012345678901234567890123456789"
+                  "0123456789012345678901234567890123456789"
+                  "0123456789012345678901234567890123456789\r\n\r\n",
+                  EMSGSIZE);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+static void
+_view_handler (flm_HTTPParser * parser,
+               void * state,
+               const struct flm_HTTPHead * head)
+{
+    const struct flm_HTTPHeader * header;
+
+    (void) parser;
+
+    header = flm_HTTPHeadFind (head, "HOST");
+    fail_if (header == NULL);
+    fail_unless (header->value.len == 1);
+    fail_unless (flm_HTTPHeadFind (head, "Hos") == NULL);
+
+    *(const char **) state = head->method.content;
+}
+
+START_TEST(test_http_views)
+{
+    const char data[] = "GET /a HTTP/1.1\r\nHost: x\r\n\r\n";
+    flm_HTTPParser * parser;
+    flm_Buffer * buffer;
+    const char * method;
+
+    setTestAlloc (0);
+
+    fail_if ((parser = flm_HTTPParserNew (FLM_HTTP_REQUEST, 256, 8, &method)) == NULL);
+    flm_HTTPParserOnHead (parser, _view_handler);
+
+    /**
+     * No copy when the head is in a single buffer
+     */
+    fail_if ((buffer = flm_BufferNew ((char *) data, sizeof (data) - 1, NULL)) == NULL);
+    fail_if (flm_HTTPParserFeed (parser, buffer) == -1);
+    flm_BufferRelease (buffer);
+    fail_unless (method == data);
+
+    /**
+     * Joined otherwise
+     */
+    fail_if ((buffer = flm_BufferNew ((char *) data, 10, NULL)) == NULL);
+    fail_if (flm_HTTPParserFeed (parser, buffer) == -1);
+    flm_BufferRelease (buffer);
+    fail_if ((buffer = flm_BufferNew ((char *) data + 10, sizeof (data) - 11, NULL)) == NULL);
+    fail_if (flm_HTTPParserFeed (parser, buffer) == -1);
+    flm_BufferRelease (buffer);
+    fail_if (method == data);
+    fail_unless (memcmp (method, "GET", 3) == 0);
+
+    flm_HTTPParserRelease (parser);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+struct _stream_state {
+    struct _log         log;
+    flm_Stream *        stream;
+    size_t              errors;
+};
+
+static void
+_stream_end_handler (flm_HTTPParser * parser, void * state)
+{
+    struct _stream_state * stream_state;
+
+    stream_state = state;
+    _end_handler (parser, &stream_state->log);
+    flm_StreamPrintf (stream_state->stream, "HTTP/1.1 204 No Content\r\n\r\n");
+}
+
+static void
+_stream_head_handler (flm_HTTPParser * parser,
+                      void * state,
+                      const struct flm_HTTPHead * head)
+{
+    struct _stream_state * stream_state;
+
+    stream_state = state;
+    fail_unless (flm_HTTPHeadFind (head, "host") != NULL);
+    _head_handler (parser, &stream_state->log, head);
+}
+
+static void
+_stream_error_handler (flm_IO * io, void * state, int error)
+{
+    struct _stream_state * stream_state;
+
+    (void) io;
+    (void) error;
+
+    stream_state = state;
+    stream_state->errors++;
+}
+
+START_TEST(test_http_stream)
+{
+    flm_Monitor * monitor;
+    flm_HTTPParser * parser;
+    struct _stream_state state;
+    char data[4096];
+    size_t len;
+    ssize_t nb_read;
+    int fds[2];
+    size_t i;
+
+    setTestAlloc (0);
+
+    fail_if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == -1);
+    fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+
+    /**
+     * Pipelined requests crossing the read buffers, then a truncated one
+     */
+    len = 0;
+    for (i = 0; i < 100; i++) {
+        len += snprintf (data + len, sizeof (data) - len,
+                         "GET /%zu HTTP/1.1\r\nHost: x\r\n\r\n", i);
+    }
+    len += snprintf (data + len, sizeof (data) - len, "GET / HTTP/1.1\r\n");
+    fail_unless (write (fds[1], data, len) == (ssize_t) len);
+    shutdown (fds[1], SHUT_WR);
+
+    memset (&state, 0, sizeof (state));
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((state.stream = flm_StreamNew (monitor, fds[0], &state)) == NULL);
+    fail_if ((parser = flm_HTTPParserNew (FLM_HTTP_REQUEST, 256, 8, &state)) == NULL);
+    flm_HTTPParserOnHead (parser, _stream_head_handler);
+    flm_HTTPParserOnEnd (parser, _stream_end_handler);
+    flm_IOOnError ((flm_IO *) state.stream, _stream_error_handler);
+    flm_StreamHTTPRead (state.stream, parser);
+    flm_HTTPParserRelease (parser);
+    flm_StreamRelease (state.stream);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (state.log.messages == 100);
+    fail_unless (state.errors == 1);
+
+    /**
+     * Every request got its response
+     */
+    len = 0;
+    while ((nb_read = read (fds[1], data, sizeof (data))) > 0) {
+        len += nb_read;
+    }
+    close (fds[1]);
+    fail_unless (len == 100 * strlen ("HTTP/1.1 204 No Content\r\n\r\n"));
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+Suite *
+http_suite (void)
+{
+  Suite * s = suite_create ("http");
+
+  /* HTTP test case */
+  TCase *tc_core = tcase_create ("http");
+
+  tcase_add_test (tc_core, test_http_create);
+  tcase_add_test (tc_core, test_http_alloc_fail);
+  tcase_add_test (tc_core, test_http_request);
+  tcase_add_test (tc_core, test_http_pipelining);
+  tcase_add_test (tc_core, test_http_chunked);
+  tcase_add_test (tc_core, test_http_response);
+  tcase_add_test (tc_core, test_http_errors);
+  tcase_add_test (tc_core, test_http_views);
+  tcase_add_test (tc_core, test_http_stream);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
@@ -22,6 +22,15 @@ main (void)
     Suite * bufferSuite = buffer_suite ();
     SRunner * bufferRunner = srunner_create (bufferSuite);
 
+    Suite * bufferBuilderSuite = buffer_builder_suite ();
+    SRunner * bufferBuilderRunner = srunner_create (bufferBuilderSuite);
+
+    Suite * bufferChainSuite = buffer_chain_suite ();
+    SRunner * bufferChainRunner = srunner_create (bufferChainSuite);
+
+    Suite * scanSuite = scan_suite ();
+    SRunner * scanRunner = srunner_create (scanSuite);
+
     Suite * monitorSuite = monitor_suite ();
     SRunner * monitorRunner = srunner_create (monitorSuite);
 
@@ -49,6 +58,33 @@ main (void)
     Suite * tcpServerSuite = tcp_server_suite ();
     SRunner * tcpServerRunner = srunner_create (tcpServerSuite);
 
+    Suite * tcpClientSuite = tcp_client_suite ();
+    SRunner * tcpClientRunner = srunner_create (tcpClientSuite);
+
+    Suite * connPoolSuite = conn_pool_suite ();
+    SRunner * connPoolRunner = srunner_create (connPoolSuite);
+
+    Suite * udpSocketSuite = udp_socket_suite ();
+    SRunner * udpSocketRunner = srunner_create (udpSocketSuite);
+
+    Suite * unixServerSuite = unix_server_suite ();
+    SRunner * unixServerRunner = srunner_create (unixServerSuite);
+
+    Suite * fileQueueSuite = file_queue_suite ();
+    SRunner * fileQueueRunner = srunner_create (fileQueueSuite);
+
+    Suite * fileCacheSuite = file_cache_suite ();
+    SRunner * fileCacheRunner = srunner_create (fileCacheSuite);
+
+    Suite * tlsCacheSuite = tls_cache_suite ();
+    SRunner * tlsCacheRunner = srunner_create (tlsCacheSuite);
+
+    Suite * framerSuite = framer_suite ();
+    SRunner * framerRunner = srunner_create (framerSuite);
+
+    Suite * httpSuite = http_suite ();
+    SRunner * httpRunner = srunner_create (httpSuite);
+
     number_failed = 0;
     
     srunner_run_all (allocRunner, CK_NORMAL);
@@ -59,6 +95,18 @@ main (void)
     number_failed += srunner_ntests_failed (bufferRunner);
     srunner_free (bufferRunner);
 
+    srunner_run_all (bufferBuilderRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (bufferBuilderRunner);
+    srunner_free (bufferBuilderRunner);
+
+    srunner_run_all (bufferChainRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (bufferChainRunner);
+    srunner_free (bufferChainRunner);
+
+    srunner_run_all (scanRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (scanRunner);
+    srunner_free (scanRunner);
+
     printf (">> Switch to the Epoll backend\n");
     flm__setMonitorBackend (FLM__MONITOR_BACKEND_EPOLL);
     srunner_run_all (ioRunner, CK_NORMAL);
@@ -85,12 +133,42 @@ main (void)
     flm__setMonitorBackend (FLM__MONITOR_BACKEND_EPOLL);
     srunner_run_all (tcpServerRunner, CK_NORMAL);
     number_failed += srunner_ntests_failed (tcpServerRunner);
+    srunner_run_all (tcpClientRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (tcpClientRunner);
+    srunner_run_all (connPoolRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (connPoolRunner);
+    srunner_run_all (udpSocketRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (udpSocketRunner);
+    srunner_run_all (unixServerRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (unixServerRunner);
+    srunner_run_all (fileQueueRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (fileQueueRunner);
+    srunner_run_all (fileCacheRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (fileCacheRunner);
 
     printf (">> Switch to the select() backend\n");
     flm__setMonitorBackend (FLM__MONITOR_BACKEND_SELECT);
     srunner_run_all (tcpServerRunner, CK_NORMAL);
     number_failed += srunner_ntests_failed (tcpServerRunner);
     srunner_free (tcpServerRunner);
+    srunner_run_all (tcpClientRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (tcpClientRunner);
+    srunner_free (tcpClientRunner);
+    srunner_run_all (connPoolRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (connPoolRunner);
+    srunner_free (connPoolRunner);
+    srunner_run_all (udpSocketRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (udpSocketRunner);
+    srunner_free (udpSocketRunner);
+    srunner_run_all (unixServerRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (unixServerRunner);
+    srunner_free (unixServerRunner);
+    srunner_run_all (fileQueueRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (fileQueueRunner);
+    srunner_free (fileQueueRunner);
+    srunner_run_all (fileCacheRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (fileCacheRunner);
+    srunner_free (fileCacheRunner);
 
     printf (">> Switch to the Epoll backend\n");
     flm__setMonitorBackend (FLM__MONITOR_BACKEND_EPOLL);
@@ -142,5 +220,25 @@ main (void)
     number_failed += srunner_ntests_failed (threadPoolRunner);
     srunner_free (threadPoolRunner);
 
+    printf (">> Switch to the Epoll backend\n");
+    flm__setMonitorBackend (FLM__MONITOR_BACKEND_EPOLL);
+    srunner_run_all (tlsCacheRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (tlsCacheRunner);
+    srunner_free (tlsCacheRunner);
+
+    srunner_run_all (framerRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (framerRunner);
+    srunner_run_all (httpRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (httpRunner);
+
+    printf (">> Switch to the select() backend\n");
+    flm__setMonitorBackend (FLM__MONITOR_BACKEND_SELECT);
+    srunner_run_all (framerRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (framerRunner);
+    srunner_free (framerRunner);
+    srunner_run_all (httpRunner, CK_NORMAL);
+    number_failed += srunner_ntests_failed (httpRunner);
+    srunner_free (httpRunner);
+
     return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "flm/flm.h"
+
+#include "flm/core/private/scan.h"
+
+/**
+ * Count the lines of a text made of lines of the same length, with
+ * memchr() loops and with each version of the scan functions. Short
+ * lines are dominated by the call overhead, long ones by the search.
+ *
+ * usage: scan_bench [text size] [rounds]
+ */
+
+#define BENCH_SET       " \t\r\n:"
+
+static char *   text;
+static size_t   text_size;
+static size_t   rounds;
+
+static const char * level_names[] = { "scalar", "sse2", "avx2" };
+
+static size_t
+_memchr_byte (void)
+{
+    const char * cur;
+    const char * end;
+    size_t count;
+
+    count = 0;
+    end = text + text_size;
+    for (cur = text; (cur = memchr (cur, '\n', end - cur)); cur++) {
+        count++;
+    }
+    return (count);
+}
+
+static size_t
+_memchr_pair (void)
+{
+    const char * cur;
+    const char * end;
+    size_t count;
+
+    count = 0;
+    end = text + text_size - 1;
+    for (cur = text; (cur = memchr (cur, '\r', end - cur)); cur++) {
+        if (cur[1] == '\n') {
+            count++;
+        }
+    }
+    return (count);
+}
+
+static size_t
+_memchr_set (void)
+{
+    size_t count;
+    size_t i;
+
+    count = 0;
+    for (i = 0; i < text_size; i++) {
+        if (memchr (BENCH_SET, text[i], sizeof (BENCH_SET) - 1)) {
+            count++;
+        }
+    }
+    return (count);
+}
+
+static size_t
+_scan_byte (void)
+{
+    const char * cur;
+    const char * end;
+    size_t count;
+
+    count = 0;
+    end = text + text_size;
+    for (cur = text; (cur = flm_ScanByte (cur, end - cur, '\n')); cur++) {
+        count++;
+    }
+    return (count);
+}
+
+static size_t
+_scan_pair (void)
+{
+    const char * cur;
+    const char * end;
+    size_t count;
+
+    count = 0;
+    end = text + text_size;
+    for (cur = text; (cur = flm_ScanPair (cur, end - cur, '\r', '\n')); cur++) {
+        count++;
+    }
+    return (count);
+}
+
+static size_t
+_scan_set (void)
+{
+    const char * cur;
+    const char * end;
+    size_t count;
+
+    count = 0;
+    end = text + text_size;
+    for (cur = text;
+         (cur = flm_ScanSet (cur, end - cur, BENCH_SET, sizeof (BENCH_SET) - 1));
+         cur++) {
+        count++;
+    }
+    return (count);
+}
+
+static void
+_run (const char * name, const char * version, size_t line, size_t (*func)(void))
+{
+    struct timespec start;
+    struct timespec end;
+    double elapsed;
+    size_t count;
+    size_t i;
+
+    count = 0;
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    for (i = 0; i < rounds; i++) {
+        count += func ();
+    }
+    clock_gettime (CLOCK_MONOTONIC, &end);
+
+    elapsed = (end.tv_sec - start.tv_sec) +
+        (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf ("%-5s %-7s lines of %5zu bytes: %10.1f MB/s (%zu found)\n",
+            name,
+            version,
+            line,
+            (text_size * rounds) / elapsed / 1e6,
+            count / rounds);
+}
+
+static void
+_fill (size_t line)
+{
+    size_t i;
+
+    /**
+     * Words separated by single spaces, ended by "\r\n"
+     */
+    for (i = 0; i < text_size; i++) {
+        if (i % line == line - 2) {
+            text[i] = '\r';
+        }
+        else if (i % line == line - 1) {
+            text[i] = '\n';
+        }
+        else if (i % 64 == 63) {
+            text[i] = ' ';
+        }
+        else {
+            text[i] = 'a' + i % 26;
+        }
+    }
+}
+
+int
+main (int argc, char ** argv)
+{
+    static const size_t lines[] = { 16, 80, 1024, 16384 };
+    size_t line;
+    int level;
+
+    text_size = argc > 1 ? strtoul (argv[1], NULL, 10) : 1 << 20;
+    rounds = argc > 2 ? strtoul (argv[2], NULL, 10) : 200;
+
+    if ((text = malloc (text_size)) == NULL) {
+        fprintf (stderr, "cannot allocate the text\n");
+        return (1);
+    }
+
+    for (line = 0; line < sizeof (lines) / sizeof (size_t); line++) {
+        _fill (lines[line]);
+
+        _run ("byte", "memchr", lines[line], _memchr_byte);
+        for (level = FLM__SCAN_SCALAR; level <= FLM__SCAN_AVX2; level++) {
+            if (flm__ScanSetLevel (level) == 0) {
+                _run ("byte", level_names[level], lines[line], _scan_byte);
+            }
+        }
+
+        _run ("pair", "memchr", lines[line], _memchr_pair);
+        for (level = FLM__SCAN_SCALAR; level <= FLM__SCAN_AVX2; level++) {
+            if (flm__ScanSetLevel (level) == 0) {
+                _run ("pair", level_names[level], lines[line], _scan_pair);
+            }
+        }
+
+        _run ("set", "memchr", lines[line], _memchr_set);
+        for (level = FLM__SCAN_SCALAR; level <= FLM__SCAN_AVX2; level++) {
+            if (flm__ScanSetLevel (level) == 0) {
+                _run ("set", level_names[level], lines[line], _scan_set);
+            }
+        }
+    }
+    free (text);
+    return (0);
+}
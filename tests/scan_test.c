@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "flm/core/private/scan.h"
+
+#include "test_utils.h"
+
+#define SCAN_SIZE       200
+
+static const int levels[] = {
+    FLM__SCAN_SCALAR,
+    FLM__SCAN_SSE2,
+    FLM__SCAN_AVX2
+};
+
+static const char *
+_reference_set (const char * content, size_t len, const char * set, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (memchr (set, content[i], count)) {
+            return (&content[i]);
+        }
+    }
+    return (NULL);
+}
+
+START_TEST(test_scan_byte)
+{
+    char content[SCAN_SIZE];
+    size_t level;
+    size_t pos;
+    size_t len;
+
+    memset (content, 'a', sizeof (content));
+
+    for (level = 0; level < sizeof (levels) / sizeof (int); level++) {
+        if (flm__ScanSetLevel (levels[level]) == -1) {
+            continue ;
+        }
+        fail_unless (flm__ScanGetLevel () == levels[level]);
+
+        /**
+         * Every position around the vector sizes, with every length
+         */
+        for (len = 0; len < 80; len++) {
+            fail_unless (flm_ScanByte (content, len, '\n') == NULL);
+            for (pos = 0; pos < len; pos++) {
+                content[pos] = '\n';
+                fail_unless (flm_ScanByte (content, len, '\n') == &content[pos]);
+                fail_unless (flm_ScanByte (content, pos, '\n') == NULL);
+                content[pos] = 'a';
+            }
+        }
+
+        /**
+         * The first occurrence is found
+         */
+        content[150] = '\n';
+        content[190] = '\n';
+        fail_unless (flm_ScanByte (content, SCAN_SIZE, '\n') == &content[150]);
+        content[150] = 'a';
+        content[190] = 'a';
+    }
+}
+END_TEST
+
+START_TEST(test_scan_pair)
+{
+    char content[SCAN_SIZE];
+    size_t level;
+    size_t pos;
+    size_t len;
+
+    memset (content, 'a', sizeof (content));
+
+    for (level = 0; level < sizeof (levels) / sizeof (int); level++) {
+        if (flm__ScanSetLevel (levels[level]) == -1) {
+            continue ;
+        }
+        for (len = 0; len < 80; len++) {
+            for (pos = 0; pos + 1 < len; pos++) {
+                content[pos] = '\r';
+                content[pos + 1] = '\n';
+                fail_unless (flm_ScanPair (content, len, '\r', '\n') == &content[pos]);
+
+                /* cut in the middle of the sequence */
+                fail_unless (flm_ScanPair (content, pos + 1, '\r', '\n') == NULL);
+                content[pos] = 'a';
+                content[pos + 1] = 'a';
+            }
+        }
+
+        /**
+         * Lone bytes of the sequence do not match
+         */
+        content[10] = '\r';
+        content[40] = '\n';
+        content[70] = '\r';
+        content[71] = '\r';
+        content[72] = '\n';
+        fail_unless (flm_ScanPair (content, SCAN_SIZE, '\r', '\n') == &content[71]);
+        content[10] = 'a';
+        content[40] = 'a';
+        content[70] = 'a';
+        content[71] = 'a';
+        content[72] = 'a';
+    }
+}
+END_TEST
+
+START_TEST(test_scan_set)
+{
+    char content[SCAN_SIZE];
+    char large_set[32];
+    size_t level;
+    size_t i;
+    size_t len;
+
+    srand (42);
+    for (i = 0; i < sizeof (large_set); i++) {
+        large_set[i] = 'A' + i;
+    }
+
+    for (level = 0; level < sizeof (levels) / sizeof (int); level++) {
+        if (flm__ScanSetLevel (levels[level]) == -1) {
+            continue ;
+        }
+        fail_unless (flm_ScanSet ("abc", 3, "", 0) == NULL);
+
+        /**
+         * Random content, mostly lower case letters
+         */
+        for (i = 0; i < 1000; i++) {
+            for (len = 0; len < SCAN_SIZE; len++) {
+                content[len] = rand () % 64 ? 'a' + rand () % 26 : rand () % 128;
+            }
+            len = rand () % SCAN_SIZE;
+            fail_unless (flm_ScanSet (content, len, " \t\r\n:", 5) ==
+                         _reference_set (content, len, " \t\r\n:", 5));
+            fail_unless (flm_ScanSet (content, len, large_set, 32) ==
+                         _reference_set (content, len, large_set, 32));
+        }
+    }
+}
+END_TEST
+
+Suite *
+scan_suite (void)
+{
+  Suite * s = suite_create ("scan");
+
+  /* Scan test case */
+  TCase *tc_core = tcase_create ("scan");
+
+  tcase_add_test (tc_core, test_scan_byte);
+  tcase_add_test (tc_core, test_scan_pair);
+  tcase_add_test (tc_core, test_scan_set);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
@@ -1,12 +1,22 @@
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include <check.h>
 
 #include "flm/flm.h"
 
 #include "test_utils.h"
+#include "tls_utils.h"
 
 START_TEST(test_stream_create)
 {
@@ -396,6 +406,1246 @@ START_TEST(test_stream_push_file)
 }
 END_TEST
 
+static int resumed = 0;
+static void
+_resume_handler (flm_Timer * timer, void * state)
+{
+    (void) timer;
+
+    /* nothing should have been read while paused */
+    fail_unless (has_read == 0);
+    resumed = 1;
+    fail_if (flm_StreamResumeRead ((flm_Stream *) state) == -1);
+}
+
+START_TEST(test_stream_pause_read)
+{
+    int baseFD;
+    int fds[2];
+    flm_Monitor * monitor;
+    flm_Stream * stream_in;
+    flm_Stream * stream_out;
+    flm_Timer * timer;
+
+    setTestAlloc (0);
+
+    baseFD = getFDCount ();
+    fail_if (pipe (fds) == -1);
+
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        fail ("Monitor creation failed");
+    }
+    if ((stream_in = flm_StreamNew (monitor, fds[1], (void *)42)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    if ((stream_out = flm_StreamNew (monitor, fds[0], stream_in)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    flm_StreamOnRead (stream_out, _read_handler);
+    flm_StreamOnClose (stream_out, _close_handler);
+    flm_StreamOnClose (stream_in, _close_handler);
+
+    fail_if (flm_StreamPauseRead (stream_out) == -1);
+    fail_if (write (fds[1], "a", 1) == -1);
+
+    timer = flm_TimerNew (monitor, _resume_handler, stream_out, 300);
+    fail_if (timer == NULL);
+    flm_TimerRelease (timer);
+
+    flm_StreamRelease (stream_in);
+    flm_StreamRelease (stream_out);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (resumed == 1);
+    fail_unless (has_read == 1);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_stream_limit_read)
+{
+    int baseFD;
+    int fds[2];
+    flm_Monitor * monitor;
+    flm_Stream * stream_in;
+    flm_Stream * stream_out;
+    flm_RateLimit * limit;
+    struct timespec start;
+    struct timespec end;
+    long elapsed;
+    size_t i;
+
+    setTestAlloc (0);
+
+    baseFD = getFDCount ();
+    fail_if (pipe (fds) == -1);
+
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        fail ("Monitor creation failed");
+    }
+    if ((stream_in = flm_StreamNew (monitor, fds[1], (void *)42)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    if ((stream_out = flm_StreamNew (monitor, fds[0], stream_in)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    flm_StreamOnRead (stream_out, _big_read_handler);
+    flm_StreamOnClose (stream_out, _close_handler);
+    flm_StreamOnClose (stream_in, _close_handler);
+
+    /**
+     * 40KB/s with a 4KB bucket, reading 20KB takes at least 400ms
+     */
+    if ((limit = flm_RateLimitNew (monitor, 40000, 4000)) == NULL) {
+        fail ("Rate limit creation failed");
+    }
+    flm_StreamLimitRead (stream_out, limit);
+    flm_RateLimitRelease (limit);
+
+    for (i = 0; i < 1000; i++) {
+        fail_if (write (fds[1], "aaaaaaaaaaaaaaaaaaaa", 20) == -1);
+    }
+
+    flm_StreamRelease (stream_in);
+    flm_StreamRelease (stream_out);
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    flm_MonitorWait (monitor);
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    flm_MonitorRelease (monitor);
+
+    elapsed = (end.tv_sec - start.tv_sec) * 1000 +
+        (end.tv_nsec - start.tv_nsec) / 1000000;
+
+    fail_unless (elapsed >= 300);
+    fail_unless (nb_read == 20000);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_stream_limit_write)
+{
+    int baseFD;
+    int fds[2];
+    flm_Monitor * monitor;
+    flm_Stream * stream_in;
+    flm_Stream * stream_out;
+    flm_RateLimit * limit;
+    struct timespec start;
+    struct timespec end;
+    long elapsed;
+    size_t i;
+
+    setTestAlloc (0);
+
+    baseFD = getFDCount ();
+    fail_if (pipe (fds) == -1);
+
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        fail ("Monitor creation failed");
+    }
+    if ((stream_in = flm_StreamNew (monitor, fds[1], (void *)42)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    if ((stream_out = flm_StreamNew (monitor, fds[0], stream_in)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    flm_StreamOnRead (stream_out, _big_read_handler);
+    flm_StreamOnClose (stream_out, _close_handler);
+    flm_StreamOnClose (stream_in, _close_handler);
+
+    if ((limit = flm_RateLimitNew (monitor, 40000, 4000)) == NULL) {
+        fail ("Rate limit creation failed");
+    }
+    flm_StreamLimitWrite (stream_in, limit);
+    flm_RateLimitRelease (limit);
+
+    for (i = 0; i < 1000; i++) {
+        flm_StreamPrintf (stream_in, "%saaaaaaaaaa", "aaaaaaaaaa");
+    }
+
+    flm_StreamRelease (stream_in);
+    flm_StreamRelease (stream_out);
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    flm_MonitorWait (monitor);
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    flm_MonitorRelease (monitor);
+
+    elapsed = (end.tv_sec - start.tv_sec) * 1000 +
+        (end.tv_nsec - start.tv_nsec) / 1000000;
+
+    fail_unless (elapsed >= 300);
+    fail_unless (nb_read == 20000);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+static void
+_set_nonblock (int fd)
+{
+    fail_if (fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK) == -1);
+}
+
+START_TEST(test_stream_relay)
+{
+    int baseFD;
+    int src[2];
+    int dst[2];
+    flm_Monitor * monitor;
+    flm_Stream * from;
+    flm_Stream * to;
+    flm_Stream * stream_out;
+    size_t i;
+
+    setTestAlloc (0);
+
+    baseFD = getFDCount ();
+    fail_if (pipe (src) == -1);
+    fail_if (pipe (dst) == -1);
+    _set_nonblock (src[0]);
+    _set_nonblock (dst[1]);
+
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        fail ("Monitor creation failed");
+    }
+    if ((from = flm_StreamNew (monitor, src[0], NULL)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    if ((to = flm_StreamNew (monitor, dst[1], NULL)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    if ((stream_out = flm_StreamNew (monitor, dst[0], to)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    flm_StreamOnRead (stream_out, _big_read_handler);
+    flm_StreamOnClose (stream_out, _close_handler);
+    flm_StreamOnClose (from, _close_handler);
+    flm_StreamOnClose (to, _close_handler);
+
+    fail_if (flm_StreamRelay (from, to) == -1);
+    fail_unless (flm_StreamRelay (from, to) == -1);
+
+    for (i = 0; i < 1000; i++) {
+        fail_if (write (src[1], "aaaaaaaaaaaaaaaaaaaa", 20) == -1);
+    }
+    close (src[1]);
+
+    flm_StreamRelease (to);
+    flm_StreamRelease (stream_out);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (flm_StreamRelayed (from) == 20000);
+    flm_StreamRelease (from);
+
+    fail_unless (nb_read == 20000);
+    fail_unless (nb_closed == 3);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+static char proxy_client[5];
+static char proxy_server[5];
+static void
+_proxy_read_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    char * dest;
+
+    dest = state;
+    fail_unless (strlen (dest) + flm_BufferLength (buffer) <= 4);
+    strncat (dest, flm_BufferContent (buffer), flm_BufferLength (buffer));
+    flm_BufferRelease (buffer);
+
+    /**
+     * The server answers once the whole request is there
+     */
+    if (dest == proxy_server && strcmp (dest, "ping") == 0) {
+        flm_StreamPrintf (stream, "pong");
+    }
+}
+
+START_TEST(test_stream_relay_proxy)
+{
+    int baseFD;
+    int a[2];
+    int b[2];
+    flm_Monitor * monitor;
+    flm_Stream * client;
+    flm_Stream * server;
+    flm_Stream * proxy_a;
+    flm_Stream * proxy_b;
+
+    setTestAlloc (0);
+
+    baseFD = getFDCount ();
+    fail_if (socketpair (AF_UNIX, SOCK_STREAM, 0, a) == -1);
+    fail_if (socketpair (AF_UNIX, SOCK_STREAM, 0, b) == -1);
+    _set_nonblock (a[0]);
+    _set_nonblock (a[1]);
+    _set_nonblock (b[0]);
+    _set_nonblock (b[1]);
+
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        fail ("Monitor creation failed");
+    }
+    if ((client = flm_StreamNew (monitor, a[0], proxy_client)) == NULL ||
+        (proxy_a = flm_StreamNew (monitor, a[1], NULL)) == NULL ||
+        (proxy_b = flm_StreamNew (monitor, b[1], NULL)) == NULL ||
+        (server = flm_StreamNew (monitor, b[0], proxy_server)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    flm_StreamOnRead (client, _proxy_read_handler);
+    flm_StreamOnRead (server, _proxy_read_handler);
+    flm_StreamOnClose (client, _close_handler);
+    flm_StreamOnClose (server, _close_handler);
+    flm_StreamOnClose (proxy_a, _close_handler);
+    flm_StreamOnClose (proxy_b, _close_handler);
+
+    fail_if (flm_StreamRelay (proxy_a, proxy_b) == -1);
+    fail_if (flm_StreamRelay (proxy_b, proxy_a) == -1);
+
+    /**
+     * The client half-closes right after the request, the server still
+     * has to be able to answer through the proxy.
+     */
+    fail_if (write (a[0], "ping", 4) != 4);
+    fail_if (shutdown (a[0], SHUT_WR) == -1);
+
+    flm_StreamRelease (client);
+    flm_StreamRelease (server);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (flm_StreamRelayed (proxy_a) == 4);
+    fail_unless (flm_StreamRelayed (proxy_b) == 4);
+    flm_StreamRelease (proxy_a);
+    flm_StreamRelease (proxy_b);
+
+    fail_unless (strcmp (proxy_server, "ping") == 0);
+    fail_unless (strcmp (proxy_client, "pong") == 0);
+    fail_unless (nb_closed == 4);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+static void
+_count_read_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    size_t i;
+
+    (void) stream;
+    (void) state;
+
+    nb_read += flm_BufferLength (buffer);
+    for (i = 0; i < flm_BufferLength (buffer); i++) {
+        fail_unless (flm_BufferContent (buffer)[i] == 'a');
+    }
+    flm_BufferRelease (buffer);
+}
+
+static void
+_tcp_pair (int fds[2])
+{
+    struct sockaddr_in addr;
+    socklen_t len;
+    int server;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    len = sizeof (addr);
+
+    fail_if ((server = socket (AF_INET, SOCK_STREAM, 0)) == -1);
+    fail_if (bind (server, (struct sockaddr *) &addr, len) == -1);
+    fail_if (listen (server, 1) == -1);
+    fail_if (getsockname (server, (struct sockaddr *) &addr, &len) == -1);
+
+    fail_if ((fds[1] = socket (AF_INET, SOCK_STREAM, 0)) == -1);
+    fail_if (connect (fds[1], (struct sockaddr *) &addr, len) == -1);
+    fail_if ((fds[0] = accept (server, NULL, NULL)) == -1);
+    close (server);
+
+    _set_nonblock (fds[0]);
+    _set_nonblock (fds[1]);
+}
+
+#define RANGE_OFF       1000
+#define RANGE_COUNT     900000
+
+static size_t range_read = 0;
+static void
+_range_read_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    size_t i;
+
+    for (i = 0; i < flm_BufferLength (buffer); i++) {
+        fail_unless ((unsigned char) flm_BufferContent (buffer)[i] ==   \
+                     (RANGE_OFF + range_read + i) % 251);
+    }
+    range_read += flm_BufferLength (buffer);
+    flm_BufferRelease (buffer);
+
+    if (range_read == RANGE_COUNT) {
+        flm_StreamClose (stream);
+        flm_StreamClose ((flm_Stream *) state);
+    }
+}
+
+START_TEST(test_stream_push_file_range)
+{
+    int raw_file;
+    flm_File * file;
+    int baseFD;
+    int fds[2];
+    int size;
+    flm_Monitor * monitor;
+    flm_Stream * stream_in;
+    flm_Stream * stream_out;
+    unsigned char block[1000];
+    size_t i;
+
+    /**
+     * Every byte tells where it comes from
+     */
+    raw_file = open ("/tmp/_libflm_testfile", O_CREAT|O_TRUNC|O_WRONLY, 0600);
+    fail_if (raw_file == -1);
+    for (i = 0; i < 1000 * sizeof (block); i++) {
+        block[i % sizeof (block)] = i % 251;
+        if (i % sizeof (block) == sizeof (block) - 1) {
+            fail_unless (write (raw_file, block, sizeof (block)) == sizeof (block));
+        }
+    }
+    close (raw_file);
+
+    setTestAlloc (0);
+    nb_closed = 0;
+
+    baseFD = getFDCount ();
+    _tcp_pair (fds);
+
+    /**
+     * Most writes are partial
+     */
+    size = 4096;
+    fail_if (setsockopt (fds[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof (size)) == -1);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((stream_in = flm_StreamNew (monitor, fds[1], NULL)) == NULL);
+    fail_if ((stream_out = flm_StreamNew (monitor, fds[0], stream_in)) == NULL);
+    flm_StreamOnRead (stream_out, _range_read_handler);
+    flm_StreamOnClose (stream_out, _close_handler);
+    flm_StreamOnClose (stream_in, _close_handler);
+
+    fail_if ((file = flm_FileOpen (NULL, "/tmp/_libflm_testfile", "r")) == NULL);
+    fail_if (flm_StreamPushFile (stream_in, file, RANGE_OFF, RANGE_COUNT) == -1);
+    flm_FileRelease (file);
+
+    flm_StreamRelease (stream_in);
+    flm_StreamRelease (stream_out);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (range_read == RANGE_COUNT);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_stream_push_chain)
+{
+    int baseFD;
+    int fds[2];
+    flm_Monitor * monitor;
+    flm_Stream * stream_in;
+    flm_Stream * stream_out;
+    flm_BufferChain * chain;
+    flm_Buffer * pattern;
+    char content[251];
+    size_t total;
+    size_t pos;
+    size_t count;
+
+    setTestAlloc (0);
+    nb_closed = 0;
+    range_read = 0;
+
+    baseFD = getFDCount ();
+    _tcp_pair (fds);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((stream_in = flm_StreamNew (monitor, fds[1], NULL)) == NULL);
+    fail_if ((stream_out = flm_StreamNew (monitor, fds[0], stream_in)) == NULL);
+    flm_StreamOnRead (stream_out, _range_read_handler);
+    flm_StreamOnClose (stream_out, _close_handler);
+    flm_StreamOnClose (stream_in, _close_handler);
+
+    /**
+     * Small slices of a single buffer, in the order the reader expects
+     */
+    for (pos = 0; pos < sizeof (content); pos++) {
+        content[pos] = pos;
+    }
+    fail_if ((pattern = flm_BufferNew (content, sizeof (content), NULL)) == NULL);
+    fail_if ((chain = flm_BufferChainNew ()) == NULL);
+    pos = RANGE_OFF % sizeof (content);
+    for (total = 0; total < RANGE_COUNT; total += count) {
+        count = 1 + total % 97;
+        if (count > sizeof (content) - pos) {
+            count = sizeof (content) - pos;
+        }
+        if (count > RANGE_COUNT - total) {
+            count = RANGE_COUNT - total;
+        }
+        fail_if (flm_BufferChainAppend (chain, pattern, pos, count) == -1);
+        pos = (pos + count) % sizeof (content);
+    }
+    flm_BufferRelease (pattern);
+    fail_unless (flm_BufferChainLength (chain) == RANGE_COUNT);
+
+    fail_if (flm_StreamPushChain (stream_in, chain) == -1);
+    flm_BufferChainRelease (chain);
+
+    flm_StreamRelease (stream_in);
+    flm_StreamRelease (stream_out);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (range_read == RANGE_COUNT);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_stream_push_map)
+{
+    int raw_file;
+    flm_File * file;
+    int baseFD;
+    int fds[2];
+    flm_Monitor * monitor;
+    flm_Stream * stream_in;
+    flm_Stream * stream_out;
+    flm_Buffer * map;
+    flm_Buffer * view;
+    unsigned char block[1000];
+    size_t i;
+
+    raw_file = open ("/tmp/_libflm_testfile", O_CREAT|O_TRUNC|O_WRONLY, 0600);
+    fail_if (raw_file == -1);
+    for (i = 0; i < 1000 * sizeof (block); i++) {
+        block[i % sizeof (block)] = i % 251;
+        if (i % sizeof (block) == sizeof (block) - 1) {
+            fail_unless (write (raw_file, block, sizeof (block)) == sizeof (block));
+        }
+    }
+    close (raw_file);
+
+    setTestAlloc (0);
+    nb_closed = 0;
+    range_read = 0;
+
+    baseFD = getFDCount ();
+    _tcp_pair (fds);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((stream_in = flm_StreamNew (monitor, fds[1], NULL)) == NULL);
+    fail_if ((stream_out = flm_StreamNew (monitor, fds[0], stream_in)) == NULL);
+    flm_StreamOnRead (stream_out, _range_read_handler);
+    flm_StreamOnClose (stream_out, _close_handler);
+    flm_StreamOnClose (stream_in, _close_handler);
+
+    /**
+     * The range is mapped from the middle of a page, then sent in two
+     * parts: a view of it, and the rest of the mapped buffer itself
+     */
+    fail_if ((file = flm_FileOpen (NULL, "/tmp/_libflm_testfile", "r")) == NULL);
+    fail_if ((map = flm_BufferMap (file, RANGE_OFF, RANGE_COUNT,        \
+                                   FLM_BUFFER_MAP_SEQUENTIAL)) == NULL);
+    flm_FileRelease (file);
+    fail_unless (flm_BufferLength (map) == RANGE_COUNT);
+
+    fail_if ((view = flm_BufferView (map, 0, RANGE_COUNT / 3)) == NULL);
+    fail_if (flm_StreamPushBuffer (stream_in, view, 0, 0) == -1);
+    flm_BufferRelease (view);
+    fail_if (flm_StreamPushBuffer (stream_in, map, RANGE_COUNT / 3,    \
+                                   RANGE_COUNT - RANGE_COUNT / 3) == -1);
+    flm_BufferRelease (map);
+
+    flm_StreamRelease (stream_in);
+    flm_StreamRelease (stream_out);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (range_read == RANGE_COUNT);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_stream_push_file_direct)
+{
+    int raw_file;
+    flm_File * file;
+    int baseFD;
+    int fds[2];
+    int size;
+    int queued;
+    flm_Monitor * monitor;
+    flm_FileQueue * file_queue;
+    flm_Stream * stream_in;
+    flm_Stream * stream_out;
+    unsigned char block[1000];
+    size_t i;
+
+    raw_file = open ("/tmp/_libflm_testfile", O_CREAT|O_TRUNC|O_WRONLY, 0600);
+    fail_if (raw_file == -1);
+    for (i = 0; i < 1000 * sizeof (block); i++) {
+        block[i % sizeof (block)] = i % 251;
+        if (i % sizeof (block) == sizeof (block) - 1) {
+            fail_unless (write (raw_file, block, sizeof (block)) == sizeof (block));
+        }
+    }
+    close (raw_file);
+
+    /**
+     * Read from the loop when the socket is full, then by the file queue
+     * while the previous chunk is sent
+     */
+    for (queued = 0; queued < 2; queued++) {
+        setTestAlloc (0);
+        nb_closed = 0;
+        range_read = 0;
+
+        baseFD = getFDCount ();
+        _tcp_pair (fds);
+
+        size = 4096;
+        fail_if (setsockopt (fds[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof (size)) == -1);
+
+        fail_if ((monitor = flm_MonitorNew ()) == NULL);
+        fail_if ((file_queue = flm_FileQueueNew (monitor, 1)) == NULL);
+        fail_if ((stream_in = flm_StreamNew (monitor, fds[1], NULL)) == NULL);
+        fail_if ((stream_out = flm_StreamNew (monitor, fds[0], stream_in)) == NULL);
+        flm_StreamOnRead (stream_out, _range_read_handler);
+        flm_StreamOnClose (stream_out, _close_handler);
+        flm_StreamOnClose (stream_in, _close_handler);
+
+        if (queued && flm_StreamPrefetch (stream_in, file_queue) == -1) {
+            fail_unless (flm_Error () == FLM_ERR_NOSYS);
+        }
+
+        fail_if ((file = flm_FileOpen (NULL, "/tmp/_libflm_testfile", "r")) == NULL);
+        if (flm_FileDirect (file) == -1) {
+            /* not supported by the file system of /tmp */
+            fail_unless (flm_Error () == FLM_ERR_ERRNO ||               \
+                         flm_Error () == FLM_ERR_NOSYS);
+        }
+        fail_if (flm_StreamPushFile (stream_in, file, RANGE_OFF, RANGE_COUNT) == -1);
+        flm_FileRelease (file);
+
+        flm_StreamRelease (stream_in);
+        flm_StreamRelease (stream_out);
+
+        flm_MonitorWait (monitor);
+        flm_FileQueueRelease (file_queue);
+        flm_MonitorRelease (monitor);
+
+        fail_unless (range_read == RANGE_COUNT);
+        fail_unless (nb_closed == 2);
+        fail_unless (getAllocSum () == 0);
+        fail_unless (getFDCount () == baseFD);
+    }
+}
+END_TEST
+
+static void
+_unlimit_handler (flm_Timer * timer, void * state)
+{
+    (void) timer;
+
+    flm_StreamLimitWrite ((flm_Stream *) state, NULL);
+}
+
+/**
+ * Push a file range through a write rate limit while the file queue
+ * reads it, the limit is dropped after the given delay
+ */
+static void
+_push_file_limited (int direct, uint32_t delay)
+{
+    int raw_file;
+    flm_File * file;
+    int baseFD;
+    int fds[2];
+    flm_Monitor * monitor;
+    flm_FileQueue * file_queue;
+    flm_RateLimit * limit;
+    flm_Stream * stream_in;
+    flm_Stream * stream_out;
+    flm_Timer * timer;
+    unsigned char block[1000];
+    size_t i;
+
+    raw_file = open ("/tmp/_libflm_testfile", O_CREAT|O_TRUNC|O_WRONLY, 0600);
+    fail_if (raw_file == -1);
+    for (i = 0; i < 1000 * sizeof (block); i++) {
+        block[i % sizeof (block)] = i % 251;
+        if (i % sizeof (block) == sizeof (block) - 1) {
+            fail_unless (write (raw_file, block, sizeof (block)) == sizeof (block));
+        }
+    }
+    fail_if (fsync (raw_file) == -1);
+    posix_fadvise (raw_file, 0, 0, POSIX_FADV_DONTNEED);
+    close (raw_file);
+
+    setTestAlloc (0);
+    nb_closed = 0;
+    range_read = 0;
+
+    baseFD = getFDCount ();
+    _tcp_pair (fds);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((file_queue = flm_FileQueueNew (monitor, 1)) == NULL);
+    fail_if ((stream_in = flm_StreamNew (monitor, fds[1], NULL)) == NULL);
+    fail_if ((stream_out = flm_StreamNew (monitor, fds[0], stream_in)) == NULL);
+    flm_StreamOnRead (stream_out, _range_read_handler);
+    flm_StreamOnClose (stream_out, _close_handler);
+    flm_StreamOnClose (stream_in, _close_handler);
+
+    if (flm_StreamPrefetch (stream_in, file_queue) == -1) {
+        fail_unless (flm_Error () == FLM_ERR_NOSYS);
+    }
+    fail_if ((limit = flm_RateLimitNew (monitor, 2000000, 65536)) == NULL);
+    flm_StreamLimitWrite (stream_in, limit);
+    flm_RateLimitRelease (limit);
+
+    fail_if ((file = flm_FileOpen (NULL, "/tmp/_libflm_testfile", "r")) == NULL);
+    if (direct && flm_FileDirect (file) == -1) {
+        fail_unless (flm_Error () == FLM_ERR_ERRNO ||                   \
+                     flm_Error () == FLM_ERR_NOSYS);
+    }
+    fail_if (flm_StreamPushFile (stream_in, file, RANGE_OFF, RANGE_COUNT) == -1);
+    flm_FileRelease (file);
+
+    fail_if ((timer = flm_TimerNew (monitor, _unlimit_handler, stream_in, delay)) == NULL);
+    flm_TimerRelease (timer);
+
+    flm_StreamRelease (stream_out);
+
+    flm_MonitorWait (monitor);
+    flm_StreamRelease (stream_in);
+    flm_FileQueueRelease (file_queue);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (range_read == RANGE_COUNT);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+
+START_TEST(test_stream_push_file_direct_limit)
+{
+    _push_file_limited (1, 100);
+}
+END_TEST
+
+START_TEST(test_stream_prefetch_limit)
+{
+    _push_file_limited (0, 0);
+}
+END_TEST
+
+START_TEST(test_stream_prefetch)
+{
+    int raw_file;
+    flm_File * file;
+    int baseFD;
+    int fds[2];
+    int cold;
+    flm_Monitor * monitor;
+    flm_FileQueue * file_queue;
+    flm_Stream * stream_in;
+    flm_Stream * stream_out;
+    struct flm_FileQueueStats stats;
+    unsigned char block[1000];
+    unsigned char page;
+    void * map;
+    size_t i;
+
+    raw_file = open ("/tmp/_libflm_testfile", O_CREAT|O_TRUNC|O_RDWR, 0600);
+    fail_if (raw_file == -1);
+    for (i = 0; i < 1000 * sizeof (block); i++) {
+        block[i % sizeof (block)] = i % 251;
+        if (i % sizeof (block) == sizeof (block) - 1) {
+            fail_unless (write (raw_file, block, sizeof (block)) == sizeof (block));
+        }
+    }
+
+    /**
+     * Out of the page cache, if the file system lets it go
+     */
+    fail_if (fsync (raw_file) == -1);
+    posix_fadvise (raw_file, 0, 0, POSIX_FADV_DONTNEED);
+    map = mmap (NULL, 1000 * sizeof (block), PROT_READ, MAP_SHARED, raw_file, 0);
+    fail_if (map == MAP_FAILED);
+    fail_if (mincore (map, 1, &page) == -1);
+    cold = !(page & 1);
+    munmap (map, 1000 * sizeof (block));
+    close (raw_file);
+
+    setTestAlloc (0);
+    nb_closed = 0;
+    range_read = 0;
+
+    baseFD = getFDCount ();
+    _tcp_pair (fds);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((file_queue = flm_FileQueueNew (monitor, 1)) == NULL);
+    fail_if ((stream_in = flm_StreamNew (monitor, fds[1], NULL)) == NULL);
+    fail_if ((stream_out = flm_StreamNew (monitor, fds[0], stream_in)) == NULL);
+    flm_StreamOnRead (stream_out, _range_read_handler);
+    flm_StreamOnClose (stream_out, _close_handler);
+    flm_StreamOnClose (stream_in, _close_handler);
+
+    if (flm_StreamPrefetch (stream_in, file_queue) == -1) {
+        fail_unless (flm_Error () == FLM_ERR_NOSYS);
+        cold = 0;
+    }
+
+    fail_if ((file = flm_FileOpen (NULL, "/tmp/_libflm_testfile", "r")) == NULL);
+    fail_if (flm_StreamPushFile (stream_in, file, RANGE_OFF, RANGE_COUNT) == -1);
+    flm_FileRelease (file);
+
+    flm_StreamRelease (stream_in);
+    flm_StreamRelease (stream_out);
+
+    flm_MonitorWait (monitor);
+
+    flm_FileQueueStats (file_queue, &stats);
+    /**
+     * Whether the probe still finds the file cold is up to the kernel
+     */
+    fail_unless (stats.probes >= 1 || !cold);
+    fail_unless (stats.stalls_avoided <= stats.probes);
+
+    flm_FileQueueRelease (file_queue);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (range_read == RANGE_COUNT);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_stream_zerocopy)
+{
+    int baseFD;
+    int fds[2];
+    flm_Monitor * monitor;
+    flm_Stream * stream_in;
+    flm_Stream * stream_out;
+    flm_Buffer * buffer;
+    char * content;
+
+    setTestAlloc (0);
+
+    baseFD = getFDCount ();
+    _tcp_pair (fds);
+
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        fail ("Monitor creation failed");
+    }
+    if ((stream_in = flm_StreamNew (monitor, fds[1], NULL)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    if ((stream_out = flm_StreamNew (monitor, fds[0], NULL)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    flm_StreamOnRead (stream_out, _count_read_handler);
+    flm_StreamOnClose (stream_out, _close_handler);
+    flm_StreamOnClose (stream_in, _close_handler);
+
+    fail_if (flm_StreamZeroCopy (stream_in, 4096) == -1);
+
+    /**
+     * One big buffer sent without copy surrounded by small ones
+     */
+    buffer = flm_BufferNew ("aaaaaaaaaaaaaaaaaaaa", 20, NULL);
+    flm_StreamPushBuffer (stream_in, buffer, 0, 0);
+    flm_BufferRelease (buffer);
+
+    fail_if ((content = malloc (19960)) == NULL);
+    memset (content, 'a', 19960);
+    buffer = flm_BufferNew (content, 19960, free);
+    flm_StreamPushBuffer (stream_in, buffer, 0, 0);
+    flm_BufferRelease (buffer);
+
+    buffer = flm_BufferNew ("aaaaaaaaaaaaaaaaaaaa", 20, NULL);
+    flm_StreamPushBuffer (stream_in, buffer, 0, 0);
+    flm_BufferRelease (buffer);
+
+    flm_StreamShutdown (stream_in);
+
+    flm_StreamRelease (stream_in);
+    flm_StreamRelease (stream_out);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (nb_read == 20000);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+static void
+_echo_read_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    (void) state;
+
+    fail_if (flm_StreamPushBuffer (stream, buffer, 0, 0) == -1);
+    flm_BufferRelease (buffer);
+}
+
+START_TEST(test_stream_tls_echo)
+{
+    int baseFD;
+    int fds[2];
+    flm_Monitor * monitor;
+    flm_Stream * client;
+    flm_Stream * server;
+    SSL_CTX * client_context;
+    SSL_CTX * server_context;
+    size_t i;
+
+    setTestAlloc (0);
+
+    baseFD = getFDCount ();
+    fail_if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == -1);
+    _set_nonblock (fds[0]);
+    _set_nonblock (fds[1]);
+
+    fail_if ((server_context = getTestTLSContext (1)) == NULL);
+    fail_if ((client_context = getTestTLSContext (0)) == NULL);
+
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        fail ("Monitor creation failed");
+    }
+    if ((server = flm_StreamNew (monitor, fds[0], NULL)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    if ((client = flm_StreamNew (monitor, fds[1], server)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    flm_StreamOnRead (server, _echo_read_handler);
+    flm_StreamOnRead (client, _big_read_handler);
+    flm_StreamOnClose (server, _close_handler);
+    flm_StreamOnClose (client, _close_handler);
+
+    fail_if (flm_StreamStartTLSServer (server, server_context) == -1);
+    fail_if (flm_StreamStartTLSClient (client, client_context) == -1);
+
+    /**
+     * Queued before the end of the handshake
+     */
+    for (i = 0; i < 1000; i++) {
+        flm_StreamPrintf (client, "%saaaaaaaaaa", "aaaaaaaaaa");
+    }
+
+    flm_StreamRelease (client);
+    flm_StreamRelease (server);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    SSL_CTX_free (server_context);
+    SSL_CTX_free (client_context);
+
+    fail_unless (nb_read == 20000);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+static int nb_errors = 0;
+static void
+_error_handler (flm_Stream * stream, void * state, int error)
+{
+    (void) stream;
+    (void) state;
+    (void) error;
+
+    nb_errors++;
+}
+
+START_TEST(test_stream_tls_bad_handshake)
+{
+    int baseFD;
+    int fds[2];
+    flm_Monitor * monitor;
+    flm_Stream * server;
+    SSL_CTX * server_context;
+
+    setTestAlloc (0);
+
+    baseFD = getFDCount ();
+    fail_if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == -1);
+    _set_nonblock (fds[0]);
+
+    fail_if ((server_context = getTestTLSContext (1)) == NULL);
+
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        fail ("Monitor creation failed");
+    }
+    if ((server = flm_StreamNew (monitor, fds[0], NULL)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    flm_StreamOnClose (server, _close_handler);
+    flm_StreamOnError (server, _error_handler);
+
+    fail_if (flm_StreamStartTLSServer (server, server_context) == -1);
+    fail_if (write (fds[1], "GET / HTTP/1.0\r\n\r\n", 18) != 18);
+
+    flm_StreamRelease (server);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    close (fds[1]);
+    SSL_CTX_free (server_context);
+
+    fail_unless (nb_errors == 1);
+    fail_unless (nb_closed == 1);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+static int tls_offload = -1;
+static void
+_offload_read_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    tls_offload = flm_StreamTLSOffload ((flm_Stream *) state);
+    _big_read_handler (stream, state, buffer);
+}
+
+START_TEST(test_stream_tls_kernel)
+{
+    int raw_file;
+    flm_File * file;
+    int baseFD;
+    int fds[2];
+    flm_Monitor * monitor;
+    flm_Stream * client;
+    flm_Stream * server;
+    SSL_CTX * client_context;
+    SSL_CTX * server_context;
+    size_t i;
+
+    raw_file = open ("/tmp/_libflm_testfile", O_CREAT|O_TRUNC|O_WRONLY, 0600);
+    for (i = 0; i < 1000; i++) {
+        fail_unless (write (raw_file, "aaaaaaaaaaaaaaaaaaaa", 20) == 20);
+    }
+    close (raw_file);
+
+    setTestAlloc (0);
+
+    baseFD = getFDCount ();
+    _tcp_pair (fds);
+
+    fail_if ((server_context = getTestTLSContext (1)) == NULL);
+    fail_if ((client_context = getTestTLSContext (0)) == NULL);
+
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        fail ("Monitor creation failed");
+    }
+    if ((server = flm_StreamNew (monitor, fds[0], NULL)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    if ((client = flm_StreamNew (monitor, fds[1], server)) == NULL) {
+        fail ("Stream creation failed");
+    }
+    flm_StreamOnRead (client, _offload_read_handler);
+    flm_StreamOnClose (server, _close_handler);
+    flm_StreamOnClose (client, _close_handler);
+
+    /**
+     * Without the kernel module the records go through user space, the
+     * file must arrive the same way.
+     */
+    if (flm_StreamKernelTLS (server) == -1) {
+        fail_unless (flm_Error () == FLM_ERR_NOSYS);
+    }
+    fail_if (flm_StreamStartTLSServer (server, server_context) == -1);
+    fail_if (flm_StreamStartTLSClient (client, client_context) == -1);
+    fail_unless (flm_StreamKernelTLS (client) == -1);
+    fail_unless (flm_StreamTLSOffload (server) == FLM_STREAM_TLS_USER);
+
+    file = flm_FileOpen ("", "/tmp/_libflm_testfile", "r");
+    flm_StreamPushFile (server, file, 0, 0);
+    flm_FileRelease (file);
+
+    flm_StreamRelease (client);
+    flm_StreamRelease (server);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    SSL_CTX_free (server_context);
+    SSL_CTX_free (client_context);
+
+    fail_unless (tls_offload != -1);
+    fail_unless ((tls_offload & ~(FLM_STREAM_TLS_KERNEL_SEND |         \
+                                  FLM_STREAM_TLS_KERNEL_RECV)) == 0);
+    fail_unless (nb_read == 20000);
+    fail_unless (nb_closed == 2);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+static pthread_t migrate_main;
+static volatile int migrate_attached;
+static volatile int migrate_read;
+static volatile int migrate_closed;
+
+static void
+_migrate_read_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    (void) state;
+
+    /**
+     * Read by the monitor of the other thread
+     */
+    if (!pthread_equal (pthread_self (), migrate_main) &&
+        flm_BufferLength (buffer) == 4 &&
+        memcmp (flm_BufferContent (buffer), "ping", 4) == 0) {
+        migrate_read = 1;
+    }
+    flm_BufferRelease (buffer);
+    flm_StreamShutdown (stream);
+}
+
+static void
+_migrate_close_handler (flm_Stream * stream, void * state)
+{
+    (void) stream;
+    (void) state;
+
+    migrate_closed = 1;
+}
+
+static void
+_migrate_handler (flm_Stream * stream, void * state, flm_Monitor * monitor)
+{
+    (void) state;
+    (void) monitor;
+
+    if (!pthread_equal (pthread_self (), migrate_main)) {
+        migrate_attached = 1;
+    }
+    flm_StreamOnRead (stream, _migrate_read_handler);
+    flm_StreamOnClose (stream, _migrate_close_handler);
+
+    /**
+     * Given by flm_StreamMigrate(), the monitor keeps the stream alive
+     */
+    flm_StreamRelease (stream);
+}
+
+START_TEST(test_stream_migrate)
+{
+    flm_Monitor * monitor;
+    flm_Thread * thread;
+    flm_Stream * stream;
+    flm_RateLimit * limit;
+    char data[16];
+    ssize_t len;
+    int fds[2];
+    int wait;
+
+    setTestAlloc (0);
+
+    migrate_main = pthread_self ();
+    migrate_attached = 0;
+    migrate_read = 0;
+    migrate_closed = 0;
+
+    fail_if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == -1);
+    fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((thread = flm_ThreadNew (NULL)) == NULL);
+    fail_if ((stream = flm_StreamNew (monitor, fds[0], NULL)) == NULL);
+
+    /**
+     * Streams bound to their monitor stay there
+     */
+    fail_if ((limit = flm_RateLimitNew (monitor, 1000, 1000)) == NULL);
+    flm_StreamLimitRead (stream, limit);
+    fail_unless (flm_StreamMigrate (stream, thread, _migrate_handler) == -1);
+    fail_unless (errno == EBUSY);
+    flm_StreamLimitRead (stream, NULL);
+    flm_RateLimitRelease (limit);
+
+    /**
+     * Written and read once on the other thread
+     */
+    fail_if (flm_StreamPrintf (stream, "hello") == -1);
+    fail_if (flm_StreamMigrate (stream, thread, _migrate_handler) == -1);
+    fail_unless (flm_StreamMigrate (stream, thread, _migrate_handler) == -1);
+    fail_unless (errno == EBUSY);
+    fail_unless (write (fds[1], "ping", 4) == 4);
+
+    /**
+     * Returns once the stream is detached
+     */
+    flm_MonitorWait (monitor);
+
+    len = read (fds[1], data, sizeof (data));
+    fail_unless (len == 5 && memcmp (data, "hello", 5) == 0);
+    for (wait = 0; wait < 100 && !migrate_closed; wait++) {
+        usleep (10000);
+    }
+    fail_unless (migrate_attached == 1);
+    fail_unless (migrate_read == 1);
+    fail_unless (migrate_closed == 1);
+
+    close (fds[1]);
+    flm_MonitorRelease (monitor);
+
+    /**
+     * Waits for the thread to be done
+     */
+    flm_ThreadRelease (thread);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
 Suite *
 stream_suite (void)
 {
@@ -412,9 +1662,26 @@ stream_suite (void)
   tcase_add_test (tc_core, test_stream_big_read);
   tcase_add_test (tc_core, test_stream_printf);
   tcase_add_test (tc_core, test_stream_push_buffer);
+  tcase_add_test (tc_core, test_stream_pause_read);
+  tcase_add_test (tc_core, test_stream_limit_read);
+  tcase_add_test (tc_core, test_stream_limit_write);
+  tcase_add_test (tc_core, test_stream_relay);
+  tcase_add_test (tc_core, test_stream_relay_proxy);
+  tcase_add_test (tc_core, test_stream_zerocopy);
+  tcase_add_test (tc_core, test_stream_migrate);
+  tcase_add_test (tc_core, test_stream_tls_echo);
+  tcase_add_test (tc_core, test_stream_tls_bad_handshake);
+  tcase_add_test (tc_core, test_stream_tls_kernel);
 
   tcase_set_timeout(tc_core, 30);
   tcase_add_test (tc_core, test_stream_push_file);
+  tcase_add_test (tc_core, test_stream_push_file_range);
+  tcase_add_test (tc_core, test_stream_prefetch);
+  tcase_add_test (tc_core, test_stream_prefetch_limit);
+  tcase_add_test (tc_core, test_stream_push_file_direct);
+  tcase_add_test (tc_core, test_stream_push_file_direct_limit);
+  tcase_add_test (tc_core, test_stream_push_chain);
+  tcase_add_test (tc_core, test_stream_push_map);
 
   suite_add_tcase (s, tc_core);
 
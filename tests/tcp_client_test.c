@@ -0,0 +1,347 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "test_utils.h"
+
+struct _result {
+    int                 connected;
+    int                 error;
+    int                 sys_error;
+};
+
+/**
+ * A listening socket on the loopback, returns its port
+ */
+static int
+_listen (int * fd, int backlog)
+{
+    struct sockaddr_in addr;
+    socklen_t len;
+
+    if ((*fd = socket (AF_INET, SOCK_STREAM, 0)) == -1) {
+        return (-1);
+    }
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    len = sizeof (addr);
+    if (bind (*fd, (struct sockaddr *) &addr, sizeof (addr)) == -1 ||
+        listen (*fd, backlog) == -1 ||
+        getsockname (*fd, (struct sockaddr *) &addr, &len) == -1) {
+        close (*fd);
+        return (-1);
+    }
+    return (ntohs (addr.sin_port));
+}
+
+static void
+_connect_handler (flm_TCPClient * tcp_client, void * state, flm_Stream * stream)
+{
+    struct _result * result;
+
+    (void) tcp_client;
+
+    result = state;
+    result->connected++;
+    flm_StreamPrintf (stream, "hello");
+    flm_StreamShutdown (stream);
+}
+
+static void
+_error_handler (flm_TCPClient * tcp_client, void * state, int error)
+{
+    struct _result * result;
+
+    (void) tcp_client;
+
+    result = state;
+    result->error = error;
+    result->sys_error = errno;
+}
+
+static flm_TCPClient *
+_client (flm_Monitor * monitor, int port, struct _result * result)
+{
+    flm_TCPClient * tcp_client;
+
+    memset (result, 0, sizeof (*result));
+    tcp_client = flm_TCPClientNew (monitor, "127.0.0.1", port, result);
+    if (tcp_client == NULL) {
+        return (NULL);
+    }
+    flm_TCPClientOnConnect (tcp_client, _connect_handler);
+    flm_TCPClientOnError (tcp_client, _error_handler);
+    return (tcp_client);
+}
+
+/**
+ * Accept the connection of the client and read what it sent
+ */
+static int
+_accept_hello (int listen_fd)
+{
+    char content[16];
+    ssize_t len;
+    int fd;
+
+    if ((fd = accept (listen_fd, NULL, NULL)) == -1) {
+        return (-1);
+    }
+    len = read (fd, content, sizeof (content));
+    close (fd);
+    if (len != 5 || memcmp (content, "hello", 5)) {
+        return (-1);
+    }
+    return (0);
+}
+
+START_TEST(test_tcp_client_create)
+{
+    flm_Monitor * monitor;
+    flm_TCPClient * tcp_client;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+
+    /**
+     * Names are not resolved
+     */
+    fail_unless (flm_TCPClientNew (monitor, "localhost", 80, NULL) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO);
+    fail_unless (errno == EINVAL);
+    fail_unless (flm_TCPClientNew (monitor, "127.0.0.256", 80, NULL) == NULL);
+
+    fail_if ((tcp_client = flm_TCPClientNew (monitor, "127.0.0.1", 80, NULL)) == NULL);
+    flm_TCPClientRelease (tcp_client);
+    fail_if ((tcp_client = flm_TCPClientNew (monitor, "::1", 80, NULL)) == NULL);
+
+    /**
+     * Closing an unconnected client does nothing
+     */
+    flm_TCPClientClose (tcp_client);
+    flm_TCPClientRelease (tcp_client);
+
+    flm_MonitorRelease (monitor);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_tcp_client_alloc_fail)
+{
+    int baseFD;
+
+    baseFD = getFDCount ();
+
+    /**
+     * The monitor is only needed to connect
+     */
+    setTestAlloc (1);
+    fail_if (flm_TCPClientNew (NULL, "127.0.0.1", 80, NULL) != NULL);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_tcp_client_connect)
+{
+    flm_Monitor * monitor;
+    flm_TCPClient * tcp_client;
+    struct _result result;
+    int listen_fd;
+    int port;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    fail_if ((port = _listen (&listen_fd, 16)) == -1);
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+
+    fail_if ((tcp_client = _client (monitor, port, &result)) == NULL);
+    flm_TCPClientTimeout (tcp_client, 5000);
+    fail_if (flm_TCPClientConnect (tcp_client) == -1);
+
+    /**
+     * Cannot connect twice
+     */
+    fail_unless (flm_TCPClientConnect (tcp_client) == -1);
+    fail_unless (flm_Error () == FLM_ERR_BUG);
+    flm_TCPClientRelease (tcp_client);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (result.connected == 1);
+    fail_unless (result.error == 0);
+    fail_unless (_accept_hello (listen_fd) == 0);
+    close (listen_fd);
+
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_tcp_client_refused)
+{
+    flm_Monitor * monitor;
+    flm_TCPClient * tcp_client;
+    struct _result result;
+    int listen_fd;
+    int port;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    /**
+     * Nothing listens on that port anymore
+     */
+    fail_if ((port = _listen (&listen_fd, 16)) == -1);
+    close (listen_fd);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((tcp_client = _client (monitor, port, &result)) == NULL);
+    fail_if (flm_TCPClientConnect (tcp_client) == -1);
+    flm_TCPClientRelease (tcp_client);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (result.connected == 0);
+    fail_unless (result.error == FLM_ERR_ERRNO);
+    fail_unless (result.sys_error == ECONNREFUSED);
+
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_tcp_client_timeout)
+{
+    flm_Monitor * monitor;
+    flm_TCPClient * tcp_client;
+    struct sockaddr_in addr;
+    struct _result result;
+    socklen_t len;
+    int listen_fd;
+    int fds[4];
+    int port;
+    int baseFD;
+    size_t i;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    /**
+     * Once the accept queue is full the SYNs are dropped and the
+     * handshake never ends.
+     */
+    fail_if ((port = _listen (&listen_fd, 0)) == -1);
+    len = sizeof (addr);
+    fail_if (getsockname (listen_fd, (struct sockaddr *) &addr, &len) == -1);
+    for (i = 0; i < sizeof (fds) / sizeof (int); i++) {
+        fail_if ((fds[i] = socket (AF_INET, SOCK_STREAM, 0)) == -1);
+        fcntl (fds[i], F_SETFL, fcntl (fds[i], F_GETFL) | O_NONBLOCK);
+        connect (fds[i], (struct sockaddr *) &addr, len);
+    }
+    usleep (100000);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((tcp_client = _client (monitor, port, &result)) == NULL);
+    flm_TCPClientTimeout (tcp_client, 200);
+    fail_if (flm_TCPClientConnect (tcp_client) == -1);
+    flm_TCPClientRelease (tcp_client);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (result.connected == 0);
+    fail_unless (result.error == FLM_ERR_ERRNO);
+    fail_unless (result.sys_error == ETIMEDOUT);
+
+    for (i = 0; i < sizeof (fds) / sizeof (int); i++) {
+        close (fds[i]);
+    }
+    close (listen_fd);
+
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_tcp_client_fast_open)
+{
+    flm_Monitor * monitor;
+    flm_TCPClient * tcp_client;
+    struct _result result;
+    int listen_fd;
+    int port;
+
+    setTestAlloc (0);
+
+    fail_if ((port = _listen (&listen_fd, 16)) == -1);
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((tcp_client = _client (monitor, port, &result)) == NULL);
+
+    if (flm_TCPClientFastOpen (tcp_client) == -1) {
+        fail_unless (flm_Error () == FLM_ERR_NOSYS);
+        flm_TCPClientRelease (tcp_client);
+        goto out;
+    }
+
+    /**
+     * Without a cookie from the server the kernel does a regular
+     * handshake, the data are sent as usual.
+     */
+    fail_if (flm_TCPClientConnect (tcp_client) == -1);
+    fail_unless (flm_TCPClientFastOpen (tcp_client) == -1);
+    fail_unless (flm_Error () == FLM_ERR_BUG);
+    flm_TCPClientRelease (tcp_client);
+
+    flm_MonitorWait (monitor);
+
+    fail_unless (result.connected == 1);
+    fail_unless (_accept_hello (listen_fd) == 0);
+
+  out:
+    flm_MonitorRelease (monitor);
+    close (listen_fd);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+Suite *
+tcp_client_suite (void)
+{
+  Suite * s = suite_create ("tcp_client");
+
+  /* TCP client test case */
+  TCase *tc_core = tcase_create ("tcp_client");
+
+  tcase_add_test (tc_core, test_tcp_client_create);
+  tcase_add_test (tc_core, test_tcp_client_alloc_fail);
+  tcase_add_test (tc_core, test_tcp_client_connect);
+  tcase_add_test (tc_core, test_tcp_client_refused);
+  tcase_add_test (tc_core, test_tcp_client_timeout);
+  tcase_add_test (tc_core, test_tcp_client_fast_open);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
@@ -6,6 +6,15 @@ alloc_suite (void);
 Suite *
 buffer_suite (void);
 
+Suite *
+buffer_builder_suite (void);
+
+Suite *
+buffer_chain_suite (void);
+
+Suite *
+scan_suite (void);
+
 Suite *
 monitor_suite (void);
 
@@ -32,3 +41,30 @@ stream_suite (void);
 
 Suite *
 tcp_server_suite (void);
+
+Suite *
+tcp_client_suite (void);
+
+Suite *
+conn_pool_suite (void);
+
+Suite *
+udp_socket_suite (void);
+
+Suite *
+unix_server_suite (void);
+
+Suite *
+file_queue_suite (void);
+
+Suite *
+file_cache_suite (void);
+
+Suite *
+tls_cache_suite (void);
+
+Suite *
+framer_suite (void);
+
+Suite *
+http_suite (void);
@@ -80,6 +80,24 @@ testFreeHandler (void * ptr)
     return ;
 }
 
+void *
+testReallocHandler (void * ptr, size_t size)
+{
+    size_t old_size;
+    void * new;
+
+    if (ptr == NULL) {
+        return (testAllocHandler (size));
+    }
+    if ((new = testAllocHandler (size)) == NULL) {
+        return (NULL);
+    }
+    old_size = ((size_t *) ptr)[-1];
+    memcpy (new, ptr, old_size < size ? old_size : size);
+    testFreeHandler (ptr);
+    return (new);
+}
+
 void
 setTestAlloc (uint32_t count)
 {
@@ -88,6 +106,7 @@ setTestAlloc (uint32_t count)
     alloc_sum = 0;
 
     flm__SetAlloc (testAllocHandler);
+    flm__SetRealloc (testReallocHandler);
     flm__SetFree (testFreeHandler);
 
     if (DEBUG) {
@@ -0,0 +1,399 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "test_utils.h"
+#include "tls_utils.h"
+
+struct _conn {
+    flm_Stream *        client;
+    flm_Stream *        server;
+    SSL_SESSION *       session;
+    int                 resumed;
+};
+
+static void
+_echo_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    (void) state;
+
+    flm_StreamPushBuffer (stream, buffer, 0, 0);
+    flm_BufferRelease (buffer);
+}
+
+static void
+_reply_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    struct _conn * conn;
+
+    conn = state;
+    flm_BufferRelease (buffer);
+
+    /**
+     * The TLS 1.3 session arrives before the echo
+     */
+    conn->session = flm_StreamTLSSession (stream);
+    conn->resumed = flm_StreamTLSResumed (conn->server);
+
+    flm_StreamClose (conn->client);
+    flm_StreamClose (conn->server);
+}
+
+/**
+ * One echo over TLS, returns whether the session was resumed
+ */
+static int
+_connect (SSL_CTX * server_context,
+          SSL_CTX * client_context,
+          SSL_SESSION * session,
+          SSL_SESSION ** new_session)
+{
+    flm_Monitor * monitor;
+    struct _conn conn;
+    int fds[2];
+
+    conn.session = NULL;
+    conn.resumed = -1;
+
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        return (-1);
+    }
+    fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl (fds[1], F_SETFL, fcntl (fds[1], F_GETFL) | O_NONBLOCK);
+
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        return (-1);
+    }
+    conn.server = flm_StreamNew (monitor, fds[0], &conn);
+    conn.client = flm_StreamNew (monitor, fds[1], &conn);
+    if (conn.server == NULL || conn.client == NULL) {
+        return (-1);
+    }
+    flm_StreamOnRead (conn.server, _echo_handler);
+    flm_StreamOnRead (conn.client, _reply_handler);
+
+    if (session && flm_StreamTLSResume (conn.client, session) == -1) {
+        return (-1);
+    }
+    if (flm_StreamStartTLSServer (conn.server, server_context) == -1 ||
+        flm_StreamStartTLSClient (conn.client, client_context) == -1) {
+        return (-1);
+    }
+    flm_StreamPrintf (conn.client, "hello");
+
+    flm_StreamRelease (conn.server);
+    flm_StreamRelease (conn.client);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    if (new_session) {
+        *new_session = conn.session;
+    }
+    else if (conn.session) {
+        SSL_SESSION_free (conn.session);
+    }
+    return (conn.resumed);
+}
+
+START_TEST(test_tls_cache_create)
+{
+    flm_TLSCache * cache;
+    struct flm_TLSCacheStats stats;
+
+    setTestAlloc (0);
+
+    fail_unless (flm_TLSCacheNew (0) == NULL);
+    fail_if ((cache = flm_TLSCacheNew (100)) == NULL);
+
+    flm_TLSCacheStats (cache, &stats);
+    fail_unless (stats.lookups == 0);
+    fail_unless (stats.rotations == 1);
+
+    flm_TLSCacheRelease (cache);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_tls_cache_alloc_fail)
+{
+    setTestAlloc (1);
+    fail_if (flm_TLSCacheNew (100) != NULL);
+    fail_unless (getAllocSum () == 0);
+
+    setTestAlloc (2);
+    fail_if (flm_TLSCacheNew (100) != NULL);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_tls_cache_session_id)
+{
+    flm_TLSCache * cache;
+    struct flm_TLSCacheStats stats;
+    SSL_CTX * server_context;
+    SSL_CTX * client_context;
+    SSL_SESSION * session;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    fail_if ((server_context = getTestTLSContext (1)) == NULL);
+    fail_if ((client_context = getTestTLSContext (0)) == NULL);
+
+    /**
+     * Without tickets the sessions are kept by the server
+     */
+    SSL_CTX_set_options (server_context, SSL_OP_NO_TICKET);
+
+    fail_if ((cache = flm_TLSCacheNew (100)) == NULL);
+    fail_if (flm_TLSCacheAttach (cache, server_context) == -1);
+    fail_unless (flm_TLSCacheAttach (cache, server_context) == -1);
+
+    fail_unless (_connect (server_context, client_context, NULL, &session) == 0);
+    fail_if (session == NULL);
+    fail_unless (_connect (server_context, client_context, session, NULL) == 1);
+    SSL_SESSION_free (session);
+
+    flm_TLSCacheStats (cache, &stats);
+    fail_unless (stats.lookups == 1);
+    fail_unless (stats.hits == 1);
+    fail_unless (stats.stores >= 1);
+    fail_unless (stats.tickets == 0);
+
+    /**
+     * The context keeps the cache alive
+     */
+    flm_TLSCacheRelease (cache);
+    SSL_CTX_free (server_context);
+    SSL_CTX_free (client_context);
+
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_tls_cache_eviction)
+{
+    flm_TLSCache * cache;
+    struct flm_TLSCacheStats stats;
+    SSL_CTX * server_context;
+    SSL_CTX * client_context;
+    size_t i;
+
+    setTestAlloc (0);
+
+    fail_if ((server_context = getTestTLSContext (1)) == NULL);
+    fail_if ((client_context = getTestTLSContext (0)) == NULL);
+    SSL_CTX_set_options (server_context, SSL_OP_NO_TICKET);
+
+    /**
+     * One session per shard
+     */
+    fail_if ((cache = flm_TLSCacheNew (1)) == NULL);
+    fail_if (flm_TLSCacheAttach (cache, server_context) == -1);
+    flm_TLSCacheRelease (cache);
+
+    for (i = 0; i < 64; i++) {
+        fail_unless (_connect (server_context, client_context, NULL, NULL) == 0);
+    }
+    flm_TLSCacheStats (cache, &stats);
+    fail_unless (stats.evictions > 0);
+    fail_unless (stats.stores - stats.evictions <= 16);
+
+    SSL_CTX_free (server_context);
+    SSL_CTX_free (client_context);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_tls_cache_tickets)
+{
+    flm_TLSCache * cache;
+    struct flm_TLSCacheStats stats;
+    SSL_CTX * server_context;
+    SSL_CTX * client_context;
+    SSL_SESSION * session;
+
+    setTestAlloc (0);
+
+    fail_if ((server_context = getTestTLSContext (1)) == NULL);
+    fail_if ((client_context = getTestTLSContext (0)) == NULL);
+
+    fail_if ((cache = flm_TLSCacheNew (100)) == NULL);
+    fail_if (flm_TLSCacheAttach (cache, server_context) == -1);
+
+    fail_unless (_connect (server_context, client_context, NULL, &session) == 0);
+    fail_if (session == NULL);
+
+    /**
+     * Still accepted with the previous key
+     */
+    fail_if (flm_TLSCacheRotateKeys (cache) == -1);
+    fail_unless (_connect (server_context, client_context, session, NULL) == 1);
+
+    flm_TLSCacheStats (cache, &stats);
+    fail_unless (stats.tickets == 1);
+    fail_unless (stats.bad_tickets == 0);
+
+    /**
+     * The first key is forgotten now
+     */
+    fail_if (flm_TLSCacheRotateKeys (cache) == -1);
+    fail_if (flm_TLSCacheRotateKeys (cache) == -1);
+    fail_unless (_connect (server_context, client_context, session, NULL) == 0);
+    SSL_SESSION_free (session);
+
+    flm_TLSCacheStats (cache, &stats);
+    fail_unless (stats.tickets == 1);
+    fail_unless (stats.bad_tickets == 1);
+    fail_unless (stats.rotations == 4);
+
+    flm_TLSCacheRelease (cache);
+    SSL_CTX_free (server_context);
+    SSL_CTX_free (client_context);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+static void
+_stop_handler (flm_Timer * timer, void * state)
+{
+    (void) timer;
+
+    fail_if (flm_TLSCacheRotate (state, NULL, 0) == -1);
+}
+
+START_TEST(test_tls_cache_rotate)
+{
+    flm_Monitor * monitor;
+    flm_TLSCache * cache;
+    flm_Timer * timer;
+    struct flm_TLSCacheStats stats;
+
+    setTestAlloc (0);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((cache = flm_TLSCacheNew (100)) == NULL);
+
+    fail_if (flm_TLSCacheRotate (cache, monitor, 100) == -1);
+    fail_if ((timer = flm_TimerNew (monitor, _stop_handler, cache, 550)) == NULL);
+    flm_TimerRelease (timer);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    flm_TLSCacheStats (cache, &stats);
+    fail_unless (stats.rotations >= 3);
+    flm_TLSCacheRelease (cache);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+#define NB_THREADS      4
+#define NB_CONNECTIONS  5
+
+static SSL_CTX *        shared_server_context;
+static SSL_CTX *        shared_client_context;
+static SSL_SESSION *    shared_session;
+
+static void *
+_resume_routine (void * arg)
+{
+    size_t i;
+    long resumed;
+
+    (void) arg;
+
+    resumed = 0;
+    for (i = 0; i < NB_CONNECTIONS; i++) {
+        if (_connect (shared_server_context,
+                      shared_client_context,
+                      shared_session,
+                      NULL) == 1) {
+            resumed++;
+        }
+    }
+    return ((void *) resumed);
+}
+
+START_TEST(test_tls_cache_threads)
+{
+    flm_TLSCache * cache;
+    struct flm_TLSCacheStats stats;
+    pthread_t threads[NB_THREADS];
+    void * resumed;
+    size_t i;
+
+    /**
+     * The test allocator is not thread safe, the default one is used.
+     */
+    fail_if ((shared_server_context = getTestTLSContext (1)) == NULL);
+    fail_if ((shared_client_context = getTestTLSContext (0)) == NULL);
+    SSL_CTX_set_options (shared_server_context, SSL_OP_NO_TICKET);
+
+    fail_if ((cache = flm_TLSCacheNew (1000)) == NULL);
+    fail_if (flm_TLSCacheAttach (cache, shared_server_context) == -1);
+
+    /**
+     * Created on this thread, resumed by all the others
+     */
+    fail_unless (_connect (shared_server_context,
+                           shared_client_context,
+                           NULL,
+                           &shared_session) == 0);
+    fail_if (shared_session == NULL);
+
+    for (i = 0; i < NB_THREADS; i++) {
+        fail_if (pthread_create (&threads[i],
+                                 NULL,
+                                 _resume_routine,
+                                 NULL) != 0);
+    }
+    for (i = 0; i < NB_THREADS; i++) {
+        fail_if (pthread_join (threads[i], &resumed) != 0);
+        fail_unless ((long) resumed == NB_CONNECTIONS);
+    }
+
+    flm_TLSCacheStats (cache, &stats);
+    fail_unless (stats.hits == NB_THREADS * NB_CONNECTIONS);
+
+    SSL_SESSION_free (shared_session);
+    flm_TLSCacheRelease (cache);
+    SSL_CTX_free (shared_server_context);
+    SSL_CTX_free (shared_client_context);
+}
+END_TEST
+
+Suite *
+tls_cache_suite (void)
+{
+  Suite * s = suite_create ("tls_cache");
+
+  /* TLS cache test case */
+  TCase *tc_core = tcase_create ("tls_cache");
+
+  tcase_add_test (tc_core, test_tls_cache_create);
+  tcase_add_test (tc_core, test_tls_cache_alloc_fail);
+  tcase_add_test (tc_core, test_tls_cache_session_id);
+  tcase_add_test (tc_core, test_tls_cache_eviction);
+  tcase_add_test (tc_core, test_tls_cache_tickets);
+  tcase_add_test (tc_core, test_tls_cache_rotate);
+  tcase_add_test (tc_core, test_tls_cache_threads);
+
+  tcase_set_timeout(tc_core, 30);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
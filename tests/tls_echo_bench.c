@@ -0,0 +1,212 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <signal.h>
+
+#include "flm/flm.h"
+
+#include "tls_utils.h"
+
+/**
+ * Echo over loopback TCP: every client sends its payload, the server
+ * pushes back every buffer it reads and the client closes both ends once
+ * everything came back. Both sides run on the same monitor.
+ *
+ * usage: tls_echo_bench [connections] [bytes per connection]
+ */
+
+struct bench_conn {
+    flm_Stream *        client;
+    flm_Stream *        server;
+    size_t              received;
+};
+
+static size_t   payload_size;
+static char *   payload;
+static size_t   nb_done;
+static int      offload;
+
+static void
+_echo (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    (void) state;
+
+    flm_StreamPushBuffer (stream, buffer, 0, 0);
+    flm_BufferRelease (buffer);
+}
+
+static void
+_receive (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    struct bench_conn * conn;
+
+    (void) stream;
+
+    conn = state;
+    offload = flm_StreamTLSOffload (conn->server);
+    conn->received += flm_BufferLength (buffer);
+    flm_BufferRelease (buffer);
+
+    if (conn->received == payload_size) {
+        nb_done++;
+        flm_StreamClose (conn->client);
+        flm_StreamClose (conn->server);
+    }
+}
+
+static int
+_pair (int fds[2])
+{
+    struct sockaddr_in addr;
+    socklen_t len;
+    int server;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    len = sizeof (addr);
+
+    if ((server = socket (AF_INET, SOCK_STREAM, 0)) == -1 ||
+        bind (server, (struct sockaddr *) &addr, len) == -1 ||
+        listen (server, 1) == -1 ||
+        getsockname (server, (struct sockaddr *) &addr, &len) == -1) {
+        return (-1);
+    }
+    if ((fds[1] = socket (AF_INET, SOCK_STREAM, 0)) == -1 ||
+        connect (fds[1], (struct sockaddr *) &addr, len) == -1 ||
+        (fds[0] = accept (server, NULL, NULL)) == -1) {
+        return (-1);
+    }
+    close (server);
+
+    fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl (fds[1], F_SETFL, fcntl (fds[1], F_GETFL) | O_NONBLOCK);
+    return (0);
+}
+
+static int
+_run (const char * name,
+      size_t nb_conns,
+      SSL_CTX * server_context,
+      SSL_CTX * client_context,
+      int kernel)
+{
+    flm_Monitor * monitor;
+    flm_Buffer * buffer;
+    struct bench_conn * conns;
+    struct timespec start;
+    struct timespec end;
+    double elapsed;
+    size_t i;
+    int fds[2];
+
+    if ((conns = calloc (nb_conns, sizeof (struct bench_conn))) == NULL) {
+        return (-1);
+    }
+    if ((monitor = flm_MonitorNew ()) == NULL) {
+        return (-1);
+    }
+    if ((buffer = flm_BufferNew (payload, payload_size, NULL)) == NULL) {
+        return (-1);
+    }
+
+    nb_done = 0;
+    offload = FLM_STREAM_TLS_USER;
+    clock_gettime (CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < nb_conns; i++) {
+        if (_pair (fds) == -1) {
+            perror ("socket");
+            return (-1);
+        }
+        conns[i].server = flm_StreamNew (monitor, fds[0], &conns[i]);
+        conns[i].client = flm_StreamNew (monitor, fds[1], &conns[i]);
+        if (conns[i].server == NULL || conns[i].client == NULL) {
+            return (-1);
+        }
+        flm_StreamOnRead (conns[i].server, _echo);
+        flm_StreamOnRead (conns[i].client, _receive);
+
+        if (kernel &&
+            (flm_StreamKernelTLS (conns[i].server) == -1 ||
+             flm_StreamKernelTLS (conns[i].client) == -1)) {
+            fprintf (stderr, "kTLS not supported by OpenSSL\n");
+            return (-1);
+        }
+        if (server_context &&
+            (flm_StreamStartTLSServer (conns[i].server, server_context) == -1 ||
+             flm_StreamStartTLSClient (conns[i].client, client_context) == -1)) {
+            fprintf (stderr, "TLS setup failed\n");
+            return (-1);
+        }
+        flm_StreamPushBuffer (conns[i].client, buffer, 0, 0);
+
+        flm_StreamRelease (conns[i].server);
+        flm_StreamRelease (conns[i].client);
+    }
+    flm_BufferRelease (buffer);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) +
+        (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf ("%-6s %6zu connections %10zu bytes each: %8.3f s, %9.1f MB/s, "
+            "%8.1f connections/s (%zu complete%s)\n",
+            name, nb_conns, payload_size, elapsed,
+            (2.0 * nb_conns * payload_size) / elapsed / 1e6,
+            nb_conns / elapsed, nb_done,
+            kernel && (offload & FLM_STREAM_TLS_KERNEL_SEND) ?
+            ", kernel encryption" : kernel ? ", user space fallback" : "");
+
+    free (conns);
+    return (nb_done == nb_conns ? 0 : -1);
+}
+
+int
+main (int argc, char ** argv)
+{
+    SSL_CTX * server_context;
+    SSL_CTX * client_context;
+    size_t nb_conns;
+    int ret;
+
+    nb_conns = argc > 1 ? strtoul (argv[1], NULL, 10) : 64;
+    payload_size = argc > 2 ? strtoul (argv[2], NULL, 10) : 1024 * 1024;
+
+    signal (SIGPIPE, SIG_IGN);
+
+    if ((payload = malloc (payload_size)) == NULL) {
+        return (1);
+    }
+    memset (payload, 'a', payload_size);
+
+    server_context = getTestTLSContext (1);
+    client_context = getTestTLSContext (0);
+    if (server_context == NULL || client_context == NULL) {
+        fprintf (stderr, "cannot create the TLS contexts\n");
+        return (1);
+    }
+
+    ret = 0;
+    ret |= _run ("plain", nb_conns, NULL, NULL, 0);
+    ret |= _run ("tls", nb_conns, server_context, client_context, 0);
+    ret |= _run ("ktls", nb_conns, server_context, client_context, 1);
+
+    SSL_CTX_free (server_context);
+    SSL_CTX_free (client_context);
+    free (payload);
+    return (ret ? 1 : 0);
+}
@@ -0,0 +1,70 @@
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "tls_utils.h"
+
+static EVP_PKEY *       test_key = NULL;
+static X509 *           test_cert = NULL;
+
+static int
+_generateCert (void)
+{
+    EVP_PKEY_CTX *      context;
+    X509_NAME *         name;
+
+    context = EVP_PKEY_CTX_new_id (EVP_PKEY_EC, NULL);
+    if (context == NULL) {
+        return (-1);
+    }
+    if (EVP_PKEY_keygen_init (context) <= 0 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid (context,
+                                                NID_X9_62_prime256v1) <= 0 ||
+        EVP_PKEY_keygen (context, &test_key) <= 0) {
+        EVP_PKEY_CTX_free (context);
+        return (-1);
+    }
+    EVP_PKEY_CTX_free (context);
+
+    if ((test_cert = X509_new ()) == NULL) {
+        return (-1);
+    }
+    X509_set_version (test_cert, 2);
+    ASN1_INTEGER_set (X509_get_serialNumber (test_cert), 1);
+    X509_gmtime_adj (X509_getm_notBefore (test_cert), 0);
+    X509_gmtime_adj (X509_getm_notAfter (test_cert), 3600);
+    X509_set_pubkey (test_cert, test_key);
+
+    name = X509_get_subject_name (test_cert);
+    X509_NAME_add_entry_by_txt (name, "CN", MBSTRING_ASC,
+                                (unsigned char *) "localhost", -1, -1, 0);
+    X509_set_issuer_name (test_cert, name);
+
+    if (X509_sign (test_cert, test_key, EVP_sha256 ()) == 0) {
+        return (-1);
+    }
+    return (0);
+}
+
+SSL_CTX *
+getTestTLSContext (int server)
+{
+    SSL_CTX * context;
+
+    if (!server) {
+        return (SSL_CTX_new (TLS_client_method ()));
+    }
+
+    if (test_cert == NULL && _generateCert () == -1) {
+        return (NULL);
+    }
+    if ((context = SSL_CTX_new (TLS_server_method ())) == NULL) {
+        return (NULL);
+    }
+    if (SSL_CTX_use_certificate (context, test_cert) != 1 ||
+        SSL_CTX_use_PrivateKey (context, test_key) != 1) {
+        SSL_CTX_free (context);
+        return (NULL);
+    }
+    return (context);
+}
@@ -0,0 +1,7 @@
+#include <openssl/ssl.h>
+
+/**
+ * Self-signed certificate for localhost, generated once per process
+ */
+SSL_CTX *
+getTestTLSContext (int server);
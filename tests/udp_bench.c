@@ -0,0 +1,184 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "flm/flm.h"
+
+/**
+ * Send datagrams of the same size over the loopback, one system call per
+ * datagram, in batches of messages, then with segmentation offload. The
+ * sender keeps a window of datagrams in flight, small enough to never
+ * overflow the receive queue.
+ *
+ * usage: udp_bench [datagrams] [size] [window]
+ */
+
+struct bench {
+    flm_UDPSocket *             sender;
+    flm_UDPSocket *             receiver;
+    flm_Buffer *                payload;
+    struct sockaddr_storage     addr;
+    socklen_t                   addr_len;
+    flm_Timer *                 timer;
+
+    size_t                      total;
+    size_t                      window;
+    size_t                      sent;
+    size_t                      received;
+    size_t                      lost;
+    size_t                      last;
+};
+
+static void
+_fill (struct bench * bench)
+{
+    while (bench->sent < bench->total &&
+           bench->sent - bench->received - bench->lost < bench->window) {
+        if (flm_UDPSocketSend (bench->sender,
+                               bench->payload,
+                               (struct sockaddr *) &bench->addr,
+                               bench->addr_len) == -1) {
+            break ;
+        }
+        bench->sent++;
+    }
+}
+
+static void
+_stop (struct bench * bench)
+{
+    flm_TimerCancel (bench->timer);
+    flm_UDPSocketClose (bench->sender);
+    flm_UDPSocketClose (bench->receiver);
+}
+
+static void
+_read_handler (flm_UDPSocket * udp_socket,
+               void * state,
+               flm_Buffer * datagram,
+               const struct sockaddr * addr,
+               socklen_t addr_len)
+{
+    struct bench * bench;
+
+    (void) udp_socket;
+    (void) datagram;
+    (void) addr;
+    (void) addr_len;
+
+    bench = state;
+    if (++bench->received + bench->lost == bench->total) {
+        _stop (bench);
+        return ;
+    }
+    if (bench->sent - bench->received - bench->lost <= bench->window / 2) {
+        _fill (bench);
+    }
+}
+
+/**
+ * Datagrams lost by the loopback would stall the window
+ */
+static void
+_stall_handler (flm_Timer * timer, void * state)
+{
+    struct bench * bench;
+
+    bench = state;
+    if (bench->received == bench->last) {
+        bench->lost = bench->sent - bench->received;
+        if (bench->received + bench->lost == bench->total) {
+            _stop (bench);
+            return ;
+        }
+        _fill (bench);
+    }
+    bench->last = bench->received;
+    flm_TimerReset (timer, 100);
+}
+
+static void
+_run (const char * name, size_t total, size_t size, size_t window, size_t batch, int offload)
+{
+    flm_Monitor * monitor;
+    struct bench bench;
+    struct timespec start;
+    struct timespec end;
+    double elapsed;
+    char * content;
+
+    memset (&bench, 0, sizeof (bench));
+    bench.total = total;
+    bench.window = window;
+
+    monitor = flm_MonitorNew ();
+    bench.sender = flm_UDPSocketNew (monitor, "127.0.0.1", 0, &bench);
+    bench.receiver = flm_UDPSocketNew (monitor, "127.0.0.1", 0, &bench);
+    if (monitor == NULL || bench.sender == NULL || bench.receiver == NULL) {
+        fprintf (stderr, "cannot create the sockets\n");
+        exit (1);
+    }
+    flm_UDPSocketBatch (bench.sender, batch, size);
+    flm_UDPSocketBatch (bench.receiver, batch, size);
+    if (offload &&
+        (flm_UDPSocketGSO (bench.sender) == -1 ||
+         flm_UDPSocketGRO (bench.receiver) == -1)) {
+        printf ("%-6s not supported\n", name);
+        goto out;
+    }
+    flm_UDPSocketOnRead (bench.receiver, _read_handler);
+
+    bench.addr_len = sizeof (bench.addr);
+    getsockname (flm_IODescriptor ((flm_IO *) bench.receiver),
+                 (struct sockaddr *) &bench.addr,
+                 &bench.addr_len);
+
+    content = malloc (size);
+    memset (content, 'x', size);
+    bench.payload = flm_BufferNew (content, size, free);
+    bench.timer = flm_TimerNew (monitor, _stall_handler, &bench, 100);
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    _fill (&bench);
+    flm_MonitorWait (monitor);
+    clock_gettime (CLOCK_MONOTONIC, &end);
+
+    elapsed = (end.tv_sec - start.tv_sec) +
+        (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf ("%-6s %5zu bytes: %10.0f datagrams/s %8.1f MB/s (%zu lost)\n",
+            name,
+            size,
+            bench.received / elapsed,
+            bench.received * size / elapsed / 1e6,
+            bench.lost);
+
+    flm_TimerRelease (bench.timer);
+    flm_BufferRelease (bench.payload);
+  out:
+    flm_UDPSocketClose (bench.sender);
+    flm_UDPSocketClose (bench.receiver);
+    flm_UDPSocketRelease (bench.sender);
+    flm_UDPSocketRelease (bench.receiver);
+    flm_MonitorRelease (monitor);
+}
+
+int
+main (int argc, char ** argv)
+{
+    size_t total;
+    size_t size;
+    size_t window;
+
+    total = argc > 1 ? strtoul (argv[1], NULL, 10) : 1000000;
+    size = argc > 2 ? strtoul (argv[2], NULL, 10) : 1200;
+    window = argc > 3 ? strtoul (argv[3], NULL, 10) : 64;
+
+    _run ("plain", total, size, window, 1, 0);
+    _run ("mmsg", total, size, window, 64, 0);
+    _run ("gso", total, size, window, 64, 1);
+    return (0);
+}
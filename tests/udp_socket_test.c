@@ -0,0 +1,352 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "test_utils.h"
+
+#define NB_DATAGRAMS    100
+
+struct _peer {
+    flm_UDPSocket *     socket;
+    flm_UDPSocket *     other;
+    struct sockaddr_storage addr;
+    socklen_t           addr_len;
+    size_t              received;
+    size_t              bytes;
+    int                 errors;
+    int                 ordered;
+};
+
+static int
+_address (flm_UDPSocket * udp_socket, struct _peer * peer)
+{
+    peer->addr_len = sizeof (peer->addr);
+    return (getsockname (flm_IODescriptor ((flm_IO *) udp_socket),
+                         (struct sockaddr *) &peer->addr,
+                         &peer->addr_len));
+}
+
+static void
+_count_handler (flm_UDPSocket * udp_socket,
+                void * state,
+                flm_Buffer * datagram,
+                const struct sockaddr * addr,
+                socklen_t addr_len)
+{
+    struct _peer * peer;
+    char expected[32];
+    int len;
+
+    (void) udp_socket;
+    (void) addr;
+    (void) addr_len;
+
+    peer = state;
+
+    /**
+     * Loopback keeps the order of the datagrams
+     */
+    len = snprintf (expected, sizeof (expected), "datagram %zu", peer->received);
+    if ((size_t) len != flm_BufferLength (datagram) ||
+        memcmp (expected, flm_BufferContent (datagram), len)) {
+        peer->ordered = 0;
+    }
+    peer->bytes += flm_BufferLength (datagram);
+    if (++peer->received == NB_DATAGRAMS) {
+        flm_UDPSocketClose (peer->socket);
+        flm_UDPSocketClose (peer->other);
+    }
+}
+
+static void
+_echo_handler (flm_UDPSocket * udp_socket,
+               void * state,
+               flm_Buffer * datagram,
+               const struct sockaddr * addr,
+               socklen_t addr_len)
+{
+    struct _peer * peer;
+
+    peer = state;
+    fail_if (flm_UDPSocketSend (udp_socket, datagram, addr, addr_len) == -1);
+    peer->received++;
+}
+
+static void
+_error_handler (flm_UDPSocket * udp_socket, void * state, int error)
+{
+    struct _peer * peer;
+
+    (void) udp_socket;
+    (void) error;
+
+    peer = state;
+    peer->errors++;
+}
+
+START_TEST(test_udp_socket_create)
+{
+    flm_Monitor * monitor;
+    flm_UDPSocket * udp_socket;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+
+    fail_unless (flm_UDPSocketNew (monitor, "localhost", 0, NULL) == NULL);
+    fail_unless (errno == EINVAL);
+
+    fail_if ((udp_socket = flm_UDPSocketNew (monitor, "127.0.0.1", 0, NULL)) == NULL);
+    fail_unless (flm_UDPSocketBatch (udp_socket, 0, 2048) == -1);
+    fail_unless (flm_UDPSocketBatch (udp_socket, 2000, 2048) == -1);
+    fail_unless (flm_UDPSocketBatch (udp_socket, 16, 0) == -1);
+    fail_if (flm_UDPSocketBatch (udp_socket, 1, 1) == -1);
+    fail_if (flm_UDPSocketBatch (udp_socket, 1024, 65535) == -1);
+    flm_UDPSocketClose (udp_socket);
+    flm_UDPSocketRelease (udp_socket);
+
+    flm_MonitorRelease (monitor);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_udp_socket_alloc_fail)
+{
+    setTestAlloc (1);
+    fail_if (flm_UDPSocketNew (NULL, "127.0.0.1", 0, NULL) != NULL);
+    fail_unless (getAllocSum () == 0);
+
+    setTestAlloc (2);
+    fail_if (flm_UDPSocketNew (NULL, "127.0.0.1", 0, NULL) != NULL);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+static void
+_run_echo (size_t count, size_t size, int offload)
+{
+    flm_Monitor * monitor;
+    struct _peer client;
+    struct _peer server;
+    flm_Buffer * datagram;
+    size_t i;
+
+    setTestAlloc (0);
+
+    memset (&client, 0, sizeof (client));
+    memset (&server, 0, sizeof (server));
+    client.ordered = 1;
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((client.socket = flm_UDPSocketNew (monitor, "127.0.0.1", 0, &client)) == NULL);
+    fail_if ((server.socket = flm_UDPSocketNew (monitor, "127.0.0.1", 0, &server)) == NULL);
+    client.other = server.socket;
+    fail_if (flm_UDPSocketBatch (client.socket, count, size) == -1);
+    fail_if (flm_UDPSocketBatch (server.socket, count, size) == -1);
+    fail_if (_address (server.socket, &server) == -1);
+
+    if (offload &&
+        (flm_UDPSocketGSO (client.socket) == -1 ||
+         flm_UDPSocketGSO (server.socket) == -1 ||
+         flm_UDPSocketGRO (client.socket) == -1 ||
+         flm_UDPSocketGRO (server.socket) == -1)) {
+        fail_unless (flm_Error () == FLM_ERR_NOSYS);
+    }
+
+    flm_UDPSocketOnRead (client.socket, _count_handler);
+    flm_UDPSocketOnRead (server.socket, _echo_handler);
+    flm_UDPSocketOnError (client.socket, _error_handler);
+    flm_UDPSocketOnError (server.socket, _error_handler);
+
+    /**
+     * All queued before the first iteration, the loopback queue is large
+     * enough to hold them.
+     */
+    for (i = 0; i < NB_DATAGRAMS; i++) {
+        fail_if ((datagram = flm_BufferPrintf ("datagram %zu", i)) == NULL);
+        fail_if (flm_UDPSocketSend (client.socket,
+                                    datagram,
+                                    (struct sockaddr *) &server.addr,
+                                    server.addr_len) == -1);
+        flm_BufferRelease (datagram);
+    }
+
+    flm_MonitorWait (monitor);
+    flm_UDPSocketRelease (client.socket);
+    flm_UDPSocketRelease (server.socket);
+    flm_MonitorRelease (monitor);
+
+    fail_unless (server.received == NB_DATAGRAMS);
+    fail_unless (client.received == NB_DATAGRAMS);
+    fail_unless (client.ordered == 1);
+    fail_unless (client.errors == 0);
+    fail_unless (server.errors == 0);
+    fail_unless (getAllocSum () == 0);
+}
+
+START_TEST(test_udp_socket_echo)
+{
+    _run_echo (32, 2048, 0);
+}
+END_TEST
+
+START_TEST(test_udp_socket_batches)
+{
+    /**
+     * One datagram per system call, and batches larger than the traffic
+     */
+    _run_echo (1, 64, 0);
+    _run_echo (7, 64, 0);
+    _run_echo (1024, 512, 0);
+}
+END_TEST
+
+START_TEST(test_udp_socket_offload)
+{
+    /**
+     * The datagrams have the same size in runs, from "datagram 10" to
+     * "datagram 99", they are split in several messages by small batches.
+     */
+    _run_echo (32, 2048, 1);
+    _run_echo (1, 64, 1);
+    _run_echo (3, 16, 1);
+}
+END_TEST
+
+static void
+_keep_handler (flm_UDPSocket * udp_socket,
+               void * state,
+               flm_Buffer * datagram,
+               const struct sockaddr * addr,
+               socklen_t addr_len)
+{
+    flm_Buffer ** kept;
+
+    (void) addr;
+    (void) addr_len;
+
+    kept = state;
+    if (*kept == NULL) {
+        *kept = flm_BufferRetain (datagram);
+    }
+    else {
+        fail_unless (flm_BufferLength (datagram) == 1);
+        flm_UDPSocketClose (udp_socket);
+    }
+}
+
+START_TEST(test_udp_socket_truncate)
+{
+    flm_Monitor * monitor;
+    flm_UDPSocket * udp_socket;
+    struct _peer peer;
+    flm_Buffer * kept;
+    flm_Buffer * datagram;
+
+    setTestAlloc (0);
+
+    kept = NULL;
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((udp_socket = flm_UDPSocketNew (monitor, "127.0.0.1", 0, &kept)) == NULL);
+    fail_if (flm_UDPSocketBatch (udp_socket, 4, 8) == -1);
+    fail_if (_address (udp_socket, &peer) == -1);
+    flm_UDPSocketOnRead (udp_socket, _keep_handler);
+
+    /**
+     * The datagrams too large are dropped, a datagram kept by the handler
+     * outlives its batch.
+     */
+    fail_if ((datagram = flm_BufferPrintf ("first")) == NULL);
+    fail_if (flm_UDPSocketSend (udp_socket, datagram,
+                                (struct sockaddr *) &peer.addr, peer.addr_len) == -1);
+    flm_BufferRelease (datagram);
+    fail_if ((datagram = flm_BufferPrintf ("much too long")) == NULL);
+    fail_if (flm_UDPSocketSend (udp_socket, datagram,
+                                (struct sockaddr *) &peer.addr, peer.addr_len) == -1);
+    flm_BufferRelease (datagram);
+    fail_if ((datagram = flm_BufferPrintf ("x")) == NULL);
+    fail_if (flm_UDPSocketSend (udp_socket, datagram,
+                                (struct sockaddr *) &peer.addr, peer.addr_len) == -1);
+    flm_BufferRelease (datagram);
+
+    flm_MonitorWait (monitor);
+
+    fail_if (kept == NULL);
+    fail_unless (flm_BufferLength (kept) == 5);
+    fail_unless (memcmp (flm_BufferContent (kept), "first", 5) == 0);
+    flm_BufferRelease (kept);
+
+    flm_UDPSocketRelease (udp_socket);
+    flm_MonitorRelease (monitor);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_udp_socket_queue_full)
+{
+    flm_Monitor * monitor;
+    flm_UDPSocket * udp_socket;
+    struct _peer peer;
+    flm_Buffer * datagram;
+    int i;
+
+    setTestAlloc (0);
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((udp_socket = flm_UDPSocketNew (monitor, "127.0.0.1", 0, NULL)) == NULL);
+    fail_if (_address (udp_socket, &peer) == -1);
+    fail_if ((datagram = flm_BufferPrintf ("x")) == NULL);
+
+    for (i = 0; flm_UDPSocketSend (udp_socket,
+                                   datagram,
+                                   (struct sockaddr *) &peer.addr,
+                                   peer.addr_len) == 0; i++) {
+        fail_if (i > 100000);
+    }
+    fail_unless (flm_Error () == FLM_ERR_ERRNO);
+    fail_unless (errno == ENOBUFS);
+
+    /**
+     * The datagrams still queued are dropped
+     */
+    flm_UDPSocketClose (udp_socket);
+    flm_UDPSocketRelease (udp_socket);
+    flm_BufferRelease (datagram);
+
+    flm_MonitorWait (monitor);
+    flm_MonitorRelease (monitor);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+Suite *
+udp_socket_suite (void)
+{
+  Suite * s = suite_create ("udp_socket");
+
+  /* UDP socket test case */
+  TCase *tc_core = tcase_create ("udp_socket");
+
+  tcase_add_test (tc_core, test_udp_socket_create);
+  tcase_add_test (tc_core, test_udp_socket_alloc_fail);
+  tcase_add_test (tc_core, test_udp_socket_echo);
+  tcase_add_test (tc_core, test_udp_socket_batches);
+  tcase_add_test (tc_core, test_udp_socket_offload);
+  tcase_add_test (tc_core, test_udp_socket_truncate);
+  tcase_add_test (tc_core, test_udp_socket_queue_full);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}
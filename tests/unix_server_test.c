@@ -0,0 +1,319 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include "flm/flm.h"
+
+#include "test_utils.h"
+
+static char             path[64];
+
+static const char *
+_path (void)
+{
+    snprintf (path, sizeof (path), "/tmp/flm_test_%d.sock", (int) getpid ());
+    return (path);
+}
+
+/**
+ * Blocking connection to a path, or to an abstract name starting with '@'
+ */
+static int
+_connect (const char * name)
+{
+    struct sockaddr_un addr;
+    socklen_t len;
+    int fd;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strncpy (addr.sun_path, name, sizeof (addr.sun_path) - 1);
+    len = offsetof (struct sockaddr_un, sun_path) + strlen (name);
+    if (name[0] == '@') {
+        addr.sun_path[0] = '\0';
+    }
+    else {
+        len++;
+    }
+    if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) == -1) {
+        return (-1);
+    }
+    if (connect (fd, (struct sockaddr *) &addr, len) == -1) {
+        close (fd);
+        return (-1);
+    }
+    return (fd);
+}
+
+static int              accepted;
+
+static void
+_accept_handler (flm_UnixServer * unix_server, void * state, int fd)
+{
+    (void) state;
+
+    accepted++;
+    close (fd);
+    flm_UnixServerClose (unix_server);
+}
+
+START_TEST(test_unix_server_create)
+{
+    flm_Monitor * monitor;
+    flm_UnixServer * unix_server;
+    struct stat st;
+    int client;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((unix_server = flm_UnixServerNew (monitor, _path (), NULL)) == NULL);
+    flm_UnixServerOnAccept (unix_server, _accept_handler);
+    fail_if (stat (path, &st) == -1);
+    fail_unless (S_ISSOCK (st.st_mode));
+
+    fail_if ((client = _connect (path)) == -1);
+    accepted = 0;
+    flm_MonitorWait (monitor);
+    fail_unless (accepted == 1);
+    close (client);
+
+    /**
+     * The path is removed with the server
+     */
+    flm_UnixServerRelease (unix_server);
+    flm_MonitorRelease (monitor);
+    fail_unless (stat (path, &st) == -1 && errno == ENOENT);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+START_TEST(test_unix_server_alloc_fail)
+{
+    struct stat st;
+
+    setTestAlloc (1);
+    fail_if (flm_UnixServerNew (NULL, _path (), NULL) != NULL);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (stat (path, &st) == -1 && errno == ENOENT);
+}
+END_TEST
+
+START_TEST(test_unix_server_path)
+{
+    flm_UnixServer * unix_server;
+    flm_UnixServer * other;
+    struct sockaddr_un addr;
+    char name[sizeof (addr.sun_path) + 1];
+    int fd;
+
+    setTestAlloc (0);
+
+    memset (name, 'x', sizeof (name) - 1);
+    name[sizeof (name) - 1] = '\0';
+    fail_unless (flm_UnixServerNew (NULL, name, NULL) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == ENAMETOOLONG);
+    fail_unless (flm_UnixServerNew (NULL, "", NULL) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == EINVAL);
+
+    /**
+     * Left behind by a server that is gone
+     */
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, _path ());
+    fail_if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) == -1);
+    fail_if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) == -1);
+    close (fd);
+    fail_if ((unix_server = flm_UnixServerNew (NULL, path, NULL)) == NULL);
+
+    /**
+     * Still listening
+     */
+    fail_unless ((other = flm_UnixServerNew (NULL, path, NULL)) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == EADDRINUSE);
+    flm_UnixServerRelease (unix_server);
+
+    /**
+     * Not a socket
+     */
+    fail_if ((fd = open (path, O_CREAT | O_WRONLY, 0600)) == -1);
+    close (fd);
+    fail_unless (flm_UnixServerNew (NULL, path, NULL) == NULL);
+    fail_unless (flm_Error () == FLM_ERR_ERRNO && errno == EADDRINUSE);
+    fail_if (unlink (path) == -1);
+
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+START_TEST(test_unix_server_abstract)
+{
+    flm_Monitor * monitor;
+    flm_UnixServer * unix_server;
+    char name[64];
+    int client;
+
+    setTestAlloc (0);
+
+    snprintf (name, sizeof (name), "@flm_test_%d", (int) getpid ());
+    fail_if ((monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((unix_server = flm_UnixServerNew (monitor, name, NULL)) == NULL);
+    flm_UnixServerOnAccept (unix_server, _accept_handler);
+    fail_if (access (name, F_OK) == 0);
+
+    fail_if ((client = _connect (name)) == -1);
+    accepted = 0;
+    flm_MonitorWait (monitor);
+    fail_unless (accepted == 1);
+    close (client);
+
+    flm_UnixServerRelease (unix_server);
+    flm_MonitorRelease (monitor);
+    fail_unless (getAllocSum () == 0);
+}
+END_TEST
+
+struct _handoff {
+    flm_Monitor *       monitor;
+    flm_Stream *        front;
+    flm_Stream *        worker;
+    int                 received;
+    int                 passed;
+    char                data[8];
+};
+
+static void
+_descriptor_handler (flm_Stream * stream, void * state, int fd)
+{
+    struct _handoff * handoff;
+
+    (void) stream;
+
+    handoff = state;
+    if (handoff->received != -1) {
+        close (handoff->received);
+    }
+    handoff->received = fd;
+    handoff->passed++;
+}
+
+static void
+_worker_read_handler (flm_Stream * stream, void * state, flm_Buffer * buffer)
+{
+    struct _handoff * handoff;
+
+    handoff = state;
+
+    /**
+     * The descriptor is handed out before the data sent with it
+     */
+    fail_unless (handoff->received != -1);
+    fail_unless (flm_BufferLength (buffer) < sizeof (handoff->data));
+    memcpy (handoff->data, flm_BufferContent (buffer), flm_BufferLength (buffer));
+    flm_BufferRelease (buffer);
+
+    flm_StreamClose (stream);
+    flm_StreamClose (handoff->front);
+}
+
+static void
+_handoff_accept_handler (flm_UnixServer * unix_server, void * state, int fd)
+{
+    struct _handoff * handoff;
+
+    handoff = state;
+    fail_if ((handoff->worker = flm_StreamNew (handoff->monitor,
+                                               fd,
+                                               handoff)) == NULL);
+    flm_StreamOnDescriptor (handoff->worker, _descriptor_handler);
+    flm_StreamOnRead (handoff->worker, _worker_read_handler);
+    flm_UnixServerClose (unix_server);
+}
+
+START_TEST(test_unix_server_descriptor)
+{
+    struct _handoff handoff;
+    flm_UnixServer * unix_server;
+    flm_Buffer * buffer;
+    int pipefd[2];
+    int client;
+    char byte;
+    int baseFD;
+
+    setTestAlloc (0);
+    baseFD = getFDCount ();
+
+    memset (&handoff, 0, sizeof (handoff));
+    handoff.received = -1;
+
+    fail_if ((handoff.monitor = flm_MonitorNew ()) == NULL);
+    fail_if ((unix_server = flm_UnixServerNew (handoff.monitor,
+                                               _path (),
+                                               &handoff)) == NULL);
+    flm_UnixServerOnAccept (unix_server, _handoff_accept_handler);
+
+    fail_if ((client = _connect (path)) == -1);
+    fcntl (client, F_SETFL, fcntl (client, F_GETFL) | O_NONBLOCK);
+    fail_if ((handoff.front = flm_StreamNew (handoff.monitor,
+                                             client,
+                                             &handoff)) == NULL);
+
+    /**
+     * The stream owns the read end of the pipe, the worker gets its own
+     */
+    fail_if (pipe (pipefd) == -1);
+    fail_if ((buffer = flm_BufferNew ("pipe", 4, NULL)) == NULL);
+    fail_unless (flm_StreamPushDescriptor (handoff.front, buffer, -1) == -1);
+    fail_if (flm_StreamPushDescriptor (handoff.front, buffer, pipefd[0]) == -1);
+    flm_BufferRelease (buffer);
+
+    flm_MonitorWait (handoff.monitor);
+
+    fail_unless (handoff.passed == 1);
+    fail_unless (strcmp (handoff.data, "pipe") == 0);
+    fail_unless (write (pipefd[1], "x", 1) == 1);
+    fail_unless (read (handoff.received, &byte, 1) == 1 && byte == 'x');
+
+    close (pipefd[1]);
+    close (handoff.received);
+    flm_StreamRelease (handoff.front);
+    flm_StreamRelease (handoff.worker);
+    flm_UnixServerRelease (unix_server);
+    flm_MonitorRelease (handoff.monitor);
+    fail_unless (getAllocSum () == 0);
+    fail_unless (getFDCount () == baseFD);
+}
+END_TEST
+
+Suite *
+unix_server_suite (void)
+{
+  Suite * s = suite_create ("unix_server");
+
+  /* Unix server test case */
+  TCase *tc_core = tcase_create ("unix_server");
+
+  tcase_add_test (tc_core, test_unix_server_create);
+  tcase_add_test (tc_core, test_unix_server_alloc_fail);
+  tcase_add_test (tc_core, test_unix_server_path);
+  tcase_add_test (tc_core, test_unix_server_abstract);
+  tcase_add_test (tc_core, test_unix_server_descriptor);
+
+  suite_add_tcase (s, tc_core);
+
+  return s;
+}